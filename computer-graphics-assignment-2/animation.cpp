@@ -0,0 +1,313 @@
+#include "animation.h"
+
+#include <string.h>
+#include <algorithm>
+
+void lerp_node(const Node *a, const Node *b, float t, Node *out)
+{
+	out->translation.x = lerp(a->translation.x, b->translation.x, t);
+	out->translation.y = lerp(a->translation.y, b->translation.y, t);
+	out->translation.z = lerp(a->translation.z, b->translation.z, t);
+
+	out->rotation.x = lerp(a->rotation.x, b->rotation.x, t);
+	out->rotation.y = lerp(a->rotation.y, b->rotation.y, t);
+	out->rotation.z = lerp(a->rotation.z, b->rotation.z, t);
+
+	out->scale.x = lerp(a->scale.x, b->scale.x, t);
+	out->scale.y = lerp(a->scale.y, b->scale.y, t);
+	out->scale.z = lerp(a->scale.z, b->scale.z, t);
+}
+
+// Writes the interpolated transforms into pose, which must hold one node per limb.
+// Times past the end of the clip hold the last key.
+void sample_key_frames(const std::vector<std::vector<Node>> &key_frames, float t, Node *pose)
+{
+	const unsigned int frames = key_frames.size();
+	if (frames == 0) {
+		return;
+	}
+
+	if (frames == 1) {
+		for (unsigned int i = 0; i < key_frames[0].size(); i++) {
+			lerp_node(&key_frames[0][i], &key_frames[0][i], 0.f, pose + i);
+		}
+		return;
+	}
+
+	unsigned int frame = t > 0.f ? (unsigned int)t : 0;
+	float t_frame = t > 0.f ? t - frame : 0.f;
+
+	if (frame >= frames - 1) {
+		frame = frames - 2;
+		t_frame = 1.f;
+	}
+
+	const std::vector<Node> &this_data = key_frames[frame];
+	const std::vector<Node> &next_data = key_frames[frame + 1];
+
+	for (unsigned int i = 0; i < this_data.size(); i++) {
+		lerp_node(&this_data[i], &next_data[i], t_frame, pose + i);
+	}
+}
+
+// t is the time in the animation.
+// e.g t = 1.5 will interpolate frame 1 and frame 2.
+//     t = 2.2 will interpolate frame 2 and frame 3.
+void get_frame(const std::vector<std::vector<Node>> &key_frames, float t, const std::vector<Node *> &limbs)
+{
+	const unsigned int frames = key_frames.size();
+	const unsigned int frame = (unsigned int)t;
+	const float t_frame = t - frame;
+
+	// Prevent any accidental overflows.
+	if (t + 0.0000001f >= frames) {
+		return;
+	}
+
+	const std::vector<Node> &this_data = key_frames[frame];
+	const std::vector<Node> &next_data = key_frames[frame + 1];
+
+	for (unsigned int i = 0; i < this_data.size(); i++) {
+		lerp_node(&this_data[i], &next_data[i], t_frame, limbs[i]);
+	}
+}
+
+float key_frames_duration(const std::vector<std::vector<Node>> &key_frames)
+{
+	return key_frames.empty() ? 0.f : (float)(key_frames.size() - 1);
+}
+
+void build_quat_clip(const std::vector<std::vector<Node>> &key_frames, QuatClip *clip)
+{
+	clip->keys = key_frames.size();
+	clip->limbs = key_frames.empty() ? 0 : key_frames[0].size();
+
+	const unsigned int count = clip->keys * clip->limbs;
+	clip->translations.resize(count);
+	clip->rotations.resize(count);
+	clip->scales.resize(count);
+
+	for (unsigned int k = 0; k < clip->keys; k++) {
+		for (unsigned int i = 0; i < clip->limbs; i++) {
+			const Node *node = &key_frames[k][i];
+			const unsigned int at = k * clip->limbs + i;
+
+			clip->translations[at] = node->translation;
+			clip->rotations[at] = quat_from_euler(node->rotation);
+			clip->scales[at] = node->scale;
+		}
+	}
+}
+
+float quat_clip_duration(const QuatClip *clip)
+{
+	return clip->keys == 0 ? 0.f : (float)(clip->keys - 1);
+}
+
+void quat_pose_from_limbs(const std::vector<Node *> &limbs, QuatPose *pose)
+{
+	pose->translations.resize(limbs.size());
+	pose->rotations.resize(limbs.size());
+	pose->scales.resize(limbs.size());
+
+	for (unsigned int i = 0; i < limbs.size(); i++) {
+		pose->translations[i] = limbs[i]->translation;
+		pose->rotations[i] = quat_from_euler(limbs[i]->rotation);
+		pose->scales[i] = limbs[i]->scale;
+	}
+}
+
+void quat_pose_to_limbs(const QuatPose *pose, const std::vector<Node *> &limbs)
+{
+	for (unsigned int i = 0; i < limbs.size() && i < pose->rotations.size(); i++) {
+		limbs[i]->translation = pose->translations[i];
+		limbs[i]->rotation = quat_to_euler(pose->rotations[i]);
+		limbs[i]->scale = pose->scales[i];
+	}
+}
+
+static void lerp_v3s(const V3 *a, const V3 *b, float t, V3 *out, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++) {
+		out[i].x = lerp(a[i].x, b[i].x, t);
+		out[i].y = lerp(a[i].y, b[i].y, t);
+		out[i].z = lerp(a[i].z, b[i].z, t);
+	}
+}
+
+void sample_quat_clip(const QuatClip *clip, float t, bool slerp, QuatPose *pose)
+{
+	const unsigned int limbs = clip->limbs;
+	pose->translations.resize(limbs);
+	pose->rotations.resize(limbs);
+	pose->scales.resize(limbs);
+
+	if (clip->keys == 0) {
+		return;
+	}
+
+	unsigned int frame = 0;
+	float t_frame = 0.f;
+
+	if (clip->keys > 1) {
+		frame = t > 0.f ? (unsigned int)t : 0;
+		t_frame = t > 0.f ? t - frame : 0.f;
+
+		if (frame >= clip->keys - 1) {
+			frame = clip->keys - 2;
+			t_frame = 1.f;
+		}
+	}
+
+	const unsigned int a = frame * limbs;
+	const unsigned int b = (clip->keys > 1) ? a + limbs : a;
+
+	lerp_v3s(&clip->translations[a], &clip->translations[b], t_frame, pose->translations.data(), limbs);
+	lerp_v3s(&clip->scales[a], &clip->scales[b], t_frame, pose->scales.data(), limbs);
+
+	if (slerp) {
+		quat_slerp_batch(pose->rotations.data(), &clip->rotations[a], &clip->rotations[b], t_frame, limbs);
+	} else {
+		quat_nlerp_batch(pose->rotations.data(), &clip->rotations[a], &clip->rotations[b], t_frame, limbs);
+	}
+}
+
+void quat_pose_world_matrices(const Skeleton *skeleton, const QuatPose *pose, float *worlds, float *models)
+{
+	for (auto i : skeleton->order) {
+		float *world = worlds + 16 * i;
+
+		if (skeleton->parents[i] == -1) {
+			mat4_identity(world);
+		} else {
+			memcpy(world, worlds + 16 * skeleton->parents[i], 16 * sizeof(float));
+		}
+
+		const V3 &translation = pose->translations[i];
+		mat4_translate(world, translation.x, translation.y, translation.z);
+		mat4_rotate_quat(world, pose->rotations[i]);
+
+		const V3 &scale = pose->scales[i];
+		float *model = models + 16 * i;
+		memcpy(model, world, 16 * sizeof(float));
+		mat4_scale(model, scale.x, scale.y, scale.z);
+	}
+}
+
+void build_track_clip(const std::vector<std::vector<Node>> &key_frames, const std::vector<float> &times, TrackClip *clip)
+{
+	const unsigned int keys = key_frames.size();
+	const unsigned int limbs = key_frames.empty() ? 0 : key_frames[0].size();
+
+	*clip = TrackClip();
+
+	std::vector<float> key_times(keys);
+	for (unsigned int k = 0; k < keys; k++) {
+		key_times[k] = times.empty() ? (float)k : times[k];
+	}
+
+	std::vector<V3> translations(keys), scales(keys);
+	std::vector<Quat> rotations(keys);
+	for (unsigned int i = 0; i < limbs; i++) {
+		for (unsigned int k = 0; k < keys; k++) {
+			translations[k] = key_frames[k][i].translation;
+			rotations[k] = quat_from_euler(key_frames[k][i].rotation);
+			scales[k] = key_frames[k][i].scale;
+		}
+
+		add_key_track(&clip->translations, key_times.data(), translations.data(), keys);
+		add_key_track(&clip->rotations, key_times.data(), rotations.data(), keys);
+		add_key_track(&clip->scales, key_times.data(), scales.data(), keys);
+	}
+
+	finish_track_clip(clip);
+}
+
+template <typename T>
+static float last_key_time(const KeyTracks<T> &tracks)
+{
+	float last = 0.f;
+	for (unsigned int i = 0; i + 1 < tracks.first.size(); i++) {
+		if (tracks.first[i + 1] > tracks.first[i]) {
+			last = std::max(last, tracks.times[tracks.first[i + 1] - 1]);
+		}
+	}
+	return last;
+}
+
+void finish_track_clip(TrackClip *clip)
+{
+	clip->limbs = clip->rotations.first.empty() ? 0 : clip->rotations.first.size() - 1;
+	clip->duration = std::max(last_key_time(clip->translations), std::max(last_key_time(clip->rotations), last_key_time(clip->scales)));
+}
+
+// How far t is from times[k] towards times[k + 1].
+static float key_fraction(const float *times, unsigned int count, unsigned int k, float t)
+{
+	if (count < 2 || times[k + 1] <= times[k]) {
+		return 0.f;
+	}
+	return std::min(std::max((t - times[k]) / (times[k + 1] - times[k]), 0.f), 1.f);
+}
+
+static void sample_v3_tracks(const KeyTracks<V3> &tracks, float t, unsigned int *cursors, V3 *out, unsigned int limbs)
+{
+	for (unsigned int i = 0; i < limbs; i++) {
+		const unsigned int first = tracks.first[i];
+		const unsigned int count = tracks.first[i + 1] - first;
+		if (count == 0) {
+			continue;
+		}
+
+		const float *times = &tracks.times[first];
+		const unsigned int key = find_key(times, count, t, cursors + i);
+		const float u = key_fraction(times, count, key, t);
+		const unsigned int k = first + key;
+		if (count == 1) {
+			out[i] = tracks.values[k];
+		} else {
+			const V3 &a = tracks.values[k], &b = tracks.values[k + 1];
+			out[i] = { a.x + u * (b.x - a.x), a.y + u * (b.y - a.y), a.z + u * (b.z - a.z) };
+		}
+	}
+}
+
+void sample_track_clip(const TrackClip *clip, float t, TrackCursor *cursor, QuatPose *pose)
+{
+	const unsigned int limbs = clip->limbs;
+	pose->translations.resize(limbs, { 0.f, 0.f, 0.f });
+	pose->rotations.resize(limbs, quat_identity());
+	pose->scales.resize(limbs, { 1.f, 1.f, 1.f });
+
+	cursor->translations.resize(limbs);
+	cursor->rotations.resize(limbs);
+	cursor->scales.resize(limbs);
+	cursor->from.resize(limbs);
+	cursor->to.resize(limbs);
+	cursor->t.resize(limbs);
+
+	sample_v3_tracks(clip->translations, t, cursor->translations.data(), pose->translations.data(), limbs);
+	sample_v3_tracks(clip->scales, t, cursor->scales.data(), pose->scales.data(), limbs);
+
+	// The rotation pairs are gathered so they slerp in one batch. A track
+	// without keys slerps the pose's rotation with itself.
+	const KeyTracks<Quat> &rotations = clip->rotations;
+	for (unsigned int i = 0; i < limbs; i++) {
+		const unsigned int first = rotations.first[i];
+		const unsigned int count = rotations.first[i + 1] - first;
+		if (count == 0) {
+			cursor->from[i] = cursor->to[i] = pose->rotations[i];
+			cursor->t[i] = 0.f;
+			continue;
+		}
+
+		const float *times = &rotations.times[first];
+		const unsigned int key = find_key(times, count, t, &cursor->rotations[i]);
+		const unsigned int k = first + key;
+		cursor->t[i] = key_fraction(times, count, key, t);
+		cursor->from[i] = rotations.values[k];
+		cursor->to[i] = rotations.values[count > 1 ? k + 1 : k];
+	}
+
+	quat_slerp_batch_each(pose->rotations.data(), cursor->from.data(), cursor->to.data(), cursor->t.data(), limbs);
+}
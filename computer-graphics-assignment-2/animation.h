@@ -0,0 +1,129 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <vector>
+#include <algorithm>
+
+#include "node.h"
+
+// Key frames are one second apart, so t = 1.5 is halfway between key 1 and key 2.
+// TrackClip below has keys at any time.
+extern void lerp_node(const Node *a, const Node *b, float t, Node *out);
+extern void sample_key_frames(const std::vector<std::vector<Node>> &key_frames, float t, Node *pose);
+extern float key_frames_duration(const std::vector<std::vector<Node>> &key_frames);
+
+// Interpolates two key frames into the limbs, as sample_key_frames does, but
+// leaves them untouched at or past the last key.
+extern void get_frame(const std::vector<std::vector<Node>> &key_frames, float t, const std::vector<Node *> &limbs);
+
+// Key frames with the rotations converted to quaternions once, up front, so
+// sampling needs no trig and turns the short way between keys. Each array
+// holds keys * limbs entries, key by key.
+struct QuatClip {
+	unsigned int keys, limbs;
+	std::vector<V3> translations;
+	std::vector<Quat> rotations;
+	std::vector<V3> scales;
+};
+
+// One entry per limb.
+struct QuatPose {
+	std::vector<V3> translations;
+	std::vector<Quat> rotations;
+	std::vector<V3> scales;
+};
+
+extern void build_quat_clip(const std::vector<std::vector<Node>> &key_frames, QuatClip *clip);
+extern float quat_clip_duration(const QuatClip *clip);
+
+// Between the limbs' Euler transforms and a pose.
+extern void quat_pose_from_limbs(const std::vector<Node *> &limbs, QuatPose *pose);
+extern void quat_pose_to_limbs(const QuatPose *pose, const std::vector<Node *> &limbs);
+
+// Timing matches sample_key_frames. slerp keeps the angular speed constant
+// between keys, otherwise the rotations are nlerped.
+extern void sample_quat_clip(const QuatClip *clip, float t, bool slerp, QuatPose *pose);
+
+// skeleton_world_matrices for a quaternion pose.
+extern void quat_pose_world_matrices(const Skeleton *skeleton, const QuatPose *pose, float *worlds, float *models);
+
+// One track per limb, each with its own keys. Track i's keys are
+// [first[i], first[i + 1]) in times and values, with the times ascending.
+template <typename T>
+struct KeyTracks {
+	std::vector<unsigned int> first;
+	std::vector<float> times;
+	std::vector<T> values;
+};
+
+// A clip whose translation, rotation and scale channels each key at their
+// own times, so a limb that barely moves needs few keys. Before a track's
+// first key or after its last the value is held.
+struct TrackClip {
+	unsigned int limbs;
+	float duration;
+	KeyTracks<V3> translations;
+	KeyTracks<Quat> rotations;
+	KeyTracks<V3> scales;
+};
+
+// Where each track was last sampled. Playing forwards the next sample is
+// almost always between the same keys or the next two, so a search is only
+// needed after a seek. Also holds the sampler's scratch.
+struct TrackCursor {
+	std::vector<unsigned int> translations, rotations, scales;
+	std::vector<Quat> from, to;
+	std::vector<float> t;
+};
+
+// The key at or before t on a track of count keys, or the first if t is
+// before it, never the last so there's always a key after. Starts from where
+// the cursor was left, playing forwards that is this key or the next one, and
+// only searches otherwise.
+template <typename T>
+unsigned int find_key(const T *times, unsigned int count, float t, unsigned int *cursor)
+{
+	if (count < 2) {
+		return 0;
+	}
+
+	unsigned int k = std::min(*cursor, count - 2);
+	if (t < times[k]) {
+		k = std::upper_bound(times, times + k, t) - times;
+		k = k > 0 ? k - 1 : 0;
+	} else if (t >= times[k + 1]) {
+		if (k + 2 < count && t < times[k + 2]) {
+			k++;
+		} else {
+			k = std::upper_bound(times + k + 1, times + count, t) - times - 1;
+			k = std::min(k, count - 2);
+		}
+	}
+
+	*cursor = k;
+	return k;
+}
+
+// times has a time per key frame, or is empty for one second apart as in
+// sample_key_frames. Every channel keys on every key frame.
+extern void build_track_clip(const std::vector<std::vector<Node>> &key_frames, const std::vector<float> &times, TrackClip *clip);
+
+// Building a clip by hand: add each channel's tracks in limb order, then
+// finish_track_clip sets limbs and duration.
+template <typename T>
+void add_key_track(KeyTracks<T> *tracks, const float *times, const T *values, unsigned int count)
+{
+	if (tracks->first.empty()) {
+		tracks->first.push_back(0);
+	}
+	tracks->times.insert(tracks->times.end(), times, times + count);
+	tracks->values.insert(tracks->values.end(), values, values + count);
+	tracks->first.push_back(tracks->times.size());
+}
+
+extern void finish_track_clip(TrackClip *clip);
+
+// A track without keys leaves the pose's value as it was.
+extern void sample_track_clip(const TrackClip *clip, float t, TrackCursor *cursor, QuatPose *pose);
+
+#endif
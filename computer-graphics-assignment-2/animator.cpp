@@ -0,0 +1,357 @@
+#include "animator.h"
+
+#include <algorithm>
+#include <math.h>
+
+static void resize_pose(QuatPose *pose, unsigned int bones)
+{
+	pose->translations.resize(bones);
+	pose->rotations.resize(bones);
+	pose->scales.resize(bones);
+}
+
+void animator_init(Animator *animator, const QuatPose *rest)
+{
+	animator->bones = rest->rotations.size();
+	animator->rest = *rest;
+	animator->layers.clear();
+	animator->instances.clear();
+	animator->next_id = 1;
+
+	resize_pose(&animator->sample, animator->bones);
+	resize_pose(&animator->layer_pose, animator->bones);
+
+	animator_add_layer(animator, ANIM_LAYER_OVERRIDE, 1.f);
+}
+
+unsigned int animator_add_layer(Animator *animator, unsigned int mode, float weight)
+{
+	AnimLayer layer;
+	layer.mode = mode;
+	layer.weight = weight;
+	animator->layers.push_back(layer);
+
+	return animator->layers.size() - 1;
+}
+
+void animator_set_mask(Animator *animator, unsigned int layer, const std::vector<float> &mask)
+{
+	animator->layers[layer].mask = mask;
+	animator->layers[layer].mask.resize(mask.empty() ? 0 : animator->bones, 0.f);
+}
+
+// Fades the instance out from its current weight, or removes it at once.
+// Returns false if it was removed.
+static bool fade_out(AnimInstance *instance, float fade)
+{
+	if (fade <= 0.f || instance->weight <= 0.f) {
+		return false;
+	}
+
+	instance->target_weight = 0.f;
+	instance->fade_rate = instance->weight / fade;
+	return true;
+}
+
+static AnimInstance *start_instance(Animator *animator, unsigned int layer, unsigned int limbs, float fade, bool loop)
+{
+	if (limbs != animator->bones || layer >= animator->layers.size()) {
+		return 0;
+	}
+
+	// Weights on the layer keep summing to 1 through the cross-fade.
+	auto &instances = animator->instances;
+	instances.erase(std::remove_if(instances.begin(), instances.end(), [&](AnimInstance &instance)
+	{
+		return instance.layer == layer && !fade_out(&instance, fade);
+	}), instances.end());
+
+	AnimInstance instance;
+	instance.id = animator->next_id++;
+	instance.clip = 0;
+	instance.compressed = 0;
+	instance.layer = layer;
+	instance.time = 0.f;
+	instance.speed = 1.f;
+	instance.loop = loop;
+	instance.weight = fade > 0.f ? 0.f : 1.f;
+	instance.target_weight = 1.f;
+	instance.fade_rate = fade > 0.f ? 1.f / fade : 0.f;
+	instances.push_back(instance);
+
+	return &instances.back();
+}
+
+unsigned int animator_play(Animator *animator, unsigned int layer, const TrackClip *clip, float fade, bool loop)
+{
+	AnimInstance *instance = start_instance(animator, layer, clip->limbs, fade, loop);
+	if (!instance) {
+		return 0;
+	}
+
+	instance->clip = clip;
+	return instance->id;
+}
+
+unsigned int animator_play_compressed(Animator *animator, unsigned int layer, const CompressedClip *clip, float fade, bool loop)
+{
+	AnimInstance *instance = start_instance(animator, layer, clip->limbs, fade, loop);
+	if (!instance) {
+		return 0;
+	}
+
+	instance->compressed = clip;
+	return instance->id;
+}
+
+void animator_stop(Animator *animator, unsigned int id, float fade)
+{
+	auto &instances = animator->instances;
+	for (unsigned int i = 0; i < instances.size(); i++) {
+		if (instances[i].id == id) {
+			if (!fade_out(&instances[i], fade)) {
+				instances.erase(instances.begin() + i);
+			}
+			return;
+		}
+	}
+}
+
+AnimInstance *animator_find(Animator *animator, unsigned int id)
+{
+	for (auto &instance : animator->instances) {
+		if (instance.id == id) {
+			return &instance;
+		}
+	}
+
+	return 0;
+}
+
+void animator_update(Animator *animator, float dt)
+{
+	for (auto &instance : animator->instances) {
+		const float duration = instance.compressed ? instance.compressed->duration : instance.clip->duration;
+
+		instance.time += instance.speed * dt;
+		if (instance.loop && duration > 0.f) {
+			instance.time = fmodf(instance.time, duration);
+			if (instance.time < 0.f) {
+				instance.time += duration;
+			}
+		} else {
+			instance.time = std::min(std::max(instance.time, 0.f), duration);
+		}
+
+		const float step = instance.fade_rate * dt;
+		if (instance.weight < instance.target_weight) {
+			instance.weight = std::min(instance.weight + step, instance.target_weight);
+		} else {
+			instance.weight = std::max(instance.weight - step, instance.target_weight);
+		}
+	}
+
+	auto &instances = animator->instances;
+	instances.erase(std::remove_if(instances.begin(), instances.end(), [](const AnimInstance &instance)
+	{
+		return instance.target_weight <= 0.f && instance.weight <= 0.f;
+	}), instances.end());
+}
+
+// The blends below run once per bone per layer, so they are written out here
+// where they inline rather than calling the quat_ functions in maths.cpp.
+static inline float dot(const Quat &a, const Quat &b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+
+static inline Quat scaled(const Quat &q, float s)
+{
+	return { s * q.x, s * q.y, s * q.z, s * q.w };
+}
+
+static inline Quat normalised(const Quat &q)
+{
+	return scaled(q, 1.f / sqrtf(dot(q, q)));
+}
+
+static inline V3 lerp_v3(const V3 &a, const V3 &b, float t)
+{
+	return { a.x + t * (b.x - a.x), a.y + t * (b.y - a.y), a.z + t * (b.z - a.z) };
+}
+
+// Weighted average of every instance on the layer into layer_pose. Returns
+// the layer's total weight, 0 if nothing on it has any.
+static float accumulate_layer(Animator *animator, unsigned int layer)
+{
+	const unsigned int bones = animator->bones;
+	V3 *translations = animator->layer_pose.translations.data();
+	V3 *scales = animator->layer_pose.scales.data();
+	Quat *rotations = animator->layer_pose.rotations.data();
+	QuatPose *sample = &animator->sample;
+
+	float total = 0.f;
+	for (auto &instance : animator->instances) {
+		if (instance.layer != layer || instance.weight <= 0.f) {
+			continue;
+		}
+
+		// Limbs the clip has no keys for stay at rest.
+		*sample = animator->rest;
+		if (instance.compressed) {
+			sample_compressed_clip(instance.compressed, instance.time, &instance.cursor, sample);
+		} else {
+			sample_track_clip(instance.clip, instance.time, &instance.cursor, sample);
+		}
+
+		const float w = instance.weight;
+		const V3 *st = sample->translations.data();
+		const V3 *ss = sample->scales.data();
+		const Quat *sr = sample->rotations.data();
+
+		if (total == 0.f) {
+			for (unsigned int i = 0; i < bones; i++) {
+				translations[i] = { w * st[i].x, w * st[i].y, w * st[i].z };
+				scales[i] = { w * ss[i].x, w * ss[i].y, w * ss[i].z };
+				rotations[i] = scaled(sr[i], w);
+			}
+		} else {
+			for (unsigned int i = 0; i < bones; i++) {
+				translations[i] = { translations[i].x + w * st[i].x, translations[i].y + w * st[i].y, translations[i].z + w * st[i].z };
+				scales[i] = { scales[i].x + w * ss[i].x, scales[i].y + w * ss[i].y, scales[i].z + w * ss[i].z };
+
+				// Summed in one hemisphere so opposite signs don't cancel.
+				const Quat &q = sr[i];
+				Quat &r = rotations[i];
+				const float wq = dot(r, q) < 0.f ? -w : w;
+				r = { r.x + wq * q.x, r.y + wq * q.y, r.z + wq * q.z, r.w + wq * q.w };
+			}
+		}
+
+		total += w;
+	}
+
+	if (total > 0.f) {
+		const float inverse = 1.f / total;
+		for (unsigned int i = 0; i < bones; i++) {
+			translations[i] = { inverse * translations[i].x, inverse * translations[i].y, inverse * translations[i].z };
+			scales[i] = { inverse * scales[i].x, inverse * scales[i].y, inverse * scales[i].z };
+			rotations[i] = normalised(rotations[i]);
+		}
+	}
+
+	return total;
+}
+
+static void blend_override(QuatPose *pose, const QuatPose *layer, float weight, const float *mask, unsigned int bones)
+{
+	V3 *translations = pose->translations.data();
+	V3 *scales = pose->scales.data();
+	Quat *rotations = pose->rotations.data();
+
+	for (unsigned int i = 0; i < bones; i++) {
+		const float w = mask ? weight * mask[i] : weight;
+		if (w <= 0.f) {
+			continue;
+		}
+
+		translations[i] = lerp_v3(translations[i], layer->translations[i], w);
+		scales[i] = lerp_v3(scales[i], layer->scales[i], w);
+
+		const Quat &q = layer->rotations[i];
+		Quat &r = rotations[i];
+		const float wq = dot(r, q) < 0.f ? -w : w;
+		r = normalised({ r.x + wq * q.x - w * r.x, r.y + wq * q.y - w * r.y, r.z + wq * q.z - w * r.z, r.w + wq * q.w - w * r.w });
+	}
+}
+
+static void blend_additive(QuatPose *pose, const QuatPose *layer, float weight, const float *mask, unsigned int bones)
+{
+	V3 *translations = pose->translations.data();
+	V3 *scales = pose->scales.data();
+	Quat *rotations = pose->rotations.data();
+
+	for (unsigned int i = 0; i < bones; i++) {
+		const float w = mask ? weight * mask[i] : weight;
+		if (w <= 0.f) {
+			continue;
+		}
+
+		const V3 &lt = layer->translations[i];
+		const V3 &ls = layer->scales[i];
+		translations[i] = { translations[i].x + w * lt.x, translations[i].y + w * lt.y, translations[i].z + w * lt.z };
+		scales[i] = {
+			scales[i].x * (1.f + w * (ls.x - 1.f)),
+			scales[i].y * (1.f + w * (ls.y - 1.f)),
+			scales[i].z * (1.f + w * (ls.z - 1.f))
+		};
+
+		// The offset is scaled by nlerping it from the identity.
+		Quat d = layer->rotations[i];
+		const float wd = d.w < 0.f ? -w : w;
+		d = normalised({ wd * d.x, wd * d.y, wd * d.z, 1.f - w + wd * d.w });
+
+		const Quat a = rotations[i];
+		rotations[i] = {
+			a.w * d.x + a.x * d.w + a.y * d.z - a.z * d.y,
+			a.w * d.y - a.x * d.z + a.y * d.w + a.z * d.x,
+			a.w * d.z + a.x * d.y - a.y * d.x + a.z * d.w,
+			a.w * d.w - a.x * d.x - a.y * d.y - a.z * d.z
+		};
+	}
+}
+
+void animator_evaluate(Animator *animator, QuatPose *pose)
+{
+	*pose = animator->rest;
+
+	for (unsigned int l = 0; l < animator->layers.size(); l++) {
+		const AnimLayer &layer = animator->layers[l];
+		if (layer.weight <= 0.f) {
+			continue;
+		}
+
+		const float total = accumulate_layer(animator, l);
+		if (total <= 0.f) {
+			continue;
+		}
+
+		// A layer that is fading in from nothing only partly covers the pose below.
+		const float weight = layer.weight * std::min(total, 1.f);
+		const float *mask = layer.mask.empty() ? 0 : layer.mask.data();
+
+		if (layer.mode == ANIM_LAYER_ADDITIVE) {
+			blend_additive(pose, &animator->layer_pose, weight, mask, animator->bones);
+		} else {
+			blend_override(pose, &animator->layer_pose, weight, mask, animator->bones);
+		}
+	}
+}
+
+void make_additive_clip(const TrackClip *clip, TrackClip *additive)
+{
+	*additive = *clip;
+
+	for (unsigned int i = 0; i < clip->limbs; i++) {
+		const unsigned int t0 = clip->translations.first[i], t1 = clip->translations.first[i + 1];
+		for (unsigned int k = t0; k < t1; k++) {
+			additive->translations.values[k] = clip->translations.values[k] - clip->translations.values[t0];
+		}
+
+		const unsigned int r0 = clip->rotations.first[i], r1 = clip->rotations.first[i + 1];
+		for (unsigned int k = r0; k < r1; k++) {
+			additive->rotations.values[k] = quat_multiply(quat_conjugate(clip->rotations.values[r0]), clip->rotations.values[k]);
+		}
+
+		const unsigned int s0 = clip->scales.first[i], s1 = clip->scales.first[i + 1];
+		for (unsigned int k = s0; k < s1; k++) {
+			const V3 &first = clip->scales.values[s0];
+			const V3 &s = clip->scales.values[k];
+			additive->scales.values[k] = {
+				first.x != 0.f ? s.x / first.x : 1.f,
+				first.y != 0.f ? s.y / first.y : 1.f,
+				first.z != 0.f ? s.z / first.z : 1.f
+			};
+		}
+	}
+}
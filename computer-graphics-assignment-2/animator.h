@@ -0,0 +1,75 @@
+#ifndef ANIMATOR_H
+#define ANIMATOR_H
+
+#include <vector>
+
+#include "animation.h"
+#include "clip-compression.h"
+
+// Plays any number of clips at once and blends them into one pose. Each
+// playing clip is an instance on a layer, and layers are applied in order over
+// the rest pose. An override layer replaces the pose below it by its weight,
+// an additive layer adds its clips' offsets from their first key, see
+// make_additive_clip. A layer's mask scales its weight per bone.
+//
+// Everything works on QuatPose arrays indexed by bone, so blending is a few
+// linear sweeps however many clips are playing, and the hierarchy is resolved
+// once, on the blended pose.
+
+enum AnimLayerMode {
+	ANIM_LAYER_OVERRIDE,
+	ANIM_LAYER_ADDITIVE
+};
+
+struct AnimLayer {
+	unsigned int mode;
+	float weight;
+	std::vector<float> mask; // One weight per bone, empty for all at 1.
+};
+
+struct AnimInstance {
+	unsigned int id;
+	const TrackClip *clip; // Not owned, must outlive the instance.
+	const CompressedClip *compressed; // Played instead of clip if set.
+	TrackCursor cursor;
+	unsigned int layer;
+	float time, speed;
+	bool loop; // Otherwise the last key is held.
+	float weight, target_weight;
+	float fade_rate; // Weight per second towards target_weight.
+};
+
+struct Animator {
+	unsigned int bones;
+	QuatPose rest;
+	std::vector<AnimLayer> layers;
+	std::vector<AnimInstance> instances;
+	unsigned int next_id;
+
+	// Kept between evaluations so they don't allocate.
+	QuatPose sample, layer_pose;
+};
+
+// rest is what shows where no layer has weight. Starts with one override layer.
+extern void animator_init(Animator *animator, const QuatPose *rest);
+extern unsigned int animator_add_layer(Animator *animator, unsigned int mode, float weight);
+extern void animator_set_mask(Animator *animator, unsigned int layer, const std::vector<float> &mask);
+
+// Starts a clip on a layer and cross-fades to it over fade seconds, anything
+// else on the layer fading out meanwhile. A fade of 0 cuts. The id stays valid
+// until the instance has faded out. A compressed clip, such as one from a
+// ClipLibrary, is sampled where it lies and has to stay there meanwhile.
+extern unsigned int animator_play(Animator *animator, unsigned int layer, const TrackClip *clip, float fade, bool loop);
+extern unsigned int animator_play_compressed(Animator *animator, unsigned int layer, const CompressedClip *clip, float fade, bool loop);
+extern void animator_stop(Animator *animator, unsigned int id, float fade);
+extern AnimInstance *animator_find(Animator *animator, unsigned int id);
+
+// Advances clip times and fades, and drops instances that have faded out.
+extern void animator_update(Animator *animator, float dt);
+extern void animator_evaluate(Animator *animator, QuatPose *pose);
+
+// Every key as an offset from the first on its track: translations
+// subtracted, rotations relative to the first key's and scales divided.
+extern void make_additive_clip(const TrackClip *clip, TrackClip *additive);
+
+#endif
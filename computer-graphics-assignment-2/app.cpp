@@ -1,54 +1,40 @@
 #include "app.h"
 
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string>
 #include <algorithm>
+#include <chrono>
 
 #include "maths.h"
 #include "win32-opengl.h"
 #include "opengl-util.h"
 #include "shaders.h"
 #include "bitmap.h"
-
-static const float SPACING = 1.f;
-static const float ROOT_WIDTH = 5;
-static const float LEG_WIDTH = 1;
-static const float LEG_HEIGHT = 3;
-static const float ARM_WIDTH = 3;
-static const float ARM_HEIGHT = 1;
-static const float SPINE_WIDTH = 1;
-static const float SPINE_HEIGHT = 3;
-static const float ROOT_LEG_OFFSET = (ROOT_WIDTH - 1.f) / 2.f;
-static const float SPINE_ARM_OFFSET = SPINE_WIDTH / 2.f + SPACING;
-static const float LOWER_ARM_OFFSET = ARM_WIDTH + SPACING;
-static const float LOWER_LEG_OFFSET = LEG_HEIGHT + SPACING;
-static const float LOWER_SPINE_OFFSET = 2 * SPACING;
-static const float UPPER_SPINE_OFFSET = SPINE_HEIGHT + SPACING;
+#include "animation.h"
+#include "clip-validation.h"
+#include "frame-export.h"
+#include "input-log.h"
+#include "profiler.h"
+#include "render.h"
+#include "scene.h"
 
 static const float LIMB_MOVE_RATE = 5.f;
 static const float LIMB_ROTATE_RATE = 50.f;
 
-static const int SEGMENTS = 12; // for cylinder
-
-static float lerp(float v0, float v1, float t)
-{
-	return (1 - t) * v0 + t * v1;
-}
-
-#define TOP_MODEL state->model_stack + state->depth
+static const unsigned int CONTACT_ITERATIONS = 8; // Bisection steps when an edit collides.
 
-static void push_matrix(app_state *state)
-{
-	assert(state->depth + 16 < 256);
-	CopyMemory(TOP_MODEL + 16, TOP_MODEL, 16 * sizeof(float));
-	state->depth += 16;
-}
 
-static void pop_matrix(app_state *state)
+static void get_light_uniforms(unsigned int program, LightUniforms *lights)
 {
-	assert(state->depth > 0);
-	state->depth -= 16;
+	for (unsigned int i = 0; i < 2; i++) {
+		std::string light = "lights[" + std::to_string(i) + "].";
+		lights[i].pos = glGetUniformLocation(program, (light + "pos").c_str());
+		lights[i].colour = glGetUniformLocation(program, (light + "colour").c_str());
+		lights[i].ambient = glGetUniformLocation(program, (light + "ambient").c_str());
+		lights[i].diffuse = glGetUniformLocation(program, (light + "diffuse").c_str());
+	}
 }
 
 static void init_shaders(app_state *state)
@@ -62,6 +48,12 @@ static void init_shaders(app_state *state)
 	state->textured_shader.gamma_correction = glGetUniformLocation(state->textured_shader.program, "gamma_correction");
 	state->textured_shader.view_position = glGetUniformLocation(state->textured_shader.program, "view_position");
 	state->textured_shader.texture = glGetUniformLocation(state->textured_shader.program, "tex");
+	state->textured_shader.object_id = glGetUniformLocation(state->textured_shader.program, "object_id");
+	state->textured_shader.cascade_count = glGetUniformLocation(state->textured_shader.program, "cascade_count");
+	state->textured_shader.cascade_splits = glGetUniformLocation(state->textured_shader.program, "cascade_splits");
+	state->textured_shader.cascade_matrices = glGetUniformLocation(state->textured_shader.program, "cascade_matrices");
+	state->textured_shader.cascade_maps = glGetUniformLocation(state->textured_shader.program, "cascade_maps");
+	get_light_uniforms(state->textured_shader.program, state->textured_shader.lights);
 
 	state->diffuse_shader.program = create_shader(Shaders::TEXTURED_VERTEX_SHADER_SOURCE, Shaders::DIFFUSE_FRAGMENT_SHADER_SOURCE);
 	state->diffuse_shader.projection = glGetUniformLocation(state->diffuse_shader.program, "projection");
@@ -72,6 +64,12 @@ static void init_shaders(app_state *state)
 	state->diffuse_shader.gamma_correction = glGetUniformLocation(state->diffuse_shader.program, "gamma_correction");
 	state->diffuse_shader.view_position = glGetUniformLocation(state->diffuse_shader.program, "view_position");
 	state->diffuse_shader.object_colour = glGetUniformLocation(state->diffuse_shader.program, "object_colour");
+	state->diffuse_shader.object_id = glGetUniformLocation(state->diffuse_shader.program, "object_id");
+	state->diffuse_shader.cascade_count = glGetUniformLocation(state->diffuse_shader.program, "cascade_count");
+	state->diffuse_shader.cascade_splits = glGetUniformLocation(state->diffuse_shader.program, "cascade_splits");
+	state->diffuse_shader.cascade_matrices = glGetUniformLocation(state->diffuse_shader.program, "cascade_matrices");
+	state->diffuse_shader.cascade_maps = glGetUniformLocation(state->diffuse_shader.program, "cascade_maps");
+	get_light_uniforms(state->diffuse_shader.program, state->diffuse_shader.lights);
 
 	state->depth_shader.program = create_shader(Shaders::DEPTH_VERTEX_SHADER_SOURCE, Shaders::DEPTH_FRAGMENT_SHADER_SOURCE);
 	state->depth_shader.projection = glGetUniformLocation(state->depth_shader.program, "projection");
@@ -131,219 +129,12 @@ static void load_bitmaps(app_state *state)
 	for (auto &b : bitmaps) {
 		delete b;
 	}
-}
-
-static void create_skeleton(app_state *state)
-{
-	Node *root = create_node();
-	root->translation = { 0, 8, 0 };
-	root->scale = { ROOT_WIDTH, 1, 1 };
-
-	Node *upper_left_leg = create_node();
-	upper_left_leg->translation = { -ROOT_LEG_OFFSET, -SPACING, 0 };
-	upper_left_leg->scale = { LEG_WIDTH, LEG_HEIGHT, LEG_WIDTH };
-	upper_left_leg->rotation = { 0, 0, 180 };
-
-	Node *upper_right_leg = create_node();
-	upper_right_leg->translation = { ROOT_LEG_OFFSET, -SPACING, 0 };
-	upper_right_leg->scale = { LEG_WIDTH, LEG_HEIGHT, LEG_WIDTH };
-	upper_right_leg->rotation = { 0, 0, 180 };
-
-	Node *lower_left_leg = create_node();
-	lower_left_leg->translation = { 0, LOWER_LEG_OFFSET, 0 };
-	lower_left_leg->scale = { LEG_WIDTH, LEG_HEIGHT, LEG_WIDTH };
-	lower_left_leg->rotation = { 0, 0, 0 };
-	lower_left_leg->flip = true;
-
-	Node *lower_right_leg = create_node();
-	lower_right_leg->translation = { 0, LOWER_LEG_OFFSET, 0 };
-	lower_right_leg->scale = { LEG_WIDTH, LEG_HEIGHT, LEG_WIDTH };
-	lower_right_leg->rotation = { 0, 0, 0 };
-	lower_right_leg->flip = true;
-
-	Node *lower_spine = create_node();
-	lower_spine->translation = { 0, LOWER_SPINE_OFFSET, 0 };
-	lower_spine->scale = { SPINE_WIDTH, SPINE_HEIGHT, SPINE_WIDTH };
-	lower_spine->rotation = { 0, 0, 0 };
-
-	Node *upper_spine = create_node();
-	upper_spine->translation = { 0, UPPER_SPINE_OFFSET, 0 };
-	upper_spine->scale = { SPINE_WIDTH, SPINE_HEIGHT, SPINE_WIDTH };
-	upper_spine->rotation = { 0, 0, 0 };
-
-	Node *upper_left_arm = create_node();
-	upper_left_arm->translation = { -SPINE_ARM_OFFSET, 0, 0 };
-	upper_left_arm->scale = { ARM_HEIGHT, ARM_WIDTH, ARM_HEIGHT };
-	upper_left_arm->rotation = { 0, 0, 90 };
-
-	Node *upper_right_arm = create_node();
-	upper_right_arm->translation = { SPINE_ARM_OFFSET, 0, 0 };
-	upper_right_arm->scale = { ARM_HEIGHT, ARM_WIDTH, ARM_HEIGHT };
-	upper_right_arm->rotation = { 0, 0, -90 };
-
-	Node *lower_left_arm = create_node();
-	lower_left_arm->translation = { 0, LOWER_ARM_OFFSET, 0 };
-	lower_left_arm->scale = { ARM_HEIGHT, ARM_WIDTH, ARM_HEIGHT };
-	lower_left_arm->rotation = { 0, 0, 10 };
-
-	Node *lower_right_arm = create_node();
-	lower_right_arm->translation = { 0, LOWER_ARM_OFFSET, 0 };
-	lower_right_arm->scale = { ARM_HEIGHT, ARM_WIDTH, ARM_HEIGHT };
-	lower_right_arm->rotation = { 0, 0, -10 };
-
-	root->children.push_back(upper_left_leg);
-	root->children.push_back(upper_right_leg);
-	root->children.push_back(lower_spine);
-	lower_spine->children.push_back(upper_spine);
-	upper_spine->children.push_back(upper_left_arm);
-	upper_spine->children.push_back(upper_right_arm);
-	upper_left_arm->children.push_back(lower_left_arm);
-	upper_right_arm->children.push_back(lower_right_arm);
-	upper_left_leg->children.push_back(lower_left_leg);
-	upper_right_leg->children.push_back(lower_right_leg);
-
-	state->limbs.push_back(root);
-	state->limbs.push_back(upper_spine);
-	state->limbs.push_back(lower_spine);
-	state->limbs.push_back(upper_left_arm);
-	state->limbs.push_back(upper_right_arm);
-	state->limbs.push_back(lower_left_arm);
-	state->limbs.push_back(lower_right_arm);
-	state->limbs.push_back(upper_left_leg);
-	state->limbs.push_back(upper_right_leg);
-	state->limbs.push_back(lower_left_leg);
-	state->limbs.push_back(lower_right_leg);
-}
-
-static void create_animation(app_state *state)
-{
-	std::vector<Node> frame1;
-	for (unsigned int i = 0; i < 11; i++) {
-		frame1.push_back(*state->limbs[i]);
-	}
-
-	frame1[3].rotation.x  = -26.f;
-	frame1[3].rotation.z  = 161.f;
-	frame1[4].rotation.x  = 47.f;
-	frame1[4].rotation.z  = -157.f;
-	frame1[5].rotation.x  = -61.f;
-	frame1[5].rotation.z  = 10.f;
-	frame1[6].rotation.x  = -94.f;
-	frame1[6].rotation.z  = -10.f;
-	frame1[7].rotation.x  = 48.f;
-	frame1[8].rotation.x  = -59.f;
-	frame1[9].rotation.x  = -14.f;
-	frame1[10].rotation.x = 53.f;
-
-	std::vector<Node> frame2;
-	for (unsigned int i = 0; i < 11; i++) {
-		frame2.push_back(*state->limbs[i]);
-	}
-
-	frame2[3].rotation.x = 70.f;
-	frame2[3].rotation.z = 152.f;
-	frame2[4].rotation.x = -40.f;
-	frame2[4].rotation.z = -148.f;
-	frame2[5].rotation.x = -91.f;
-	frame2[5].rotation.z = 9.f;
-	frame2[6].rotation.x = -78.f;
-	frame2[6].rotation.z = -2.f;
-	frame2[7].rotation.x = -45.f;
-	frame2[8].rotation.x = 44.f;
-	frame2[9].rotation.x = 48.f;
-	frame2[10].rotation.x = 61.f;
-
-	std::vector<Node> frame3;
-	for (unsigned int i = 0; i < 11; i++) {
-		frame3.push_back(*state->limbs[i]);
-	}
 
-	frame3[3].rotation.x = -26.f;
-	frame3[3].rotation.z = 161.f;
-	frame3[4].rotation.x = 47.f;
-	frame3[4].rotation.z = -157.f;
-	frame3[5].rotation.x = -61.f;
-	frame3[5].rotation.z = 10.f;
-	frame3[6].rotation.x = -94.f;
-	frame3[6].rotation.z = -10.f;
-	frame3[7].rotation.x = 48.f;
-	frame3[8].rotation.x = -59.f;
-	frame3[9].rotation.x = -14.f;
-	frame3[10].rotation.x = 53.f;
-
-	std::vector<Node> frame4;
-	for (unsigned int i = 0; i < 11; i++) {
-		frame4.push_back(*state->limbs[i]);
-	}
-
-	frame4[3].rotation.x = 70.f;
-	frame4[3].rotation.z = 152.f;
-	frame4[4].rotation.x = -40.f;
-	frame4[4].rotation.z = -148.f;
-	frame4[5].rotation.x = -91.f;
-	frame4[5].rotation.z = 9.f;
-	frame4[6].rotation.x = -78.f;
-	frame4[6].rotation.z = -2.f;
-	frame4[7].rotation.x = -45.f;
-	frame4[8].rotation.x = 44.f;
-	frame4[9].rotation.x = 48.f;
-	frame4[10].rotation.x = 61.f;
-
-	std::vector<Node> frame5;
-	for (unsigned int i = 0; i < 11; i++) {
-		frame5.push_back(*state->limbs[i]);
-	}
-
-	frame5[3].rotation.x = -26.f;
-	frame5[3].rotation.z = 161.f;
-	frame5[4].rotation.x = 47.f;
-	frame5[4].rotation.z = -157.f;
-	frame5[5].rotation.x = -61.f;
-	frame5[5].rotation.z = 10.f;
-	frame5[6].rotation.x = -94.f;
-	frame5[6].rotation.z = -10.f;
-	frame5[7].rotation.x = 48.f;
-	frame5[8].rotation.x = -59.f;
-	frame5[9].rotation.x = -14.f;
-	frame5[10].rotation.x = 53.f;
-
-	state->key_frames.push_back(frame1);
-	state->key_frames.push_back(frame2);
-	state->key_frames.push_back(frame3);
-	state->key_frames.push_back(frame4);
-	state->key_frames.push_back(frame5);
-}
-
-// Interpolates the transformation data of two frames.
-// t is the time in the animation.
-// e.g t = 1.5 will interpolate frame 1 and frame 2.
-//     t = 2.2 will interpolate frame 2 and frame 3.
-static void get_frame(app_state *state, const float t)
-{
-	const unsigned int frames = state->key_frames.size();
-	const unsigned int frame = (unsigned int)t;
-	const float t_frame = t - frame;
-	
-	// Prevent any accidental overflows.
-	if (t + 0.0000001f >= frames) {
-		return;
-	}
-
-	const std::vector<Node> this_data = state->key_frames[frame];
-	const std::vector<Node> next_data = state->key_frames[frame + 1];
-
-	for (unsigned int i = 0; i < this_data.size(); i++) {
-		state->limbs[i]->translation.x = lerp(this_data[i].translation.x, next_data[i].translation.x, t_frame);
-		state->limbs[i]->translation.y = lerp(this_data[i].translation.y, next_data[i].translation.y, t_frame);
-		state->limbs[i]->translation.z = lerp(this_data[i].translation.z, next_data[i].translation.z, t_frame);
-
-		state->limbs[i]->rotation.x = lerp(this_data[i].rotation.x, next_data[i].rotation.x, t_frame);
-		state->limbs[i]->rotation.y = lerp(this_data[i].rotation.y, next_data[i].rotation.y, t_frame);
-		state->limbs[i]->rotation.z = lerp(this_data[i].rotation.z, next_data[i].rotation.z, t_frame);
-
-		state->limbs[i]->scale.x = lerp(this_data[i].scale.x, next_data[i].scale.x, t_frame);
-		state->limbs[i]->scale.y = lerp(this_data[i].scale.y, next_data[i].scale.y, t_frame);
-		state->limbs[i]->scale.z = lerp(this_data[i].scale.z, next_data[i].scale.z, t_frame);
+	unsigned int glyph[GLYPH_W * GLYPH_H];
+	Bitmap glyph_bitmap = { (unsigned char *)glyph, GLYPH_W, GLYPH_H };
+	for (unsigned int i = 0; i < GLYPH_COUNT; i++) {
+		glyph_pixels(i, glyph);
+		state->glyph_textures[i] = create_texture(&glyph_bitmap);
 	}
 }
 
@@ -353,25 +144,13 @@ static void init_meshes(app_state *state)
 	glBindVertexArray(state->triangle_vao);
 
 	// --- Quad mesh
-	float quad_verts[32] = {
-		 0.5f,  0, 0.5f, 0, 1.f, 0, 1.f, 0.f,
-		 0.5f, 0, -0.5f, 0, 1.f, 0, 1.f, 1.f,
-		-0.5f, 0, -0.5f, 0, 1.f, 0, 0.f, 1.f,
-		-0.5f,  0, 0.5f, 0, 1.f, 0, 0.f, 0.f,
-	};
-
-	unsigned int quad_indices[6] = {
-		0, 1, 3,
-		1, 2, 3
-	};
-
 	glGenBuffers(1, &state->quad_vbo);
 	glBindBuffer(GL_ARRAY_BUFFER, state->quad_vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof quad_verts, quad_verts, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof QUAD_VERTICES, QUAD_VERTICES, GL_STATIC_DRAW);
 
 	glGenBuffers(1, &state->quad_ebo);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, state->quad_ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof quad_indices, quad_indices, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof QUAD_INDICES, QUAD_INDICES, GL_STATIC_DRAW);
 
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof Vertex, (void *)0);
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof Vertex, (void *)(3 * sizeof(float)));
@@ -384,105 +163,20 @@ static void init_meshes(app_state *state)
 	// ---End of quad mesh
 
 	// --- cylinder mesh
-	const float length = 3.f;
-
-	// Calculate angle between each triangle.
-	const float theta = (2 * M_PI) / SEGMENTS;
-	const float r = 0.5f;
-
-	// Center vertex.
-	const unsigned int face_verts_count = SEGMENTS + 1;
-	const unsigned int cylinder_verts_count = face_verts_count * 2;
-
-	const unsigned int face_verts_data_offset = face_verts_count * 8;
-
-	// Array for vertex points.
-	const unsigned VERT_DATA_COUNT = face_verts_data_offset * 2;
-	float *CYLINDER = (float *)calloc(VERT_DATA_COUNT, sizeof(float));
-
-	CYLINDER[4] = 1.f;
-	CYLINDER[face_verts_count + 1] = length;
-	CYLINDER[face_verts_count + 4] = 1.f;
-
-	// Calculate x,y for each point.
-	for (int i = 1, j = i - 1; i < face_verts_count; ++i, ++j) {
-		const int k = i * 8;
-		CYLINDER[k + 0] = r * sin(j * theta);
-		CYLINDER[k + 1] = 0.f;
-		CYLINDER[k + 2] = r * cos(j * theta);
-		CYLINDER[k + 3] = r * sin(j * theta);
-		CYLINDER[k + 4] = -1.f;
-		CYLINDER[k + 5] = r * cos(j * theta);
-		CYLINDER[k + 6] = 0.f;
-		CYLINDER[k + 7] = 0.f;
-
-		// 2nd circle face.
-		const int l = (face_verts_count * 8) + i * 8;
-		CYLINDER[l + 0] = r * sin(j * theta);
-		CYLINDER[l + 1] = length;
-		CYLINDER[l + 2] = r * cos(j * theta);
-		CYLINDER[l + 3] = r * sin(j * theta);
-		CYLINDER[l + 4] = 1.f;
-		CYLINDER[l + 5] = r * cos(j * theta);
-		CYLINDER[l + 6] = 0.f;
-		CYLINDER[l + 7] = 0.f;
-	}
-
-	const unsigned int face_indices_offset = SEGMENTS * 3;
-
-	// Polygon data.
-	const unsigned POLY_DATA_COUNT = face_indices_offset * 4;
-	unsigned int *POLY = (unsigned int *)calloc(POLY_DATA_COUNT, sizeof(unsigned int));
-
-	// Bottom face
-	for (int i = 0; i < SEGMENTS; ++i) {
-		const int j = i * 3;
-		POLY[j + 0] = 0;
-		POLY[j + 1] = face_verts_count - i - 2;
-		POLY[j + 2] = face_verts_count - i - 1;
-	}
-
-	// Top face
-	for (int i = 0; i < SEGMENTS; ++i) {
-		const int j = (SEGMENTS + i) * 3;
-		POLY[j + 0] = face_verts_count;
-		POLY[j + 1] = cylinder_verts_count - i - 2;
-		POLY[j + 2] = cylinder_verts_count - i - 1;
-	}
-
-	// Triangle 1 connecting face
-	for (int i = 0; i < SEGMENTS; ++i) {
-		const int j = (SEGMENTS * 2 + i) * 3;
-		POLY[j + 0] = face_verts_count - i - 2;
-		POLY[j + 1] = face_verts_count - i - 1;
-		POLY[j + 2] = cylinder_verts_count - i - 1;
-	}
-
-	// Triangle 2 connecting face
-	for (int i = 0; i < SEGMENTS; ++i) {
-		const int j = (SEGMENTS * 3 + i) * 3;
-		POLY[j + 0] = face_verts_count - i - 2;
-		POLY[j + 1] = cylinder_verts_count - i - 1;
-		POLY[j + 2] = cylinder_verts_count - i - 2;
-	}
-
-	POLY[POLY_DATA_COUNT - (face_indices_offset * 3) - 2] = SEGMENTS;
-	POLY[POLY_DATA_COUNT - (face_indices_offset * 2) - 2] = SEGMENTS * 2 + 1;
-	POLY[POLY_DATA_COUNT - (face_indices_offset * 1) - 3] = SEGMENTS;
-
-	POLY[POLY_DATA_COUNT - (face_indices_offset * 0) - 3] = SEGMENTS;
-	POLY[POLY_DATA_COUNT - (face_indices_offset * 0) - 1] = SEGMENTS * 2 + 1;
+	std::vector<float> cylinder_verts;
+	std::vector<unsigned int> cylinder_indices;
+	cylinder_mesh(cylinder_verts, cylinder_indices);
 
 	glGenVertexArrays(1, &state->cylinder_vao);
 	glBindVertexArray(state->cylinder_vao);
 
 	glGenBuffers(1, &state->cylinder_vbo);
 	glBindBuffer(GL_ARRAY_BUFFER, state->cylinder_vbo);
-	glBufferData(GL_ARRAY_BUFFER, VERT_DATA_COUNT * sizeof(float), CYLINDER, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, cylinder_verts.size() * sizeof(float), cylinder_verts.data(), GL_STATIC_DRAW);
 
 	glGenBuffers(1, &state->cylinder_ebo);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, state->cylinder_ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, POLY_DATA_COUNT * sizeof(unsigned int), POLY, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, cylinder_indices.size() * sizeof(unsigned int), cylinder_indices.data(), GL_STATIC_DRAW);
 
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof Vertex, (void *)0);
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof Vertex, (void *)(3 * sizeof(float)));
@@ -492,8 +186,6 @@ static void init_meshes(app_state *state)
 	glEnableVertexAttribArray(1);
 	glEnableVertexAttribArray(2);
 
-	free(POLY);
-	free(CYLINDER);
 	// --- end of cylinder mesh
 	
 	//
@@ -501,25 +193,13 @@ static void init_meshes(app_state *state)
 	glBindVertexArray(state->interface_vao);
 
 	// --- interface mesh
-	float interface_verts[16] = {
-		 1.f, 1.f, 1.f, 0.f,
-		 1.f, 0.f, 1.f, 1.f,
-		 0.f, 0.f, 0.f, 1.f,
-		 0.f, 1.f, 0.f, 0.f,
-	};
-
-	unsigned int interface_indices[6] = {
-		0, 1, 3,
-		1, 2, 3
-	};
-
 	glGenBuffers(1, &state->interface_vbo);
 	glBindBuffer(GL_ARRAY_BUFFER, state->interface_vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof interface_verts, interface_verts, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof INTERFACE_VERTICES, INTERFACE_VERTICES, GL_STATIC_DRAW);
 
 	glGenBuffers(1, &state->interface_ebo);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, state->interface_ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof interface_indices, interface_indices, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof INTERFACE_INDICES, INTERFACE_INDICES, GL_STATIC_DRAW);
 
 	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)0);
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)(2 * sizeof(float)));
@@ -529,130 +209,90 @@ static void init_meshes(app_state *state)
 }
 
 
-static bool is_between(float value, float min, float max)
+// Places the selected subtree at base + t and tests it against the rest of the skeleton.
+static bool try_edit_fraction(app_state *state, float *value, float base, float step, float t)
 {
-	return value >= min && value <= max;
-}
+	*value = base + step * t;
 
-static bool overlaps(float min1, float max1, float min2, float max2)
-{
-	return is_between(min2, min1, max1) || is_between(min1, min2, max2);
+	update_node_tree(state, state->limbs[0]);
+	update_limb_bounds(state->limbs, state->limb_bounds, state->moved_limbs);
+
+	state->edit_stats.iterations++;
+
+	return check_subtree_collisions(state->limb_bounds, state->moved_limbs, state->moved_scratch);
 }
 
-static bool check_limb_collisions(std::vector<Node*> &limbs)
+// Moves the selected limb one step along the current axis. Only the moved
+// subtree is re-tested against the cached bounds of the rest of the skeleton.
+// If the full step collides and contact resolution is on, the step is bisected
+// to find the largest fraction that is still collision free.
+static void nudge_selected(app_state *state, float direction)
 {
-	const unsigned int NOOFPTS = 8;
-	float points[4 * NOOFPTS] = {
-		-0.55f, -0.05f, -0.55f, 1.f,
-		-0.55f, -0.05f,  0.55f, 1.f,
-		 0.55f, -0.05f, -0.55f, 1.f,
-		 0.55f, -0.05f,  0.55f, 1.f,
-		-0.55f,  1.05f, -0.55f, 1.f,
-		-0.55f,  1.05f,  0.55f, 1.f,
-		 0.55f,  1.05f, -0.55f, 1.f,
-		 0.55f,  1.05f,  0.55f, 1.f
-	};
-
-	for (unsigned int l1 = 0; l1 < limbs.size(); l1++) {
-		for (unsigned int l2 = 0; l2 < limbs.size(); l2++) {
-			if (l1 == l2) {
-				continue;
-			}
+	if (!state->selected) {
+		return;
+	}
 
-			float arm_points[4 * NOOFPTS];
-			float root_points[4 * NOOFPTS];
-
-			for (unsigned int p = 0; p < NOOFPTS; p++) {
-				float *current_point = points + 4 * p;
-				float *arm_current_point = arm_points + 4 * p;
-				float *root_current_point = root_points + 4 * p;
-
-				for (unsigned int i = 0; i < 4; i++) {
-					arm_current_point[i] = 0;
-					root_current_point[i] = 0;
-					for (unsigned int j = 0; j < 4; j++) {
-						arm_current_point[i] += limbs[l1]->model[i + 4 * j] * current_point[j];
-						root_current_point[i] += limbs[l2]->model[i + 4 * j] * current_point[j];
-					}
-				}
-			}
+	float *value = (state->edit_mode == 0) ? &state->selected->translation.E[state->axis] : &state->selected->rotation.E[state->axis];
+	const float step = direction * ((state->edit_mode == 0) ? LIMB_MOVE_RATE : LIMB_ROTATE_RATE) * state->dt;
+	const float base = *value;
 
-			bool intersect = true;
-
-			for (unsigned int o = 0; o < 2 && intersect; o++) {
-				Node *source = (o == 0) ? limbs[l1] : limbs[l2];
-
-				for (unsigned int a = 0; a < 3 && intersect; a++) {
-					V3 nor;
-					nor.E[0] = source->model[a * 4 + 0];
-					nor.E[1] = source->model[a * 4 + 1];
-					nor.E[2] = source->model[a * 4 + 2];
-					nor = v3_normalise(nor);
-
-					float min_along_arm, max_along_arm;
-					min_along_arm = max_along_arm = v3_dot(nor, v4_to_v3(*(V4 *)arm_points));
-					for (unsigned int p = 1; p < NOOFPTS; p++) {
-						V3 temp = { arm_points[(4 * p) + 0], arm_points[(4 * p) + 1], arm_points[(4 * p) + 2] };
-						float distance = v3_dot(nor, temp);
-						if (distance < min_along_arm) {
-							min_along_arm = distance;
-						}
-						else if (distance > max_along_arm) {
-							max_along_arm = distance;
-						}
-					}
-
-					float min_along_root, max_along_root;
-					min_along_root = max_along_root = v3_dot(nor, v4_to_v3(*(V4 *)root_points));
-					for (unsigned int p = 1; p < NOOFPTS; p++) {
-						V3 temp = { root_points[(4 * p) + 0], root_points[(4 * p) + 1], root_points[(4 * p) + 2] };
-						float distance = v3_dot(nor, temp);
-						if (distance < min_along_root) {
-							min_along_root = distance;
-						}
-						else if (distance > max_along_root) {
-							max_along_root = distance;
-						}
-					}
-
-					if (!overlaps(min_along_arm, max_along_arm, min_along_root, max_along_root)) {
-						intersect = false;
-					}
-				}
-			}
+	if (!state->limb_bounds_valid) {
+		update_node_tree(state, state->limbs[0]);
 
-			if (intersect) {
-				return true;
-			}
-		}
+		state->limb_bounds.resize(state->limbs.size());
+		collect_subtree(state->limbs, state->limbs[0], state->moved_limbs);
+		update_limb_bounds(state->limbs, state->limb_bounds, state->moved_limbs);
+		state->limb_bounds_valid = true;
 	}
 
-	return false;
-}
+	collect_subtree(state->limbs, state->selected, state->moved_limbs);
 
-static void update_node_tree(app_state *state, Node *node)
-{
-	push_matrix(state);
+	state->saved_bounds.clear();
+	for (auto i : state->moved_limbs) {
+		state->saved_bounds.push_back(state->limb_bounds[i]);
+	}
 
-	mat4_translate(TOP_MODEL, node->translation.x, node->translation.y, node->translation.z);
+	state->edit_stats.iterations = 0;
 
-	mat4_rotate_z(TOP_MODEL, node->rotation.z);
-	mat4_rotate_y(TOP_MODEL, node->rotation.y);
-	mat4_rotate_x(TOP_MODEL, node->rotation.x);
+	if (!try_edit_fraction(state, value, base, step, 1.f)) {
+		return;
+	}
 
-	push_matrix(state);
+	float free_t = 0.f;
 
-	mat4_scale(TOP_MODEL, node->scale.x, node->scale.y, node->scale.z);
+	if (state->resolve_contacts) {
+		float hit_t = 1.f;
+		bool last_free = false;
 
-	memcpy(node->model, TOP_MODEL, 16 * sizeof(float));
+		for (unsigned int i = 0; i < CONTACT_ITERATIONS; i++) {
+			const float t = 0.5f * (free_t + hit_t);
+			last_free = !try_edit_fraction(state, value, base, step, t);
 
-	pop_matrix(state);
+			if (last_free) {
+				free_t = t;
+			} else {
+				hit_t = t;
+			}
+		}
+
+		// The bounds cache must match the pose that is kept.
+		if (!last_free && free_t > 0.f) {
+			try_edit_fraction(state, value, base, step, free_t);
+		}
 
-	for (unsigned int i = 0; i < node->children.size(); i++) {
-		update_node_tree(state, node->children[i]);
+		state->edit_stats.resolved_edits++;
+		state->edit_stats.resolve_iterations += state->edit_stats.iterations;
 	}
 
-	pop_matrix(state);
+	state->edit_stats.kept = free_t;
+
+	if (free_t == 0.f) {
+		*value = base;
+
+		for (unsigned int i = 0; i < state->moved_limbs.size(); i++) {
+			state->limb_bounds[state->moved_limbs[i]] = state->saved_bounds[i];
+		}
+	}
 }
 
 static void create_ui(app_state *state)
@@ -708,23 +348,7 @@ static void create_ui(app_state *state)
 	b.size = { 50, 50 };
 	b.on_click = [&](app_state *state)
 	{
-		if (state->selected) {
-			if (state->edit_mode == 0) {
-				state->selected->translation.E[state->axis] -= LIMB_MOVE_RATE * state->dt;
-			} else {
-				state->selected->rotation.E[state->axis] -= LIMB_ROTATE_RATE * state->dt;
-			}
-
-			update_node_tree(state, state->limbs[0]);
-
-			if (check_limb_collisions(state->limbs)) {
-				if (state->edit_mode == 0) {
-					state->selected->translation.E[state->axis] += LIMB_MOVE_RATE * state->dt;
-				} else {
-					state->selected->rotation.E[state->axis] += LIMB_ROTATE_RATE * state->dt;
-				}
-			}
-		}
+		nudge_selected(state, -1.f);
 	};
 	state->buttons.push_back(b);
 
@@ -733,23 +357,7 @@ static void create_ui(app_state *state)
 	b.size = { 50, 50 };
 	b.on_click = [&](app_state *state)
 	{
-		if (state->selected) {
-			if (state->edit_mode == 0) {
-				state->selected->translation.E[state->axis] += LIMB_MOVE_RATE * state->dt;
-			} else {
-				state->selected->rotation.E[state->axis] += LIMB_ROTATE_RATE * state->dt;
-			}
-
-			update_node_tree(state, state->limbs[0]);
-
-			if (check_limb_collisions(state->limbs)) {
-				if (state->edit_mode == 0) {
-					state->selected->translation.E[state->axis] -= LIMB_MOVE_RATE * state->dt;
-				} else {
-					state->selected->rotation.E[state->axis] -= LIMB_ROTATE_RATE * state->dt;
-				}
-			}
-		}
+		nudge_selected(state, 1.f);
 	};
 	state->buttons.push_back(b);
 
@@ -759,9 +367,15 @@ static void create_ui(app_state *state)
 	b.on_click = [&](app_state *state)
 	{
 		state->playing = true;
+		state->limb_bounds_valid = false;
 		for (unsigned int i = 0; i < state->limbs.size(); i++) {
 			state->backup[i] = *state->limbs[i];
 		}
+
+		quat_pose_from_limbs(state->limbs, &state->pose);
+		build_track_clip(state->key_frames, {}, &state->clip);
+		animator_init(&state->animator, &state->pose);
+		animator_play(&state->animator, 0, &state->clip, 0.f, false);
 	};
 	state->buttons.push_back(b);
 
@@ -797,492 +411,423 @@ static void create_ui(app_state *state)
 	state->buttons.push_back(b);
 }
 
-static void textured_shader_use(app_state *state)
+app_state *app_init(unsigned int w, unsigned int h)
 {
-	glUseProgram(state->textured_shader.program);
-
-	glUniform1f(state->textured_shader.gamma_correction, 2.2);
-
-	glUniformMatrix4fv(state->textured_shader.projection, 1, GL_FALSE, state->cur_cam->frustrum);
-	glUniformMatrix4fv(state->textured_shader.view, 1, GL_FALSE, state->cur_cam->view);
-
-	glUniform3fv(glGetUniformLocation(state->textured_shader.program, "lights[0].pos"), 1, (GLfloat *)&state->light_0.pos);
-	glUniform3fv(glGetUniformLocation(state->textured_shader.program, "lights[0].colour"), 1, (GLfloat *)&state->light_0.colour);
-	glUniform1f(glGetUniformLocation(state->textured_shader.program, "lights[0].ambient"), state->light_0.ambient);
-	glUniform1f(glGetUniformLocation(state->textured_shader.program, "lights[0].diffuse"), state->light_0.diffuse);
+	PROFILE_THREAD("main");
 
-	glUniform3fv(glGetUniformLocation(state->textured_shader.program, "lights[1].pos"), 1, (GLfloat *)&state->light_1.pos);
-	glUniform3fv(glGetUniformLocation(state->textured_shader.program, "lights[1].colour"), 1, (GLfloat *)&state->light_1.colour);
-	glUniform1f(glGetUniformLocation(state->textured_shader.program, "lights[1].ambient"), state->light_1.ambient);
-	glUniform1f(glGetUniformLocation(state->textured_shader.program, "lights[1].diffuse"), state->light_1.diffuse);
-
-	glUniform3fv(state->textured_shader.view_position, 1, (GLfloat*)&state->cur_cam->pos);
-
-	glUniform1i(state->textured_shader.shadow_map, 0);
-	glUniform1i(state->textured_shader.texture, 1);
-}
+	app_state *state = new app_state;
 
-static void diffuse_shader_use(app_state *state)
-{
-	glUseProgram(state->diffuse_shader.program);
+	if (!state) {
+		return nullptr;
+	}
 
-	glUniform1f(state->diffuse_shader.gamma_correction, 2.2);
+	state->window_info.w = w;
+	state->window_info.h = h;
+	state->window_info.resize = false;
+	state->window_info.running = true;
 
-	glUniformMatrix4fv(state->diffuse_shader.projection, 1, GL_FALSE, state->cur_cam->frustrum);
-	glUniformMatrix4fv(state->diffuse_shader.view, 1, GL_FALSE, state->cur_cam->view);
+	init_meshes(state);
 
-	glUniform3fv(glGetUniformLocation(state->diffuse_shader.program, "lights[0].pos"), 1, (GLfloat *)&state->light_0.pos);
-	glUniform3fv(glGetUniformLocation(state->diffuse_shader.program, "lights[0].colour"), 1, (GLfloat *)&state->light_0.colour);
-	glUniform1f(glGetUniformLocation(state->diffuse_shader.program, "lights[0].ambient"), state->light_0.ambient);
-	glUniform1f(glGetUniformLocation(state->diffuse_shader.program, "lights[0].diffuse"), state->light_0.diffuse);
+	init_shaders(state);
 
-	glUniform3fv(glGetUniformLocation(state->diffuse_shader.program, "lights[1].pos"), 1, (GLfloat *)&state->light_1.pos);
-	glUniform3fv(glGetUniformLocation(state->diffuse_shader.program, "lights[1].colour"), 1, (GLfloat *)&state->light_1.colour);
-	glUniform1f(glGetUniformLocation(state->diffuse_shader.program, "lights[1].ambient"), state->light_1.ambient);
-	glUniform1f(glGetUniformLocation(state->diffuse_shader.program, "lights[1].diffuse"), state->light_1.diffuse);
+	create_depth_map(state->depth_map_fbo, state->depth_map);
+	create_depth_map(state->static_depth_fbo, state->static_depth_map);
+	create_depth_array(CASCADE_SIZE, MAX_CASCADES, state->cascade_fbos, state->cascade_maps);
+	create_pick_target(w, h, state->scene_fbo, state->scene_colour, state->scene_ids, state->scene_depth);
 
-	glUniform3fv(state->diffuse_shader.view_position, 1, (GLfloat *)&state->cur_cam->pos);
+	glGenBuffers(1, &state->pick_pbo);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, state->pick_pbo);
+	glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(unsigned int), 0, GL_STREAM_READ);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 
-	glUniform1i(state->diffuse_shader.shadow_map, 0);
-}
+	load_bitmaps(state);
 
-void draw_sphere(app_state *state)
-{
-	glBindVertexArray(state->sphere->vao);
-	glDrawElements(GL_TRIANGLES, 3 * state->sphere->polygons.size(), GL_UNSIGNED_INT, 0);
-}
+	state->sphere = load_object("sphere.obj");
+	state->box = load_object("box.obj");
 
-void draw_skybox(app_state *state)
-{
-	glBindVertexArray(state->triangle_vao);
+	create_vbos(state->sphere);
+	create_vbos(state->box);
 
-	float view[16];
-	mat4_copy(view, state->cur_cam->view);
-	mat4_remove_translation(view);
+	state->skybox = skybox_init();
 
-	glUseProgram(state->skybox_shader.program);
+	scene_init(state);
 
-	glBindTexture(GL_TEXTURE_CUBE_MAP, state->skybox->texture);
+	gpu_timer_init(&state->gpu_timer);
 
-	glUniform1i(state->skybox_shader.skybox, 0);
-	glUniformMatrix4fv(state->skybox_shader.projection, 1, GL_FALSE, state->cur_cam->frustrum);
-	glUniformMatrix4fv(state->skybox_shader.view, 1, GL_FALSE, view);
+	create_ui(state);
 
-	glBindBuffer(GL_ARRAY_BUFFER, state->skybox->vbos);
-	glVertexAttribPointer(0, 3, GL_FLOAT, false, 8 * sizeof(float), (void *)0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(3 * sizeof(float)));
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
+	glViewport(0, 0, state->window_info.w, state->window_info.h);
 
-	glDrawArrays(GL_TRIANGLES, 0, 36);
-	glBindBuffer(GL_ARRAY_BUFFER, state->quad_vbo);
-	glVertexAttribPointer(0, 3, GL_FLOAT, false, 8 * sizeof(float), (void *)0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(3 * sizeof(float)));
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
+	return state;
 }
 
-void draw_node_tree(app_state *state, Node *node, unsigned int model_handle, bool only_selected, bool reflect)
+// Runs the continuous collision check over every clip and prints the impacts.
+// Returns the number of limb pairs that collide.
+unsigned int app_validate_clips(app_state *state)
 {
-	push_matrix(state);
-
-	mat4_translate(TOP_MODEL, node->translation.x, node->translation.y, node->translation.z);
+	Skeleton skeleton;
+	build_skeleton(state->limbs, &skeleton);
 
-	mat4_rotate_z(TOP_MODEL, node->rotation.z);
-	mat4_rotate_y(TOP_MODEL, node->rotation.y);
-	mat4_rotate_x(TOP_MODEL, node->rotation.x);
+	std::vector<std::vector<std::vector<Node>>> clips;
+	clips.push_back(state->key_frames);
 
-	push_matrix(state);
+	ClipValidationSettings settings = default_clip_validation_settings();
+	std::vector<ClipContact> contacts = validate_clips(&skeleton, clips, &settings);
 
-	if (reflect) {
-		mat4_scale(TOP_MODEL, node->scale.x, node->scale.y * -1.f, node->scale.z);
-	} else {
-		mat4_scale(TOP_MODEL, node->scale.x, node->scale.y, node->scale.z);
+	for (auto &c : contacts) {
+		printf("clip %u: limbs %u and %u collide at %.3fs\n", c.clip, c.limb_a, c.limb_b, c.time);
 	}
 
-	memcpy(node->model, TOP_MODEL, 16 * sizeof(float));
-
-	if (only_selected) {
-		if (node == state->selected) {
-			glUniformMatrix4fv(model_handle, 1, GL_FALSE, TOP_MODEL);
-			glBindVertexArray(state->box->vao);
-			glDrawElements(GL_TRIANGLES, 3 * state->box->polygons.size(), GL_UNSIGNED_INT, 0);
-		}
-	} else {
-		glUniformMatrix4fv(model_handle, 1, GL_FALSE, TOP_MODEL);
-		glBindVertexArray(state->box->vao);
-		glDrawElements(GL_TRIANGLES, 3 * state->box->polygons.size(), GL_UNSIGNED_INT, 0);
-	}
+	printf("%zu clip(s) validated, %zu collision(s)\n", clips.size(), contacts.size());
 
-	pop_matrix(state);
-
-	for (unsigned int i = 0; i < node->children.size(); i++) {
-		draw_node_tree(state, node->children[i], model_handle, only_selected, reflect);
-	}
-
-	pop_matrix(state);
+	return contacts.size();
 }
 
-static void render_interface(app_state *state)
+// Waits for the readback of a frame, then hands its pixels to the exporter.
+static void collect_export_frame(FrameExport *exporter, unsigned int frame, unsigned int pbo, GLsync fence, unsigned int size)
 {
-	glBindVertexArray(state->interface_vao);
-
-	glUniformMatrix4fv(state->interface_shader.projection, 1, GL_FALSE, (GLfloat *)state->cur_cam->ortho);
-	glUniform1i(state->interface_shader.texture, 0);
-
-	float model[16];
-
-	for (auto &b : state->buttons) {
-		mat4_identity(model);
-		mat4_translate(model, b.pos.x, b.pos.y, 0.f);
-		mat4_scale(model, b.size.x, b.size.y, 0.f);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, b.texture);
-
-		glUniformMatrix4fv(state->interface_shader.model, 1, GL_FALSE, model);
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+	while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+	glDeleteSync(fence);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+	void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+	if (data) {
+		frame_export_submit(exporter, frame, data);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
 	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 }
 
-static void render_skeleton(app_state *state, unsigned int model_handle, bool reflect)
+// Renders the animation offscreen at fixed time steps and writes the frames to
+// disk. Each frame is read into one of two pixel buffers while the next one is
+// drawn, so the readback is collected a frame late instead of stalling.
+// Returns the number of frames that failed to write.
+unsigned int app_export_animation(app_state *state, const FrameExportSettings *settings)
 {
-	mat4_identity(TOP_MODEL);
-	draw_node_tree(state, state->limbs.at(0), model_handle, false, reflect);
-}
-
-static void render_floor(app_state *state, unsigned int model_handle)
-{
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, state->floor_tex);
-
-	float model[16];
+	const unsigned int w = settings->w, h = settings->h;
+	const unsigned int size = w * h * 4;
 
-	mat4_identity(model);
-	mat4_scale(model, 300.f, 1.f, 300.f);
+	// The backup is only filled when playing starts, so the pose is kept here.
+	std::vector<Node> saved_limbs(state->limbs.size());
+	for (unsigned int i = 0; i < state->limbs.size(); i++) {
+		saved_limbs[i] = *state->limbs[i];
+	}
+	const unsigned int saved_pick_mode = state->pick_mode;
 
-	glUniformMatrix4fv(model_handle, 1, GL_FALSE, (GLfloat *)model);
+	// The id target doubles as the offscreen target, at the export size.
+	state->window_info.w = w;
+	state->window_info.h = h;
+	state->pick_mode = PICK_GPU;
+	state->show_interface = false;
+	state->playing = false;
+	state->selected = 0;
+	state->selected_prop = -1;
 
-	glBindVertexArray(state->triangle_vao);
+	camera_frustrum(state->cur_cam, w, h);
+	camera_update(state->cur_cam);
+	camera_look_at(state->cur_cam);
 
-	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-}
+	destroy_pick_target(state->scene_fbo, state->scene_colour, state->scene_ids, state->scene_depth);
+	create_pick_target(w, h, state->scene_fbo, state->scene_colour, state->scene_ids, state->scene_depth);
 
-static void render_selected_limb(app_state *state)
-{
-	glBindVertexArray(state->triangle_vao);
+	unsigned int pbos[2];
+	GLsync fences[2] = {};
+	glGenBuffers(2, pbos);
+	for (unsigned int i = 0; i < 2; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 
-	glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-	glStencilMask(0x00);
-	glDisable(GL_DEPTH_TEST);
+	const unsigned int frames = frame_export_count(state->key_frames, settings->fps);
+	FrameExport *exporter = frame_export_begin(state->key_frames, settings);
 
-	glUseProgram(state->outline_shader.program);
+	for (unsigned int frame = 0; frame < frames; frame++) {
+		const Node *pose = frame_export_pose(exporter, frame);
+		for (unsigned int i = 0; i < state->limbs.size(); i++) {
+			*state->limbs[i] = pose[i];
+		}
 
-	glUniformMatrix4fv(state->outline_shader.projection, 1, GL_FALSE, state->cur_cam->frustrum);
-	glUniformMatrix4fv(state->outline_shader.view, 1, GL_FALSE, state->cur_cam->view);
+		render(state);
+		gfx_gl_replay(&state->gfx, 0);
 
-	mat4_identity(TOP_MODEL);
+		const unsigned int b = frame % 2;
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, state->scene_fbo);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[b]);
+		glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		fences[b] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 
-	draw_node_tree(state, state->limbs.at(0), state->outline_shader.model, true, false);
+		if (frame > 0) {
+			collect_export_frame(exporter, frame - 1, pbos[1 - b], fences[1 - b], size);
+		}
 
-	glStencilMask(0xFF);
-	glStencilFunc(GL_ALWAYS, 1, 0xFF);
-	glEnable(GL_DEPTH_TEST);
-}
+		state->frame++;
+	}
 
-static void render_cylinders(app_state *state, unsigned int model_handle, bool reflect)
-{
-	glBindVertexArray(state->cylinder_vao);
+	if (frames > 0) {
+		const unsigned int b = (frames - 1) % 2;
+		collect_export_frame(exporter, frames - 1, pbos[b], fences[b], size);
+	}
 
-	float model[16];
-	for (unsigned int i = 0; i < 20; i++) {
-		mat4_identity(model);
-		mat4_translate(model, state->cylinders[i].x, state->cylinders[i].y, state->cylinders[i].z);
+	FrameExportStats stats = frame_export_end(exporter);
+	print_frame_export_stats(&stats);
 
-		if (reflect) {
-			mat4_scale(model, 3.f, -2.f, 3.f);
-		} else {
-			mat4_scale(model, 3.f, 2.f, 3.f);
-		}
+	glDeleteBuffers(2, pbos);
 
-		glUniformMatrix4fv(model_handle, 1, GL_FALSE, (GLfloat *)model);
-		glDrawElements(GL_TRIANGLES, SEGMENTS * 3 * 4, GL_UNSIGNED_INT, 0);
+	for (unsigned int i = 0; i < state->limbs.size(); i++) {
+		*state->limbs[i] = saved_limbs[i];
 	}
+	state->pick_mode = saved_pick_mode;
+	state->show_interface = true;
+
+	return stats.failed_writes;
 }
 
-static void render_selected_button(app_state *state)
+// Plays a recorded input log through the app as fast as it runs. Each frame
+// is finished on the GPU, so its time covers all of its work. Prints the frame
+// times and whether the session ended in the state the recording did.
+// Returns false if the log can't be read or the state differs.
+bool app_replay_input(app_state *state, const char *filename)
 {
-	glUseProgram(state->outline_shader.program);
-
-	float m[16];
-	mat4_identity(m);
+	InputReplay *replay = input_replay_open(filename);
+	if (!replay) {
+		printf("Couldn't read the input log %s\n", filename);
+		return false;
+	}
 
-	glUniformMatrix4fv(state->outline_shader.projection, 1, GL_FALSE, state->cur_cam->ortho);
-	glUniformMatrix4fv(state->outline_shader.view, 1, GL_FALSE, m);
+	state->lockstep_picks = true;
 
-	glStencilFunc(GL_ALWAYS, 1, 0xFF);
-	glStencilMask(0xFF);
+	std::vector<float> frame_ms;
+	frame_ms.reserve(input_replay_frames(replay));
 
-	Button edit_button = state->buttons.at(state->edit_mode);
+	float dt;
+	app_input input;
+	app_window_info window_info;
+	while (input_replay_next(replay, &dt, &input, &window_info)) {
+		// Sets up the camera and targets at the recorded size.
+		window_info.resize = window_info.resize || frame_ms.empty();
 
-	float model[16];
-	mat4_identity(model);
-	mat4_translate(model, edit_button.pos.x, edit_button.pos.y, 0.f);
-	mat4_scale(model, edit_button.size.x * 1.1f, edit_button.size.y * 1.1f, 0.f);
+		auto start = std::chrono::steady_clock::now();
+		app_update_and_render(dt, state, &input, &window_info);
+		glFinish();
+		frame_ms.push_back(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
 
-	glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-	glStencilMask(0x00);
+	unsigned long long recorded;
+	const bool ended = input_replay_checksum(replay, &recorded);
+	const unsigned long long replayed = scene_checksum(state);
+	input_replay_close(replay);
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, state->buttons.at(state->edit_mode).texture);
+	float total_ms = 0.f;
+	for (auto ms : frame_ms) {
+		total_ms += ms;
+	}
 
-	glUniformMatrix4fv(state->outline_shader.model, 1, GL_FALSE, model);
-	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+	std::vector<float> sorted = frame_ms;
+	std::sort(sorted.begin(), sorted.end());
+	auto percentile = [&](float p) { return sorted.empty() ? 0.f : sorted[(unsigned int)(p * (sorted.size() - 1))]; };
 
-	unsigned int axis_button_index = 2 + state->axis;
-	Button axis_button = state->buttons.at(axis_button_index);
+	printf("Replayed %zu frames in %.1f ms, %.3f ms mean, %.3f ms median, %.3f ms 95th percentile, %.3f ms worst\n",
+		frame_ms.size(), total_ms, frame_ms.empty() ? 0.f : total_ms / frame_ms.size(), percentile(0.5f), percentile(0.95f), percentile(1.f));
 
-	mat4_identity(model);
-	mat4_translate(model, axis_button.pos.x, axis_button.pos.y, 0.f);
-	mat4_scale(model, axis_button.size.x * 1.1f, axis_button.size.y * 1.1f, 0.f);
+	if (!ended) {
+		printf("The recording wasn't ended cleanly, so the final state can't be checked (%016llx)\n", replayed);
+		return true;
+	}
 
-	glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-	glStencilMask(0x00);
+	printf("Final state %016llx, recorded %016llx: %s\n", replayed, recorded, replayed == recorded ? "match" : "DIVERGED");
+	return replayed == recorded;
+}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, axis_button.texture);
+bool mouse_in_button(unsigned int x, unsigned int y, unsigned int w, unsigned int h, unsigned int mx, unsigned int my)
+{
+	return (mx >= x && mx < x + w) && (my >= y && my < y + h);
+}
 
-	glUniformMatrix4fv(state->outline_shader.model, 1, GL_FALSE, model);
-	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+// Primitives in the picking BVH are the limbs followed by the props.
+// A leaf is tested as one packet against the resolved boxes.
+static void pick_test(app_state *state, V3 ray_pos, V3 ray_dir, const unsigned int *primitives, unsigned int count, float *distances)
+{
+	const Obb *boxes[BVH_LEAF_SIZE];
+	for (unsigned int i = 0; i < count; i++) {
+		boxes[i] = &state->pick_boxes[primitives[i]];
+	}
 
-	glStencilMask(0xFF);
-	glStencilFunc(GL_ALWAYS, 1, 0xFF);
+	ObbPack4 pack;
+	obb_pack4(&pack, boxes, count);
+	ray_obb4_intersect(ray_pos, ray_dir, &pack, distances);
 }
 
-static void render(app_state *state)
+// Resolves the limb boxes from the transforms of the last render and keeps the
+// picking BVH in step with them. Props don't move, so they are only resolved
+// when the tree is built.
+static void refresh_pick_bvh(app_state *state)
 {
-	glStencilMask(0x00);
+	const unsigned int limbs = state->limbs.size();
 
-	float light_projection[16], light_view[16];
-	mat4_identity(light_projection);
-	mat4_identity(light_view);
-	mat4_ortho(light_projection, -200.f, 200.f, -200.f, 200.f, 1.f, 1000.f);
-	mat4_look_at(light_view, state->light_0.pos, { 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f });
+	if (state->pick_bvh.bounds.size() != limbs + CYLINDER_COUNT) {
+		state->pick_boxes.resize(limbs + CYLINDER_COUNT);
 
-	float light_space_matrix[16];
-	mat4_identity(light_space_matrix);
-	mat4_multiply(light_space_matrix, light_projection, light_view);
-
-	glClearColor(0.1f, 0.1f, 0.1f, 1.f);
+		std::vector<Aabb> bounds;
+		for (unsigned int i = 0; i < limbs; i++) {
+			obb_from_box(&state->pick_boxes[i], state->limbs[i]->model, LIMB_BOX_MIN, LIMB_BOX_MAX);
+			bounds.push_back(aabb_from_box(state->limbs[i]->model, LIMB_BOX_MIN, LIMB_BOX_MAX));
+		}
 
-	// Render to frame buffer
-	glViewport(0, 0, 2048, 2048);
-	glBindFramebuffer(GL_FRAMEBUFFER, state->depth_map_fbo);
-	glClear(GL_DEPTH_BUFFER_BIT);
+		for (unsigned int i = 0; i < CYLINDER_COUNT; i++) {
+			obb_from_box(&state->pick_boxes[limbs + i], state->cylinder_models[i], CYLINDER_BOX_MIN, CYLINDER_BOX_MAX);
+			bounds.push_back(aabb_from_box(state->cylinder_models[i], CYLINDER_BOX_MIN, CYLINDER_BOX_MAX));
+		}
 
-	// Render the shadow map from the lights POV.
-	glUseProgram(state->depth_shader.program);
-	glUniformMatrix4fv(state->depth_shader.projection, 1, GL_FALSE, light_projection);
-	glUniformMatrix4fv(state->depth_shader.view, 1, GL_FALSE, light_view);
-	
-	glCullFace(GL_FRONT);
-	
-	render_floor(state, state->depth_shader.model);
-	render_skeleton(state, state->depth_shader.model, false);
-	render_cylinders(state, state->depth_shader.model, false);
+		bvh_build(&state->pick_bvh, bounds);
+		return;
+	}
 
-	glCullFace(GL_BACK);
-	
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glViewport(0, 0, state->window_info.w, state->window_info.h);
-	
-	// Finally render to screen.
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	for (unsigned int i = 0; i < limbs; i++) {
+		obb_from_box(&state->pick_boxes[i], state->limbs[i]->model, LIMB_BOX_MIN, LIMB_BOX_MAX);
+		bvh_refit(&state->pick_bvh, i, aabb_from_box(state->limbs[i]->model, LIMB_BOX_MIN, LIMB_BOX_MAX));
+	}
+}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, state->depth_map);
+// Returns the pick id of the nearest limb or prop along the ray.
+static unsigned int cpu_pick(app_state *state, V3 ray_pos, V3 ray_dir)
+{
+	auto start = std::chrono::steady_clock::now();
+	refresh_pick_bvh(state);
 
-	textured_shader_use(state);
-	glUniformMatrix4fv(state->textured_shader.light_space_matrix, 1, GL_FALSE, light_space_matrix);
-	render_floor(state, state->textured_shader.model);
+	unsigned int hit;
+	float distance;
+	auto test = [&](const unsigned int *primitives, unsigned int count, float *distances)
+	{
+		pick_test(state, ray_pos, ray_dir, primitives, count, distances);
+	};
 
-	diffuse_shader_use(state);
-	glUniformMatrix4fv(state->diffuse_shader.light_space_matrix, 1, GL_FALSE, light_space_matrix);
-	V3 c = { 1.f, 1.f, 1.f };
-	glUniform3fv(state->diffuse_shader.object_colour, 1, (GLfloat *)&c);
-	render_skeleton(state, state->diffuse_shader.model, false);
+	const bool found = bvh_raycast(&state->pick_bvh, ray_pos, ray_dir, test, &hit, &distance);
 
-	c = { 0.f, 0.5f, 0.f };
-	glUniform3fv(state->diffuse_shader.object_colour, 1, (GLfloat *)&c);
-	render_cylinders(state, state->diffuse_shader.model, false);
+	state->pick_stats.cpu_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return found ? hit + 1 : 0;
+}
 
-	glDepthFunc(GL_LEQUAL);
-	draw_skybox(state);
-	glDepthFunc(GL_LESS);
+static void select_pick_id(app_state *state, unsigned int id)
+{
+	const unsigned int limbs = state->limbs.size();
 
-	glClear(GL_STENCIL_BUFFER_BIT);
+	state->selected = 0;
+	state->selected_prop = -1;
 
-	glEnable(GL_DEPTH_TEST);
-	glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+	if (id == 0 || id > limbs + CYLINDER_COUNT) {
+		return;
+	}
 
-	diffuse_shader_use(state);
-	glUniformMatrix4fv(state->diffuse_shader.light_space_matrix, 1, GL_FALSE, light_space_matrix);
-	render_selected_limb(state);
-	
-	glUseProgram(state->interface_shader.program);
-	render_interface(state);
-	render_selected_button(state);
+	if (id <= limbs) {
+		state->selected = state->limbs[id - 1];
+	} else {
+		state->selected_prop = id - limbs - 1;
+	}
 }
 
-app_state *app_init(unsigned int w, unsigned int h)
+// Copies the id under the mouse from the last frame into the pick buffer. The
+// read is only queued here and collected by resolve_gpu_pick once it lands, so
+// the pipeline never stalls. Clicks while a read is in flight are dropped.
+static void request_gpu_pick(app_state *state, unsigned int x, unsigned int y)
 {
-	app_state *state = new app_state;
-
-	if (!state) {
-		return nullptr;
+	if (state->pick_fence || x >= state->window_info.w || y >= state->window_info.h) {
+		return;
 	}
 
-	state->window_info.w = w;
-	state->window_info.h = h;
-	state->window_info.resize = false;
-	state->window_info.running = true;
-
-	init_meshes(state);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, state->scene_fbo);
+	glReadBuffer(GL_COLOR_ATTACHMENT1);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, state->pick_pbo);
 
-	init_shaders(state);
-
-	create_depth_map(state->depth_map_fbo, state->depth_map);
+	glReadPixels(x, state->window_info.h - 1 - y, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
 
-	load_bitmaps(state);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
 
-	state->sphere = load_object("sphere.obj");
-	state->box = load_object("box.obj");
-
-	create_vbos(state->sphere);
-	create_vbos(state->box);
-
-	state->skybox = skybox_init();
-
-	create_skeleton(state);
-	create_animation(state);
-
-	state->backup.resize(state->limbs.size());
-
-	create_ui(state);
-
-	glViewport(0, 0, state->window_info.w, state->window_info.h);
-
-	camera_init(&state->main_cam);
-	state->main_cam.pos = { 0.f, 10.f, -20.f };
-	state->main_cam.front = { 0.f, 0.f, -1.f };
-	state->main_cam.yaw = 90;
-
-	camera_init(&state->skeleton_cam);
-
-	camera_frustrum(&state->skeleton_cam, state->window_info.w, state->window_info.h);
-	camera_ortho(&state->skeleton_cam, state->window_info.w, state->window_info.h);
-
-	camera_frustrum(&state->main_cam, state->window_info.w, state->window_info.h);
-	camera_ortho(&state->main_cam, state->window_info.w, state->window_info.h);
-
-	state->cur_cam = &state->main_cam;
+	state->pick_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	state->pick_frame = state->frame;
+	state->pick_start = std::chrono::steady_clock::now();
+	state->pick_ray_pos = state->ray_pos;
+	state->pick_ray_dir = state->ray_dir;
+}
 
-	state->depth = 0;
+static void resolve_gpu_pick(app_state *state)
+{
+	PROFILE_FUNCTION();
 
-	state->selected = 0;
+	if (!state->pick_fence) {
+		return;
+	}
 
-	state->light_0.pos = { -100.f, 400.f, -500.f };
-	state->light_0.colour = { 1.f, 1.f, 1.f };
-	state->light_0.ambient = 0.2f;
-	state->light_0.diffuse = 0.4f;
-	state->light_0.specular = 0.3f;
+	GLsync fence = (GLsync)state->pick_fence;
+	GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	while (state->lockstep_picks && status == GL_TIMEOUT_EXPIRED) {
+		status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+	}
 
-	state->light_1.pos = { 100.f, 400.f, 500.f };
-	state->light_1.colour = { 0.f, 0.f, 1.f };
-	state->light_1.ambient = 0.2f;
-	state->light_1.diffuse = 1.f;
-	state->light_1.specular = 1.f;
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+		return;
+	}
 
-	state->edit_mode = 0; // 0 - position, 1 - rotation.
-	state->axis = 0; // 0 - x, 1 - y, 2 - z.
+	glDeleteSync(fence);
+	state->pick_fence = 0;
 
-	state->ray_pos = { 0, 0, 0 };
-	state->ray_dir = { 1, 0, 0 };
+	unsigned int id = 0;
 
-	state->playing = false;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, state->pick_pbo);
+	void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sizeof(unsigned int), GL_MAP_READ_BIT);
+	if (data) {
+		id = *(unsigned int *)data;
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 
-	state->rng = std::mt19937(0);
+	state->pick_stats.requests++;
+	state->pick_stats.latency_frames = state->frame - state->pick_frame;
+	state->pick_stats.gpu_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - state->pick_start).count();
 
-	for (unsigned int i = 0; i < 20; i++) {
-		std::uniform_int_distribution<> pos(-100, 100);
+	// Check against the CPU path along the ray stored with the request, later
+	// clicks are dropped while it's pending but still move state->ray_dir.
+	unsigned int cpu_id = cpu_pick(state, state->pick_ray_pos, state->pick_ray_dir);
 
-		state->cylinders[i].x = pos(state->rng);
-		state->cylinders[i].y = 0;
-		state->cylinders[i].z = pos(state->rng);
+	if (cpu_id != id) {
+		state->pick_stats.mismatches++;
 	}
 
-	return state;
+	select_pick_id(state, id);
 }
 
-bool mouse_in_button(unsigned int x, unsigned int y, unsigned int w, unsigned int h, unsigned int mx, unsigned int my)
-{
-	return (mx >= x && mx < x + w) && (my >= y && my < y + h);
-}
-
-float testRayOOBIntersect(V3 ray_pos, V3 ray_dir, float *min, float *max, float *model)
+void handle_input(float dt, app_state *state, app_keyboard_input *keyboard, app_mouse_input *mouse)
 {
-	float d_min = 0.f;
-	float d_max = 1000000;
-
-	V3 temp;
-	temp.E[0] = model[12] - ray_pos.E[0];
-	temp.E[1] = model[13] - ray_pos.E[1];
-	temp.E[2] = model[14] - ray_pos.E[2];
-
-	for (unsigned int i = 0; i < 3; i++) {
-		int axis = i * 4;
+	PROFILE_FUNCTION();
 
-		V3 naxis;
-		for (unsigned int i = 0; i < 3; i++) {
-			naxis.E[i] = model[axis + i];
+	if (keyboard->trace.ended_down && !keyboard->trace.started_down) {
+		const char *filename = "profile.json";
+		if (profiler_write_trace(filename)) {
+			printf("Wrote the profile to %s\n", filename);
 		}
-		naxis = v3_normalise(naxis);
-
-		float e = v3_dot(temp, naxis);
-		float f = v3_dot(ray_dir, naxis);
-
-		if (abs(f) > 0.0001f) {
-			float d1 = (e + min[i]) / f;
-			float d2 = (e + max[i]) / f;
-
-			if (d1 > d2) {
-				float s = d1;
-				d1 = d2;
-				d2 = s;
-			}
-
-			if (d2 < d_max) {
-				d_max = d2;
-			}
+	}
 
-			if (d1 > d_min) {
-				d_min = d1;
-			}
+	if (keyboard->pick_mode.ended_down && !keyboard->pick_mode.started_down) {
+		state->pick_mode = (state->pick_mode == PICK_CPU) ? PICK_GPU : PICK_CPU;
+	}
 
-			if (d_max < d_min) {
-				return -1.f;
-			}
-		}
+	if (keyboard->shadow_mode.ended_down && !keyboard->shadow_mode.started_down) {
+		state->shadow_mode = (state->shadow_mode == SHADOW_SINGLE) ? SHADOW_CASCADED : SHADOW_SINGLE;
 	}
 
-	return d_min;
-}
+	if (keyboard->gpu_times.ended_down && !keyboard->gpu_times.started_down) {
+		state->show_gpu_times = !state->show_gpu_times;
+	}
 
-float distance(const V3 &a, const V3 &b)
-{
-	return std::hypot(std::hypot(a.x - b.x, a.y - b.y), a.z - b.z);
-}
+	if (keyboard->resolve_contacts.ended_down && !keyboard->resolve_contacts.started_down) {
+		state->resolve_contacts = !state->resolve_contacts;
+	}
 
-void handle_input(float dt, app_state *state, app_keyboard_input *keyboard, app_mouse_input *mouse)
-{
 	if (state->cur_cam == &state->main_cam) {
 		if (keyboard->forward.ended_down) {
 			camera_move_forward(state->cur_cam, dt);
@@ -1326,8 +871,8 @@ void handle_input(float dt, app_state *state, app_keyboard_input *keyboard, app_
 
 		// If no button is clicked then check if a limb has been clicked.
 		if (!clicked_button) {
-			float near_clip = .05f;
-			float fov_y = (45.f * (float)M_PI / 180.f);
+			float near_clip = CAMERA_NEAR;
+			float fov_y = (state->cur_cam->fov * (float)M_PI / 180.f);
 			float aspect = (float)state->window_info.w / state->window_info.h;
 
 			V3 view, h, v;
@@ -1360,46 +905,12 @@ void handle_input(float dt, app_state *state, app_keyboard_input *keyboard, app_
 			}
 
 			state->ray_dir = v3_normalise(state->ray_dir);
-			for (unsigned int i = 0; i < 3; i++) {
-				state->ray_pos.E[i] = state->cur_cam->pos.E[i] + state->ray_dir.E[i];
-			}
+			state->ray_pos = state->cur_cam->pos;
 
-			std::vector<Node *> ordered = state->limbs;
-
-			// Sort the limbs by distance to the camera.
-			// The limbs translation is relative to its parents so
-			// instead we can use the translation componenent of its model
-			// matrix which is calculated when rendering.
-			std::sort(ordered.begin() + 1, ordered.end(),
-				[&](const Node *a, const Node *b) -> bool
-				{
-					const V3 a_t = { a->model[12], a->model[13], a->model[14] };
-					const V3 b_t = { b->model[12], b->model[13], b->model[14] };
-
-					return distance(a_t, state->cur_cam->pos) < distance(b_t, state->cur_cam->pos);
-				});
-
-			bool clicked_limb = false;
-			for (auto &l : ordered) {
-				float min[] = { -0.5f, 0.f, -0.5f, 1.f };
-				float max[] = { 0.5f, 1.f, 0.5f, 1.f };
-
-				for (unsigned int i = 0; i < 3; i++) {
-					min[i] *= l->scale.E[i];
-					max[i] *= l->scale.E[i];
-				}
-
-				float dist = testRayOOBIntersect(state->cur_cam->pos, state->ray_dir, min, max, l->model);
-
-				if (dist >= 0) {
-					state->selected = l;
-					clicked_limb = true;
-					break;
-				}
-			}
-
-			if (!clicked_limb) {
-				state->selected = 0;
+			if (state->pick_mode == PICK_GPU) {
+				request_gpu_pick(state, mx, my);
+			} else {
+				select_pick_id(state, cpu_pick(state, state->ray_pos, state->ray_dir));
 			}
 		}
 	}
@@ -1407,31 +918,32 @@ void handle_input(float dt, app_state *state, app_keyboard_input *keyboard, app_
 
 void update(app_state *state, float dt)
 {
+	PROFILE_FUNCTION();
+
 	state->dt = dt;
 
 	// Spin the light0 around the center of the scene.
-	static float j = 0;
-	state->light_0.pos.x = (cosf(j)) * 400 - 200.f;
-	state->light_0.pos.z = (sinf(j)) * 400 - 200.f;
-	j += 0.01f;
+	state->light_0.pos.x = (cosf(state->light_angle)) * 400 - 200.f;
+	state->light_0.pos.z = (sinf(state->light_angle)) * 400 - 200.f;
+	state->light_angle += 0.01f;
 
 	camera_update(state->cur_cam);
 	camera_look_at(state->cur_cam);
 
-
-	static float i = 0;
 	if (state->playing) {
-		i += 1.f * dt; // 1 frame / second
+		state->play_time += dt;
 
 		// Stop the animation when it reaches the last frame.
-		if (i >= state->key_frames.size() - 1) {
+		if (state->play_time >= state->clip.duration) {
 			state->playing = false;
 			for (unsigned int i = 0; i < state->limbs.size(); i++) {
 				*state->limbs[i] = state->backup[i];
 			}
-			i = 0;
+			state->play_time = 0;
 		} else {
-			get_frame(state, i);
+			animator_update(&state->animator, dt);
+			animator_evaluate(&state->animator, &state->pose);
+			quat_pose_to_limbs(&state->pose, state->limbs);
 		}
 	}
 }
@@ -1456,6 +968,18 @@ static void app_on_destroy(app_state *state)
 	glDeleteVertexArrays(1, &state->interface_vao);
 
 	glDeleteBuffers(1, &state->depth_map_fbo);
+	glDeleteFramebuffers(1, &state->static_depth_fbo);
+	glDeleteTextures(1, &state->static_depth_map);
+	glDeleteFramebuffers(MAX_CASCADES, state->cascade_fbos);
+	glDeleteTextures(1, &state->cascade_maps);
+
+	if (state->pick_fence) {
+		glDeleteSync((GLsync)state->pick_fence);
+		state->pick_fence = 0;
+	}
+
+	glDeleteBuffers(1, &state->pick_pbo);
+	destroy_pick_target(state->scene_fbo, state->scene_colour, state->scene_ids, state->scene_depth);
 
 	glDeleteTextures(1, &state->depth_map);
 	glDeleteTextures(1, &state->floor_tex);
@@ -1467,6 +991,9 @@ static void app_on_destroy(app_state *state)
 	glDeleteTextures(1, &state->inc_tex);
 	glDeleteTextures(1, &state->dec_tex);
 	glDeleteTextures(1, &state->play_tex);
+	glDeleteTextures(GLYPH_COUNT, state->glyph_textures);
+
+	gpu_timer_destroy(&state->gpu_timer);
 
 	glDeleteProgram(state->depth_shader.program);
 	glDeleteProgram(state->interface_shader.program);
@@ -1496,13 +1023,36 @@ void app_update_and_render(float dt, app_state *state, app_input *input, app_win
 		return;
 	}
 
+	PROFILE_ZONE("frame");
+
 	if (window_info->resize) {
 		glViewport(0, 0, window_info->w, window_info->h);
 		camera_frustrum(state->cur_cam, window_info->w, window_info->h);
 		camera_ortho(state->cur_cam, state->window_info.w, state->window_info.h);
+
+		destroy_pick_target(state->scene_fbo, state->scene_colour, state->scene_ids, state->scene_depth);
+		create_pick_target(window_info->w, window_info->h, state->scene_fbo, state->scene_colour, state->scene_ids, state->scene_depth);
 	}
 
+	resolve_gpu_pick(state);
+
 	update(state, dt);
 	handle_input(dt, state, &input->keyboard, &input->mouse);
+
+	auto start = std::chrono::steady_clock::now();
 	render(state);
+	auto recorded = std::chrono::steady_clock::now();
+	gpu_timer_begin_frame(&state->gpu_timer);
+	gfx_gl_replay(&state->gfx, &state->gpu_timer);
+	auto replayed = std::chrono::steady_clock::now();
+
+	state->gfx_stats.record_ms = std::chrono::duration<float, std::milli>(recorded - start).count();
+	state->gfx_stats.replay_ms = std::chrono::duration<float, std::milli>(replayed - recorded).count();
+
+	// Counted for the overlay, which shows the previous frame's stream.
+	if (state->show_gpu_times) {
+		gfx_null_replay(&state->gfx, &state->gfx_stats.calls);
+	}
+
+	state->frame++;
 }
\ No newline at end of file
@@ -5,14 +5,25 @@
 #include <random>
 #include <vector>
 #include <array>
+#include <chrono>
 #include <functional>
 
 #include "maths.h"
 #include "camera.h"
 #include "object.h"
 #include "node.h"
+#include "animator.h"
 #include "skybox.h"
 #include "bitmap.h"
+#include "collision.h"
+#include "bvh.h"
+#include "cascades.h"
+#include "culling.h"
+#include "render-queue.h"
+#include "gfx.h"
+#include "frame-export.h"
+#include "gpu-timer.h"
+#include "font.h"
 
 struct app_button_state {
     bool started_down;
@@ -22,7 +33,7 @@ struct app_button_state {
 
 struct app_keyboard_input {
     union {
-        app_button_state buttons[8];
+        app_button_state buttons[13];
         struct {
             app_button_state forward;
             app_button_state backward;
@@ -32,6 +43,11 @@ struct app_keyboard_input {
             app_button_state cam_down;
             app_button_state cam_left;
             app_button_state cam_right;
+            app_button_state pick_mode;
+            app_button_state shadow_mode;
+            app_button_state trace;
+            app_button_state gpu_times;
+            app_button_state resolve_contacts;
         };
     };
 };
@@ -61,6 +77,14 @@ struct app_window_info {
     bool resize, running;
 };
 
+// Locations of one element of the shaders' lights array.
+struct LightUniforms {
+    unsigned int pos;
+    unsigned int colour;
+    unsigned int ambient;
+    unsigned int diffuse;
+};
+
 struct TexturedShader {
     unsigned int program;
     unsigned int projection;
@@ -71,6 +95,12 @@ struct TexturedShader {
     unsigned int gamma_correction;
     unsigned int view_position;
     unsigned int texture;
+    unsigned int object_id;
+    unsigned int cascade_count;
+    unsigned int cascade_splits;
+    unsigned int cascade_matrices;
+    unsigned int cascade_maps;
+    LightUniforms lights[2];
 };
 
 struct DiffuseShader {
@@ -83,6 +113,12 @@ struct DiffuseShader {
     unsigned int gamma_correction;
     unsigned int view_position;
     unsigned int object_colour;
+    unsigned int object_id;
+    unsigned int cascade_count;
+    unsigned int cascade_splits;
+    unsigned int cascade_matrices;
+    unsigned int cascade_maps;
+    LightUniforms lights[2];
 };
 
 struct InterfaceShader {
@@ -128,12 +164,87 @@ struct Light {
     float ambient, diffuse, specular;
 };
 
+// Telemetry for button driven edits.
+struct EditStats {
+    unsigned int iterations; // Collision checks made by the last edit.
+    unsigned int resolved_edits;
+    unsigned long long resolve_iterations;
+    float kept; // Fraction of the step kept by the last edit that collided.
+};
+
+enum PickMode {
+    PICK_CPU, // Ray cast against the picking BVH.
+    PICK_GPU, // Read the id buffer under the mouse.
+};
+
+// Telemetry for comparing the two picking paths. Each GPU pick is checked
+// against a CPU ray cast along the same ray.
+struct PickStats {
+    unsigned int requests;
+    unsigned int mismatches;
+    unsigned int latency_frames; // Frames between the last click and its readback.
+    float cpu_ms; // Cost of the last CPU ray cast.
+    float gpu_ms; // Wall time from the last click to its readback.
+};
+
+// Shadow pass telemetry. Fill counts the texels cleared or copied plus the
+// light space bounds of every caster drawn.
+struct ShadowStats {
+    unsigned int draw_calls;
+    unsigned long long fill;
+    unsigned int cache_rebuilds;
+};
+
+enum ShadowMode {
+    SHADOW_SINGLE,   // One map over the whole scene, see shadow_caching.
+    SHADOW_CASCADED, // Maps fitted to slices of the camera frustum.
+};
+
+// Texel rectangle in the shadow map, empty when x1 <= x0 or y1 <= y0.
+struct ShadowRect {
+    int x0, y0, x1, y1;
+};
+
+enum CullPass {
+    CULL_MAIN,
+    CULL_SHADOW,
+    CULL_CASCADE, // One per cascade.
+    CULL_PASS_COUNT = CULL_CASCADE + MAX_CASCADES,
+};
+
+struct CullStats {
+    unsigned int tested;
+    unsigned int visible;
+    float ms;
+};
+
+struct QueueStats {
+    unsigned int items;
+    StateChanges submitted, sorted; // What replaying would cost in each order.
+    float sort_ms;
+};
+
+struct GfxFrameStats {
+    float record_ms; // CPU time in render().
+    float replay_ms; // CPU time issuing the recorded calls.
+    GfxNullStats calls;
+};
+
+// Objects that survived culling for one pass.
+struct VisibleSet {
+    std::vector<unsigned int> props;
+    std::vector<unsigned int> limbs;
+    CullStats stats;
+};
+
 struct Button {
     unsigned int texture;
     V2 pos, size;
     std::function<void(app_state*)> on_click;
 };
 
+static const unsigned int CYLINDER_COUNT = 20;
+
 struct app_state {
     app_window_info window_info;
 
@@ -157,21 +268,81 @@ struct app_state {
     std::vector<std::vector<Node>> key_frames;
     Node *selected;
 
+    // Cached limb bounds for incremental collision checks while editing.
+    std::vector<LimbBounds> limb_bounds;
+    std::vector<LimbBounds> saved_bounds;
+    std::vector<unsigned int> moved_limbs;
+    std::vector<bool> moved_scratch; // For check_subtree_collisions.
+    bool limb_bounds_valid;
+
+    bool resolve_contacts; // Bisect colliding edits instead of reverting the whole step.
+    EditStats edit_stats;
+
     Object *box, *sphere;
 
-    float model_stack[256];
-    unsigned int depth;
+    std::vector<NodeTraversal> node_stack; // Shared by the hierarchy walks, grows to the deepest one.
 
     std::mt19937 rng;
 
     V3 ray_pos, ray_dir;
-    V3 cylinders[20];
+    V3 cylinders[CYLINDER_COUNT];
+    float cylinder_models[CYLINDER_COUNT][16];
+
+    Bvh pick_bvh; // Limbs followed by the cylinders.
+    std::vector<Obb> pick_boxes;
+    int selected_prop; // Index into cylinders, -1 when none is selected.
+
+    // Pick ids are 0 for nothing, limb index + 1 for limbs, then the cylinders.
+    unsigned int pick_mode;
+    unsigned int scene_fbo, scene_colour, scene_ids, scene_depth;
+    unsigned int pick_pbo;
+    void *pick_fence; // GLsync of the pending readback, null when idle.
+    unsigned int pick_frame;
+    V3 pick_ray_pos, pick_ray_dir; // The click's ray, for checking the readback on the CPU.
+    std::chrono::steady_clock::time_point pick_start;
+    PickStats pick_stats;
+
+    unsigned int frame;
 
     unsigned int triangle_vao, quad_vbo, quad_ebo;
     unsigned int cylinder_vao, cylinder_vbo, cylinder_ebo;
     unsigned int interface_vao, interface_vbo, interface_ebo;
     unsigned int depth_map_fbo, depth_map;
 
+    // Static casters are rendered into their own depth map for the light at
+    // shadow_light_pos, and copied under the skeleton each frame.
+    unsigned int static_depth_fbo, static_depth_map;
+    bool shadow_caching;
+    bool shadow_cache_valid;
+    V3 shadow_light_pos;
+    ShadowRect skeleton_shadow_rect; // Where the skeleton was drawn last frame.
+    ShadowStats shadow_stats;
+
+    unsigned int shadow_mode;
+    unsigned int cascade_count;
+    unsigned int cascade_fbos[MAX_CASCADES], cascade_maps;
+    Cascade cascades[MAX_CASCADES];
+    ShadowStats cascade_stats[MAX_CASCADES];
+
+    // Props don't move, so their bounds are set once. Limb bounds follow the pose.
+    bool culling;
+    CullBounds prop_cull_bounds, limb_cull_bounds;
+    VisibleSet visible[CULL_PASS_COUNT];
+
+    // Shadow and lit draws are queued each frame and replayed sorted by state.
+    RenderQueue render_queue;
+    QueueStats queue_stats;
+
+    // render() records the frame here, it is replayed to GL afterwards.
+    GfxStream gfx;
+    GfxFrameStats gfx_stats;
+
+    // GPU time of each pass, shown over the scene with the frame's other
+    // stats when show_gpu_times is set.
+    GpuTimer gpu_timer;
+    bool show_gpu_times;
+    unsigned int glyph_textures[GLYPH_COUNT];
+
     unsigned int floor_tex, pos_tex, rot_tex, x_tex, y_tex, z_tex, inc_tex, dec_tex, play_tex, cam1_tex, cam2_tex;
     
     unsigned int edit_mode;
@@ -180,9 +351,19 @@ struct app_state {
     float dt;
 
     bool playing;
+    float play_time; // Seconds into the clip.
+    TrackClip clip; // key_frames as played, rebuilt when playback starts.
+    Animator animator;
+    QuatPose pose;
+    float light_angle; // Of light_0 around the scene.
+    bool lockstep_picks; // GPU picks wait for their readback, so they land on the next frame. Set when recording or replaying input.
+    bool show_interface; // Buttons and selection outlines, hidden when exporting.
 };
 
 extern void app_update_and_render(float dt, app_state *state, app_input *input, app_window_info *window_info);
 extern app_state *app_init(unsigned int w, unsigned int h);
+extern unsigned int app_validate_clips(app_state *state);
+extern unsigned int app_export_animation(app_state *state, const FrameExportSettings *settings);
+extern bool app_replay_input(app_state *state, const char *filename);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,1181 @@
+// Benchmarks of the hot paths on synthetic data, from small to very large
+// inputs. Results are printed as JSON so they can be kept per commit and
+// compared, progress goes to stderr. Built by the benchmarks target in the
+// CMakeLists.txt next to the solution.
+//
+//   benchmarks [--quick] [--filter name] [--label text] [--data directory] [--out results.json]
+//
+// --quick runs shorter and skips the largest sizes. --data is where the
+// generated .obj, .bmp and clip library files are written, they are removed
+// afterwards. The run fails if a recorded frame makes a call GL would reject.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "maths.h"
+#include "node.h"
+#include "animation.h"
+#include "animator.h"
+#include "clip-compression.h"
+#include "clip-library.h"
+#include "pose-cache.h"
+#include "collision.h"
+#include "object.h"
+#include "bitmap.h"
+#include "image-write.h"
+#include "render.h"
+#include "headless.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+struct BenchSettings {
+	bool quick;
+	const char *filter; // Substring of the names to run, null for all.
+	std::string data; // Directory for generated files.
+	double sample_ms; // Each repeat runs at least this long.
+	unsigned int repeats;
+};
+
+struct BenchResult {
+	std::string name;
+	const char *unit; // What size and items count.
+	unsigned long long size;
+	unsigned long long items; // Per op.
+	unsigned long long iterations; // Per repeat.
+	double ns_median, ns_min; // Per op.
+};
+
+static std::vector<BenchResult> results;
+
+// Figures that aren't timings, such as a compression ratio.
+struct BenchMetric {
+	std::string name;
+	unsigned long long size;
+	double value;
+};
+
+static std::vector<BenchMetric> metrics;
+
+// GL calls the recorded frames would make that GL rejects, fails the run.
+static unsigned int invalid_calls;
+
+// Keeps results alive so the work isn't optimised away.
+static volatile float sink;
+
+static double elapsed_ns(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Times op, called once per iteration with the iteration number. The batch
+// doubles until it takes sample_ms, then the median of the repeats is kept.
+template <typename F>
+static void bench(const BenchSettings *settings, const char *name, const char *unit, unsigned long long size, unsigned long long items, F op)
+{
+	if (settings->filter && !strstr(name, settings->filter)) {
+		return;
+	}
+
+	auto run = [&](unsigned long long iterations)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned long long i = 0; i < iterations; i++) {
+			op(i);
+		}
+		return elapsed_ns(start);
+	};
+
+	unsigned long long iterations = 1;
+	double ns = run(1); // Also warms the caches.
+	while (ns < settings->sample_ms * 1e6 && iterations < (1ull << 40)) {
+		iterations *= 2;
+		ns = run(iterations);
+	}
+
+	std::vector<double> samples;
+	for (unsigned int r = 0; r < settings->repeats; r++) {
+		samples.push_back(run(iterations) / iterations);
+	}
+	std::sort(samples.begin(), samples.end());
+
+	BenchResult result;
+	result.name = name;
+	result.unit = unit;
+	result.size = size;
+	result.items = items;
+	result.iterations = iterations;
+	result.ns_median = samples[samples.size() / 2];
+	result.ns_min = samples[0];
+	results.push_back(result);
+
+	fprintf(stderr, "%-24s %10llu %-10s %14.1f ns %14.1f %s/s\n", name, size, unit, result.ns_median,
+		items * 1e9 / result.ns_median, unit);
+}
+
+static void metric(const BenchSettings *settings, const char *name, unsigned long long size, double value)
+{
+	if (settings->filter && !strstr(name, settings->filter)) {
+		return;
+	}
+
+	metrics.push_back({ name, size, value });
+	fprintf(stderr, "%-24s %10llu %14.6g\n", name, size, value);
+}
+
+// Small to very large, --quick drops the last.
+static std::vector<unsigned long long> sizes(const BenchSettings *settings, std::initializer_list<unsigned long long> all)
+{
+	std::vector<unsigned long long> list(all);
+	if (settings->quick) {
+		list.pop_back();
+	}
+	return list;
+}
+
+static void random_model(std::mt19937 &rng, float *model, float spread)
+{
+	std::uniform_real_distribution<float> pos(-spread, spread), angle(0.f, 360.f), scale(0.5f, 3.f);
+
+	mat4_identity(model);
+	mat4_translate(model, pos(rng), pos(rng), pos(rng));
+	mat4_rotate_z(model, angle(rng));
+	mat4_rotate_y(model, angle(rng));
+	mat4_rotate_x(model, angle(rng));
+	mat4_scale(model, scale(rng), scale(rng), scale(rng));
+}
+
+static void random_node(std::mt19937 &rng, Node *node)
+{
+	std::uniform_real_distribution<float> pos(-5.f, 5.f), angle(-180.f, 180.f), scale(0.5f, 2.f);
+
+	node->translation = { pos(rng), pos(rng), pos(rng) };
+	node->rotation = { angle(rng), angle(rng), angle(rng) };
+	node->scale = { scale(rng), scale(rng), scale(rng) };
+	node->flip = false;
+}
+
+static void bench_maths(const BenchSettings *settings)
+{
+	std::mt19937 rng(1);
+
+	for (auto n : sizes(settings, { 16, 4096, 262144 })) {
+		std::vector<float> a(n * 16), b(n * 16), out(n * 16);
+		for (unsigned long long i = 0; i < n; i++) {
+			random_model(rng, &a[i * 16], 10.f);
+			random_model(rng, &b[i * 16], 10.f);
+		}
+
+		bench(settings, "mat4_multiply", "matrices", n, n, [&](unsigned long long)
+		{
+			for (unsigned long long i = 0; i < n; i++) {
+				mat4_multiply(&out[i * 16], &a[i * 16], &b[i * 16]);
+			}
+			sink = out[0];
+		});
+
+		bench(settings, "mat4_transform", "vectors", n, n, [&](unsigned long long)
+		{
+			float sum = 0.f;
+			for (unsigned long long i = 0; i < n; i++) {
+				const float *p = &b[i * 16 + 12];
+				sum += mat4_transform(&a[i * 16], { { { p[0], p[1], p[2], 1.f } } }).x;
+			}
+			sink = sum;
+		});
+
+		// A node's translate, rotate and scale one call at a time, then fused.
+		bench(settings, "mat4_trs", "matrices", n, n, [&](unsigned long long)
+		{
+			for (unsigned long long i = 0; i < n; i++) {
+				float *m = &out[i * 16];
+				const float *p = &a[i * 16];
+				mat4_identity(m);
+				mat4_translate(m, p[12], p[13], p[14]);
+				mat4_rotate_z(m, p[0] * 90.f);
+				mat4_rotate_y(m, p[1] * 90.f);
+				mat4_rotate_x(m, p[2] * 90.f);
+				mat4_scale(m, 1.f + p[4], 1.f + p[5], 1.f + p[6]);
+			}
+			sink = out[0];
+		});
+
+		float identity[12];
+		affine_identity(identity);
+		bench(settings, "affine_compose_tr", "matrices", n, n, [&](unsigned long long)
+		{
+			for (unsigned long long i = 0; i < n; i++) {
+				float world[12];
+				const float *p = &a[i * 16];
+				affine_compose_tr(world, identity, { p[12], p[13], p[14] }, { p[2] * 90.f, p[1] * 90.f, p[0] * 90.f });
+				mat4_from_affine_scaled(&out[i * 16], world, { 1.f + p[4], 1.f + p[5], 1.f + p[6] });
+			}
+			sink = out[0];
+		});
+	}
+
+	float m[16];
+	bench(settings, "mat4_look_at", "matrices", 1, 1, [&](unsigned long long i)
+	{
+		mat4_identity(m);
+		mat4_look_at(m, { (float)(i & 7), 5.f, 10.f }, { 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f });
+		sink = m[0];
+	});
+}
+
+// update_node_tree as it was before the affine composition, through a stack
+// of 4x4 matrices, kept as the baseline.
+static void update_node_tree_mat4(Node *node, float *stack)
+{
+	float *world = stack + 16;
+	memcpy(world, stack, 16 * sizeof(float));
+
+	mat4_translate(world, node->translation.x, node->translation.y, node->translation.z);
+	mat4_rotate_z(world, node->rotation.z);
+	mat4_rotate_y(world, node->rotation.y);
+	mat4_rotate_x(world, node->rotation.x);
+
+	memcpy(node->model, world, 16 * sizeof(float));
+	mat4_scale(node->model, node->scale.x, node->scale.y, node->scale.z);
+
+	for (unsigned int i = 0; i < node->children.size(); i++) {
+		update_node_tree_mat4(node->children[i], world);
+	}
+}
+
+// Full trees with four children per node.
+static void bench_node_tree(const BenchSettings *settings)
+{
+	std::mt19937 rng(2);
+	app_state *state = new app_state;
+
+	for (auto depth : sizes(settings, { 2, 5, 8 })) {
+		unsigned long long count = 0;
+		for (unsigned long long level = 0, width = 1; level <= depth; level++, width *= 4) {
+			count += width;
+		}
+
+		std::vector<Node> nodes(count);
+		for (unsigned long long i = 0; i < count; i++) {
+			random_node(rng, &nodes[i]);
+			nodes[i].id = (unsigned int)i;
+			if (i > 0) {
+				nodes[(i - 1) / 4].children.push_back(&nodes[i]);
+			}
+		}
+
+		bench(settings, "update_node_tree", "nodes", count, count, [&](unsigned long long)
+		{
+			update_node_tree(state, &nodes[0]);
+			sink = nodes[count - 1].model[0];
+		});
+
+		float stack[16 * 16];
+		mat4_identity(stack);
+		bench(settings, "update_node_tree_mat4", "nodes", count, count, [&](unsigned long long)
+		{
+			update_node_tree_mat4(&nodes[0], stack);
+			sink = nodes[count - 1].model[0];
+		});
+
+		// Largest difference of the affine path from the mat4 one, relative to
+		// elements bigger than 1, so a less accurate sincos shows up.
+		update_node_tree(state, &nodes[0]);
+		std::vector<float> affine(16 * count);
+		for (unsigned long long i = 0; i < count; i++) {
+			memcpy(&affine[16 * i], nodes[i].model, 16 * sizeof(float));
+		}
+		update_node_tree_mat4(&nodes[0], stack);
+
+		double max_error = 0.0;
+		for (unsigned long long i = 0; i < count; i++) {
+			for (unsigned int j = 0; j < 16; j++) {
+				const double reference = nodes[i].model[j];
+				max_error = std::max(max_error, fabs(affine[16 * i + j] - reference) / std::max(1.0, fabs(reference)));
+			}
+		}
+		metric(settings, "update_node_tree_error", count, max_error);
+	}
+
+	// Single chains, like a long spine or tail. The deepest would overflow the
+	// call stack of a recursive walk.
+	for (auto depth : sizes(settings, { 64, 1024, 262144 })) {
+		std::vector<Node> nodes(depth);
+		for (unsigned long long i = 0; i < depth; i++) {
+			random_node(rng, &nodes[i]);
+			nodes[i].translation = { 0.f, 1.f, 0.f };
+			nodes[i].id = (unsigned int)i;
+			if (i > 0) {
+				nodes[i - 1].children.push_back(&nodes[i]);
+			}
+		}
+
+		bench(settings, "update_node_tree_chain", "nodes", depth, depth, [&](unsigned long long)
+		{
+			update_node_tree(state, &nodes[0]);
+			sink = nodes[depth - 1].model[0];
+		});
+	}
+
+	delete state;
+}
+
+static void bench_get_frame(const BenchSettings *settings)
+{
+	std::mt19937 rng(3);
+	const unsigned int KEYS = 8;
+
+	for (auto n : sizes(settings, { 16, 4096, 262144 })) {
+		std::vector<std::vector<Node>> key_frames(KEYS, std::vector<Node>(n));
+		for (auto &key : key_frames) {
+			for (auto &node : key) {
+				random_node(rng, &node);
+			}
+		}
+
+		std::vector<Node> pose(n);
+		std::vector<Node *> limbs(n);
+		for (unsigned long long i = 0; i < n; i++) {
+			limbs[i] = &pose[i];
+		}
+
+		bench(settings, "get_frame", "limbs", n, n, [&](unsigned long long i)
+		{
+			get_frame(key_frames, fmodf(i * 0.37f, KEYS - 1.f), limbs);
+			sink = pose[n - 1].translation.x;
+		});
+	}
+}
+
+// A 4-ary hierarchy over n limbs, parents before children.
+static void tree_skeleton(unsigned long long n, Skeleton *skeleton)
+{
+	skeleton->parents.resize(n);
+	skeleton->order.resize(n);
+	for (unsigned long long i = 0; i < n; i++) {
+		skeleton->parents[i] = i ? (int)((i - 1) / 4) : -1;
+		skeleton->order[i] = (unsigned int)i;
+	}
+}
+
+// Sampling a clip and resolving the model matrices, with Euler angles as the
+// editor stores them against the quaternion clip.
+static void bench_pose(const BenchSettings *settings)
+{
+	std::mt19937 rng(6);
+	const unsigned int KEYS = 8;
+
+	for (auto n : sizes(settings, { 16, 4096, 65536 })) {
+		std::vector<std::vector<Node>> key_frames(KEYS, std::vector<Node>(n));
+		for (auto &key : key_frames) {
+			for (auto &node : key) {
+				random_node(rng, &node);
+			}
+		}
+
+		Skeleton skeleton;
+		tree_skeleton(n, &skeleton);
+
+		QuatClip clip;
+		build_quat_clip(key_frames, &clip);
+
+		std::vector<Node> pose(n);
+		QuatPose quat_pose;
+		std::vector<float> worlds(n * 16), models(n * 16);
+
+		bench(settings, "pose_euler", "limbs", n, n, [&](unsigned long long i)
+		{
+			sample_key_frames(key_frames, fmodf(i * 0.37f, KEYS - 1.f), pose.data());
+			skeleton_world_matrices(&skeleton, pose.data(), worlds.data(), models.data());
+			sink = models[16 * n - 1];
+		});
+
+		bench(settings, "pose_quat_nlerp", "limbs", n, n, [&](unsigned long long i)
+		{
+			sample_quat_clip(&clip, fmodf(i * 0.37f, KEYS - 1.f), false, &quat_pose);
+			quat_pose_world_matrices(&skeleton, &quat_pose, worlds.data(), models.data());
+			sink = models[16 * n - 1];
+		});
+
+		bench(settings, "pose_quat_slerp", "limbs", n, n, [&](unsigned long long i)
+		{
+			sample_quat_clip(&clip, fmodf(i * 0.37f, KEYS - 1.f), true, &quat_pose);
+			quat_pose_world_matrices(&skeleton, &quat_pose, worlds.data(), models.data());
+			sink = models[16 * n - 1];
+		});
+
+		// The interpolation alone.
+		std::vector<Quat> out(n);
+		const Quat *a = &clip.rotations[0], *b = &clip.rotations[n];
+
+		bench(settings, "quat_slerp", "quats", n, n, [&](unsigned long long i)
+		{
+			const float t = (i & 15) / 15.f;
+			for (unsigned long long q = 0; q < n; q++) {
+				out[q] = quat_slerp(a[q], b[q], t);
+			}
+			sink = out[n - 1].w;
+		});
+
+		bench(settings, "quat_nlerp_batch", "quats", n, n, [&](unsigned long long i)
+		{
+			quat_nlerp_batch(out.data(), a, b, (i & 15) / 15.f, (unsigned int)n);
+			sink = out[n - 1].w;
+		});
+
+		bench(settings, "quat_slerp_batch", "quats", n, n, [&](unsigned long long i)
+		{
+			quat_slerp_batch(out.data(), a, b, (i & 15) / 15.f, (unsigned int)n);
+			sink = out[n - 1].w;
+		});
+	}
+}
+
+// Every track keyed at its own times, jittered so no two tracks share a key.
+// Played forwards at 60 frames a second the cursors make long clips as cheap
+// to sample as short ones, seeking pays for the binary search.
+static void bench_track_clip(const BenchSettings *settings)
+{
+	std::mt19937 rng(8);
+	std::uniform_real_distribution<float> jitter(0.25f, 1.75f);
+	const unsigned int LIMBS = 64;
+
+	for (auto keys : sizes(settings, { 5, 1000, 100000 })) {
+		TrackClip clip = TrackClip();
+		std::vector<float> times(keys);
+		std::vector<V3> v3s(keys);
+		std::vector<Quat> quats(keys);
+
+		auto key_times = [&]()
+		{
+			float t = 0.f;
+			for (auto &time : times) {
+				time = t;
+				t += jitter(rng);
+			}
+		};
+
+		Node node;
+		for (unsigned int i = 0; i < LIMBS; i++) {
+			key_times();
+			for (unsigned long long k = 0; k < keys; k++) {
+				random_node(rng, &node);
+				v3s[k] = node.translation;
+				quats[k] = quat_from_euler(node.rotation);
+			}
+			add_key_track(&clip.translations, times.data(), v3s.data(), (unsigned int)keys);
+
+			key_times();
+			add_key_track(&clip.rotations, times.data(), quats.data(), (unsigned int)keys);
+
+			key_times();
+			for (unsigned long long k = 0; k < keys; k++) {
+				v3s[k] = { 1.f, 1.f + 0.001f * k, 1.f };
+			}
+			add_key_track(&clip.scales, times.data(), v3s.data(), (unsigned int)keys);
+		}
+		finish_track_clip(&clip);
+
+		TrackCursor cursor;
+		QuatPose pose;
+
+		bench(settings, "track_clip_play", "limbs", keys, LIMBS, [&](unsigned long long i)
+		{
+			sample_track_clip(&clip, fmodf(i / 60.f, clip.duration), &cursor, &pose);
+			sink = pose.rotations[LIMBS - 1].w;
+		});
+
+		bench(settings, "track_clip_seek", "limbs", keys, LIMBS, [&](unsigned long long i)
+		{
+			sample_track_clip(&clip, fmodf(i * 0.618034f * clip.duration, clip.duration), &cursor, &pose);
+			sink = pose.rotations[LIMBS - 1].w;
+		});
+	}
+}
+
+// 10 seconds at 30 keys a second of smooth motion, with every third limb
+// holding still, which is closer to what gets authored than random keys.
+static void smooth_key_frames(std::mt19937 &rng, unsigned long long limbs, unsigned int keys, std::vector<std::vector<Node>> &key_frames)
+{
+	std::uniform_real_distribution<float> unit(-1.f, 1.f);
+	key_frames.assign(keys, std::vector<Node>(limbs));
+
+	for (unsigned long long i = 0; i < limbs; i++) {
+		const float swing = 90.f * unit(rng), sway = 40.f * unit(rng), rate = 1.f + 0.5f * unit(rng);
+		const bool still = i % 3 == 0;
+
+		for (unsigned int k = 0; k < keys; k++) {
+			const float t = k / 30.f;
+			Node &node = key_frames[k][i];
+			node.translation = still ? V3{ 1.f, 2.f, 3.f } : V3{ sinf(t), 0.5f * t, cosf(3.f * t) };
+			node.rotation = still ? V3{ 10.f, 20.f, 30.f } : V3{ swing * sinf(rate * t), sway * cosf(2.f * rate * t), 5.f * t };
+			node.scale = { 1.f, 1.f, 1.f };
+		}
+	}
+}
+
+static void bench_clip_compression(const BenchSettings *settings)
+{
+	std::mt19937 rng(9);
+	const unsigned int KEYS = 301;
+
+	for (auto n : sizes(settings, { 16, 256, 2048 })) {
+		std::vector<std::vector<Node>> key_frames;
+		smooth_key_frames(rng, n, KEYS, key_frames);
+
+		std::vector<float> times(KEYS);
+		for (unsigned int k = 0; k < KEYS; k++) {
+			times[k] = k / 30.f;
+		}
+
+		TrackClip clip;
+		build_track_clip(key_frames, times, &clip);
+
+		const ClipCompressionSettings compression = default_clip_compression_settings();
+		std::vector<unsigned char> data;
+		if (!compress_track_clip(&clip, &compression, data)) {
+			fprintf(stderr, "Couldn't compress %llu limbs within tolerance\n", n);
+			continue;
+		}
+
+		CompressedClip compressed;
+		open_compressed_clip(data.data(), data.size(), &compressed);
+
+		const double node_bytes = (double)sizeof(Node) * n * KEYS;
+		const double track_bytes = (double)n * KEYS * 3 * sizeof(float) + clip.translations.values.size() * sizeof(V3) +
+			clip.rotations.values.size() * sizeof(Quat) + clip.scales.values.size() * sizeof(V3);
+		metric(settings, "compressed_clip_bytes", n, (double)data.size());
+		metric(settings, "compression_vs_nodes", n, node_bytes / data.size());
+		metric(settings, "compression_vs_tracks", n, track_bytes / data.size());
+
+		bench(settings, "compress_track_clip", "keys", n, n * KEYS, [&](unsigned long long)
+		{
+			std::vector<unsigned char> out;
+			compress_track_clip(&clip, &compression, out);
+			sink = out[out.size() - 1];
+		});
+
+		// Played at 60 frames a second against the same clip uncompressed, and
+		// get_frame with the key frames a second apart.
+		TrackCursor cursor;
+		QuatPose pose;
+
+		bench(settings, "compressed_clip_sample", "limbs", n, n, [&](unsigned long long i)
+		{
+			sample_compressed_clip(&compressed, fmodf(i / 60.f, compressed.duration), &cursor, &pose);
+			sink = pose.rotations[n - 1].w;
+		});
+
+		bench(settings, "track_clip_sample", "limbs", n, n, [&](unsigned long long i)
+		{
+			sample_track_clip(&clip, fmodf(i / 60.f, clip.duration), &cursor, &pose);
+			sink = pose.rotations[n - 1].w;
+		});
+
+		std::vector<Node> nodes(n);
+		std::vector<Node *> limbs(n);
+		for (unsigned long long i = 0; i < n; i++) {
+			limbs[i] = &nodes[i];
+		}
+
+		bench(settings, "get_frame_long", "limbs", n, n, [&](unsigned long long i)
+		{
+			get_frame(key_frames, fmodf(i / 60.f, KEYS - 1.f), limbs);
+			sink = nodes[n - 1].translation.x;
+		});
+	}
+}
+
+// How much of a mapped file has been read in, after evict_file has dropped
+// it from the page cache. Only known on Linux, 0 elsewhere.
+static void evict_file(const char *filename)
+{
+#ifdef __linux__
+	const int file = open(filename, O_RDONLY);
+	if (file >= 0) {
+		fdatasync(file);
+		posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+		close(file);
+	}
+#else
+	(void)filename;
+#endif
+}
+
+static double resident_bytes(const void *data, size_t size)
+{
+#ifdef __linux__
+	const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	std::vector<unsigned char> pages((size + page - 1) / page);
+	if (mincore((void *)data, size, pages.data()) != 0) {
+		return 0.0;
+	}
+
+	size_t resident = 0;
+	for (auto p : pages) {
+		resident += p & 1;
+	}
+	return (double)resident * page;
+#else
+	(void)data;
+	(void)size;
+	return 0.0;
+#endif
+}
+
+// Libraries of up to thousands of 2 second clips. A handful of distinct
+// clips are compressed and repeated under different names, the library
+// doesn't care. Opening should cost the same at every size, and playing a
+// few clips should only read in those.
+static void bench_clip_library(const BenchSettings *settings)
+{
+	std::mt19937 rng(10);
+	const unsigned int LIMBS = 16, KEYS = 61, DISTINCT = 8;
+
+	std::vector<std::vector<unsigned char>> distinct(DISTINCT);
+	const ClipCompressionSettings compression = default_clip_compression_settings();
+	for (auto &data : distinct) {
+		std::vector<std::vector<Node>> key_frames;
+		smooth_key_frames(rng, LIMBS, KEYS, key_frames);
+
+		std::vector<float> times(KEYS);
+		for (unsigned int k = 0; k < KEYS; k++) {
+			times[k] = k / 30.f;
+		}
+
+		TrackClip clip;
+		build_track_clip(key_frames, times, &clip);
+		if (!compress_track_clip(&clip, &compression, data)) {
+			fprintf(stderr, "Couldn't compress a clip within tolerance\n");
+			return;
+		}
+	}
+
+	for (auto n : sizes(settings, { 100, 1000, 10000 })) {
+		std::vector<std::string> names(n);
+		std::vector<std::vector<unsigned char>> clips(n);
+		for (unsigned long long i = 0; i < n; i++) {
+			names[i] = "clip_" + std::to_string(i);
+			clips[i] = distinct[i % DISTINCT];
+		}
+
+		const std::string filename = settings->data + "/bench_" + std::to_string(n) + ".clips";
+		if (!write_clip_library(filename.c_str(), names, clips)) {
+			fprintf(stderr, "Couldn't write %s\n", filename.c_str());
+			continue;
+		}
+		clips.clear();
+
+		bench(settings, "clip_library_open", "clips", n, 1, [&](unsigned long long)
+		{
+			ClipLibrary library;
+			open_clip_library(filename.c_str(), &library);
+			sink = (float)library.clips;
+			close_clip_library(&library);
+		});
+
+		ClipLibrary library;
+		if (!open_clip_library(filename.c_str(), &library)) {
+			fprintf(stderr, "Couldn't open %s\n", filename.c_str());
+			remove(filename.c_str());
+			continue;
+		}
+
+		// Looked up by name and a pose sampled, a different clip every time.
+		TrackCursor cursor;
+		QuatPose pose;
+		bench(settings, "clip_library_lookup", "clips", n, 1, [&](unsigned long long i)
+		{
+			CompressedClip clip;
+			const int found = find_library_clip(&library, names[(i * 7919) % n].c_str());
+			if (found >= 0 && get_library_clip(&library, found, &clip)) {
+				sample_compressed_clip(&clip, fmodf(i * 0.37f, clip.duration), &cursor, &pose);
+				sink = pose.rotations[LIMBS - 1].w;
+			}
+		});
+		close_clip_library(&library);
+
+		// Out of the page cache, so only what these clips touch is read in.
+		evict_file(filename.c_str());
+		open_clip_library(filename.c_str(), &library);
+		const double opened = resident_bytes(library.data, library.size);
+
+		const unsigned int PLAYED = 8;
+		for (unsigned int c = 0; c < PLAYED; c++) {
+			CompressedClip clip;
+			if (get_library_clip(&library, find_library_clip(&library, names[c * n / PLAYED].c_str()), &clip)) {
+				for (float t = 0.f; t < clip.duration; t += 1.f / 60.f) {
+					sample_compressed_clip(&clip, t, &cursor, &pose);
+				}
+			}
+		}
+		const double played = resident_bytes(library.data, library.size);
+
+		metric(settings, "clip_library_file_kb", n, library.size / 1024.0);
+		metric(settings, "clip_library_open_resident_kb", n, opened / 1024.0);
+		metric(settings, "clip_library_8_played_resident_kb", n, played / 1024.0);
+
+		close_clip_library(&library);
+		remove(filename.c_str());
+	}
+}
+
+// Scrubbing back and forth over a 10 second clip a frame at a time, against
+// sampling and resolving every time. With a budget for a third of the clip
+// the scrub keeps running into poses that have been evicted.
+static void bench_pose_cache(const BenchSettings *settings)
+{
+	std::mt19937 rng(11);
+	const unsigned int KEYS = 301;
+	const float QUANTUM = 1.f / 60.f;
+	const unsigned int STEPS = 600; // 10 seconds of quantum.
+
+	for (auto n : sizes(settings, { 16, 256, 4096 })) {
+		std::vector<std::vector<Node>> key_frames;
+		smooth_key_frames(rng, n, KEYS, key_frames);
+
+		std::vector<float> times(KEYS);
+		for (unsigned int k = 0; k < KEYS; k++) {
+			times[k] = k / 30.f;
+		}
+
+		TrackClip clip;
+		build_track_clip(key_frames, times, &clip);
+
+		Skeleton skeleton;
+		tree_skeleton(n, &skeleton);
+
+		// Forwards then backwards over the whole clip.
+		auto scrub = [&](unsigned long long i)
+		{
+			const unsigned int step = (unsigned int)(i % (2 * STEPS));
+			return (step < STEPS ? step : 2 * STEPS - step) * QUANTUM;
+		};
+
+		std::vector<float> worlds(n * 16), models(n * 16);
+		TrackCursor cursor;
+		QuatPose pose;
+
+		bench(settings, "scrub_evaluate", "limbs", n, n, [&](unsigned long long i)
+		{
+			sample_track_clip(&clip, scrub(i), &cursor, &pose);
+			quat_pose_world_matrices(&skeleton, &pose, worlds.data(), models.data());
+			sink = models[16 * n - 1];
+		});
+
+		const size_t pose_bytes = sizeof(PoseCacheEntry) + 16 * n * sizeof(float);
+		PoseCache cache;
+		pose_cache_init(&cache, QUANTUM, (STEPS + 1) * pose_bytes);
+
+		bench(settings, "scrub_pose_cache", "limbs", n, n, [&](unsigned long long i)
+		{
+			pose_cache_models(&cache, 1, &clip, &skeleton, scrub(i), models.data());
+			sink = models[16 * n - 1];
+		});
+		metric(settings, "scrub_pose_cache_hit_rate", n, (double)cache.hits / (cache.hits + cache.misses));
+
+		pose_cache_init(&cache, QUANTUM, STEPS / 3 * pose_bytes);
+		bench(settings, "scrub_pose_cache_third", "limbs", n, n, [&](unsigned long long i)
+		{
+			pose_cache_models(&cache, 1, &clip, &skeleton, scrub(i), models.data());
+			sink = models[16 * n - 1];
+		});
+		metric(settings, "scrub_pose_cache_third_hit_rate", n, (double)cache.hits / (cache.hits + cache.misses));
+	}
+}
+
+// Two clips cross-fading on the base layer under an additive clip masked to
+// half the bones, blended and then resolved once.
+static void bench_animator(const BenchSettings *settings)
+{
+	std::mt19937 rng(7);
+	const unsigned int KEYS = 8;
+
+	for (auto n : sizes(settings, { 16, 4096, 65536 })) {
+		TrackClip clips[3];
+		for (auto &clip : clips) {
+			std::vector<std::vector<Node>> key_frames(KEYS, std::vector<Node>(n));
+			for (auto &key : key_frames) {
+				for (auto &node : key) {
+					random_node(rng, &node);
+				}
+			}
+			build_track_clip(key_frames, {}, &clip);
+		}
+
+		TrackClip additive;
+		make_additive_clip(&clips[2], &additive);
+
+		Skeleton skeleton;
+		tree_skeleton(n, &skeleton);
+
+		QuatPose rest;
+		TrackCursor cursor;
+		sample_track_clip(&clips[0], 0.f, &cursor, &rest);
+
+		Animator animator;
+		animator_init(&animator, &rest);
+		const unsigned int layer = animator_add_layer(&animator, ANIM_LAYER_ADDITIVE, 0.5f);
+
+		std::vector<float> mask(n);
+		for (unsigned long long i = 0; i < n; i++) {
+			mask[i] = i % 2 ? 1.f : 0.f;
+		}
+		animator_set_mask(&animator, layer, mask);
+
+		animator_play(&animator, 0, &clips[0], 0.f, true);
+		animator_play(&animator, 0, &clips[1], 1000.f, true);
+		animator_play(&animator, layer, &additive, 0.f, true);
+		animator_update(&animator, 250.f);
+
+		QuatPose pose;
+		std::vector<float> worlds(n * 16), models(n * 16);
+
+		bench(settings, "animator_evaluate", "limbs", n, n, [&](unsigned long long i)
+		{
+			for (auto &instance : animator.instances) {
+				instance.time = fmodf(i * 0.37f, KEYS - 1.f);
+			}
+			animator_evaluate(&animator, &pose);
+			quat_pose_world_matrices(&skeleton, &pose, worlds.data(), models.data());
+			sink = models[16 * n - 1];
+		});
+	}
+}
+
+// Limbs on a grid with no two touching, so every pair is tested.
+static void bench_collisions(const BenchSettings *settings)
+{
+	for (auto n : sizes(settings, { 16, 256, 2048 })) {
+		std::vector<Node> nodes(n);
+		std::vector<Node *> limbs(n);
+
+		const unsigned int side = (unsigned int)ceilf(cbrtf((float)n));
+		for (unsigned long long i = 0; i < n; i++) {
+			Node *node = &nodes[i];
+			mat4_identity(node->model);
+			mat4_translate(node->model, 3.f * (i % side), 3.f * (i / side % side), 3.f * (i / side / side));
+			mat4_rotate_y(node->model, (float)(i * 7 % 90));
+			limbs[i] = node;
+		}
+
+		bench(settings, "check_limb_collisions", "pairs", n, n * (n - 1) / 2, [&](unsigned long long)
+		{
+			sink = check_limb_collisions(limbs) ? 1.f : 0.f;
+		});
+	}
+}
+
+static void bench_ray_obb(const BenchSettings *settings)
+{
+	std::mt19937 rng(4);
+	std::uniform_real_distribution<float> direction(-1.f, 1.f);
+
+	for (auto n : sizes(settings, { 64, 4096, 262144 })) {
+		std::vector<float> models(n * 16);
+		std::vector<V3> dirs(n);
+		for (unsigned long long i = 0; i < n; i++) {
+			random_model(rng, &models[i * 16], 50.f);
+			dirs[i] = v3_normalise({ direction(rng), direction(rng), direction(rng) });
+		}
+
+		const V3 origin = { 0.f, 2.f, 0.f };
+		bench(settings, "testRayOOBIntersect", "rays", n, n, [&](unsigned long long)
+		{
+			float sum = 0.f;
+			for (unsigned long long i = 0; i < n; i++) {
+				sum += testRayOOBIntersect(origin, dirs[i], LIMB_BOX_MIN, LIMB_BOX_MAX, &models[i * 16]);
+			}
+			sink = sum;
+		});
+	}
+}
+
+// A grid of quads, two triangles each, with smoothing groups in bands so the
+// vertex splitting runs too.
+static bool write_obj(const char *filename, unsigned int cells)
+{
+	std::ofstream file(filename);
+	const unsigned int side = cells + 1;
+
+	char line[96];
+	for (unsigned int z = 0; z < side; z++) {
+		for (unsigned int x = 0; x < side; x++) {
+			snprintf(line, sizeof(line), "v %.4f %.4f %.4f\n", x - cells * 0.5f, 0.25f * sinf(x * 0.3f) * cosf(z * 0.2f), z - cells * 0.5f);
+			file << line;
+		}
+	}
+
+	for (unsigned int z = 0; z < cells; z++) {
+		if (z % 16 == 0) {
+			file << "s " << (z / 16 % 2 + 1) << "\n";
+		}
+
+		for (unsigned int x = 0; x < cells; x++) {
+			const unsigned int a = z * side + x + 1, b = a + 1, c = a + side, d = c + 1;
+			snprintf(line, sizeof(line), "f %u %u %u\nf %u %u %u\n", a, c, b, b, c, d);
+			file << line;
+		}
+	}
+
+	return (bool)file;
+}
+
+static void free_object(Object *obj)
+{
+	for (auto v : obj->vertices) {
+		free(v);
+	}
+	for (auto p : obj->polygons) {
+		free(p);
+	}
+	delete obj;
+}
+
+static void bench_load_object(const BenchSettings *settings)
+{
+	for (auto cells : sizes(settings, { 8, 128, 512 })) {
+		const std::string filename = settings->data + "/bench_" + std::to_string(cells) + ".obj";
+		if (!write_obj(filename.c_str(), cells)) {
+			fprintf(stderr, "Couldn't write %s\n", filename.c_str());
+			continue;
+		}
+
+		const unsigned long long triangles = 2ull * cells * cells;
+		bench(settings, "load_object", "triangles", triangles, triangles, [&](unsigned long long)
+		{
+			Object *obj = load_object(filename.c_str());
+			sink = (float)obj->polygons.size();
+			free_object(obj);
+		});
+
+		remove(filename.c_str());
+	}
+}
+
+static void bench_load_bitmap(const BenchSettings *settings)
+{
+	for (auto side : sizes(settings, { 64, 1024, 4096 })) {
+		const unsigned int w = (unsigned int)side, h = (unsigned int)side;
+		const std::string filename = settings->data + "/bench_" + std::to_string(side) + ".bmp";
+
+		std::vector<unsigned int> pixels((size_t)w * h);
+		for (unsigned int y = 0; y < h; y++) {
+			for (unsigned int x = 0; x < w; x++) {
+				pixels[(size_t)y * w + x] = 0xFF000000 | ((x ^ y) & 0xFF) << 8 | (x & 0xFF);
+			}
+		}
+
+		std::vector<unsigned char> file;
+		encode_bmp((const unsigned char *)pixels.data(), w, h, file);
+		if (!write_file(filename.c_str(), file)) {
+			fprintf(stderr, "Couldn't write %s\n", filename.c_str());
+			continue;
+		}
+
+		const unsigned long long count = (unsigned long long)w * h;
+		bench(settings, "load_bitmap", "pixels", count, count, [&](unsigned long long)
+		{
+			Bitmap *bitmap = load_bitmap(filename.c_str());
+			if (bitmap) {
+				sink = bitmap->pixels[0];
+				free(bitmap->pixels);
+				free(bitmap);
+			}
+		});
+
+		remove(filename.c_str());
+	}
+}
+
+// Records the frame headless in each of the modes that change its passes and
+// checks the stream on the null backend, so redundant state changes and calls
+// GL would reject show up without a GPU.
+static void bench_render_stream(const BenchSettings *settings)
+{
+	const unsigned int w = 480, h = 270;
+	SoftDevice *device = soft_create(w, h, 1);
+	app_state *state = headless_init(device, w, h);
+
+	struct RenderMode {
+		const char *name;
+		unsigned int shadow_mode, pick_mode;
+	};
+	const RenderMode modes[] = {
+		{ "single", SHADOW_SINGLE, PICK_CPU },
+		{ "cascaded", SHADOW_CASCADED, PICK_CPU },
+		{ "gpu_pick", SHADOW_SINGLE, PICK_GPU },
+	};
+
+	for (auto &mode : modes) {
+		state->shadow_mode = mode.shadow_mode;
+		state->pick_mode = mode.pick_mode;
+
+		// The first frame fills the static shadow cache.
+		render(state);
+		render(state);
+
+		GfxNullStats stats;
+		gfx_null_replay(&state->gfx, &stats);
+
+		const std::string prefix = std::string("render_") + mode.name;
+		bench(settings, (prefix + "_record").c_str(), "draws", stats.draws, stats.draws, [&](unsigned long long)
+		{
+			render(state);
+		});
+
+		if (!results.empty() && results.back().name == prefix + "_record") {
+			metric(settings, (prefix + "_record_ms").c_str(), stats.draws, results.back().ns_median * 1e-6);
+		}
+
+		for (unsigned int op = 0; op < GFX_OP_COUNT; op++) {
+			if (stats.calls[op] == 0) {
+				continue;
+			}
+
+			metric(settings, (prefix + "_redundant_" + gfx_op_name(op)).c_str(), stats.calls[op], stats.redundant[op]);
+			metric(settings, (prefix + "_invalid_" + gfx_op_name(op)).c_str(), stats.calls[op], stats.invalid[op]);
+			invalid_calls += stats.invalid[op];
+		}
+	}
+
+	headless_destroy(state);
+	soft_destroy(device);
+}
+
+static std::string json_string(const char *text)
+{
+	std::string out = "\"";
+	for (const char *c = text; *c; c++) {
+		if (*c == '"' || *c == '\\') {
+			out += '\\';
+		}
+		out += (unsigned char)*c >= 0x20 ? *c : ' ';
+	}
+	return out + "\"";
+}
+
+static void write_json(FILE *out, const BenchSettings *settings, const char *label)
+{
+#if defined(_MSC_VER)
+	char compiler[32];
+	snprintf(compiler, sizeof(compiler), "msvc %d", _MSC_VER);
+#elif defined(__VERSION__)
+	const char *compiler = __VERSION__;
+#else
+	const char *compiler = "unknown";
+#endif
+
+#ifdef NDEBUG
+	const char *build = "release";
+#else
+	const char *build = "debug";
+#endif
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"schema\": 1,\n");
+	fprintf(out, "  \"label\": %s,\n", json_string(label).c_str());
+	fprintf(out, "  \"compiler\": %s,\n", json_string(compiler).c_str());
+	fprintf(out, "  \"build\": \"%s\",\n", build);
+	fprintf(out, "  \"quick\": %s,\n", settings->quick ? "true" : "false");
+	fprintf(out, "  \"repeats\": %u,\n", settings->repeats);
+	fprintf(out, "  \"benchmarks\": [\n");
+
+	for (unsigned int i = 0; i < results.size(); i++) {
+		const BenchResult &r = results[i];
+		fprintf(out, "    {\"name\": \"%s\", \"unit\": \"%s\", \"size\": %llu, \"iterations\": %llu, "
+			"\"ns_per_op\": %.3f, \"ns_per_op_min\": %.3f, \"items_per_second\": %.1f}%s\n",
+			r.name.c_str(), r.unit, r.size, r.iterations, r.ns_median, r.ns_min,
+			r.items * 1e9 / r.ns_median, i + 1 < results.size() ? "," : "");
+	}
+
+	fprintf(out, "  ],\n");
+	fprintf(out, "  \"metrics\": [\n");
+
+	for (unsigned int i = 0; i < metrics.size(); i++) {
+		const BenchMetric &m = metrics[i];
+		fprintf(out, "    {\"name\": \"%s\", \"size\": %llu, \"value\": %.6g}%s\n",
+			m.name.c_str(), m.size, m.value, i + 1 < metrics.size() ? "," : "");
+	}
+
+	fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+	BenchSettings settings;
+	settings.quick = false;
+	settings.filter = 0;
+	settings.data = ".";
+	settings.repeats = 5;
+
+	const char *label = "";
+	const char *out_name = 0;
+
+	for (int i = 1; i < argc; i++) {
+		const bool has_value = i + 1 < argc;
+		if (!strcmp(argv[i], "--quick")) {
+			settings.quick = true;
+		} else if (!strcmp(argv[i], "--filter") && has_value) {
+			settings.filter = argv[++i];
+		} else if (!strcmp(argv[i], "--label") && has_value) {
+			label = argv[++i];
+		} else if (!strcmp(argv[i], "--data") && has_value) {
+			settings.data = argv[++i];
+		} else if (!strcmp(argv[i], "--out") && has_value) {
+			out_name = argv[++i];
+		} else {
+			fprintf(stderr, "usage: %s [--quick] [--filter name] [--label text] [--data directory] [--out results.json]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	settings.sample_ms = settings.quick ? 10.0 : 50.0;
+
+	bench_maths(&settings);
+	bench_node_tree(&settings);
+	bench_get_frame(&settings);
+	bench_pose(&settings);
+	bench_track_clip(&settings);
+	bench_clip_compression(&settings);
+	bench_clip_library(&settings);
+	bench_pose_cache(&settings);
+	bench_animator(&settings);
+	bench_collisions(&settings);
+	bench_ray_obb(&settings);
+	bench_load_object(&settings);
+	bench_load_bitmap(&settings);
+	bench_render_stream(&settings);
+
+	FILE *out = stdout;
+	if (out_name) {
+		out = fopen(out_name, "w");
+		if (!out) {
+			fprintf(stderr, "Couldn't write %s\n", out_name);
+			return 1;
+		}
+	}
+
+	write_json(out, &settings, label);
+
+	if (out != stdout) {
+		fclose(out);
+	}
+
+	if (invalid_calls) {
+		fprintf(stderr, "The recorded frames make %u invalid GL calls\n", invalid_calls);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,124 @@
+// Throughput of exporting the animation, rendered headless on the software
+// rasteriser. Each format is exported twice: encoding and writing each frame
+// on the render thread, then through the pipelined exporter. The pipelined
+// export should run close to the render only rate.
+//
+// Built by the root CMakeLists.txt.
+//
+//   ./frame-export-bench [directory [width height fps]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "headless.h"
+#include "render.h"
+#include "animation.h"
+#include "frame-export.h"
+#include "image-write.h"
+
+enum BenchMode {
+	BENCH_RENDER, // Render only.
+	BENCH_SERIAL, // Encode and write on the render thread.
+	BENCH_PIPELINED,
+};
+
+static const unsigned int *render_frame(app_state *state, SoftDevice *device, const Node *pose)
+{
+	for (unsigned int i = 0; i < state->limbs.size(); i++) {
+		*state->limbs[i] = pose[i];
+	}
+
+	render(state);
+	gfx_soft_replay(&state->gfx, device);
+	state->frame++;
+
+	unsigned int w, h;
+	return soft_colour_pixels(device, state->scene_fbo, &w, &h);
+}
+
+static double run(app_state *state, SoftDevice *device, const FrameExportSettings *settings, unsigned int mode, unsigned long long *bytes)
+{
+	const unsigned int frames = frame_export_count(state->key_frames, settings->fps);
+	std::vector<Node> pose = state->key_frames[0];
+	std::vector<unsigned char> file;
+
+	*bytes = 0;
+
+	auto start = std::chrono::steady_clock::now();
+
+	if (mode == BENCH_PIPELINED) {
+		FrameExport *exporter = frame_export_begin(state->key_frames, settings);
+		for (unsigned int f = 0; f < frames; f++) {
+			const unsigned int *pixels = render_frame(state, device, frame_export_pose(exporter, f));
+			frame_export_submit(exporter, f, pixels);
+		}
+
+		FrameExportStats stats = frame_export_end(exporter);
+		*bytes = stats.bytes;
+		print_frame_export_stats(&stats);
+	} else {
+		for (unsigned int f = 0; f < frames; f++) {
+			sample_key_frames(state->key_frames, f / settings->fps, pose.data());
+			const unsigned int *pixels = render_frame(state, device, pose.data());
+
+			if (mode == BENCH_SERIAL) {
+				char name[32];
+				snprintf(name, sizeof(name), "/frame_%05u.%s", f, image_format_extension(settings->format));
+
+				file.clear();
+				encode_image(settings->format, (const unsigned char *)pixels, settings->w, settings->h, file);
+				write_file((std::string(settings->directory) + name).c_str(), file);
+				*bytes += file.size();
+			}
+		}
+	}
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count();
+}
+
+int main(int argc, char **argv)
+{
+	FrameExportSettings settings = default_frame_export_settings();
+	settings.directory = argc > 1 ? argv[1] : ".";
+	settings.w = argc > 4 ? atoi(argv[2]) : 480;
+	settings.h = argc > 4 ? atoi(argv[3]) : 270;
+	settings.fps = argc > 4 ? (float)atof(argv[4]) : 15.f;
+
+	SoftDevice *device = soft_create(settings.w, settings.h, 0);
+	app_state *state = headless_init(device, settings.w, settings.h);
+
+	// Offscreen, without the interface, as app_export_animation draws it.
+	state->pick_mode = PICK_GPU;
+	state->show_interface = false;
+	state->selected = 0;
+
+	const unsigned int frames = frame_export_count(state->key_frames, settings.fps);
+	printf("%ux%u, %u frames at %.0f fps into %s, %u raster threads\n", settings.w, settings.h, frames, settings.fps, settings.directory, soft_thread_count(device));
+
+	// Fills the static shadow cache.
+	render_frame(state, device, state->key_frames[0].data());
+
+	unsigned long long bytes;
+	const double render_ms = run(state, device, &settings, BENCH_RENDER, &bytes);
+	printf("render only: %.1f fps\n", frames * 1000.0 / render_ms);
+
+	const unsigned int formats[2] = { IMAGE_BMP, IMAGE_PNG };
+	for (auto format : formats) {
+		settings.format = format;
+
+		const double serial_ms = run(state, device, &settings, BENCH_SERIAL, &bytes);
+		printf("%s serial: %.1f fps, %.1f MB\n", image_format_extension(format), frames * 1000.0 / serial_ms, bytes / (1024.0 * 1024.0));
+
+		const double pipelined_ms = run(state, device, &settings, BENCH_PIPELINED, &bytes);
+		printf("%s pipelined: %.1f fps, %.0f%% of render only\n", image_format_extension(format), frames * 1000.0 / pipelined_ms, 100.0 * render_ms / pipelined_ms);
+	}
+
+	headless_destroy(state);
+	soft_destroy(device);
+
+	return 0;
+}
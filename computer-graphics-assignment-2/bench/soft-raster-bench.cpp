@@ -0,0 +1,234 @@
+// Frames per second of the software rasteriser over thread counts, rendering
+// the scene headless. Every thread count must produce the same image, and a
+// small frame must match the reference stored next to this file. If the
+// reference is missing it is written instead, delete it to take a new one
+// after a change that is meant to alter the image.
+//
+// Built by the root CMakeLists.txt, which points SOFT_RASTER_REFERENCE at the
+// reference.
+//
+//   ./soft-raster-bench [width height frames [image.bmp [trace.json]]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "headless.h"
+#include "render.h"
+#include "bitmap.h"
+#include "profiler.h"
+
+#ifndef SOFT_RASTER_REFERENCE
+#define SOFT_RASTER_REFERENCE "bench/soft-raster-reference.bmp"
+#endif
+
+static const unsigned int REFERENCE_W = 192;
+static const unsigned int REFERENCE_H = 108;
+static const unsigned int REFERENCE_FRAME = 15;
+static const unsigned int REFERENCE_TOLERANCE = 8; // Per channel, covers floating point differences between compilers.
+static const double REFERENCE_OUTLIERS = 0.005; // Share of pixels allowed past it, edges can round either way.
+
+// 24 bit, bottom row first like the framebuffer.
+static bool write_bmp(const char *filename, const unsigned int *pixels, unsigned int w, unsigned int h)
+{
+	FILE *file = fopen(filename, "wb");
+	if (!file) {
+		return false;
+	}
+
+	const unsigned int pitch = (3 * w + 3) & ~3u;
+	const unsigned int size = 54 + pitch * h;
+
+	unsigned char header[54] = { 'B', 'M' };
+	auto put = [&](unsigned int offset, unsigned int value, unsigned int bytes)
+	{
+		for (unsigned int i = 0; i < bytes; i++) {
+			header[offset + i] = (value >> (8 * i)) & 0xFF;
+		}
+	};
+	put(2, size, 4);
+	put(10, 54, 4);
+	put(14, 40, 4);
+	put(18, w, 4);
+	put(22, h, 4);
+	put(26, 1, 2);
+	put(28, 24, 2);
+	put(34, pitch * h, 4);
+	fwrite(header, 1, sizeof(header), file);
+
+	std::vector<unsigned char> row(pitch, 0);
+	for (unsigned int y = 0; y < h; y++) {
+		for (unsigned int x = 0; x < w; x++) {
+			const unsigned int p = pixels[y * w + x];
+			row[3 * x + 0] = (p >> 16) & 0xFF;
+			row[3 * x + 1] = (p >> 8) & 0xFF;
+			row[3 * x + 2] = p & 0xFF;
+		}
+		fwrite(row.data(), 1, pitch, file);
+	}
+
+	fclose(file);
+	return true;
+}
+
+static unsigned long long hash_pixels(const unsigned int *pixels, unsigned int count)
+{
+	unsigned long long hash = 1469598103934665603ull;
+	for (unsigned int i = 0; i < count; i++) {
+		hash = (hash ^ pixels[i]) * 1099511628211ull;
+	}
+
+	return hash;
+}
+
+// Swings the arms so the skeleton's shadow is redrawn every frame.
+static void animate(app_state *state, unsigned int frame)
+{
+	const float t = frame * 0.1f;
+	state->limbs[3]->rotation.z = 30.f * sinf(t);
+	state->limbs[4]->rotation.z = -30.f * sinf(t);
+}
+
+// Renders the reference frame single threaded and compares it with the stored
+// one, writing it if there's none yet.
+static bool check_reference(const char *filename)
+{
+	SoftDevice *device = soft_create(REFERENCE_W, REFERENCE_H, 1);
+	app_state *state = headless_init(device, REFERENCE_W, REFERENCE_H);
+
+	// The interface would cover most of a frame this small.
+	state->show_interface = false;
+
+	for (unsigned int f = 0; f <= REFERENCE_FRAME; f++) {
+		state->frame = f;
+		animate(state, f);
+		render(state);
+		gfx_soft_replay(&state->gfx, device);
+	}
+
+	unsigned int w, h;
+	const unsigned char *pixels = (const unsigned char *)soft_colour_pixels(device, 0, &w, &h);
+
+	bool match = false;
+	Bitmap *reference = load_bitmap(filename);
+	if (!reference) {
+		if (write_bmp(filename, (const unsigned int *)pixels, w, h)) {
+			printf("no reference, wrote %s\n", filename);
+		} else {
+			printf("no reference, couldn't write %s\n", filename);
+		}
+	} else if (reference->width != w || reference->height != h) {
+		printf("reference %s is %ux%u, the frame %ux%u\n", filename, reference->width, reference->height, w, h);
+	} else {
+		unsigned int outliers = 0, max_difference = 0;
+		for (unsigned int i = 0; i < w * h; i++) {
+			unsigned int difference = 0;
+			for (unsigned int c = 0; c < 3; c++) {
+				difference = std::max(difference, (unsigned int)abs(pixels[4 * i + c] - reference->pixels[4 * i + c]));
+			}
+
+			max_difference = std::max(max_difference, difference);
+			if (difference > REFERENCE_TOLERANCE) {
+				outliers++;
+			}
+		}
+
+		match = outliers <= REFERENCE_OUTLIERS * w * h;
+		printf("reference %s: %u pixels differ by more than %u, at most %u\n", match ? "matches" : "DIFFERS", outliers, REFERENCE_TOLERANCE, max_difference);
+	}
+
+	if (reference) {
+		free(reference->pixels);
+		free(reference);
+	}
+
+	headless_destroy(state);
+	soft_destroy(device);
+
+	return match;
+}
+
+int main(int argc, char **argv)
+{
+	PROFILE_THREAD("main");
+
+	const unsigned int w = argc > 2 ? atoi(argv[1]) : 1280;
+	const unsigned int h = argc > 2 ? atoi(argv[2]) : 720;
+	const unsigned int frames = argc > 3 ? atoi(argv[3]) : 60;
+	const char *image = argc > 4 ? argv[4] : 0;
+	const char *trace = argc > 5 ? argv[5] : 0;
+
+	std::vector<unsigned int> threads;
+	const unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned int n = 1; n < hardware; n *= 2) {
+		threads.push_back(n);
+	}
+	threads.push_back(hardware);
+
+	printf("%ux%u, %u frames\n", w, h, frames);
+	printf("threads  ms/frame      fps  speedup  triangles  fragments/frame\n");
+
+	double base_ms = 0.0;
+	unsigned long long reference = 0;
+	bool consistent = true;
+
+	for (auto n : threads) {
+		SoftDevice *device = soft_create(w, h, n);
+		app_state *state = headless_init(device, w, h);
+
+		// The first frame fills the static shadow cache.
+		animate(state, 0);
+		render(state);
+		gfx_soft_replay(&state->gfx, device);
+		soft_reset_stats(device);
+
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned int f = 1; f <= frames; f++) {
+			state->frame = f;
+			animate(state, f);
+			render(state);
+			gfx_soft_replay(&state->gfx, device);
+		}
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+		const double ms = elapsed.count() / frames;
+		if (n == 1) {
+			base_ms = ms;
+		}
+
+		const SoftStats *stats = soft_stats(device);
+		printf("%7u  %8.2f  %7.1f  %6.2fx  %9u  %15llu\n", n, ms, 1000.0 / ms, base_ms / ms,
+			stats->triangles / frames, stats->fragments / frames);
+
+		unsigned int pw, ph;
+		const unsigned int *pixels = soft_colour_pixels(device, 0, &pw, &ph);
+		const unsigned long long hash = hash_pixels(pixels, pw * ph);
+		if (n == threads[0]) {
+			reference = hash;
+		} else if (hash != reference) {
+			consistent = false;
+		}
+
+		if (image && n == threads.back()) {
+			if (write_bmp(image, pixels, pw, ph)) {
+				printf("wrote %s\n", image);
+			}
+		}
+
+		headless_destroy(state);
+		soft_destroy(device);
+	}
+
+	printf("images %s across thread counts\n", consistent ? "match" : "DIFFER");
+
+	const bool matches_reference = check_reference(SOFT_RASTER_REFERENCE);
+
+	if (trace && profiler_write_trace(trace)) {
+		printf("wrote %s\n", trace);
+	}
+
+	return consistent && matches_reference ? 0 : 1;
+}
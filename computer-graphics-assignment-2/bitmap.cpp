@@ -1,5 +1,7 @@
 #include "bitmap.h"
 
+#ifdef _WIN32
+
 #include <windows.h>
 
 Bitmap *load_bitmap(const char *filename)
@@ -37,4 +39,73 @@ Bitmap *load_bitmap(const char *filename)
 	}
 
 	return bitmap;
-}
\ No newline at end of file
+}
+
+#else
+
+#include <stdlib.h>
+#include <fstream>
+#include <vector>
+
+static unsigned int read_u32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// Uncompressed 24 and 32 bit files only, which is what LoadImage gives the
+// Windows path above. Rows are returned bottom up like there.
+Bitmap *load_bitmap(const char *filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) {
+		return 0;
+	}
+
+	std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (data.size() < 54 || data[0] != 'B' || data[1] != 'M') {
+		return 0;
+	}
+
+	const unsigned int offset = read_u32(&data[10]);
+	const int width = (int)read_u32(&data[18]);
+	const int height = (int)read_u32(&data[22]);
+	const unsigned int bpp = data[28] | (data[29] << 8);
+	const unsigned int compression = read_u32(&data[30]);
+
+	// Negative heights are stored top down.
+	const unsigned int rows = height < 0 ? -height : height;
+	const unsigned int bytes_per_pixel = bpp / 8;
+	const size_t stride = ((size_t)width * bytes_per_pixel + 3) & ~(size_t)3;
+
+	if (width <= 0 || (bpp != 24 && bpp != 32) || (compression != 0 && compression != 3) || offset + stride * rows > data.size()) {
+		return 0;
+	}
+
+	Bitmap *bitmap = (Bitmap *)malloc(sizeof(Bitmap));
+	unsigned char *pixels = (unsigned char *)malloc(4 * (size_t)width * rows);
+	if (!bitmap || !pixels) {
+		free(bitmap);
+		free(pixels);
+		return 0;
+	}
+
+	bitmap->width = width;
+	bitmap->height = rows;
+	bitmap->pixels = pixels;
+
+	unsigned char *dest = pixels;
+	for (unsigned int j = 0; j < rows; j++) {
+		const unsigned char *source = &data[offset + stride * (height < 0 ? rows - 1 - j : j)];
+
+		for (int i = 0; i < width; i++, source += bytes_per_pixel, dest += 4) {
+			dest[0] = source[2];
+			dest[1] = source[1];
+			dest[2] = source[0];
+			dest[3] = 0xFF;
+		}
+	}
+
+	return bitmap;
+}
+
+#endif
@@ -0,0 +1,190 @@
+#include "bvh.h"
+
+#include <float.h>
+#include <algorithm>
+
+static Aabb leaf_bounds(const Bvh *bvh, const BvhNode *node)
+{
+	Aabb box = bvh->bounds[bvh->items[node->first]];
+	for (unsigned int i = 1; i < node->count; i++) {
+		box = aabb_union(box, bvh->bounds[bvh->items[node->first + i]]);
+	}
+
+	return box;
+}
+
+static V3 centre(const Aabb &box)
+{
+	return 0.5f * (box.min + box.max);
+}
+
+// Splits items [first, first + count) at the median centroid of the widest axis.
+static int build_node(Bvh *bvh, int parent, unsigned int first, unsigned int count)
+{
+	const int index = bvh->nodes.size();
+	bvh->nodes.push_back(BvhNode());
+
+	BvhNode node;
+	node.parent = parent;
+	node.left = node.right = -1;
+	node.first = first;
+	node.count = count;
+	node.bounds = leaf_bounds(bvh, &node);
+
+	if (count > BVH_LEAF_SIZE) {
+		Aabb centres = { centre(bvh->bounds[bvh->items[first]]), centre(bvh->bounds[bvh->items[first]]) };
+		for (unsigned int i = 1; i < count; i++) {
+			V3 c = centre(bvh->bounds[bvh->items[first + i]]);
+			centres = aabb_union(centres, { c, c });
+		}
+
+		unsigned int axis = 0;
+		V3 size = centres.max - centres.min;
+		if (size.y > size.E[axis]) axis = 1;
+		if (size.z > size.E[axis]) axis = 2;
+
+		auto begin = bvh->items.begin() + first;
+		std::nth_element(begin, begin + count / 2, begin + count,
+			[&](unsigned int a, unsigned int b) -> bool
+			{
+				return centre(bvh->bounds[a]).E[axis] < centre(bvh->bounds[b]).E[axis];
+			});
+
+		node.left = build_node(bvh, index, first, count / 2);
+		node.right = build_node(bvh, index, first + count / 2, count - count / 2);
+		node.count = 0;
+	} else {
+		for (unsigned int i = 0; i < count; i++) {
+			bvh->leaf_of[bvh->items[first + i]] = index;
+		}
+	}
+
+	bvh->nodes[index] = node;
+	return index;
+}
+
+void bvh_build(Bvh *bvh, const std::vector<Aabb> &bounds)
+{
+	bvh->nodes.clear();
+	bvh->bounds = bounds;
+	bvh->items.resize(bounds.size());
+	bvh->leaf_of.assign(bounds.size(), -1);
+
+	for (unsigned int i = 0; i < bounds.size(); i++) {
+		bvh->items[i] = i;
+	}
+
+	if (!bounds.empty()) {
+		build_node(bvh, -1, 0, bounds.size());
+	}
+}
+
+static bool same_box(const Aabb &a, const Aabb &b)
+{
+	return a.min == b.min && a.max == b.max;
+}
+
+// Walks from the primitive's leaf to the root, stopping early once a node's
+// box no longer changes.
+void bvh_refit(Bvh *bvh, unsigned int primitive, const Aabb &bounds)
+{
+	bvh->bounds[primitive] = bounds;
+
+	int index = bvh->leaf_of[primitive];
+	if (index < 0) {
+		return;
+	}
+
+	Aabb box = leaf_bounds(bvh, &bvh->nodes[index]);
+
+	while (index >= 0) {
+		BvhNode *node = &bvh->nodes[index];
+
+		if (node->left != -1) {
+			box = aabb_union(bvh->nodes[node->left].bounds, bvh->nodes[node->right].bounds);
+		}
+
+		if (same_box(box, node->bounds)) {
+			break;
+		}
+
+		node->bounds = box;
+		index = node->parent;
+	}
+}
+
+bool bvh_raycast(const Bvh *bvh, V3 ray_pos, V3 ray_dir, const BvhLeafTest &test, unsigned int *hit, float *distance)
+{
+	if (bvh->nodes.empty()) {
+		return false;
+	}
+
+	V3 inv_dir;
+	for (unsigned int i = 0; i < 3; i++) {
+		inv_dir.E[i] = 1.f / ray_dir.E[i];
+	}
+
+	float best = FLT_MAX;
+	bool found = false;
+
+	struct Entry {
+		int node;
+		float t;
+	};
+
+	std::vector<Entry> stack;
+	float t = ray_aabb_intersect(ray_pos, inv_dir, &bvh->nodes[0].bounds, best);
+	if (t >= 0.f) {
+		stack.push_back({ 0, t });
+	}
+
+	while (!stack.empty()) {
+		Entry entry = stack.back();
+		stack.pop_back();
+
+		if (entry.t > best) {
+			continue;
+		}
+
+		const BvhNode *node = &bvh->nodes[entry.node];
+
+		if (node->left == -1) {
+			const unsigned int *primitives = bvh->items.data() + node->first;
+			float distances[BVH_LEAF_SIZE];
+			test(primitives, node->count, distances);
+
+			for (unsigned int i = 0; i < node->count; i++) {
+				if (distances[i] >= 0.f && distances[i] < best) {
+					best = distances[i];
+					*hit = primitives[i];
+					found = true;
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first so the far one is usually culled by best.
+		float t_left = ray_aabb_intersect(ray_pos, inv_dir, &bvh->nodes[node->left].bounds, best);
+		float t_right = ray_aabb_intersect(ray_pos, inv_dir, &bvh->nodes[node->right].bounds, best);
+
+		Entry near_entry = { node->left, t_left };
+		Entry far_entry = { node->right, t_right };
+		if (t_right >= 0.f && (t_left < 0.f || t_right < t_left)) {
+			std::swap(near_entry, far_entry);
+		}
+
+		if (far_entry.t >= 0.f) {
+			stack.push_back(far_entry);
+		}
+
+		if (near_entry.t >= 0.f) {
+			stack.push_back(near_entry);
+		}
+	}
+
+	if (found) {
+		*distance = best;
+	}
+
+	return found;
+}
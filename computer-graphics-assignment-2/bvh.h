@@ -0,0 +1,40 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include <functional>
+
+#include "maths.h"
+#include "collision.h"
+
+// Bounding volume hierarchy over world space boxes. The tree is built once and
+// refit in place when primitives move, which is fine while the scene layout
+// stays roughly the same.
+
+struct BvhNode {
+	Aabb bounds;
+	int parent;
+	int left, right;           // -1 for leaves.
+	unsigned int first, count; // Range in Bvh::items for leaves.
+};
+
+struct Bvh {
+	std::vector<BvhNode> nodes;
+	std::vector<unsigned int> items; // Primitive indices grouped by leaf.
+	std::vector<Aabb> bounds;        // Per primitive.
+	std::vector<int> leaf_of;        // Leaf holding each primitive.
+};
+
+extern void bvh_build(Bvh *bvh, const std::vector<Aabb> &bounds);
+extern void bvh_refit(Bvh *bvh, unsigned int primitive, const Aabb &bounds);
+
+// Leaves hold at most this many primitives so they can be tested as one packet.
+static const unsigned int BVH_LEAF_SIZE = 4;
+
+// Finds the nearest primitive along the ray. test is given the primitives of a
+// leaf and writes the exact hit distance of each, or a negative value on a miss.
+typedef std::function<void(const unsigned int *primitives, unsigned int count, float *distances)> BvhLeafTest;
+
+extern bool bvh_raycast(const Bvh *bvh, V3 ray_pos, V3 ray_dir, const BvhLeafTest &test, unsigned int *hit, float *distance);
+
+#endif
@@ -0,0 +1,57 @@
+#include "cascades.h"
+
+#include <math.h>
+
+// Light space depth range of every cascade. Casters outside the camera frustum
+// can still throw shadows into it, so the range isn't fitted to the slice.
+static const float LIGHT_NEAR = 1.f;
+static const float LIGHT_FAR = 1000.f;
+
+// Writes the far distance of each of count slices between near and far.
+// lambda blends between uniform (0) and logarithmic (1) spacing.
+void cascade_splits(float near, float far, float lambda, unsigned int count, float *splits)
+{
+	for (unsigned int i = 1; i <= count; i++) {
+		const float f = (float)i / count;
+		const float uniform = near + (far - near) * f;
+		const float logarithmic = near * powf(far / near, f);
+
+		splits[i - 1] = lerp(uniform, logarithmic, lambda);
+	}
+}
+
+// Fits an orthographic light projection around the camera frustum slice from
+// near to far. The slice is bounded by a sphere, so the projection size doesn't
+// change as the camera turns, and its centre is snapped to whole texels so the
+// shadow edges don't shimmer as the camera moves.
+void fit_cascade(const Camera *cam, float aspect, float near, float far, const float *light_view, unsigned int size, Cascade *cascade)
+{
+	const float ty = tanf(radians(cam->fov) / 2.f);
+	const float tx = ty * aspect;
+	const float k2 = tx * tx + ty * ty;
+
+	// The smallest sphere around a symmetric slice is centred on the view axis,
+	// equidistant from the near and far corners.
+	float c = fminf(0.5f * (near + far) * (1.f + k2), far);
+	float r = fmaxf(sqrtf(near * near * k2 + (c - near) * (c - near)), sqrtf(far * far * k2 + (far - c) * (far - c)));
+	r = ceilf(r * 16.f) / 16.f;
+
+	V3 front = v3_normalise(cam->front);
+	V3 centre = cam->pos + front * c;
+
+	V4 p = { centre.x, centre.y, centre.z, 1.f };
+	p = mat4_transform(light_view, p);
+
+	const float texel = 2.f * r / size;
+	p.x = floorf(p.x / texel) * texel;
+	p.y = floorf(p.y / texel) * texel;
+
+	float projection[16];
+	mat4_identity(projection);
+	mat4_ortho(projection, p.x - r, p.x + r, p.y - r, p.y + r, LIGHT_NEAR, LIGHT_FAR);
+
+	mat4_multiply(cascade->matrix, projection, light_view);
+	cascade->near = near;
+	cascade->far = far;
+	cascade->texel_size = texel;
+}
@@ -0,0 +1,21 @@
+#ifndef CASCADES_H
+#define CASCADES_H
+
+#include "camera.h"
+
+// Cascaded shadow maps. The camera frustum is cut into slices along its view
+// direction and each slice gets its own light projection, so texels near the
+// camera cover less of the world than texels far away.
+
+static const unsigned int MAX_CASCADES = 4;
+
+struct Cascade {
+	float near, far;     // View depth covered by the cascade.
+	float matrix[16];    // Light projection * light view.
+	float texel_size;    // World units per shadow map texel.
+};
+
+extern void cascade_splits(float near, float far, float lambda, unsigned int count, float *splits);
+extern void fit_cascade(const Camera *cam, float aspect, float near, float far, const float *light_view, unsigned int size, Cascade *cascade);
+
+#endif
@@ -0,0 +1,489 @@
+#include "clip-compression.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+static const char CLIP_MAGIC[4] = { 'C', 'L', 'I', 'P' };
+static const unsigned int CLIP_VERSION = 2; // Version 1 quantised key times to 16 bits.
+
+// Translation and scale values use all 16 bits, the rotation components 15,
+// the spare bits hold which component was dropped.
+static const float VALUE_STEPS = 65535.f;
+static const float ROTATION_STEPS = 32767.f;
+static const float SQRT_HALF = 0.70710678f;
+
+// Offsets are in bytes from the start of the header, every section starts
+// 4 byte aligned. ranges is 0 for rotations, which don't have any.
+struct ClipHeader {
+	char magic[4];
+	unsigned int version;
+	unsigned int limbs;
+	float duration;
+	unsigned int size;
+	unsigned int keys[CLIP_CHANNELS];
+	unsigned int first[CLIP_CHANNELS];
+	unsigned int ranges[CLIP_CHANNELS];
+	unsigned int times[CLIP_CHANNELS];
+	unsigned int values[CLIP_CHANNELS];
+};
+
+ClipCompressionSettings default_clip_compression_settings()
+{
+	ClipCompressionSettings settings;
+	settings.max_translation_error = 0.001f;
+	settings.max_rotation_error = 0.1f;
+	settings.max_scale_error = 0.001f;
+	return settings;
+}
+
+static unsigned short quantise(float v, float steps)
+{
+	return (unsigned short)std::min(std::max(v * steps + 0.5f, 0.f), steps);
+}
+
+// The quaternion without its largest component, which is made positive so
+// it can be rebuilt from the other three. Those are then at most 1 / sqrt(2)
+// in size.
+static void encode_rotation(Quat q, unsigned short *out)
+{
+	unsigned int largest = 0;
+	for (unsigned int c = 1; c < 4; c++) {
+		if (fabsf(q.E[c]) > fabsf(q.E[largest])) {
+			largest = c;
+		}
+	}
+
+	const float sign = q.E[largest] < 0.f ? -1.f : 1.f;
+	unsigned int o = 0;
+	for (unsigned int c = 0; c < 4; c++) {
+		if (c != largest) {
+			out[o++] = (unsigned short)(quantise((sign * q.E[c] / SQRT_HALF + 1.f) * 0.5f, ROTATION_STEPS) << 1);
+		}
+	}
+	out[0] |= largest & 1;
+	out[1] |= largest >> 1;
+}
+
+static Quat decode_rotation(const unsigned short *in)
+{
+	const unsigned int largest = (in[0] & 1) | (in[1] & 1) << 1;
+
+	Quat q;
+	float sum = 0.f;
+	unsigned int o = 0;
+	for (unsigned int c = 0; c < 4; c++) {
+		if (c != largest) {
+			const float v = ((in[o++] >> 1) / ROTATION_STEPS * 2.f - 1.f) * SQRT_HALF;
+			q.E[c] = v;
+			sum += v * v;
+		}
+	}
+	q.E[largest] = sqrtf(std::max(1.f - sum, 0.f));
+
+	return q;
+}
+
+static V3 decode_v3(const unsigned short *in, const float *range)
+{
+	return { range[0] + in[0] * range[3], range[1] + in[1] * range[4], range[2] + in[2] * range[5] };
+}
+
+static float v3_distance(V3 a, V3 b)
+{
+	const V3 d = a - b;
+	return sqrtf(v3_dot(d, d));
+}
+
+// From the chord between them, acos loses too much close to 1.
+static float rotation_degrees(Quat a, Quat b)
+{
+	const float sign = quat_dot(a, b) < 0.f ? -1.f : 1.f;
+	float chord = 0.f;
+	for (unsigned int c = 0; c < 4; c++) {
+		const float d = a.E[c] - sign * b.E[c];
+		chord += d * d;
+	}
+	return 4.f * asinf(std::min(sqrtf(chord) * 0.5f, 1.f)) * (float)(180.0 / M_PI);
+}
+
+// Interpolated the way the sampler does, from the quantised keys.
+static float key_fraction(float ta, float tb, float t)
+{
+	return tb > ta ? std::min(std::max((t - ta) / (tb - ta), 0.f), 1.f) : 0.f;
+}
+
+static V3 lerp_keys(V3 a, V3 b, float u)
+{
+	return { a.x + u * (b.x - a.x), a.y + u * (b.y - a.y), a.z + u * (b.z - a.z) };
+}
+
+static Quat slerp_keys(Quat a, Quat b, float u)
+{
+	Quat q;
+	quat_slerp_batch_each(&q, &a, &b, &u, 1);
+	return q;
+}
+
+// The keys to keep so that interpolating between them stays within error of
+// every key dropped. error(a, b, k) is how far key k is from a to b
+// interpolated at its time, as a fraction of the tolerance. A track within
+// tolerance of its first key throughout is reduced to that key.
+template <typename E>
+static void reduce_keys(unsigned int count, E error, std::vector<unsigned int> &kept)
+{
+	kept.clear();
+	if (count == 0) {
+		return;
+	}
+
+	bool constant = true;
+	for (unsigned int k = 1; k < count && constant; k++) {
+		constant = error(0, 0, k) <= 1.f;
+	}
+	if (constant) {
+		kept.push_back(0);
+		return;
+	}
+
+	// Douglas-Peucker, splitting each span at its worst key until none is
+	// out of tolerance.
+	std::vector<bool> keep(count, false);
+	keep[0] = keep[count - 1] = true;
+
+	std::vector<std::pair<unsigned int, unsigned int>> spans;
+	spans.push_back({ 0, count - 1 });
+	while (!spans.empty()) {
+		const unsigned int a = spans.back().first, b = spans.back().second;
+		spans.pop_back();
+
+		float worst = 1.f;
+		unsigned int split = 0;
+		for (unsigned int k = a + 1; k < b; k++) {
+			const float e = error(a, b, k);
+			if (e > worst) {
+				worst = e;
+				split = k;
+			}
+		}
+
+		if (split) {
+			keep[split] = true;
+			spans.push_back({ a, split });
+			spans.push_back({ split, b });
+		}
+	}
+
+	for (unsigned int k = 0; k < count; k++) {
+		if (keep[k]) {
+			kept.push_back(k);
+		}
+	}
+}
+
+// The worst error of any key against the kept keys, sampled at the key's
+// time in the span the sampler would find it in. reduce_keys only measures
+// the keys it drops, against their quantised neighbours, but a kept key is
+// off by its own quantisation too.
+template <typename E>
+static float sampled_error(const float *key_times, unsigned int count, const std::vector<unsigned int> &kept, std::vector<float> &kept_times, E error)
+{
+	const unsigned int n = kept.size();
+	if (n == 0) {
+		return 0.f;
+	}
+
+	kept_times.resize(n);
+	for (unsigned int j = 0; j < n; j++) {
+		kept_times[j] = key_times[kept[j]];
+	}
+
+	float worst = 0.f;
+	unsigned int cursor = 0;
+	for (unsigned int k = 0; k < count; k++) {
+		const unsigned int j = find_key(kept_times.data(), n, key_times[k], &cursor);
+		worst = std::max(worst, error(kept[j], kept[std::min(j + 1, n - 1)], k));
+	}
+
+	return worst;
+}
+
+// The compressed channel, built up track by track before being written out.
+struct ChannelData {
+	std::vector<unsigned int> first;
+	std::vector<float> ranges;
+	std::vector<float> times;
+	std::vector<unsigned short> values;
+};
+
+static bool compress_v3_tracks(const KeyTracks<V3> &tracks, unsigned int limbs, float tolerance, ChannelData *out)
+{
+	std::vector<unsigned short> values;
+	std::vector<float> kept_times;
+	std::vector<V3> dequantised;
+	std::vector<unsigned int> kept;
+
+	out->first.push_back(0);
+	for (unsigned int i = 0; i < limbs; i++) {
+		const unsigned int first = tracks.first[i];
+		const unsigned int count = tracks.first[i + 1] - first;
+		const float *key_times = &tracks.times[first];
+		const V3 *keys = &tracks.values[first];
+
+		float range[6] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };
+		if (count) {
+			V3 lo = keys[0], hi = keys[0];
+			for (unsigned int k = 1; k < count; k++) {
+				for (unsigned int e = 0; e < 3; e++) {
+					lo.E[e] = std::min(lo.E[e], keys[k].E[e]);
+					hi.E[e] = std::max(hi.E[e], keys[k].E[e]);
+				}
+			}
+			for (unsigned int e = 0; e < 3; e++) {
+				range[e] = lo.E[e];
+				range[e + 3] = (hi.E[e] - lo.E[e]) / VALUE_STEPS;
+			}
+		}
+
+		values.resize(3 * count);
+		dequantised.resize(count);
+		for (unsigned int k = 0; k < count; k++) {
+			for (unsigned int e = 0; e < 3; e++) {
+				const float step = range[e + 3];
+				values[3 * k + e] = step > 0.f ? quantise((keys[k].E[e] - range[e]) / (step * VALUE_STEPS), VALUE_STEPS) : 0;
+			}
+			dequantised[k] = decode_v3(&values[3 * k], range);
+		}
+
+		auto error = [&](unsigned int a, unsigned int b, unsigned int k)
+		{
+			const float u = key_fraction(key_times[a], key_times[b], key_times[k]);
+			return v3_distance(lerp_keys(dequantised[a], dequantised[b], u), keys[k]) / tolerance;
+		};
+		reduce_keys(count, error, kept);
+		if (sampled_error(key_times, count, kept, kept_times, error) > 1.f) {
+			return false;
+		}
+
+		for (auto k : kept) {
+			out->times.push_back(key_times[k]);
+			out->values.insert(out->values.end(), &values[3 * k], &values[3 * k] + 3);
+		}
+		out->ranges.insert(out->ranges.end(), range, range + 6);
+		out->first.push_back(out->times.size());
+	}
+
+	return true;
+}
+
+static bool compress_rotation_tracks(const KeyTracks<Quat> &tracks, unsigned int limbs, float tolerance, ChannelData *out)
+{
+	std::vector<unsigned short> values;
+	std::vector<float> kept_times;
+	std::vector<Quat> dequantised;
+	std::vector<unsigned int> kept;
+
+	out->first.push_back(0);
+	for (unsigned int i = 0; i < limbs; i++) {
+		const unsigned int first = tracks.first[i];
+		const unsigned int count = tracks.first[i + 1] - first;
+		const float *key_times = &tracks.times[first];
+		const Quat *keys = &tracks.values[first];
+
+		values.resize(3 * count);
+		dequantised.resize(count);
+		for (unsigned int k = 0; k < count; k++) {
+			encode_rotation(quat_normalise(keys[k]), &values[3 * k]);
+			dequantised[k] = decode_rotation(&values[3 * k]);
+		}
+
+		auto error = [&](unsigned int a, unsigned int b, unsigned int k)
+		{
+			const float u = key_fraction(key_times[a], key_times[b], key_times[k]);
+			return rotation_degrees(slerp_keys(dequantised[a], dequantised[b], u), keys[k]) / tolerance;
+		};
+		reduce_keys(count, error, kept);
+		if (sampled_error(key_times, count, kept, kept_times, error) > 1.f) {
+			return false;
+		}
+
+		for (auto k : kept) {
+			out->times.push_back(key_times[k]);
+			out->values.insert(out->values.end(), &values[3 * k], &values[3 * k] + 3);
+		}
+		out->first.push_back(out->times.size());
+	}
+
+	return true;
+}
+
+// Appends a section at the next 4 byte boundary and returns its offset from base.
+static unsigned int write_section(std::vector<unsigned char> &out, size_t base, const void *data, size_t bytes)
+{
+	while ((out.size() - base) % 4) {
+		out.push_back(0);
+	}
+
+	const unsigned int offset = out.size() - base;
+	out.insert(out.end(), (const unsigned char *)data, (const unsigned char *)data + bytes);
+	return offset;
+}
+
+bool compress_track_clip(const TrackClip *clip, const ClipCompressionSettings *settings, std::vector<unsigned char> &out)
+{
+	ChannelData channels[CLIP_CHANNELS];
+	if (!compress_v3_tracks(clip->translations, clip->limbs, settings->max_translation_error, &channels[CLIP_TRANSLATION]) ||
+		!compress_rotation_tracks(clip->rotations, clip->limbs, settings->max_rotation_error, &channels[CLIP_ROTATION]) ||
+		!compress_v3_tracks(clip->scales, clip->limbs, settings->max_scale_error, &channels[CLIP_SCALE])) {
+		return false;
+	}
+
+	ClipHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CLIP_MAGIC, sizeof(CLIP_MAGIC));
+	header.version = CLIP_VERSION;
+	header.limbs = clip->limbs;
+	header.duration = clip->duration;
+
+	const size_t base = out.size();
+	out.resize(base + sizeof(header));
+
+	for (unsigned int c = 0; c < CLIP_CHANNELS; c++) {
+		const ChannelData &channel = channels[c];
+		header.keys[c] = channel.times.size();
+		header.first[c] = write_section(out, base, channel.first.data(), channel.first.size() * sizeof(unsigned int));
+		if (!channel.ranges.empty()) {
+			header.ranges[c] = write_section(out, base, channel.ranges.data(), channel.ranges.size() * sizeof(float));
+		}
+		header.times[c] = write_section(out, base, channel.times.data(), channel.times.size() * sizeof(float));
+		header.values[c] = write_section(out, base, channel.values.data(), channel.values.size() * sizeof(unsigned short));
+	}
+
+	header.size = out.size() - base;
+	memcpy(&out[base], &header, sizeof(header));
+	return true;
+}
+
+static bool section_fits(unsigned int offset, size_t bytes, size_t size)
+{
+	return offset % 4 == 0 && offset >= sizeof(ClipHeader) && offset <= size && bytes <= size - offset;
+}
+
+bool open_compressed_clip(const void *data, size_t size, CompressedClip *clip)
+{
+	if (size < sizeof(ClipHeader) || (size_t)data % 4) {
+		return false;
+	}
+
+	const ClipHeader *header = (const ClipHeader *)data;
+	if (memcmp(header->magic, CLIP_MAGIC, sizeof(CLIP_MAGIC)) || header->version != CLIP_VERSION || header->size > size) {
+		return false;
+	}
+
+	const unsigned char *bytes = (const unsigned char *)data;
+	const size_t limbs = header->limbs;
+	if (limbs >= header->size / sizeof(unsigned int)) {
+		return false;
+	}
+
+	for (unsigned int c = 0; c < CLIP_CHANNELS; c++) {
+		const size_t keys = header->keys[c];
+		if (!section_fits(header->first[c], (limbs + 1) * sizeof(unsigned int), header->size) ||
+			!section_fits(header->times[c], keys * sizeof(float), header->size) ||
+			!section_fits(header->values[c], 3 * keys * sizeof(unsigned short), header->size)) {
+			return false;
+		}
+
+		const bool ranged = c != CLIP_ROTATION;
+		if (ranged && !section_fits(header->ranges[c], 6 * limbs * sizeof(float), header->size)) {
+			return false;
+		}
+
+		// Tracks have to lie within the keys for sampling to stay in bounds.
+		const unsigned int *first = (const unsigned int *)(bytes + header->first[c]);
+		if (first[0] != 0 || first[limbs] != keys) {
+			return false;
+		}
+		for (size_t i = 0; i < limbs; i++) {
+			if (first[i + 1] < first[i]) {
+				return false;
+			}
+		}
+
+		clip->first[c] = first;
+		clip->times[c] = (const float *)(bytes + header->times[c]);
+		clip->values[c] = (const unsigned short *)(bytes + header->values[c]);
+		clip->ranges[c] = ranged ? (const float *)(bytes + header->ranges[c]) : 0;
+	}
+
+	clip->limbs = header->limbs;
+	clip->duration = header->duration;
+	clip->size = header->size;
+	return true;
+}
+
+static void sample_v3_channel(const CompressedClip *clip, unsigned int channel, float t, unsigned int *cursors, V3 *out)
+{
+	const unsigned int *first = clip->first[channel];
+	const float *times = clip->times[channel];
+	const unsigned short *values = clip->values[channel];
+	const float *ranges = clip->ranges[channel];
+
+	for (unsigned int i = 0; i < clip->limbs; i++) {
+		const unsigned int count = first[i + 1] - first[i];
+		if (count == 0) {
+			continue;
+		}
+
+		const float *track = times + first[i];
+		const unsigned int key = find_key(track, count, t, cursors + i);
+		const unsigned short *a = values + 3 * (first[i] + key);
+		const float *range = ranges + 6 * i;
+
+		if (count == 1) {
+			out[i] = decode_v3(a, range);
+		} else {
+			out[i] = lerp_keys(decode_v3(a, range), decode_v3(a + 3, range), key_fraction(track[key], track[key + 1], t));
+		}
+	}
+}
+
+void sample_compressed_clip(const CompressedClip *clip, float t, TrackCursor *cursor, QuatPose *pose)
+{
+	const unsigned int limbs = clip->limbs;
+	pose->translations.resize(limbs, { 0.f, 0.f, 0.f });
+	pose->rotations.resize(limbs, quat_identity());
+	pose->scales.resize(limbs, { 1.f, 1.f, 1.f });
+
+	cursor->translations.resize(limbs);
+	cursor->rotations.resize(limbs);
+	cursor->scales.resize(limbs);
+	cursor->from.resize(limbs);
+	cursor->to.resize(limbs);
+	cursor->t.resize(limbs);
+
+	sample_v3_channel(clip, CLIP_TRANSLATION, t, cursor->translations.data(), pose->translations.data());
+	sample_v3_channel(clip, CLIP_SCALE, t, cursor->scales.data(), pose->scales.data());
+
+	const unsigned int *first = clip->first[CLIP_ROTATION];
+	const float *times = clip->times[CLIP_ROTATION];
+	const unsigned short *values = clip->values[CLIP_ROTATION];
+	for (unsigned int i = 0; i < limbs; i++) {
+		const unsigned int count = first[i + 1] - first[i];
+		if (count == 0) {
+			cursor->from[i] = cursor->to[i] = pose->rotations[i];
+			cursor->t[i] = 0.f;
+			continue;
+		}
+
+		const float *track = times + first[i];
+		const unsigned int key = find_key(track, count, t, &cursor->rotations[i]);
+		const unsigned short *a = values + 3 * (first[i] + key);
+
+		cursor->from[i] = decode_rotation(a);
+		cursor->to[i] = count > 1 ? decode_rotation(a + 3) : cursor->from[i];
+		cursor->t[i] = count > 1 ? key_fraction(track[key], track[key + 1], t) : 0.f;
+	}
+
+	quat_slerp_batch_each(pose->rotations.data(), cursor->from.data(), cursor->to.data(), cursor->t.data(), limbs);
+}
@@ -0,0 +1,60 @@
+#ifndef CLIP_COMPRESSION_H
+#define CLIP_COMPRESSION_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "animation.h"
+
+// Lossy compression of TrackClips into a flat binary format that is sampled
+// in place. Each track keeps only the keys needed to stay within the
+// tolerances when interpolated, so a limb that holds still is one key.
+// What's kept is quantised to 16 bits: translations and scales within each
+// track's range, and rotations as the three smallest components of the
+// quaternion. Key times stay in seconds, 16 bits over a long clip would move
+// a fast track's keys by more than the tolerance.
+
+struct ClipCompressionSettings {
+	float max_translation_error; // Distance, at every original key.
+	float max_rotation_error;    // Degrees.
+	float max_scale_error;
+};
+
+extern ClipCompressionSettings default_clip_compression_settings();
+
+// Appends the compressed clip to out. The data is only ever read through
+// open_compressed_clip, which wants it 4 byte aligned. Fails, leaving out as
+// it was, if sampling it would miss a key by more than the tolerance. 16 bits
+// over a track's range can be too coarse for a track that covers a lot of
+// ground.
+extern bool compress_track_clip(const TrackClip *clip, const ClipCompressionSettings *settings, std::vector<unsigned char> &out);
+
+enum ClipChannel {
+	CLIP_TRANSLATION,
+	CLIP_ROTATION,
+	CLIP_SCALE,
+	CLIP_CHANNELS
+};
+
+// Points into the data, which must outlive it. Per channel, track i's keys
+// are [first[i], first[i + 1]). Translations and scales are 3 values a key
+// and each track has 6 floats, a minimum and a step per axis. Rotations are
+// 3 values a key.
+struct CompressedClip {
+	unsigned int limbs;
+	float duration;
+	size_t size; // Of the data, in bytes.
+	const unsigned int *first[CLIP_CHANNELS];
+	const float *times[CLIP_CHANNELS];
+	const unsigned short *values[CLIP_CHANNELS];
+	const float *ranges[CLIP_CHANNELS];
+};
+
+// Checks the header and that every section lies within size. Nothing is
+// copied.
+extern bool open_compressed_clip(const void *data, size_t size, CompressedClip *clip);
+
+// As sample_track_clip.
+extern void sample_compressed_clip(const CompressedClip *clip, float t, TrackCursor *cursor, QuatPose *pose);
+
+#endif
@@ -0,0 +1,254 @@
+#include "clip-library.h"
+
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char LIBRARY_MAGIC[4] = { 'C', 'L', 'I', 'B' };
+static const unsigned int LIBRARY_VERSION = 1;
+
+// Clips start on a page so that reading one never pulls in its neighbours.
+static const unsigned long long LIBRARY_ALIGN = 4096;
+
+struct ClipLibraryHeader {
+	char magic[4];
+	unsigned int version;
+	unsigned int clips;
+	unsigned int entry_size;
+	unsigned long long index; // Offset of the first entry.
+	unsigned long long size; // Of the whole file.
+};
+
+struct ClipLibraryEntry {
+	char name[48]; // Nul terminated.
+	unsigned long long offset, size;
+};
+
+bool write_clip_library(const char *filename, const std::vector<std::string> &names, const std::vector<std::vector<unsigned char>> &clips)
+{
+	if (names.size() != clips.size()) {
+		return false;
+	}
+
+	std::vector<unsigned int> order(names.size());
+	for (unsigned int i = 0; i < order.size(); i++) {
+		order[i] = i;
+		if (names[i].size() >= sizeof(ClipLibraryEntry::name)) {
+			return false;
+		}
+	}
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b)
+	{
+		return names[a] < names[b];
+	});
+	for (unsigned int i = 1; i < order.size(); i++) {
+		if (names[order[i]] == names[order[i - 1]]) {
+			return false;
+		}
+	}
+
+	ClipLibraryHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, LIBRARY_MAGIC, sizeof(LIBRARY_MAGIC));
+	header.version = LIBRARY_VERSION;
+	header.clips = clips.size();
+	header.entry_size = sizeof(ClipLibraryEntry);
+	header.index = sizeof(header);
+
+	std::vector<ClipLibraryEntry> index(order.size());
+	unsigned long long offset = header.index + index.size() * sizeof(ClipLibraryEntry);
+	for (unsigned int i = 0; i < order.size(); i++) {
+		ClipLibraryEntry &entry = index[i];
+		memset(&entry, 0, sizeof(entry));
+		memcpy(entry.name, names[order[i]].c_str(), names[order[i]].size());
+
+		offset = (offset + LIBRARY_ALIGN - 1) / LIBRARY_ALIGN * LIBRARY_ALIGN;
+		entry.offset = offset;
+		entry.size = clips[order[i]].size();
+		offset += entry.size;
+	}
+	header.size = offset;
+
+	std::ofstream file(filename, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	file.write((const char *)&header, sizeof(header));
+	file.write((const char *)index.data(), index.size() * sizeof(ClipLibraryEntry));
+
+	unsigned long long at = header.index + index.size() * sizeof(ClipLibraryEntry);
+	const char padding[LIBRARY_ALIGN] = {};
+	for (unsigned int i = 0; i < order.size(); i++) {
+		file.write(padding, index[i].offset - at);
+		file.write((const char *)clips[order[i]].data(), index[i].size);
+		at = index[i].offset + index[i].size;
+	}
+
+	return (bool)file;
+}
+
+#ifdef _WIN32
+
+static bool map_file(const char *filename, ClipLibrary *library)
+{
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, 0);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	HANDLE mapping = 0;
+	const void *view = 0;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+		mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+		if (mapping) {
+			view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		}
+	}
+
+	if (!view) {
+		if (mapping) {
+			CloseHandle(mapping);
+		}
+		CloseHandle(file);
+		return false;
+	}
+
+	library->data = (const unsigned char *)view;
+	library->size = (size_t)size.QuadPart;
+	library->file = file;
+	library->mapping = mapping;
+	return true;
+}
+
+static void unmap_file(ClipLibrary *library)
+{
+	UnmapViewOfFile(library->data);
+	CloseHandle(library->mapping);
+	CloseHandle(library->file);
+}
+
+#else
+
+static bool map_file(const char *filename, ClipLibrary *library)
+{
+	const int file = open(filename, O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+
+	struct stat info;
+	void *view = MAP_FAILED;
+	if (fstat(file, &info) == 0 && info.st_size > 0) {
+		view = mmap(0, (size_t)info.st_size, PROT_READ, MAP_SHARED, file, 0);
+	}
+	close(file);
+
+	if (view == MAP_FAILED) {
+		return false;
+	}
+
+	// Clips are looked up in any order, reading ahead would only bring in
+	// clips that aren't being played.
+	madvise(view, (size_t)info.st_size, MADV_RANDOM);
+
+	library->data = (const unsigned char *)view;
+	library->size = (size_t)info.st_size;
+	return true;
+}
+
+static void unmap_file(ClipLibrary *library)
+{
+	munmap((void *)library->data, library->size);
+}
+
+#endif
+
+bool open_clip_library(const char *filename, ClipLibrary *library)
+{
+	memset(library, 0, sizeof(*library));
+	if (!map_file(filename, library)) {
+		return false;
+	}
+
+	const ClipLibraryHeader *header = (const ClipLibraryHeader *)library->data;
+	const bool valid = library->size >= sizeof(ClipLibraryHeader) &&
+		memcmp(header->magic, LIBRARY_MAGIC, sizeof(LIBRARY_MAGIC)) == 0 &&
+		header->version == LIBRARY_VERSION &&
+		header->entry_size == sizeof(ClipLibraryEntry) &&
+		header->size == library->size &&
+		header->index % alignof(ClipLibraryEntry) == 0 &&
+		header->index <= library->size &&
+		header->clips <= (library->size - header->index) / sizeof(ClipLibraryEntry);
+
+	if (!valid) {
+		close_clip_library(library);
+		return false;
+	}
+
+	library->clips = header->clips;
+	library->index = (const ClipLibraryEntry *)(library->data + header->index);
+	return true;
+}
+
+void close_clip_library(ClipLibrary *library)
+{
+	if (library->data) {
+		unmap_file(library);
+	}
+	memset(library, 0, sizeof(*library));
+}
+
+int find_library_clip(const ClipLibrary *library, const char *name)
+{
+	unsigned int lo = 0, hi = library->clips;
+	while (lo < hi) {
+		const unsigned int mid = lo + (hi - lo) / 2;
+		const int order = strncmp(library->index[mid].name, name, sizeof(ClipLibraryEntry::name));
+		if (order == 0) {
+			return (int)mid;
+		}
+		if (order < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return -1;
+}
+
+const char *library_clip_name(const ClipLibrary *library, unsigned int clip)
+{
+	if (clip >= library->clips) {
+		return 0;
+	}
+
+	// Entries are only checked when they're used, opening doesn't read the index.
+	const ClipLibraryEntry *entry = &library->index[clip];
+	return memchr(entry->name, 0, sizeof(entry->name)) ? entry->name : 0;
+}
+
+bool get_library_clip(const ClipLibrary *library, unsigned int clip, CompressedClip *compressed)
+{
+	if (clip >= library->clips) {
+		return false;
+	}
+
+	const ClipLibraryEntry *entry = &library->index[clip];
+	if (entry->offset > library->size || entry->size > library->size - entry->offset) {
+		return false;
+	}
+
+	return open_compressed_clip(library->data + entry->offset, (size_t)entry->size, compressed);
+}
@@ -0,0 +1,44 @@
+#ifndef CLIP_LIBRARY_H
+#define CLIP_LIBRARY_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "clip-compression.h"
+
+// A file of compressed clips that is memory mapped rather than read. The
+// header is followed by an index of names, sorted so a clip can be found by
+// binary search, and then each clip in the format compress_track_clip writes,
+// starting on its own page. Opening maps the file and checks the header, so
+// it costs the same however many clips there are, and only the pages of
+// clips that are looked up and played are ever read in.
+
+struct ClipLibraryEntry;
+
+struct ClipLibrary {
+	const unsigned char *data;
+	size_t size;
+	unsigned int clips;
+	const ClipLibraryEntry *index;
+
+#ifdef _WIN32
+	void *file, *mapping;
+#endif
+};
+
+// names and clips pair up, clips as written by compress_track_clip. Fails if
+// two names are the same or a name doesn't fit in the index.
+extern bool write_clip_library(const char *filename, const std::vector<std::string> &names, const std::vector<std::vector<unsigned char>> &clips);
+
+extern bool open_clip_library(const char *filename, ClipLibrary *library);
+extern void close_clip_library(ClipLibrary *library);
+
+// -1 if there is no clip by that name.
+extern int find_library_clip(const ClipLibrary *library, const char *name);
+extern const char *library_clip_name(const ClipLibrary *library, unsigned int clip);
+
+// The clip straight from the mapped pages, valid until the library is closed.
+extern bool get_library_clip(const ClipLibrary *library, unsigned int clip, CompressedClip *compressed);
+
+#endif
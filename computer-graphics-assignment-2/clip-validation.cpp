@@ -0,0 +1,197 @@
+#include "clip-validation.h"
+
+#include <math.h>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#include "animation.h"
+#include "collision.h"
+
+// Scratch buffers owned by one worker thread.
+struct ClipSampler {
+	const Skeleton *skeleton;
+	std::vector<Node> pose;
+	std::vector<float> worlds;
+	std::vector<float> models;
+	std::vector<LimbBounds> bounds;
+};
+
+static void sample_bounds(ClipSampler *sampler, const std::vector<std::vector<Node>> &clip, float t)
+{
+	sample_key_frames(clip, t, sampler->pose.data());
+	skeleton_world_matrices(sampler->skeleton, sampler->pose.data(), sampler->worlds.data(), sampler->models.data());
+
+	for (unsigned int i = 0; i < sampler->bounds.size(); i++) {
+		limb_bounds_from_model(&sampler->bounds[i], sampler->models.data() + 16 * i);
+	}
+}
+
+// Number of samples needed so no limb moves further than the settings allow
+// between two of them. A joint swings everything below it, so rotations are
+// accumulated down the hierarchy.
+static unsigned int interval_steps(const Skeleton *skeleton, const std::vector<Node> &a, const std::vector<Node> &b, const ClipValidationSettings *settings)
+{
+	std::vector<float> swing(a.size(), 0.f);
+	float max_swing = 0.f;
+	float max_distance = 0.f;
+
+	for (auto i : skeleton->order) {
+		float degrees = 0.f;
+		for (unsigned int e = 0; e < 3; e++) {
+			degrees += fabsf(b[i].rotation.E[e] - a[i].rotation.E[e]);
+		}
+
+		if (skeleton->parents[i] != -1) {
+			degrees += swing[skeleton->parents[i]];
+		}
+
+		swing[i] = degrees;
+		max_swing = std::max(max_swing, degrees);
+
+		V3 delta = b[i].translation - a[i].translation;
+		max_distance = std::max(max_distance, sqrtf(v3_dot(delta, delta)));
+	}
+
+	const float by_angle = max_swing / settings->max_degrees_per_step;
+	const float by_distance = max_distance / settings->max_distance_per_step;
+
+	return std::max(1u, (unsigned int)ceilf(std::max(by_angle, by_distance)));
+}
+
+// Tests every unreported pair at time t and appends the new impacts.
+static void find_impacts(ClipSampler *sampler, const std::vector<std::vector<Node>> &clip, unsigned int clip_index, float t, std::vector<bool> &reported, std::vector<ClipContact> &hits)
+{
+	const unsigned int limbs = sampler->bounds.size();
+
+	sample_bounds(sampler, clip, t);
+
+	for (unsigned int a = 0; a < limbs; a++) {
+		for (unsigned int b = a + 1; b < limbs; b++) {
+			if (reported[a * limbs + b]) {
+				continue;
+			}
+
+			if (limb_bounds_overlap(&sampler->bounds[a], &sampler->bounds[b])) {
+				reported[a * limbs + b] = true;
+
+				ClipContact contact = { clip_index, a, b, t };
+				hits.push_back(contact);
+			}
+		}
+	}
+}
+
+static void validate_clip(ClipSampler *sampler, unsigned int clip_index, const std::vector<std::vector<Node>> &clip, const ClipValidationSettings *settings, std::vector<ClipContact> &contacts)
+{
+	const unsigned int limbs = sampler->bounds.size();
+	std::vector<bool> reported(limbs * limbs, false);
+	std::vector<ClipContact> hits;
+
+	// Anything overlapping in the first key collides from the start.
+	find_impacts(sampler, clip, clip_index, 0.f, reported, hits);
+	contacts.insert(contacts.end(), hits.begin(), hits.end());
+
+	float previous_t = 0.f;
+
+	for (unsigned int key = 0; key + 1 < clip.size(); key++) {
+		const unsigned int steps = interval_steps(sampler->skeleton, clip[key], clip[key + 1], settings);
+
+		for (unsigned int s = 1; s <= steps; s++) {
+			const float t = key + (float)s / steps;
+
+			hits.clear();
+			find_impacts(sampler, clip, clip_index, t, reported, hits);
+
+			// Narrow each impact down between this sample and the last free one.
+			for (auto &contact : hits) {
+				float free_t = previous_t;
+				float hit_t = t;
+
+				for (unsigned int i = 0; i < settings->refine_iterations; i++) {
+					const float mid = 0.5f * (free_t + hit_t);
+					sample_bounds(sampler, clip, mid);
+
+					if (limb_bounds_overlap(&sampler->bounds[contact.limb_a], &sampler->bounds[contact.limb_b])) {
+						hit_t = mid;
+					} else {
+						free_t = mid;
+					}
+				}
+
+				contact.time = hit_t;
+				contacts.push_back(contact);
+			}
+
+			previous_t = t;
+		}
+	}
+}
+
+ClipValidationSettings default_clip_validation_settings()
+{
+	ClipValidationSettings settings;
+	settings.max_degrees_per_step = 2.f;
+	settings.max_distance_per_step = 0.1f;
+	settings.refine_iterations = 10;
+	settings.threads = 0;
+	return settings;
+}
+
+std::vector<ClipContact> validate_clips(const Skeleton *skeleton, const std::vector<std::vector<std::vector<Node>>> &clips, const ClipValidationSettings *settings)
+{
+	unsigned int thread_count = settings->threads ? settings->threads : std::thread::hardware_concurrency();
+	thread_count = std::max(1u, std::min(thread_count, (unsigned int)clips.size()));
+
+	std::vector<std::vector<ClipContact>> results(thread_count);
+	std::atomic<unsigned int> next_clip(0);
+
+	auto worker = [&](unsigned int thread_index)
+	{
+		ClipSampler sampler;
+		sampler.skeleton = skeleton;
+
+		for (unsigned int c = next_clip++; c < clips.size(); c = next_clip++) {
+			const std::vector<std::vector<Node>> &clip = clips[c];
+			if (clip.empty()) {
+				continue;
+			}
+
+			const unsigned int limbs = clip[0].size();
+			sampler.pose = clip[0];
+			sampler.worlds.resize(16 * limbs);
+			sampler.models.resize(16 * limbs);
+			sampler.bounds.resize(limbs);
+
+			validate_clip(&sampler, c, clip, settings, results[thread_index]);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < thread_count; i++) {
+		threads.push_back(std::thread(worker, i));
+	}
+
+	worker(0);
+
+	for (auto &t : threads) {
+		t.join();
+	}
+
+	std::vector<ClipContact> contacts;
+	for (auto &r : results) {
+		contacts.insert(contacts.end(), r.begin(), r.end());
+	}
+
+	std::sort(contacts.begin(), contacts.end(),
+		[](const ClipContact &a, const ClipContact &b) -> bool
+		{
+			if (a.clip != b.clip) {
+				return a.clip < b.clip;
+			}
+
+			return a.time < b.time;
+		});
+
+	return contacts;
+}
@@ -0,0 +1,28 @@
+#ifndef CLIP_VALIDATION_H
+#define CLIP_VALIDATION_H
+
+#include <vector>
+
+#include "node.h"
+
+// Offline continuous collision check for key frame clips. Each interval between
+// keys is sub-sampled according to how far the limbs swing, and the first time
+// of impact of every colliding limb pair is reported.
+
+struct ClipContact {
+	unsigned int clip;
+	unsigned int limb_a, limb_b;
+	float time; // Seconds from the start of the clip.
+};
+
+struct ClipValidationSettings {
+	float max_degrees_per_step;    // Largest accumulated joint rotation between samples.
+	float max_distance_per_step;   // Largest joint translation between samples.
+	unsigned int refine_iterations; // Bisection steps used to narrow each impact.
+	unsigned int threads;          // 0 uses every hardware thread.
+};
+
+extern ClipValidationSettings default_clip_validation_settings();
+extern std::vector<ClipContact> validate_clips(const Skeleton *skeleton, const std::vector<std::vector<std::vector<Node>>> &clips, const ClipValidationSettings *settings);
+
+#endif
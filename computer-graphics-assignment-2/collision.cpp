@@ -0,0 +1,462 @@
+#include "collision.h"
+
+#include <math.h>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define COLLISION_SSE
+#include <xmmintrin.h>
+#endif
+
+#include "node.h"
+#include "profiler.h"
+
+// Corners of the unit limb box, padded slightly so limbs can't quite touch.
+static const float LIMB_POINTS[8][3] = {
+	{ -0.55f, -0.05f, -0.55f },
+	{ -0.55f, -0.05f,  0.55f },
+	{  0.55f, -0.05f, -0.55f },
+	{  0.55f, -0.05f,  0.55f },
+	{ -0.55f,  1.05f, -0.55f },
+	{ -0.55f,  1.05f,  0.55f },
+	{  0.55f,  1.05f, -0.55f },
+	{  0.55f,  1.05f,  0.55f }
+};
+
+static bool is_between(float value, float min, float max)
+{
+	return value >= min && value <= max;
+}
+
+static bool overlaps(float min1, float max1, float min2, float max2)
+{
+	return is_between(min2, min1, max1) || is_between(min1, min2, max2);
+}
+
+static void project(const LimbBounds *bounds, V3 axis, float *min, float *max)
+{
+	*min = *max = v3_dot(axis, bounds->corners[0]);
+	for (unsigned int p = 1; p < 8; p++) {
+		float distance = v3_dot(axis, bounds->corners[p]);
+		if (distance < *min) {
+			*min = distance;
+		} else if (distance > *max) {
+			*max = distance;
+		}
+	}
+}
+
+void limb_bounds_from_model(LimbBounds *bounds, const float *model)
+{
+	for (unsigned int p = 0; p < 8; p++) {
+		const float *point = LIMB_POINTS[p];
+		for (unsigned int i = 0; i < 3; i++) {
+			bounds->corners[p].E[i] = model[i] * point[0] + model[i + 4] * point[1] + model[i + 8] * point[2] + model[i + 12];
+		}
+	}
+
+	for (unsigned int a = 0; a < 3; a++) {
+		V3 axis = { model[a * 4 + 0], model[a * 4 + 1], model[a * 4 + 2] };
+		bounds->axes[a] = v3_normalise(axis);
+	}
+}
+
+// Separating axis test using the face normals of both boxes.
+bool limb_bounds_overlap(const LimbBounds *a, const LimbBounds *b)
+{
+	for (unsigned int o = 0; o < 2; o++) {
+		const LimbBounds *source = (o == 0) ? a : b;
+
+		for (unsigned int i = 0; i < 3; i++) {
+			float min_a, max_a, min_b, max_b;
+			project(a, source->axes[i], &min_a, &max_a);
+			project(b, source->axes[i], &min_b, &max_b);
+
+			if (!overlaps(min_a, max_a, min_b, max_b)) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+float testRayOOBIntersect(V3 ray_pos, V3 ray_dir, const float *min, const float *max, const float *model)
+{
+	float d_min = 0.f;
+	float d_max = 1000000;
+
+	V3 temp;
+	temp.E[0] = model[12] - ray_pos.E[0];
+	temp.E[1] = model[13] - ray_pos.E[1];
+	temp.E[2] = model[14] - ray_pos.E[2];
+
+	for (unsigned int i = 0; i < 3; i++) {
+		int axis = i * 4;
+
+		V3 naxis;
+		for (unsigned int i = 0; i < 3; i++) {
+			naxis.E[i] = model[axis + i];
+		}
+		naxis = v3_normalise(naxis);
+
+		float e = v3_dot(temp, naxis);
+		float f = v3_dot(ray_dir, naxis);
+
+		if (fabsf(f) > 0.0001f) {
+			float d1 = (e + min[i]) / f;
+			float d2 = (e + max[i]) / f;
+
+			if (d1 > d2) {
+				float s = d1;
+				d1 = d2;
+				d2 = s;
+			}
+
+			if (d2 < d_max) {
+				d_max = d2;
+			}
+
+			if (d1 > d_min) {
+				d_min = d1;
+			}
+
+			if (d_max < d_min) {
+				return -1.f;
+			}
+		} else if (e + min[i] > 0.f || e + max[i] < 0.f) {
+			// Parallel to the slab and outside it.
+			return -1.f;
+		}
+	}
+
+	return d_min;
+}
+
+void obb_from_box(Obb *obb, const float *model, const float *min, const float *max)
+{
+	obb->centre = { model[12], model[13], model[14] };
+
+	for (unsigned int i = 0; i < 3; i++) {
+		V3 axis = { model[i * 4 + 0], model[i * 4 + 1], model[i * 4 + 2] };
+		const float length = sqrtf(v3_dot(axis, axis));
+
+		obb->axes[i] = axis * (1.f / length);
+		obb->min[i] = min[i] * length;
+		obb->max[i] = max[i] * length;
+	}
+}
+
+// Same slab test as testRayOOBIntersect on a resolved box.
+float ray_obb_intersect(V3 ray_pos, V3 ray_dir, const Obb *box)
+{
+	float d_min = 0.f;
+	float d_max = 1000000;
+
+	V3 temp = box->centre - ray_pos;
+
+	for (unsigned int i = 0; i < 3; i++) {
+		float e = v3_dot(temp, box->axes[i]);
+		float f = v3_dot(ray_dir, box->axes[i]);
+
+		if (fabsf(f) > 0.0001f) {
+			float d1 = (e + box->min[i]) / f;
+			float d2 = (e + box->max[i]) / f;
+
+			d_min = std::max(d_min, std::min(d1, d2));
+			d_max = std::min(d_max, std::max(d1, d2));
+
+			if (d_max < d_min) {
+				return -1.f;
+			}
+		} else if (e + box->min[i] > 0.f || e + box->max[i] < 0.f) {
+			// Parallel to the slab and outside it.
+			return -1.f;
+		}
+	}
+
+	return d_min;
+}
+
+// Unused lanes repeat the first box and are masked out of the result.
+void obb_pack4(ObbPack4 *pack, const Obb *const *boxes, unsigned int count)
+{
+	for (unsigned int lane = 0; lane < 4; lane++) {
+		const Obb *box = boxes[lane < count ? lane : 0];
+
+		for (unsigned int i = 0; i < 3; i++) {
+			pack->centre[i][lane] = box->centre.E[i];
+			pack->min[i][lane] = box->min[i];
+			pack->max[i][lane] = box->max[i];
+
+			for (unsigned int j = 0; j < 3; j++) {
+				pack->axes[i][j][lane] = box->axes[i].E[j];
+			}
+		}
+	}
+}
+
+#ifdef COLLISION_SSE
+
+static inline __m128 select_ps(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Slab test for four ray/box pairs at once. Each argument holds one lane per pair.
+static inline __m128 slab4(const __m128 *origin, const __m128 *dir, const __m128 *centre, const __m128 (*axes)[3], const __m128 *min, const __m128 *max)
+{
+	const __m128 sign = _mm_set1_ps(-0.f);
+	const __m128 epsilon = _mm_set1_ps(0.0001f);
+	const __m128 zero = _mm_setzero_ps();
+
+	__m128 t_min = zero;
+	__m128 t_max = _mm_set1_ps(1000000.f);
+	__m128 missed = zero;
+
+	__m128 temp[3];
+	for (unsigned int i = 0; i < 3; i++) {
+		temp[i] = _mm_sub_ps(centre[i], origin[i]);
+	}
+
+	for (unsigned int i = 0; i < 3; i++) {
+		__m128 e = _mm_add_ps(_mm_add_ps(_mm_mul_ps(temp[0], axes[i][0]), _mm_mul_ps(temp[1], axes[i][1])), _mm_mul_ps(temp[2], axes[i][2]));
+		__m128 f = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dir[0], axes[i][0]), _mm_mul_ps(dir[1], axes[i][1])), _mm_mul_ps(dir[2], axes[i][2]));
+
+		// Rays parallel to a slab miss unless they start inside it, like the
+		// scalar test.
+		__m128 valid = _mm_cmpgt_ps(_mm_andnot_ps(sign, f), epsilon);
+		__m128 safe_f = select_ps(valid, f, _mm_set1_ps(1.f));
+
+		__m128 near = _mm_add_ps(e, min[i]);
+		__m128 far = _mm_add_ps(e, max[i]);
+		__m128 outside = _mm_or_ps(_mm_cmpgt_ps(near, zero), _mm_cmplt_ps(far, zero));
+		missed = _mm_or_ps(missed, _mm_andnot_ps(valid, outside));
+
+		__m128 d1 = _mm_div_ps(near, safe_f);
+		__m128 d2 = _mm_div_ps(far, safe_f);
+
+		t_min = select_ps(valid, _mm_max_ps(t_min, _mm_min_ps(d1, d2)), t_min);
+		t_max = select_ps(valid, _mm_min_ps(t_max, _mm_max_ps(d1, d2)), t_max);
+	}
+
+	__m128 hit = _mm_andnot_ps(missed, _mm_cmpge_ps(t_max, t_min));
+	return select_ps(hit, t_min, _mm_set1_ps(-1.f));
+}
+
+unsigned int ray_obb4_intersect(V3 ray_pos, V3 ray_dir, const ObbPack4 *pack, float *distances)
+{
+	__m128 origin[3], dir[3], centre[3], axes[3][3], min[3], max[3];
+
+	for (unsigned int i = 0; i < 3; i++) {
+		origin[i] = _mm_set1_ps(ray_pos.E[i]);
+		dir[i] = _mm_set1_ps(ray_dir.E[i]);
+		centre[i] = _mm_loadu_ps(pack->centre[i]);
+		min[i] = _mm_loadu_ps(pack->min[i]);
+		max[i] = _mm_loadu_ps(pack->max[i]);
+
+		for (unsigned int j = 0; j < 3; j++) {
+			axes[i][j] = _mm_loadu_ps(pack->axes[i][j]);
+		}
+	}
+
+	__m128 d = slab4(origin, dir, centre, axes, min, max);
+	_mm_storeu_ps(distances, d);
+
+	return _mm_movemask_ps(_mm_cmpge_ps(d, _mm_setzero_ps()));
+}
+
+unsigned int rays4_obb_intersect(const V3 *ray_pos, const V3 *ray_dir, const Obb *box, float *distances)
+{
+	__m128 origin[3], dir[3], centre[3], axes[3][3], min[3], max[3];
+
+	for (unsigned int i = 0; i < 3; i++) {
+		origin[i] = _mm_setr_ps(ray_pos[0].E[i], ray_pos[1].E[i], ray_pos[2].E[i], ray_pos[3].E[i]);
+		dir[i] = _mm_setr_ps(ray_dir[0].E[i], ray_dir[1].E[i], ray_dir[2].E[i], ray_dir[3].E[i]);
+		centre[i] = _mm_set1_ps(box->centre.E[i]);
+		min[i] = _mm_set1_ps(box->min[i]);
+		max[i] = _mm_set1_ps(box->max[i]);
+
+		for (unsigned int j = 0; j < 3; j++) {
+			axes[i][j] = _mm_set1_ps(box->axes[i].E[j]);
+		}
+	}
+
+	__m128 d = slab4(origin, dir, centre, axes, min, max);
+	_mm_storeu_ps(distances, d);
+
+	return _mm_movemask_ps(_mm_cmpge_ps(d, _mm_setzero_ps()));
+}
+
+#else
+
+unsigned int ray_obb4_intersect(V3 ray_pos, V3 ray_dir, const ObbPack4 *pack, float *distances)
+{
+	unsigned int mask = 0;
+
+	for (unsigned int lane = 0; lane < 4; lane++) {
+		Obb box;
+		for (unsigned int i = 0; i < 3; i++) {
+			box.centre.E[i] = pack->centre[i][lane];
+			box.min[i] = pack->min[i][lane];
+			box.max[i] = pack->max[i][lane];
+
+			for (unsigned int j = 0; j < 3; j++) {
+				box.axes[i].E[j] = pack->axes[i][j][lane];
+			}
+		}
+
+		distances[lane] = ray_obb_intersect(ray_pos, ray_dir, &box);
+		mask |= (distances[lane] >= 0.f) << lane;
+	}
+
+	return mask;
+}
+
+unsigned int rays4_obb_intersect(const V3 *ray_pos, const V3 *ray_dir, const Obb *box, float *distances)
+{
+	unsigned int mask = 0;
+
+	for (unsigned int lane = 0; lane < 4; lane++) {
+		distances[lane] = ray_obb_intersect(ray_pos[lane], ray_dir[lane], box);
+		mask |= (distances[lane] >= 0.f) << lane;
+	}
+
+	return mask;
+}
+
+#endif
+
+// Slab test against a world space box. Returns the entry distance, or -1 if the
+// ray misses or only hits beyond t_max.
+float ray_aabb_intersect(V3 ray_pos, V3 inv_dir, const Aabb *box, float t_max)
+{
+	float t_min = 0.f;
+
+	for (unsigned int i = 0; i < 3; i++) {
+		float t1 = (box->min.E[i] - ray_pos.E[i]) * inv_dir.E[i];
+		float t2 = (box->max.E[i] - ray_pos.E[i]) * inv_dir.E[i];
+
+		if (t1 > t2) {
+			float s = t1;
+			t1 = t2;
+			t2 = s;
+		}
+
+		t_min = std::max(t_min, t1);
+		t_max = std::min(t_max, t2);
+
+		if (t_max < t_min) {
+			return -1.f;
+		}
+	}
+
+	return t_min;
+}
+
+Aabb aabb_from_box(const float *model, const float *min, const float *max)
+{
+	Aabb box;
+
+	for (unsigned int i = 0; i < 3; i++) {
+		float centre = model[12 + i];
+		float extent = 0.f;
+
+		for (unsigned int j = 0; j < 3; j++) {
+			const float c = 0.5f * (min[j] + max[j]);
+			const float e = 0.5f * (max[j] - min[j]);
+			centre += model[i + 4 * j] * c;
+			extent += fabsf(model[i + 4 * j]) * e;
+		}
+
+		box.min.E[i] = centre - extent;
+		box.max.E[i] = centre + extent;
+	}
+
+	return box;
+}
+
+Aabb aabb_union(const Aabb &a, const Aabb &b)
+{
+	Aabb box;
+
+	for (unsigned int i = 0; i < 3; i++) {
+		box.min.E[i] = std::min(a.min.E[i], b.min.E[i]);
+		box.max.E[i] = std::max(a.max.E[i], b.max.E[i]);
+	}
+
+	return box;
+}
+
+bool check_limb_collisions(std::vector<Node *> &limbs)
+{
+	PROFILE_FUNCTION();
+
+	std::vector<LimbBounds> bounds(limbs.size());
+	for (unsigned int i = 0; i < limbs.size(); i++) {
+		limb_bounds_from_model(&bounds[i], limbs[i]->model);
+	}
+
+	for (unsigned int l1 = 0; l1 < limbs.size(); l1++) {
+		for (unsigned int l2 = l1 + 1; l2 < limbs.size(); l2++) {
+			if (limb_bounds_overlap(&bounds[l1], &bounds[l2])) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void collect_subtree(std::vector<Node *> &limbs, Node *root, std::vector<unsigned int> &indices)
+{
+	indices.clear();
+
+	std::vector<Node *> pending;
+	pending.push_back(root);
+
+	while (!pending.empty()) {
+		Node *node = pending.back();
+		pending.pop_back();
+
+		// A limb's id is its index.
+		if (node->id < limbs.size() && limbs[node->id] == node) {
+			indices.push_back(node->id);
+		}
+
+		for (auto &child : node->children) {
+			pending.push_back(child);
+		}
+	}
+}
+
+void update_limb_bounds(std::vector<Node *> &limbs, std::vector<LimbBounds> &bounds, const std::vector<unsigned int> &indices)
+{
+	for (auto i : indices) {
+		limb_bounds_from_model(&bounds[i], limbs[i]->model);
+	}
+}
+
+// A subtree moves rigidly, so pairs inside it can't start colliding. Only the
+// subtree x rest pairs need testing.
+bool check_subtree_collisions(const std::vector<LimbBounds> &bounds, const std::vector<unsigned int> &subtree, std::vector<bool> &moved)
+{
+	moved.assign(bounds.size(), false);
+	for (auto i : subtree) {
+		moved[i] = true;
+	}
+
+	for (auto i : subtree) {
+		for (unsigned int j = 0; j < bounds.size(); j++) {
+			if (moved[j]) {
+				continue;
+			}
+
+			if (limb_bounds_overlap(&bounds[i], &bounds[j])) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,59 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <vector>
+
+#include "maths.h"
+
+struct Node;
+
+// World space bounding box of a limb, resolved from its model matrix.
+struct LimbBounds {
+	V3 corners[8];
+	V3 axes[3];
+};
+
+struct Aabb {
+	V3 min, max;
+};
+
+// Box with its axes normalised and extents scaled up front, so ray tests don't
+// have to do it per query. Extents are measured along each axis from centre.
+struct Obb {
+	V3 centre;
+	V3 axes[3];
+	float min[3], max[3];
+};
+
+// Four boxes in SoA layout for the packet ray kernels.
+struct ObbPack4 {
+	float centre[3][4];
+	float axes[3][3][4];
+	float min[3][4];
+	float max[3][4];
+};
+
+extern void limb_bounds_from_model(LimbBounds *bounds, const float *model);
+extern bool limb_bounds_overlap(const LimbBounds *a, const LimbBounds *b);
+
+extern bool check_limb_collisions(std::vector<Node *> &limbs);
+
+// Ray picking. The box is given in model space and transformed by model.
+extern float testRayOOBIntersect(V3 ray_pos, V3 ray_dir, const float *min, const float *max, const float *model);
+extern void obb_from_box(Obb *obb, const float *model, const float *min, const float *max);
+extern float ray_obb_intersect(V3 ray_pos, V3 ray_dir, const Obb *box);
+extern void obb_pack4(ObbPack4 *pack, const Obb *const *boxes, unsigned int count);
+extern unsigned int ray_obb4_intersect(V3 ray_pos, V3 ray_dir, const ObbPack4 *pack, float *distances);
+extern unsigned int rays4_obb_intersect(const V3 *ray_pos, const V3 *ray_dir, const Obb *box, float *distances);
+extern float ray_aabb_intersect(V3 ray_pos, V3 inv_dir, const Aabb *box, float t_max);
+extern Aabb aabb_from_box(const float *model, const float *min, const float *max);
+extern Aabb aabb_union(const Aabb &a, const Aabb &b);
+
+// Incremental queries used while editing. Only the subtree under the moved node
+// is re-resolved and tested against the cached bounds of every other limb.
+extern void collect_subtree(std::vector<Node *> &limbs, Node *root, std::vector<unsigned int> &indices);
+extern void update_limb_bounds(std::vector<Node *> &limbs, std::vector<LimbBounds> &bounds, const std::vector<unsigned int> &indices);
+// moved is scratch, kept by the caller so repeated checks don't allocate.
+extern bool check_subtree_collisions(const std::vector<LimbBounds> &bounds, const std::vector<unsigned int> &subtree, std::vector<bool> &moved);
+
+#endif
@@ -0,0 +1,109 @@
+#include "culling.h"
+
+#include <math.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define CULLING_SSE
+#include <xmmintrin.h>
+#endif
+
+// Extracts the clip planes of a projection * view matrix (column major).
+void frustum_from_matrix(Frustum *frustum, const float *matrix)
+{
+	for (unsigned int i = 0; i < 3; i++) {
+		for (unsigned int j = 0; j < 4; j++) {
+			frustum->planes[i * 2 + 0][j] = matrix[3 + j * 4] + matrix[i + j * 4];
+			frustum->planes[i * 2 + 1][j] = matrix[3 + j * 4] - matrix[i + j * 4];
+		}
+	}
+
+	for (auto &p : frustum->planes) {
+		const float length = sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+		for (unsigned int j = 0; j < 4; j++) {
+			p[j] /= length;
+		}
+	}
+}
+
+// Storage is padded to a whole number of SIMD lanes.
+void cull_bounds_resize(CullBounds *bounds, unsigned int count)
+{
+	const unsigned int padded = (count + 3) & ~3u;
+
+	for (unsigned int i = 0; i < 3; i++) {
+		bounds->centre[i].resize(padded, 0.f);
+		bounds->extent[i].resize(padded, 0.f);
+	}
+
+	bounds->count = count;
+}
+
+void cull_bounds_set(CullBounds *bounds, unsigned int index, const Aabb &box)
+{
+	for (unsigned int i = 0; i < 3; i++) {
+		bounds->centre[i][index] = 0.5f * (box.max.E[i] + box.min.E[i]);
+		bounds->extent[i][index] = 0.5f * (box.max.E[i] - box.min.E[i]);
+	}
+}
+
+// Appends the index of every box that is at least partly inside the frustum.
+// A box is outside when it is entirely behind one plane. Boxes that straddle
+// two planes outside a corner are kept, which only costs a wasted draw.
+void frustum_cull(const Frustum *frustum, const CullBounds *bounds, std::vector<unsigned int> &visible)
+{
+	visible.clear();
+
+	const float *cx = bounds->centre[0].data(), *cy = bounds->centre[1].data(), *cz = bounds->centre[2].data();
+	const float *ex = bounds->extent[0].data(), *ey = bounds->extent[1].data(), *ez = bounds->extent[2].data();
+
+#ifdef CULLING_SSE
+	__m128 n[6][3], d[6], abs_n[6][3];
+	const __m128 sign = _mm_set1_ps(-0.f);
+
+	for (unsigned int p = 0; p < 6; p++) {
+		for (unsigned int j = 0; j < 3; j++) {
+			n[p][j] = _mm_set1_ps(frustum->planes[p][j]);
+			abs_n[p][j] = _mm_andnot_ps(sign, n[p][j]);
+		}
+		d[p] = _mm_set1_ps(frustum->planes[p][3]);
+	}
+
+	for (unsigned int i = 0; i < bounds->count; i += 4) {
+		const __m128 x = _mm_loadu_ps(cx + i), y = _mm_loadu_ps(cy + i), z = _mm_loadu_ps(cz + i);
+		const __m128 hx = _mm_loadu_ps(ex + i), hy = _mm_loadu_ps(ey + i), hz = _mm_loadu_ps(ez + i);
+
+		__m128 outside = _mm_setzero_ps();
+		for (unsigned int p = 0; p < 6; p++) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n[p][0], x), _mm_mul_ps(n[p][1], y)), _mm_add_ps(_mm_mul_ps(n[p][2], z), d[p]));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abs_n[p][0], hx), _mm_mul_ps(abs_n[p][1], hy)), _mm_mul_ps(abs_n[p][2], hz));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+		}
+
+		unsigned int mask = ~_mm_movemask_ps(outside) & 0xF;
+		while (mask) {
+			unsigned int lane = 0;
+			while (!(mask & (1u << lane))) lane++;
+			mask &= mask - 1;
+
+			if (i + lane < bounds->count) {
+				visible.push_back(i + lane);
+			}
+		}
+	}
+#else
+	for (unsigned int i = 0; i < bounds->count; i++) {
+		bool inside = true;
+
+		for (unsigned int p = 0; p < 6 && inside; p++) {
+			const float *plane = frustum->planes[p];
+			const float distance = plane[0] * cx[i] + plane[1] * cy[i] + plane[2] * cz[i] + plane[3];
+			const float radius = fabsf(plane[0]) * ex[i] + fabsf(plane[1]) * ey[i] + fabsf(plane[2]) * ez[i];
+			inside = distance + radius >= 0.f;
+		}
+
+		if (inside) {
+			visible.push_back(i);
+		}
+	}
+#endif
+}
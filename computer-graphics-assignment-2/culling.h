@@ -0,0 +1,27 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <vector>
+
+#include "collision.h"
+
+// View frustum culling. Bounds are kept as world space boxes in SoA layout so
+// four of them are tested against a plane at once.
+
+// Planes point inwards: a point p is inside when dot(n, p) + d >= 0.
+struct Frustum {
+	float planes[6][4];
+};
+
+struct CullBounds {
+	std::vector<float> centre[3];
+	std::vector<float> extent[3];
+	unsigned int count;
+};
+
+extern void frustum_from_matrix(Frustum *frustum, const float *matrix);
+extern void cull_bounds_resize(CullBounds *bounds, unsigned int count);
+extern void cull_bounds_set(CullBounds *bounds, unsigned int index, const Aabb &box);
+extern void frustum_cull(const Frustum *frustum, const CullBounds *bounds, std::vector<unsigned int> &visible);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef FONT_H
+#define FONT_H
+
+// A 5x7 pixel font for debug text. Each glyph is its own texture, as the
+// interface shader draws whole textures onto quads.
+
+static const unsigned int GLYPH_W = 5;
+static const unsigned int GLYPH_H = 7;
+static const unsigned int GLYPH_COUNT = 38; // A-Z, 0-9, '.' and a solid block.
+static const unsigned int GLYPH_SOLID = GLYPH_COUNT - 1; // For bars.
+
+// -1 for characters without a glyph, which are drawn as spaces. Lower case
+// letters use the upper case glyphs.
+extern int glyph_index(char c);
+
+// White where the glyph is set and transparent elsewhere, GLYPH_W * GLYPH_H
+// RGBA texels stored bottom row first like a Bitmap.
+extern void glyph_pixels(unsigned int glyph, unsigned int *pixels);
+
+#endif
@@ -0,0 +1,333 @@
+#include "frame-export.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <algorithm>
+
+#include "animation.h"
+#include "image-write.h"
+#include "profiler.h"
+
+struct PoseSlot {
+	int frame; // Last frame sampled into the slot, -1 before the first.
+	std::vector<Node> pose;
+};
+
+struct ExportFrame {
+	unsigned int frame;
+	std::vector<unsigned char> data; // Pixels before encoding, the file after.
+};
+
+// Frames move renderer -> encode queue -> encoders -> write queue -> writer.
+// Both queues are bounded, so a slow disk eventually holds up the renderer
+// rather than filling memory. One mutex covers everything, it is only taken a
+// few times per frame.
+struct FrameExport {
+	FrameExportSettings settings;
+	std::vector<std::vector<Node>> key_frames;
+	unsigned int frame_count;
+	size_t frame_bytes;
+
+	std::mutex mutex;
+	bool finished; // No more frames will be asked for or submitted.
+
+	std::vector<PoseSlot> slots; // Frame f is sampled into slot f % lookahead.
+	unsigned int consumed; // Poses the renderer is done with.
+	std::atomic<unsigned int> next_pose;
+	std::condition_variable pose_ready, pose_free;
+	std::vector<std::thread> pose_workers;
+
+	std::deque<ExportFrame> encode_queue, write_queue;
+	std::vector<std::vector<unsigned char>> free_buffers;
+	unsigned int encoders_running;
+	std::condition_variable frame_queued, frame_taken, file_queued, file_taken;
+	std::vector<std::thread> encoders;
+	std::thread writer;
+
+	FrameExportStats stats;
+	std::chrono::steady_clock::time_point start;
+};
+
+static float ms_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void pose_worker(FrameExport *e)
+{
+	PROFILE_THREAD("export poses");
+
+	const unsigned int lookahead = e->slots.size();
+
+	for (;;) {
+		const unsigned int frame = e->next_pose++;
+		if (frame >= e->frame_count) {
+			return;
+		}
+
+		PoseSlot *slot = &e->slots[frame % lookahead];
+		{
+			std::unique_lock<std::mutex> lock(e->mutex);
+			e->pose_free.wait(lock, [&] { return e->consumed + lookahead > frame || e->finished; });
+			if (e->finished) {
+				return;
+			}
+		}
+
+		PROFILE_ZONE("sample pose");
+		sample_key_frames(e->key_frames, frame / e->settings.fps, slot->pose.data());
+
+		{
+			std::lock_guard<std::mutex> lock(e->mutex);
+			slot->frame = frame;
+		}
+		e->pose_ready.notify_all();
+	}
+}
+
+static void encode_worker(FrameExport *e)
+{
+	PROFILE_THREAD("export encoder");
+
+	std::vector<unsigned char> pixels;
+
+	for (;;) {
+		ExportFrame f;
+		{
+			std::unique_lock<std::mutex> lock(e->mutex);
+			e->frame_queued.wait(lock, [&] { return !e->encode_queue.empty() || e->finished; });
+
+			if (e->encode_queue.empty()) {
+				if (--e->encoders_running == 0) {
+					e->file_queued.notify_all();
+				}
+				return;
+			}
+
+			f = std::move(e->encode_queue.front());
+			e->encode_queue.pop_front();
+		}
+		e->frame_taken.notify_one();
+
+		auto start = std::chrono::steady_clock::now();
+		pixels.swap(f.data);
+		f.data.clear();
+		{
+			PROFILE_ZONE("encode frame");
+			encode_image(e->settings.format, pixels.data(), e->settings.w, e->settings.h, f.data);
+		}
+		const float encode_ms = ms_since(start);
+
+		{
+			std::unique_lock<std::mutex> lock(e->mutex);
+			e->stats.encode_ms += encode_ms;
+			e->free_buffers.push_back(std::move(pixels));
+
+			e->file_taken.wait(lock, [&] { return e->write_queue.size() < e->settings.queue_frames; });
+			e->write_queue.push_back(std::move(f));
+		}
+		e->file_queued.notify_one();
+	}
+}
+
+static void write_worker(FrameExport *e)
+{
+	PROFILE_THREAD("export writer");
+
+	const std::string directory = e->settings.directory ? e->settings.directory : ".";
+	const char *extension = image_format_extension(e->settings.format);
+
+	for (;;) {
+		ExportFrame f;
+		{
+			std::unique_lock<std::mutex> lock(e->mutex);
+			e->file_queued.wait(lock, [&] { return !e->write_queue.empty() || e->encoders_running == 0; });
+
+			if (e->write_queue.empty()) {
+				return;
+			}
+
+			f = std::move(e->write_queue.front());
+			e->write_queue.pop_front();
+		}
+		e->file_taken.notify_all();
+
+		char name[32];
+		snprintf(name, sizeof(name), "frame_%05u.%s", f.frame, extension);
+
+		auto start = std::chrono::steady_clock::now();
+		bool written;
+		{
+			PROFILE_ZONE("write frame");
+			written = write_file((directory + "/" + name).c_str(), f.data);
+		}
+		const float write_ms = ms_since(start);
+
+		std::lock_guard<std::mutex> lock(e->mutex);
+		e->stats.write_ms += write_ms;
+		if (written) {
+			e->stats.bytes += f.data.size();
+		} else {
+			e->stats.failed_writes++;
+		}
+	}
+}
+
+FrameExportSettings default_frame_export_settings()
+{
+	FrameExportSettings settings;
+	settings.directory = "export";
+	settings.format = IMAGE_PNG;
+	settings.w = 1280;
+	settings.h = 720;
+	settings.fps = 30.f;
+	settings.lookahead = 8;
+	settings.queue_frames = 4;
+	settings.pose_threads = 2;
+	settings.encode_threads = 0;
+	return settings;
+}
+
+unsigned int frame_export_count(const std::vector<std::vector<Node>> &key_frames, float fps)
+{
+	if (key_frames.empty() || fps <= 0.f) {
+		return 0;
+	}
+
+	// Includes the last key, the small bias keeps rounding from dropping it.
+	return (unsigned int)floorf(key_frames_duration(key_frames) * fps + 0.001f) + 1;
+}
+
+FrameExport *frame_export_begin(const std::vector<std::vector<Node>> &key_frames, const FrameExportSettings *settings)
+{
+	FrameExport *e = new FrameExport;
+	e->settings = *settings;
+	e->settings.lookahead = std::max(1u, settings->lookahead);
+	e->settings.queue_frames = std::max(1u, settings->queue_frames);
+
+	e->key_frames = key_frames;
+	e->frame_count = frame_export_count(key_frames, settings->fps);
+	e->frame_bytes = (size_t)settings->w * settings->h * 4;
+	e->finished = false;
+
+	// Sampling only writes the transforms, so the slots start as copies of the
+	// first key to keep its hierarchy, like the key frames themselves.
+	e->slots.resize(e->settings.lookahead);
+	for (auto &slot : e->slots) {
+		slot.frame = -1;
+		if (!key_frames.empty()) {
+			slot.pose = key_frames[0];
+		}
+	}
+
+	e->consumed = 0;
+	e->next_pose = 0;
+	e->stats = {};
+	e->start = std::chrono::steady_clock::now();
+
+	const unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+	const unsigned int pose_threads = std::min(settings->pose_threads ? settings->pose_threads : hardware, e->settings.lookahead);
+	const unsigned int encode_threads = settings->encode_threads ? settings->encode_threads : hardware;
+
+	for (unsigned int i = 0; i < pose_threads; i++) {
+		e->pose_workers.push_back(std::thread(pose_worker, e));
+	}
+
+	e->encoders_running = encode_threads;
+	for (unsigned int i = 0; i < encode_threads; i++) {
+		e->encoders.push_back(std::thread(encode_worker, e));
+	}
+
+	e->writer = std::thread(write_worker, e);
+
+	return e;
+}
+
+const Node *frame_export_pose(FrameExport *e, unsigned int frame)
+{
+	PoseSlot *slot = &e->slots[frame % e->slots.size()];
+
+	std::unique_lock<std::mutex> lock(e->mutex);
+
+	// Asking for a frame releases the ones before it.
+	e->consumed = frame;
+	e->pose_free.notify_all();
+
+	auto start = std::chrono::steady_clock::now();
+	e->pose_ready.wait(lock, [&] { return slot->frame == (int)frame; });
+	e->stats.pose_wait_ms += ms_since(start);
+
+	return slot->pose.data();
+}
+
+void frame_export_submit(FrameExport *e, unsigned int frame, const void *pixels)
+{
+	std::vector<unsigned char> buffer;
+	{
+		std::unique_lock<std::mutex> lock(e->mutex);
+
+		auto start = std::chrono::steady_clock::now();
+		e->frame_taken.wait(lock, [&] { return e->encode_queue.size() < e->settings.queue_frames; });
+		e->stats.queue_wait_ms += ms_since(start);
+
+		if (!e->free_buffers.empty()) {
+			buffer = std::move(e->free_buffers.back());
+			e->free_buffers.pop_back();
+		}
+	}
+
+	const unsigned char *bytes = (const unsigned char *)pixels;
+	buffer.assign(bytes, bytes + e->frame_bytes);
+
+	{
+		std::lock_guard<std::mutex> lock(e->mutex);
+
+		ExportFrame f;
+		f.frame = frame;
+		f.data = std::move(buffer);
+		e->encode_queue.push_back(std::move(f));
+		e->stats.frames++;
+	}
+	e->frame_queued.notify_one();
+}
+
+FrameExportStats frame_export_end(FrameExport *e)
+{
+	{
+		std::lock_guard<std::mutex> lock(e->mutex);
+		e->finished = true;
+	}
+	e->pose_free.notify_all();
+	e->frame_queued.notify_all();
+
+	for (auto &t : e->pose_workers) {
+		t.join();
+	}
+	for (auto &t : e->encoders) {
+		t.join();
+	}
+	e->writer.join();
+
+	FrameExportStats stats = e->stats;
+	stats.total_ms = ms_since(e->start);
+
+	delete e;
+	return stats;
+}
+
+void print_frame_export_stats(const FrameExportStats *stats)
+{
+	const float seconds = stats->total_ms / 1000.f;
+
+	printf("Exported %u frames in %.2f s (%.1f fps), %.1f MB written, %u failed\n",
+		stats->frames, seconds, seconds > 0.f ? stats->frames / seconds : 0.f, stats->bytes / (1024.f * 1024.f), stats->failed_writes);
+	printf("  renderer waited %.1f ms for poses and %.1f ms for the encoders\n", stats->pose_wait_ms, stats->queue_wait_ms);
+	printf("  encoding took %.1f ms and writing %.1f ms in total\n", stats->encode_ms, stats->write_ms);
+}
@@ -0,0 +1,56 @@
+#ifndef FRAME_EXPORT_H
+#define FRAME_EXPORT_H
+
+#include <vector>
+
+#include "node.h"
+
+// Offline export of a key frame clip as an image sequence at a fixed frame
+// rate. The renderer drives it: it asks for each frame's pose, draws it, and
+// hands back the pixels. Poses are sampled ahead of it on worker threads, and
+// the frames are encoded and written to disk behind it, so the export runs at
+// the speed of the renderer rather than the disk.
+
+struct FrameExportSettings {
+	const char *directory; // Frames are written as frame_00000.png and so on.
+	unsigned int format; // ImageFormat.
+	unsigned int w, h;
+	float fps; // Frames per second of clip time, key frames being a second apart.
+	unsigned int lookahead; // Poses sampled ahead of the renderer.
+	unsigned int queue_frames; // Frames waiting to be encoded before the renderer blocks.
+	unsigned int pose_threads; // 0 uses every hardware thread.
+	unsigned int encode_threads; // 0 uses every hardware thread.
+};
+
+struct FrameExportStats {
+	unsigned int frames;
+	unsigned int failed_writes;
+	unsigned long long bytes;
+	float total_ms;
+	float pose_wait_ms; // Renderer waiting for a pose.
+	float queue_wait_ms; // Renderer waiting for room in the encode queue.
+	float encode_ms; // Summed over the encode threads.
+	float write_ms;
+};
+
+struct FrameExport;
+
+extern FrameExportSettings default_frame_export_settings();
+extern unsigned int frame_export_count(const std::vector<std::vector<Node>> &key_frames, float fps);
+
+extern FrameExport *frame_export_begin(const std::vector<std::vector<Node>> &key_frames, const FrameExportSettings *settings);
+
+// Frames must be asked for in order. The pose holds one node per limb and
+// stays valid until the next call.
+extern const Node *frame_export_pose(FrameExport *exporter, unsigned int frame);
+
+// Copies the frame's pixels, RGBA8 bottom row first, and queues them to be
+// encoded and written.
+extern void frame_export_submit(FrameExport *exporter, unsigned int frame, const void *pixels);
+
+// Waits for every frame to be written, then frees the exporter.
+extern FrameExportStats frame_export_end(FrameExport *exporter);
+
+extern void print_frame_export_stats(const FrameExportStats *stats);
+
+#endif
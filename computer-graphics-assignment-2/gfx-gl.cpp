@@ -0,0 +1,107 @@
+#include "gfx.h"
+
+#include "win32-opengl.h"
+#include "profiler.h"
+#include "gpu-timer.h"
+
+// Issues the recorded calls. The enums were recorded with GL's values, so
+// they pass straight through. Timestamps are dropped without a timer.
+void gfx_gl_replay(const GfxStream *gfx, GpuTimer *timer)
+{
+	PROFILE_FUNCTION();
+
+	unsigned int cursor = 0;
+	GfxCommand c;
+	while (gfx_next(gfx, &cursor, &c)) {
+		const GfxWord *a = c.args;
+
+		switch (c.op) {
+		case GFX_OP_USE_PROGRAM:
+			glUseProgram(a[0].u);
+			break;
+		case GFX_OP_BIND_VERTEX_ARRAY:
+			glBindVertexArray(a[0].u);
+			break;
+		case GFX_OP_BIND_FRAMEBUFFER:
+			glBindFramebuffer(a[0].u, a[1].u);
+			break;
+		case GFX_OP_ACTIVE_TEXTURE:
+			glActiveTexture(a[0].u);
+			break;
+		case GFX_OP_BIND_TEXTURE:
+			glBindTexture(a[0].u, a[1].u);
+			break;
+		case GFX_OP_VIEWPORT:
+			glViewport(a[0].i, a[1].i, a[2].i, a[3].i);
+			break;
+		case GFX_OP_CLEAR_COLOUR:
+			glClearColor(a[0].f, a[1].f, a[2].f, a[3].f);
+			break;
+		case GFX_OP_CLEAR:
+			glClear(a[0].u);
+			break;
+		case GFX_OP_CLEAR_BUFFER_UIV:
+			glClearBufferuiv(a[0].u, a[1].i, (const GLuint *)&a[2]);
+			break;
+		case GFX_OP_ENABLE:
+			glEnable(a[0].u);
+			break;
+		case GFX_OP_DISABLE:
+			glDisable(a[0].u);
+			break;
+		case GFX_OP_CULL_FACE:
+			glCullFace(a[0].u);
+			break;
+		case GFX_OP_DEPTH_FUNC:
+			glDepthFunc(a[0].u);
+			break;
+		case GFX_OP_STENCIL_FUNC:
+			glStencilFunc(a[0].u, a[1].i, a[2].u);
+			break;
+		case GFX_OP_STENCIL_OP:
+			glStencilOp(a[0].u, a[1].u, a[2].u);
+			break;
+		case GFX_OP_STENCIL_MASK:
+			glStencilMask(a[0].u);
+			break;
+		case GFX_OP_DRAW_BUFFERS:
+			glDrawBuffers(a[0].u, (const GLenum *)&a[1]);
+			break;
+		case GFX_OP_READ_BUFFER:
+			glReadBuffer(a[0].u);
+			break;
+		case GFX_OP_BLIT_FRAMEBUFFER:
+			glBlitFramebuffer(a[0].i, a[1].i, a[2].i, a[3].i, a[4].i, a[5].i, a[6].i, a[7].i, a[8].u, a[9].u);
+			break;
+		case GFX_OP_UNIFORM_1I:
+			glUniform1i(a[0].u, a[1].i);
+			break;
+		case GFX_OP_UNIFORM_1UI:
+			glUniform1ui(a[0].u, a[1].u);
+			break;
+		case GFX_OP_UNIFORM_1F:
+			glUniform1f(a[0].u, a[1].f);
+			break;
+		case GFX_OP_UNIFORM_3FV:
+			glUniform3fv(a[0].u, a[1].u, &a[2].f);
+			break;
+		case GFX_OP_UNIFORM_4FV:
+			glUniform4fv(a[0].u, a[1].u, &a[2].f);
+			break;
+		case GFX_OP_UNIFORM_MATRIX_4FV:
+			glUniformMatrix4fv(a[0].u, a[1].u, GL_FALSE, &a[2].f);
+			break;
+		case GFX_OP_DRAW_ELEMENTS:
+			glDrawElements(a[0].u, a[1].u, GL_UNSIGNED_INT, 0);
+			break;
+		case GFX_OP_DRAW_ARRAYS:
+			glDrawArrays(a[0].u, a[1].i, a[2].u);
+			break;
+		case GFX_OP_TIMESTAMP:
+			if (timer) {
+				gpu_timer_mark(timer, a[0].u);
+			}
+			break;
+		}
+	}
+}
@@ -0,0 +1,494 @@
+#include "gfx.h"
+
+#include <string.h>
+#include <unordered_map>
+
+static const unsigned int UNKNOWN = (unsigned int)-1;
+
+void gfx_reset(GfxStream *gfx)
+{
+	gfx->words.clear();
+	gfx->commands = 0;
+}
+
+// Appends a header for a command of size argument words and returns where
+// the arguments go.
+static GfxWord *push(GfxStream *gfx, unsigned int op, unsigned int size)
+{
+	const unsigned int at = gfx->words.size();
+	gfx->words.resize(at + 1 + size);
+	gfx->words[at].u = op | (size << 8);
+	gfx->commands++;
+
+	return &gfx->words[at + 1];
+}
+
+bool gfx_next(const GfxStream *gfx, unsigned int *cursor, GfxCommand *command)
+{
+	if (*cursor >= gfx->words.size()) {
+		return false;
+	}
+
+	const unsigned int header = gfx->words[*cursor].u;
+	command->op = header & 0xFF;
+	command->size = header >> 8;
+	command->args = &gfx->words[*cursor + 1];
+
+	if (*cursor + 1 + command->size > gfx->words.size()) {
+		return false;
+	}
+
+	*cursor += 1 + command->size;
+	return true;
+}
+
+const char *gfx_op_name(unsigned int op)
+{
+	static const char *names[GFX_OP_COUNT] = {
+		"UseProgram", "BindVertexArray", "BindFramebuffer", "ActiveTexture", "BindTexture",
+		"Viewport", "ClearColor", "Clear", "ClearBufferuiv", "Enable", "Disable", "CullFace",
+		"DepthFunc", "StencilFunc", "StencilOp", "StencilMask", "DrawBuffers", "ReadBuffer",
+		"BlitFramebuffer", "Uniform1i", "Uniform1ui", "Uniform1f", "Uniform3fv", "Uniform4fv",
+		"UniformMatrix4fv", "DrawElements", "DrawArrays", "QueryCounter"
+	};
+
+	return op < GFX_OP_COUNT ? names[op] : "Unknown";
+}
+
+void gfx_use_program(GfxStream *gfx, unsigned int program)
+{
+	push(gfx, GFX_OP_USE_PROGRAM, 1)[0].u = program;
+}
+
+void gfx_bind_vertex_array(GfxStream *gfx, unsigned int vao)
+{
+	push(gfx, GFX_OP_BIND_VERTEX_ARRAY, 1)[0].u = vao;
+}
+
+void gfx_bind_framebuffer(GfxStream *gfx, unsigned int target, unsigned int fbo)
+{
+	GfxWord *a = push(gfx, GFX_OP_BIND_FRAMEBUFFER, 2);
+	a[0].u = target;
+	a[1].u = fbo;
+}
+
+void gfx_active_texture(GfxStream *gfx, unsigned int unit)
+{
+	push(gfx, GFX_OP_ACTIVE_TEXTURE, 1)[0].u = unit;
+}
+
+void gfx_bind_texture(GfxStream *gfx, unsigned int target, unsigned int texture)
+{
+	GfxWord *a = push(gfx, GFX_OP_BIND_TEXTURE, 2);
+	a[0].u = target;
+	a[1].u = texture;
+}
+
+void gfx_viewport(GfxStream *gfx, int x, int y, int w, int h)
+{
+	GfxWord *a = push(gfx, GFX_OP_VIEWPORT, 4);
+	a[0].i = x;
+	a[1].i = y;
+	a[2].i = w;
+	a[3].i = h;
+}
+
+void gfx_clear_colour(GfxStream *gfx, float r, float g, float b, float alpha)
+{
+	GfxWord *a = push(gfx, GFX_OP_CLEAR_COLOUR, 4);
+	a[0].f = r;
+	a[1].f = g;
+	a[2].f = b;
+	a[3].f = alpha;
+}
+
+void gfx_clear(GfxStream *gfx, unsigned int mask)
+{
+	push(gfx, GFX_OP_CLEAR, 1)[0].u = mask;
+}
+
+void gfx_clear_buffer_uiv(GfxStream *gfx, unsigned int buffer, int draw_buffer, const unsigned int *value)
+{
+	GfxWord *a = push(gfx, GFX_OP_CLEAR_BUFFER_UIV, 6);
+	a[0].u = buffer;
+	a[1].i = draw_buffer;
+	for (unsigned int i = 0; i < 4; i++) {
+		a[2 + i].u = value[i];
+	}
+}
+
+void gfx_enable(GfxStream *gfx, unsigned int cap)
+{
+	push(gfx, GFX_OP_ENABLE, 1)[0].u = cap;
+}
+
+void gfx_disable(GfxStream *gfx, unsigned int cap)
+{
+	push(gfx, GFX_OP_DISABLE, 1)[0].u = cap;
+}
+
+void gfx_cull_face(GfxStream *gfx, unsigned int mode)
+{
+	push(gfx, GFX_OP_CULL_FACE, 1)[0].u = mode;
+}
+
+void gfx_depth_func(GfxStream *gfx, unsigned int func)
+{
+	push(gfx, GFX_OP_DEPTH_FUNC, 1)[0].u = func;
+}
+
+void gfx_stencil_func(GfxStream *gfx, unsigned int func, int ref, unsigned int mask)
+{
+	GfxWord *a = push(gfx, GFX_OP_STENCIL_FUNC, 3);
+	a[0].u = func;
+	a[1].i = ref;
+	a[2].u = mask;
+}
+
+void gfx_stencil_op(GfxStream *gfx, unsigned int sfail, unsigned int dpfail, unsigned int dppass)
+{
+	GfxWord *a = push(gfx, GFX_OP_STENCIL_OP, 3);
+	a[0].u = sfail;
+	a[1].u = dpfail;
+	a[2].u = dppass;
+}
+
+void gfx_stencil_mask(GfxStream *gfx, unsigned int mask)
+{
+	push(gfx, GFX_OP_STENCIL_MASK, 1)[0].u = mask;
+}
+
+void gfx_draw_buffers(GfxStream *gfx, unsigned int count, const unsigned int *buffers)
+{
+	GfxWord *a = push(gfx, GFX_OP_DRAW_BUFFERS, 1 + count);
+	a[0].u = count;
+	for (unsigned int i = 0; i < count; i++) {
+		a[1 + i].u = buffers[i];
+	}
+}
+
+void gfx_read_buffer(GfxStream *gfx, unsigned int mode)
+{
+	push(gfx, GFX_OP_READ_BUFFER, 1)[0].u = mode;
+}
+
+void gfx_blit_framebuffer(GfxStream *gfx, int sx0, int sy0, int sx1, int sy1, int dx0, int dy0, int dx1, int dy1, unsigned int mask, unsigned int filter)
+{
+	GfxWord *a = push(gfx, GFX_OP_BLIT_FRAMEBUFFER, 10);
+	a[0].i = sx0;
+	a[1].i = sy0;
+	a[2].i = sx1;
+	a[3].i = sy1;
+	a[4].i = dx0;
+	a[5].i = dy0;
+	a[6].i = dx1;
+	a[7].i = dy1;
+	a[8].u = mask;
+	a[9].u = filter;
+}
+
+void gfx_uniform_1i(GfxStream *gfx, unsigned int location, int v)
+{
+	GfxWord *a = push(gfx, GFX_OP_UNIFORM_1I, 2);
+	a[0].u = location;
+	a[1].i = v;
+}
+
+void gfx_uniform_1ui(GfxStream *gfx, unsigned int location, unsigned int v)
+{
+	GfxWord *a = push(gfx, GFX_OP_UNIFORM_1UI, 2);
+	a[0].u = location;
+	a[1].u = v;
+}
+
+void gfx_uniform_1f(GfxStream *gfx, unsigned int location, float v)
+{
+	GfxWord *a = push(gfx, GFX_OP_UNIFORM_1F, 2);
+	a[0].u = location;
+	a[1].f = v;
+}
+
+// Vector and matrix uniforms are stored as location, count, then the floats.
+static void push_uniform_floats(GfxStream *gfx, unsigned int op, unsigned int location, unsigned int count, unsigned int floats, const float *v)
+{
+	GfxWord *a = push(gfx, op, 2 + count * floats);
+	a[0].u = location;
+	a[1].u = count;
+	memcpy(a + 2, v, count * floats * sizeof(float));
+}
+
+void gfx_uniform_3fv(GfxStream *gfx, unsigned int location, unsigned int count, const float *v)
+{
+	push_uniform_floats(gfx, GFX_OP_UNIFORM_3FV, location, count, 3, v);
+}
+
+void gfx_uniform_4fv(GfxStream *gfx, unsigned int location, unsigned int count, const float *v)
+{
+	push_uniform_floats(gfx, GFX_OP_UNIFORM_4FV, location, count, 4, v);
+}
+
+void gfx_uniform_matrix_4fv(GfxStream *gfx, unsigned int location, unsigned int count, const float *m)
+{
+	push_uniform_floats(gfx, GFX_OP_UNIFORM_MATRIX_4FV, location, count, 16, m);
+}
+
+void gfx_draw_elements(GfxStream *gfx, unsigned int mode, unsigned int count)
+{
+	GfxWord *a = push(gfx, GFX_OP_DRAW_ELEMENTS, 2);
+	a[0].u = mode;
+	a[1].u = count;
+}
+
+void gfx_draw_arrays(GfxStream *gfx, unsigned int mode, int first, unsigned int count)
+{
+	GfxWord *a = push(gfx, GFX_OP_DRAW_ARRAYS, 3);
+	a[0].u = mode;
+	a[1].i = first;
+	a[2].u = count;
+}
+
+void gfx_timestamp(GfxStream *gfx, unsigned int mark)
+{
+	push(gfx, GFX_OP_TIMESTAMP, 1)[0].u = mark;
+}
+
+// State the null backend tracks. UNKNOWN means the previous frame set it and
+// any value is accepted without being counted as redundant.
+struct NullState {
+	unsigned int program, vao, read_fbo, draw_fbo, unit;
+	unsigned int textures[GFX_MAX_TEXTURE_UNITS][3];
+	GfxWord viewport[4], clear_colour[4];
+	unsigned int caps[3];
+	unsigned int cull_face, depth_func, stencil_mask;
+	GfxWord stencil_func[3], stencil_op[3];
+	std::vector<unsigned int> draw_buffers;
+	unsigned int read_buffer;
+	bool draw_buffers_known;
+
+	// Uniform values keyed by program and location. Uniforms live in the
+	// program, so they survive switching programs.
+	std::unordered_map<unsigned long long, std::vector<unsigned int>> uniforms;
+};
+
+static int texture_target_index(unsigned int target)
+{
+	switch (target) {
+	case GFX_TEXTURE_2D: return 0;
+	case GFX_TEXTURE_CUBE_MAP: return 1;
+	case GFX_TEXTURE_2D_ARRAY: return 2;
+	}
+
+	return -1;
+}
+
+static int cap_index(unsigned int cap)
+{
+	switch (cap) {
+	case GFX_CULL_FACE: return 0;
+	case GFX_DEPTH_TEST: return 1;
+	case GFX_STENCIL_TEST: return 2;
+	}
+
+	return -1;
+}
+
+// Sets a tracked value, returning whether it was already set to it.
+static bool set_state(unsigned int *state, unsigned int value)
+{
+	const bool same = *state == value;
+	*state = value;
+	return same;
+}
+
+static bool set_words(GfxWord *state, const GfxWord *args, unsigned int count, bool *known)
+{
+	bool same = *known;
+	for (unsigned int i = 0; i < count; i++) {
+		same = same && state[i].u == args[i].u;
+		state[i] = args[i];
+	}
+	*known = true;
+
+	return same;
+}
+
+static bool set_uniform(NullState *s, const GfxCommand &c, unsigned int first, bool *invalid)
+{
+	const unsigned int location = c.args[0].u;
+	if (location == GFX_NO_UNIFORM || s->program == 0) {
+		*invalid = true;
+		return false;
+	}
+
+	if (s->program == UNKNOWN) {
+		return false;
+	}
+
+	std::vector<unsigned int> &value = s->uniforms[((unsigned long long)s->program << 32) | location];
+	const unsigned int n = c.size - first;
+
+	bool same = value.size() == n;
+	for (unsigned int i = 0; same && i < n; i++) {
+		same = value[i] == c.args[first + i].u;
+	}
+
+	value.resize(n);
+	for (unsigned int i = 0; i < n; i++) {
+		value[i] = c.args[first + i].u;
+	}
+
+	return same;
+}
+
+// Replays the stream without a GPU. Every call is counted, and calls that
+// change nothing or that GL would reject are counted separately per op.
+void gfx_null_replay(const GfxStream *gfx, GfxNullStats *stats)
+{
+	*stats = {};
+	stats->bytes = gfx->words.size() * sizeof(GfxWord);
+
+	NullState s;
+	s.program = s.vao = s.read_fbo = s.draw_fbo = s.unit = UNKNOWN;
+	for (auto &unit : s.textures) {
+		unit[0] = unit[1] = unit[2] = UNKNOWN;
+	}
+	s.caps[0] = s.caps[1] = s.caps[2] = UNKNOWN;
+	s.cull_face = s.depth_func = s.stencil_mask = s.read_buffer = UNKNOWN;
+	s.draw_buffers_known = false;
+
+	bool viewport_known = false, clear_colour_known = false, stencil_func_known = false, stencil_op_known = false;
+
+	unsigned int cursor = 0;
+	GfxCommand c;
+	while (gfx_next(gfx, &cursor, &c)) {
+		if (c.op >= GFX_OP_COUNT) {
+			break;
+		}
+
+		stats->commands++;
+		stats->calls[c.op]++;
+
+		bool redundant = false, invalid = false;
+
+		switch (c.op) {
+		case GFX_OP_USE_PROGRAM:
+			redundant = set_state(&s.program, c.args[0].u);
+			break;
+		case GFX_OP_BIND_VERTEX_ARRAY:
+			redundant = set_state(&s.vao, c.args[0].u);
+			break;
+		case GFX_OP_BIND_FRAMEBUFFER: {
+			// Draw and read buffer selections belong to the framebuffer.
+			const bool read = c.args[0].u == GFX_FRAMEBUFFER || c.args[0].u == GFX_READ_FRAMEBUFFER;
+			const bool draw = c.args[0].u == GFX_FRAMEBUFFER || c.args[0].u == GFX_DRAW_FRAMEBUFFER;
+
+			redundant = read || draw;
+			if (read && !set_state(&s.read_fbo, c.args[1].u)) {
+				redundant = false;
+				s.read_buffer = UNKNOWN;
+			}
+			if (draw && !set_state(&s.draw_fbo, c.args[1].u)) {
+				redundant = false;
+				s.draw_buffers_known = false;
+			}
+			invalid = !read && !draw;
+			break;
+		}
+		case GFX_OP_ACTIVE_TEXTURE:
+			if (c.args[0].u - GFX_TEXTURE0 >= GFX_MAX_TEXTURE_UNITS) {
+				invalid = true;
+			} else {
+				redundant = set_state(&s.unit, c.args[0].u - GFX_TEXTURE0);
+			}
+			break;
+		case GFX_OP_BIND_TEXTURE: {
+			const int target = texture_target_index(c.args[0].u);
+			if (target < 0) {
+				invalid = true;
+			} else if (s.unit != UNKNOWN) {
+				redundant = set_state(&s.textures[s.unit][target], c.args[1].u);
+			}
+			break;
+		}
+		case GFX_OP_VIEWPORT:
+			invalid = c.args[2].i < 0 || c.args[3].i < 0;
+			redundant = set_words(s.viewport, c.args, 4, &viewport_known);
+			break;
+		case GFX_OP_CLEAR_COLOUR:
+			redundant = set_words(s.clear_colour, c.args, 4, &clear_colour_known);
+			break;
+		case GFX_OP_CLEAR:
+			invalid = (c.args[0].u & ~(GFX_COLOR_BUFFER_BIT | GFX_DEPTH_BUFFER_BIT | GFX_STENCIL_BUFFER_BIT)) != 0;
+			break;
+		case GFX_OP_CLEAR_BUFFER_UIV:
+			invalid = c.args[0].u != GFX_COLOR;
+			break;
+		case GFX_OP_ENABLE:
+		case GFX_OP_DISABLE: {
+			const int cap = cap_index(c.args[0].u);
+			if (cap < 0) {
+				invalid = true;
+			} else {
+				redundant = set_state(&s.caps[cap], c.op == GFX_OP_ENABLE);
+			}
+			break;
+		}
+		case GFX_OP_CULL_FACE:
+			redundant = set_state(&s.cull_face, c.args[0].u);
+			break;
+		case GFX_OP_DEPTH_FUNC:
+			redundant = set_state(&s.depth_func, c.args[0].u);
+			break;
+		case GFX_OP_STENCIL_FUNC:
+			redundant = set_words(s.stencil_func, c.args, 3, &stencil_func_known);
+			break;
+		case GFX_OP_STENCIL_OP:
+			redundant = set_words(s.stencil_op, c.args, 3, &stencil_op_known);
+			break;
+		case GFX_OP_STENCIL_MASK:
+			redundant = set_state(&s.stencil_mask, c.args[0].u);
+			break;
+		case GFX_OP_DRAW_BUFFERS: {
+			std::vector<unsigned int> buffers(c.args[0].u);
+			for (unsigned int i = 0; i < buffers.size(); i++) {
+				buffers[i] = c.args[1 + i].u;
+			}
+			redundant = s.draw_buffers_known && buffers == s.draw_buffers;
+			s.draw_buffers = buffers;
+			s.draw_buffers_known = s.draw_fbo != UNKNOWN;
+			break;
+		}
+		case GFX_OP_READ_BUFFER:
+			redundant = set_state(&s.read_buffer, c.args[0].u);
+			break;
+		case GFX_OP_BLIT_FRAMEBUFFER:
+			// Depth and stencil can only be blitted with nearest filtering.
+			invalid = (c.args[8].u & (GFX_DEPTH_BUFFER_BIT | GFX_STENCIL_BUFFER_BIT)) && c.args[9].u != GFX_NEAREST;
+			invalid = invalid || (s.read_fbo != UNKNOWN && s.read_fbo == s.draw_fbo);
+			break;
+		case GFX_OP_UNIFORM_1I:
+		case GFX_OP_UNIFORM_1UI:
+		case GFX_OP_UNIFORM_1F:
+			redundant = set_uniform(&s, c, 1, &invalid);
+			break;
+		case GFX_OP_UNIFORM_3FV:
+		case GFX_OP_UNIFORM_4FV:
+		case GFX_OP_UNIFORM_MATRIX_4FV:
+			redundant = set_uniform(&s, c, 2, &invalid);
+			break;
+		case GFX_OP_DRAW_ELEMENTS:
+		case GFX_OP_DRAW_ARRAYS: {
+			const unsigned int count = c.args[c.op == GFX_OP_DRAW_ELEMENTS ? 1 : 2].u;
+			invalid = s.program == 0 || s.vao == 0 || count == 0;
+			stats->draws++;
+			if (c.args[0].u == GFX_TRIANGLES) {
+				stats->triangles += count / 3;
+			}
+			break;
+		}
+		}
+
+		if (redundant) stats->redundant[c.op]++;
+		if (invalid) stats->invalid[c.op]++;
+	}
+}
@@ -0,0 +1,149 @@
+#ifndef GFX_H
+#define GFX_H
+
+#include <vector>
+
+// The frame is recorded as a stream of GL commands and replayed afterwards by
+// a backend. The GL backend issues the calls, the null backend only counts and
+// validates them, so render() can run and be timed without a GPU, and the
+// software backend rasterises them, see soft-raster.h.
+
+// GL enum values, so the GL backend can pass them straight through.
+static const unsigned int GFX_TRIANGLES = 0x0004;
+static const unsigned int GFX_DEPTH_BUFFER_BIT = 0x0100;
+static const unsigned int GFX_STENCIL_BUFFER_BIT = 0x0400;
+static const unsigned int GFX_COLOR_BUFFER_BIT = 0x4000;
+static const unsigned int GFX_NEVER = 0x0200;
+static const unsigned int GFX_LESS = 0x0201;
+static const unsigned int GFX_LEQUAL = 0x0203;
+static const unsigned int GFX_NOTEQUAL = 0x0205;
+static const unsigned int GFX_ALWAYS = 0x0207;
+static const unsigned int GFX_FRONT = 0x0404;
+static const unsigned int GFX_BACK = 0x0405;
+static const unsigned int GFX_CULL_FACE = 0x0B44;
+static const unsigned int GFX_DEPTH_TEST = 0x0B71;
+static const unsigned int GFX_STENCIL_TEST = 0x0B90;
+static const unsigned int GFX_KEEP = 0x1E00;
+static const unsigned int GFX_REPLACE = 0x1E01;
+static const unsigned int GFX_COLOR = 0x1800;
+static const unsigned int GFX_NEAREST = 0x2600;
+static const unsigned int GFX_TEXTURE_2D = 0x0DE1;
+static const unsigned int GFX_TEXTURE_CUBE_MAP = 0x8513;
+static const unsigned int GFX_TEXTURE_2D_ARRAY = 0x8C1A;
+static const unsigned int GFX_TEXTURE0 = 0x84C0;
+static const unsigned int GFX_FRAMEBUFFER = 0x8D40;
+static const unsigned int GFX_READ_FRAMEBUFFER = 0x8CA8;
+static const unsigned int GFX_DRAW_FRAMEBUFFER = 0x8CA9;
+static const unsigned int GFX_COLOR_ATTACHMENT0 = 0x8CE0;
+static const unsigned int GFX_COLOR_ATTACHMENT1 = 0x8CE1;
+
+static const unsigned int GFX_MAX_TEXTURE_UNITS = 16;
+static const unsigned int GFX_NO_UNIFORM = (unsigned int)-1; // Location of a uniform a program doesn't have.
+
+enum GfxOp {
+	GFX_OP_USE_PROGRAM,
+	GFX_OP_BIND_VERTEX_ARRAY,
+	GFX_OP_BIND_FRAMEBUFFER,
+	GFX_OP_ACTIVE_TEXTURE,
+	GFX_OP_BIND_TEXTURE,
+	GFX_OP_VIEWPORT,
+	GFX_OP_CLEAR_COLOUR,
+	GFX_OP_CLEAR,
+	GFX_OP_CLEAR_BUFFER_UIV,
+	GFX_OP_ENABLE,
+	GFX_OP_DISABLE,
+	GFX_OP_CULL_FACE,
+	GFX_OP_DEPTH_FUNC,
+	GFX_OP_STENCIL_FUNC,
+	GFX_OP_STENCIL_OP,
+	GFX_OP_STENCIL_MASK,
+	GFX_OP_DRAW_BUFFERS,
+	GFX_OP_READ_BUFFER,
+	GFX_OP_BLIT_FRAMEBUFFER,
+	GFX_OP_UNIFORM_1I,
+	GFX_OP_UNIFORM_1UI,
+	GFX_OP_UNIFORM_1F,
+	GFX_OP_UNIFORM_3FV,
+	GFX_OP_UNIFORM_4FV,
+	GFX_OP_UNIFORM_MATRIX_4FV,
+	GFX_OP_DRAW_ELEMENTS,
+	GFX_OP_DRAW_ARRAYS,
+	GFX_OP_TIMESTAMP,
+	GFX_OP_COUNT
+};
+
+union GfxWord {
+	unsigned int u;
+	int i;
+	float f;
+};
+
+// Each command is a header word, the op in the low byte and its length in
+// words above it, followed by its arguments.
+struct GfxStream {
+	std::vector<GfxWord> words;
+	unsigned int commands;
+};
+
+struct GfxCommand {
+	unsigned int op;
+	unsigned int size; // Argument words.
+	const GfxWord *args;
+};
+
+struct SoftDevice;
+struct GpuTimer;
+
+struct GfxNullStats {
+	unsigned int commands;
+	unsigned int bytes;
+	unsigned int calls[GFX_OP_COUNT];
+	unsigned int redundant[GFX_OP_COUNT]; // Calls that set state to what it already was.
+	unsigned int invalid[GFX_OP_COUNT]; // Calls GL would reject or ignore.
+	unsigned int draws;
+	unsigned int triangles;
+};
+
+extern void gfx_reset(GfxStream *gfx);
+extern bool gfx_next(const GfxStream *gfx, unsigned int *cursor, GfxCommand *command);
+extern const char *gfx_op_name(unsigned int op);
+
+extern void gfx_use_program(GfxStream *gfx, unsigned int program);
+extern void gfx_bind_vertex_array(GfxStream *gfx, unsigned int vao);
+extern void gfx_bind_framebuffer(GfxStream *gfx, unsigned int target, unsigned int fbo);
+extern void gfx_active_texture(GfxStream *gfx, unsigned int unit);
+extern void gfx_bind_texture(GfxStream *gfx, unsigned int target, unsigned int texture);
+extern void gfx_viewport(GfxStream *gfx, int x, int y, int w, int h);
+extern void gfx_clear_colour(GfxStream *gfx, float r, float g, float b, float a);
+extern void gfx_clear(GfxStream *gfx, unsigned int mask);
+extern void gfx_clear_buffer_uiv(GfxStream *gfx, unsigned int buffer, int draw_buffer, const unsigned int *value);
+extern void gfx_enable(GfxStream *gfx, unsigned int cap);
+extern void gfx_disable(GfxStream *gfx, unsigned int cap);
+extern void gfx_cull_face(GfxStream *gfx, unsigned int mode);
+extern void gfx_depth_func(GfxStream *gfx, unsigned int func);
+extern void gfx_stencil_func(GfxStream *gfx, unsigned int func, int ref, unsigned int mask);
+extern void gfx_stencil_op(GfxStream *gfx, unsigned int sfail, unsigned int dpfail, unsigned int dppass);
+extern void gfx_stencil_mask(GfxStream *gfx, unsigned int mask);
+extern void gfx_draw_buffers(GfxStream *gfx, unsigned int count, const unsigned int *buffers);
+extern void gfx_read_buffer(GfxStream *gfx, unsigned int mode);
+extern void gfx_blit_framebuffer(GfxStream *gfx, int sx0, int sy0, int sx1, int sy1, int dx0, int dy0, int dx1, int dy1, unsigned int mask, unsigned int filter);
+extern void gfx_uniform_1i(GfxStream *gfx, unsigned int location, int v);
+extern void gfx_uniform_1ui(GfxStream *gfx, unsigned int location, unsigned int v);
+extern void gfx_uniform_1f(GfxStream *gfx, unsigned int location, float v);
+extern void gfx_uniform_3fv(GfxStream *gfx, unsigned int location, unsigned int count, const float *v);
+extern void gfx_uniform_4fv(GfxStream *gfx, unsigned int location, unsigned int count, const float *v);
+extern void gfx_uniform_matrix_4fv(GfxStream *gfx, unsigned int location, unsigned int count, const float *m);
+extern void gfx_draw_elements(GfxStream *gfx, unsigned int mode, unsigned int count);
+extern void gfx_draw_arrays(GfxStream *gfx, unsigned int mode, int first, unsigned int count);
+
+// Marks where a timed section of the frame starts, see gpu-timer.h. Only the GL
+// backend acts on it.
+extern void gfx_timestamp(GfxStream *gfx, unsigned int mark);
+
+// Backends. The state the null backend checks against starts out unknown, as
+// it is whatever the previous frame left.
+extern void gfx_null_replay(const GfxStream *gfx, GfxNullStats *stats);
+extern void gfx_gl_replay(const GfxStream *gfx, GpuTimer *timer);
+extern void gfx_soft_replay(const GfxStream *gfx, SoftDevice *device);
+
+#endif
@@ -0,0 +1,150 @@
+#include "gpu-timer.h"
+
+#include <string.h>
+
+#include "win32-opengl.h"
+#include "profiler.h"
+
+static const unsigned int GPU_TIMER_SYNC_FRAMES = 256; // Clocks are related again this often.
+static const float GPU_TIMER_SMOOTHING = 0.05f;
+
+// Relates the GPU clock to the profiler's. Reading GL_TIMESTAMP doesn't wait
+// for the GPU, it returns the time commands issued now would start at.
+static void sync_clocks(GpuTimer *timer)
+{
+	GLint64 gpu_ns = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpu_ns);
+
+	timer->gpu_sync_ns = gpu_ns;
+	timer->cpu_sync_ticks = profiler_ticks();
+	timer->ticks_per_ns = profiler_ticks_per_us() / 1000.0;
+}
+
+static unsigned long long gpu_to_ticks(const GpuTimer *timer, GLuint64 gpu_ns)
+{
+	const double ns = (double)(long long)(gpu_ns - (GLuint64)timer->gpu_sync_ns);
+	return timer->cpu_sync_ticks + (long long)(ns * timer->ticks_per_ns);
+}
+
+// Reads the set back if its last query is available. Timestamps complete in
+// the order they were issued, so the earlier ones are then available too.
+static bool resolve(GpuTimer *timer, GpuTimerFrame *f)
+{
+	if (f->marks == 0) {
+		return true;
+	}
+
+	GLint available = 0;
+	glGetQueryObjectiv(f->queries[f->marks - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) {
+		return false;
+	}
+
+	GLuint64 times[GPU_TIMER_MARKS];
+	for (unsigned int i = 0; i < f->marks; i++) {
+		glGetQueryObjectui64v(f->queries[i], GL_QUERY_RESULT, &times[i]);
+	}
+
+	// A pass may be marked more than once, its sections add up.
+	memset(timer->pass_ms, 0, sizeof(timer->pass_ms));
+	timer->total_ms = 0.f;
+
+	for (unsigned int i = 0; i + 1 < f->marks; i++) {
+		const unsigned int pass = f->passes[i];
+		if (pass >= GPU_PASS_COUNT) {
+			continue;
+		}
+
+		const float ms = (float)((double)(times[i + 1] - times[i]) / 1000000.0);
+		timer->pass_ms[pass] += ms;
+		timer->total_ms += ms;
+
+#if PROFILER_ENABLED
+		profiler_record(timer->track, GPU_PASS_NAMES[pass], gpu_to_ticks(timer, times[i]), gpu_to_ticks(timer, times[i + 1]), 1);
+#endif
+	}
+
+#if PROFILER_ENABLED
+	if (f->marks > 1) {
+		profiler_record(timer->track, "gpu frame", gpu_to_ticks(timer, times[0]), gpu_to_ticks(timer, times[f->marks - 1]), 0);
+	}
+#endif
+
+	// The first frame read back seeds the averages.
+	const float k = timer->resolved ? GPU_TIMER_SMOOTHING : 1.f;
+	for (unsigned int p = 0; p < GPU_PASS_COUNT; p++) {
+		timer->average_ms[p] += (timer->pass_ms[p] - timer->average_ms[p]) * k;
+	}
+	timer->average_total_ms += (timer->total_ms - timer->average_total_ms) * k;
+	timer->resolved++;
+
+	f->marks = 0;
+	return true;
+}
+
+void gpu_timer_init(GpuTimer *timer)
+{
+	*timer = {};
+
+	// Loaded as null where the driver has no GL 3.3 or ARB_timer_query.
+	timer->supported = glGenQueries && glQueryCounter && glGetQueryObjectui64v && glGetInteger64v;
+	if (!timer->supported) {
+		return;
+	}
+
+	for (auto &f : timer->frames) {
+		glGenQueries(GPU_TIMER_MARKS, f.queries);
+	}
+
+	timer->track = profiler_track("gpu");
+	sync_clocks(timer);
+}
+
+void gpu_timer_destroy(GpuTimer *timer)
+{
+	if (!timer->supported) {
+		return;
+	}
+
+	for (auto &f : timer->frames) {
+		glDeleteQueries(GPU_TIMER_MARKS, f.queries);
+	}
+
+	timer->supported = false;
+}
+
+void gpu_timer_begin_frame(GpuTimer *timer)
+{
+	if (!timer->supported) {
+		return;
+	}
+
+	GpuTimerFrame *f = &timer->frames[timer->frame % GPU_TIMER_FRAMES];
+	if (!resolve(timer, f)) {
+		// Overwriting the queries is fine, their old results are discarded.
+		timer->dropped++;
+		f->marks = 0;
+	}
+
+	timer->frame++;
+
+	if (timer->frame % GPU_TIMER_SYNC_FRAMES == 0) {
+		sync_clocks(timer);
+	}
+}
+
+void gpu_timer_mark(GpuTimer *timer, unsigned int pass)
+{
+	if (!timer->supported || timer->frame == 0) {
+		return;
+	}
+
+	GpuTimerFrame *f = &timer->frames[(timer->frame - 1) % GPU_TIMER_FRAMES];
+	if (f->marks == GPU_TIMER_MARKS) {
+		return;
+	}
+
+	glQueryCounter(f->queries[f->marks], GL_TIMESTAMP);
+	f->passes[f->marks] = pass;
+	f->marks++;
+}
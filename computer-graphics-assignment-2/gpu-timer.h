@@ -0,0 +1,63 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+// GPU time per render pass. render() records a timestamp mark where each pass
+// starts, and the GL backend turns the marks into timestamp queries. Results
+// are read a few frames later from a ring of query sets, once the GPU has
+// finished with them, so reading never stalls the CPU. A frame whose results
+// still aren't ready when its set comes round again is dropped.
+
+enum GpuPass {
+	GPU_PASS_SHADOW,
+	GPU_PASS_CLEAR, // Binding and clearing the scene target.
+	GPU_PASS_FLOOR,
+	GPU_PASS_SKELETON,
+	GPU_PASS_CYLINDERS,
+	GPU_PASS_SKYBOX,
+	GPU_PASS_OUTLINE,
+	GPU_PASS_UI, // Buttons, this overlay and the blit to the window.
+	GPU_PASS_COUNT, // Marks the end of the frame.
+};
+
+static const char *const GPU_PASS_NAMES[GPU_PASS_COUNT] = {
+	"shadow", "clear", "floor", "skeleton", "cylinders", "skybox", "outline", "ui"
+};
+
+static const unsigned int GPU_TIMER_FRAMES = 4; // Frames in flight before a set is reused.
+static const unsigned int GPU_TIMER_MARKS = 32; // Per frame, later marks are ignored.
+
+struct GpuTimerFrame {
+	unsigned int queries[GPU_TIMER_MARKS];
+	unsigned int passes[GPU_TIMER_MARKS]; // Pass started by each mark.
+	unsigned int marks;
+};
+
+struct ProfileRing;
+
+struct GpuTimer {
+	bool supported; // Timestamp queries need GL 3.3.
+	GpuTimerFrame frames[GPU_TIMER_FRAMES];
+	unsigned int frame; // Frames begun.
+
+	float pass_ms[GPU_PASS_COUNT]; // Last frame read back.
+	float average_ms[GPU_PASS_COUNT]; // Smoothed for display.
+	float total_ms, average_total_ms;
+	unsigned int resolved, dropped;
+
+	// The GPU clock is related to the profiler's so the passes can be written
+	// to the same trace as the CPU zones.
+	ProfileRing *track;
+	long long gpu_sync_ns;
+	unsigned long long cpu_sync_ticks;
+	double ticks_per_ns;
+};
+
+extern void gpu_timer_init(GpuTimer *timer);
+extern void gpu_timer_destroy(GpuTimer *timer);
+
+// Reads back the oldest set of queries if the GPU is done with it, then starts
+// recording the new frame into it. Call before replaying the frame.
+extern void gpu_timer_begin_frame(GpuTimer *timer);
+extern void gpu_timer_mark(GpuTimer *timer, unsigned int pass);
+
+#endif
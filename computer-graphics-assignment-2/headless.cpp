@@ -0,0 +1,325 @@
+#include "headless.h"
+
+#include <stdlib.h>
+#include <vector>
+
+#include "render.h"
+#include "scene.h"
+#include "opengl-util.h"
+
+// Stands in for glGen*, names only have to be unique per device.
+static unsigned int gen_name(unsigned int *names)
+{
+	return ++*names;
+}
+
+// Checkerboard of two RGBA8 colours packed as 0xAABBGGRR.
+static void register_checker(SoftDevice *device, unsigned int texture, unsigned int size, unsigned int cells, unsigned int a, unsigned int b, unsigned int layers)
+{
+	std::vector<unsigned int> texels(size * size * layers);
+	for (unsigned int l = 0; l < layers; l++) {
+		for (unsigned int y = 0; y < size; y++) {
+			for (unsigned int x = 0; x < size; x++) {
+				const bool odd = ((x * cells / size) + (y * cells / size) + l) & 1;
+				texels[(l * size + y) * size + x] = odd ? a : b;
+			}
+		}
+	}
+
+	soft_register_texture(device, texture, size, size, layers, (unsigned char *)texels.data());
+}
+
+// Unit box over LIMB_BOX_MIN to LIMB_BOX_MAX with a normal per face. Faces are
+// given by their normal and two axes with s x t = n, so they wind counter
+// clockwise from outside.
+static void box_mesh(std::vector<float> &vertices, std::vector<unsigned int> &indices)
+{
+	static const float faces[6][3][3] = {
+		{ { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } },
+		{ { -1, 0, 0 }, { 0, 0, 1 }, { 0, 1, 0 } },
+		{ { 0, 1, 0 }, { 0, 0, 1 }, { 1, 0, 0 } },
+		{ { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },
+		{ { 0, 0, 1 }, { 1, 0, 0 }, { 0, 1, 0 } },
+		{ { 0, 0, -1 }, { 0, 1, 0 }, { 1, 0, 0 } },
+	};
+	static const float corners[4][2] = { { -0.5f, -0.5f }, { 0.5f, -0.5f }, { 0.5f, 0.5f }, { -0.5f, 0.5f } };
+	static const float centre[3] = { 0.f, 0.5f, 0.f };
+
+	for (unsigned int f = 0; f < 6; f++) {
+		const unsigned int base = vertices.size() / 8;
+
+		for (unsigned int c = 0; c < 4; c++) {
+			for (unsigned int i = 0; i < 3; i++) {
+				vertices.push_back(centre[i] + 0.5f * faces[f][0][i] + corners[c][0] * faces[f][1][i] + corners[c][1] * faces[f][2][i]);
+			}
+			for (unsigned int i = 0; i < 3; i++) {
+				vertices.push_back(faces[f][0][i]);
+			}
+			vertices.push_back(corners[c][0] + 0.5f);
+			vertices.push_back(corners[c][1] + 0.5f);
+		}
+
+		const unsigned int quad[6] = { 0, 1, 2, 0, 2, 3 };
+		for (auto q : quad) {
+			indices.push_back(base + q);
+		}
+	}
+}
+
+// 36 positions of a cube around the origin, wound to face inwards.
+static void skybox_mesh(std::vector<float> &vertices)
+{
+	std::vector<float> box;
+	std::vector<unsigned int> indices;
+	box_mesh(box, indices);
+
+	for (unsigned int i = 0; i < indices.size(); i += 3) {
+		const unsigned int tri[3] = { indices[i], indices[i + 2], indices[i + 1] };
+		for (auto v : tri) {
+			vertices.push_back(box[v * 8 + 0] * 2.f);
+			vertices.push_back(box[v * 8 + 1] * 2.f - 1.f);
+			vertices.push_back(box[v * 8 + 2] * 2.f);
+		}
+	}
+}
+
+static void init_shaders(app_state *state, SoftDevice *device, unsigned int *names)
+{
+	LightUniforms lights[2];
+	for (unsigned int i = 0; i < 2; i++) {
+		lights[i].pos = SOFT_UNIFORM_LIGHTS + 4 * i;
+		lights[i].colour = SOFT_UNIFORM_LIGHTS + 4 * i + 1;
+		lights[i].ambient = SOFT_UNIFORM_LIGHTS + 4 * i + 2;
+		lights[i].diffuse = SOFT_UNIFORM_LIGHTS + 4 * i + 3;
+	}
+
+	TexturedShader *textured = &state->textured_shader;
+	textured->program = gen_name(names);
+	textured->projection = SOFT_UNIFORM_PROJECTION;
+	textured->view = SOFT_UNIFORM_VIEW;
+	textured->model = SOFT_UNIFORM_MODEL;
+	textured->light_space_matrix = SOFT_UNIFORM_LIGHT_SPACE_MATRIX;
+	textured->shadow_map = SOFT_UNIFORM_SHADOW_MAP;
+	textured->gamma_correction = SOFT_UNIFORM_GAMMA_CORRECTION;
+	textured->view_position = SOFT_UNIFORM_VIEW_POSITION;
+	textured->texture = SOFT_UNIFORM_TEXTURE;
+	textured->object_id = SOFT_UNIFORM_OBJECT_ID;
+	textured->cascade_count = SOFT_UNIFORM_CASCADE_COUNT;
+	textured->cascade_splits = SOFT_UNIFORM_CASCADE_SPLITS;
+	textured->cascade_matrices = SOFT_UNIFORM_CASCADE_MATRICES;
+	textured->cascade_maps = SOFT_UNIFORM_CASCADE_MAPS;
+	textured->lights[0] = lights[0];
+	textured->lights[1] = lights[1];
+	soft_register_program(device, textured->program, SOFT_SHADER_TEXTURED);
+
+	DiffuseShader *diffuse = &state->diffuse_shader;
+	diffuse->program = gen_name(names);
+	diffuse->projection = SOFT_UNIFORM_PROJECTION;
+	diffuse->view = SOFT_UNIFORM_VIEW;
+	diffuse->model = SOFT_UNIFORM_MODEL;
+	diffuse->light_space_matrix = SOFT_UNIFORM_LIGHT_SPACE_MATRIX;
+	diffuse->shadow_map = SOFT_UNIFORM_SHADOW_MAP;
+	diffuse->gamma_correction = SOFT_UNIFORM_GAMMA_CORRECTION;
+	diffuse->view_position = SOFT_UNIFORM_VIEW_POSITION;
+	diffuse->object_colour = SOFT_UNIFORM_OBJECT_COLOUR;
+	diffuse->object_id = SOFT_UNIFORM_OBJECT_ID;
+	diffuse->cascade_count = SOFT_UNIFORM_CASCADE_COUNT;
+	diffuse->cascade_splits = SOFT_UNIFORM_CASCADE_SPLITS;
+	diffuse->cascade_matrices = SOFT_UNIFORM_CASCADE_MATRICES;
+	diffuse->cascade_maps = SOFT_UNIFORM_CASCADE_MAPS;
+	diffuse->lights[0] = lights[0];
+	diffuse->lights[1] = lights[1];
+	soft_register_program(device, diffuse->program, SOFT_SHADER_DIFFUSE);
+
+	state->interface_shader.program = gen_name(names);
+	state->interface_shader.projection = SOFT_UNIFORM_PROJECTION;
+	state->interface_shader.model = SOFT_UNIFORM_MODEL;
+	state->interface_shader.texture = SOFT_UNIFORM_TEXTURE;
+	soft_register_program(device, state->interface_shader.program, SOFT_SHADER_INTERFACE);
+
+	state->depth_shader.program = gen_name(names);
+	state->depth_shader.projection = SOFT_UNIFORM_PROJECTION;
+	state->depth_shader.view = SOFT_UNIFORM_VIEW;
+	state->depth_shader.model = SOFT_UNIFORM_MODEL;
+	soft_register_program(device, state->depth_shader.program, SOFT_SHADER_DEPTH);
+
+	state->outline_shader.program = gen_name(names);
+	state->outline_shader.projection = SOFT_UNIFORM_PROJECTION;
+	state->outline_shader.view = SOFT_UNIFORM_VIEW;
+	state->outline_shader.model = SOFT_UNIFORM_MODEL;
+	soft_register_program(device, state->outline_shader.program, SOFT_SHADER_OUTLINE);
+
+	state->skybox_shader.program = gen_name(names);
+	state->skybox_shader.projection = SOFT_UNIFORM_PROJECTION;
+	state->skybox_shader.view = SOFT_UNIFORM_VIEW;
+	state->skybox_shader.skybox = SOFT_UNIFORM_SKYBOX;
+	soft_register_program(device, state->skybox_shader.program, SOFT_SHADER_SKYBOX);
+}
+
+static void init_meshes(app_state *state, SoftDevice *device, unsigned int *names)
+{
+	state->triangle_vao = gen_name(names);
+	soft_register_mesh(device, state->triangle_vao, QUAD_VERTICES, 4, 8, QUAD_INDICES, 6);
+
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	cylinder_mesh(vertices, indices);
+	state->cylinder_vao = gen_name(names);
+	soft_register_mesh(device, state->cylinder_vao, vertices.data(), vertices.size() / 8, 8, indices.data(), indices.size());
+
+	state->interface_vao = gen_name(names);
+	soft_register_mesh(device, state->interface_vao, INTERFACE_VERTICES, 4, 4, INTERFACE_INDICES, 6);
+
+	vertices.clear();
+	indices.clear();
+	box_mesh(vertices, indices);
+
+	state->box = new Object();
+	state->box->vao = gen_name(names);
+	for (unsigned int i = 0; i < indices.size(); i += 3) {
+		Poly *p = (Poly *)malloc(sizeof(Poly));
+		p->indices[0] = indices[i];
+		p->indices[1] = indices[i + 1];
+		p->indices[2] = indices[i + 2];
+		p->smoothing_group = 0;
+		state->box->polygons.push_back(p);
+	}
+	soft_register_mesh(device, state->box->vao, vertices.data(), vertices.size() / 8, 8, indices.data(), indices.size());
+
+	state->sphere = 0;
+
+	vertices.clear();
+	skybox_mesh(vertices);
+
+	state->skybox = new Skybox();
+	state->skybox->vao = gen_name(names);
+	state->skybox->texture = gen_name(names);
+	soft_register_mesh(device, state->skybox->vao, vertices.data(), vertices.size() / 3, 3, 0, 0);
+	register_checker(device, state->skybox->texture, 16, 4, 0xFFE0C080, 0xFFD0B070, 6);
+}
+
+static void init_textures(app_state *state, SoftDevice *device, unsigned int *names)
+{
+	state->floor_tex = gen_name(names);
+	register_checker(device, state->floor_tex, 256, 32, 0xFF406040, 0xFF305030, 1);
+
+	unsigned int *buttons[] = {
+		&state->pos_tex, &state->rot_tex, &state->x_tex, &state->y_tex, &state->z_tex,
+		&state->inc_tex, &state->dec_tex, &state->play_tex, &state->cam1_tex, &state->cam2_tex,
+	};
+
+	for (unsigned int i = 0; i < sizeof(buttons) / sizeof(buttons[0]); i++) {
+		*buttons[i] = gen_name(names);
+		register_checker(device, *buttons[i], 8, 2, 0xFFFFFFFF, 0xFF202020 + 0x101010 * i, 1);
+	}
+
+	unsigned int glyph[GLYPH_W * GLYPH_H];
+	for (unsigned int i = 0; i < GLYPH_COUNT; i++) {
+		state->glyph_textures[i] = gen_name(names);
+		glyph_pixels(i, glyph);
+		soft_register_texture(device, state->glyph_textures[i], GLYPH_W, GLYPH_H, 1, (unsigned char *)glyph);
+	}
+}
+
+static void init_targets(app_state *state, SoftDevice *device, unsigned int *names)
+{
+	state->depth_map = gen_name(names);
+	state->depth_map_fbo = gen_name(names);
+	soft_register_depth_texture(device, state->depth_map, SHADOW_MAP_SIZE, 1);
+	soft_register_framebuffer(device, state->depth_map_fbo, 0, 0, state->depth_map, 0);
+
+	state->static_depth_map = gen_name(names);
+	state->static_depth_fbo = gen_name(names);
+	soft_register_depth_texture(device, state->static_depth_map, SHADOW_MAP_SIZE, 1);
+	soft_register_framebuffer(device, state->static_depth_fbo, 0, 0, state->static_depth_map, 0);
+
+	state->cascade_maps = gen_name(names);
+	soft_register_depth_texture(device, state->cascade_maps, CASCADE_SIZE, MAX_CASCADES);
+	for (unsigned int i = 0; i < MAX_CASCADES; i++) {
+		state->cascade_fbos[i] = gen_name(names);
+		soft_register_framebuffer(device, state->cascade_fbos[i], 0, 0, state->cascade_maps, i);
+	}
+
+	const unsigned int w = state->window_info.w, h = state->window_info.h;
+	std::vector<unsigned int> black(w * h, 0);
+
+	state->scene_colour = gen_name(names);
+	state->scene_ids = gen_name(names);
+	state->scene_depth = 0;
+	state->scene_fbo = gen_name(names);
+	soft_register_texture(device, state->scene_colour, w, h, 1, (unsigned char *)black.data());
+	soft_register_id_texture(device, state->scene_ids, w, h);
+	soft_register_framebuffer(device, state->scene_fbo, state->scene_colour, state->scene_ids, 0, 0);
+
+	state->pick_pbo = 0;
+}
+
+// Same layout as create_ui. Nothing handles input headless, so the buttons
+// have no click handlers.
+static void create_buttons(app_state *state)
+{
+	const struct { unsigned int texture; V2 pos, size; } layout[] = {
+		{ state->pos_tex, { 20, 20 }, { 70, 50 } },
+		{ state->rot_tex, { 100, 20 }, { 70, 50 } },
+		{ state->x_tex, { 20, 80 }, { 50, 50 } },
+		{ state->y_tex, { 80, 80 }, { 50, 50 } },
+		{ state->z_tex, { 140, 80 }, { 50, 50 } },
+		{ state->dec_tex, { 20, 140 }, { 50, 50 } },
+		{ state->inc_tex, { 80, 140 }, { 50, 50 } },
+		{ state->play_tex, { 20, 200 }, { 50, 50 } },
+		{ state->cam1_tex, { 20, 260 }, { 50, 50 } },
+		{ state->cam2_tex, { 80, 260 }, { 50, 50 } },
+	};
+
+	for (auto &l : layout) {
+		Button b;
+		b.texture = l.texture;
+		b.pos = l.pos;
+		b.size = l.size;
+		state->buttons.push_back(b);
+	}
+}
+
+app_state *headless_init(SoftDevice *device, unsigned int w, unsigned int h)
+{
+	app_state *state = new app_state;
+
+	state->window_info.w = w;
+	state->window_info.h = h;
+	state->window_info.resize = false;
+	state->window_info.running = true;
+
+	unsigned int names = 0;
+	init_shaders(state, device, &names);
+	init_meshes(state, device, &names);
+	init_textures(state, device, &names);
+	init_targets(state, device, &names);
+
+	scene_init(state);
+
+	// There are no queries to time, the overlay shows whatever is put here.
+	state->gpu_timer = {};
+
+	create_buttons(state);
+
+	camera_update(state->cur_cam);
+	mat4_look_at(state->cur_cam->view, state->cur_cam->pos, state->cur_cam->pos + state->cur_cam->front, state->cur_cam->up);
+
+	return state;
+}
+
+void headless_destroy(app_state *state)
+{
+	for (auto p : state->box->polygons) {
+		free(p);
+	}
+
+	delete state->box;
+	delete state->skybox;
+
+	for (auto l : state->limbs) {
+		delete l;
+	}
+
+	delete state;
+}
@@ -0,0 +1,13 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "app.h"
+#include "soft-raster.h"
+
+// The scene without a window or GL. Meshes, shaders, textures and render
+// targets are registered with a software device, which must outlive the state.
+// Textures are generated rather than loaded, so nothing has to be found on disk.
+extern app_state *headless_init(SoftDevice *device, unsigned int w, unsigned int h);
+extern void headless_destroy(app_state *state);
+
+#endif
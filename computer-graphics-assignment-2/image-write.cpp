@@ -0,0 +1,440 @@
+#include "image-write.h"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+
+// Deflate with the fixed Huffman codes, so no tables go in the stream. Matches
+// come from 3 byte hash chains over the 32K window.
+static const unsigned int DEFLATE_WINDOW = 32768;
+static const unsigned int DEFLATE_HASH_BITS = 15;
+static const unsigned int DEFLATE_MAX_CHAIN = 16;
+static const unsigned int DEFLATE_MIN_MATCH = 3;
+static const unsigned int DEFLATE_MAX_MATCH = 258;
+
+static const unsigned short LENGTH_BASE[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const unsigned char LENGTH_EXTRA[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const unsigned short DISTANCE_BASE[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const unsigned char DISTANCE_EXTRA[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// Codes are stored bit reversed, since deflate packs Huffman codes from their
+// most significant bit but everything else from the least.
+struct DeflateTables {
+	unsigned short literal_code[288];
+	unsigned char literal_bits[288];
+	unsigned char distance_code[30];
+	unsigned char length_symbol[DEFLATE_MAX_MATCH + 1]; // Index into LENGTH_BASE.
+	unsigned char distance_symbol[512]; // Distances - 1 under 256, then (distance - 1) >> 7.
+	unsigned int crc[256];
+};
+
+static unsigned int reverse_bits(unsigned int code, unsigned int bits)
+{
+	unsigned int reversed = 0;
+	for (unsigned int i = 0; i < bits; i++) {
+		reversed = (reversed << 1) | ((code >> i) & 1);
+	}
+	return reversed;
+}
+
+static DeflateTables make_deflate_tables()
+{
+	DeflateTables t;
+
+	for (unsigned int s = 0; s < 288; s++) {
+		unsigned int code, bits;
+		if (s < 144) {
+			code = 0x30 + s;
+			bits = 8;
+		} else if (s < 256) {
+			code = 0x190 + s - 144;
+			bits = 9;
+		} else if (s < 280) {
+			code = s - 256;
+			bits = 7;
+		} else {
+			code = 0xC0 + s - 280;
+			bits = 8;
+		}
+		t.literal_code[s] = reverse_bits(code, bits);
+		t.literal_bits[s] = bits;
+	}
+
+	for (unsigned int d = 0; d < 30; d++) {
+		t.distance_code[d] = reverse_bits(d, 5);
+	}
+
+	for (unsigned int s = 0; s < 29; s++) {
+		for (unsigned int l = LENGTH_BASE[s]; l < LENGTH_BASE[s] + (1u << LENGTH_EXTRA[s]) && l <= DEFLATE_MAX_MATCH; l++) {
+			t.length_symbol[l] = s;
+		}
+	}
+
+	for (unsigned int s = 0; s < 30; s++) {
+		for (unsigned int d = DISTANCE_BASE[s] - 1; d < DISTANCE_BASE[s] - 1 + (1u << DISTANCE_EXTRA[s]); d++) {
+			t.distance_symbol[d < 256 ? d : 256 + (d >> 7)] = s;
+		}
+	}
+
+	for (unsigned int i = 0; i < 256; i++) {
+		unsigned int c = i;
+		for (unsigned int k = 0; k < 8; k++) {
+			c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+		}
+		t.crc[i] = c;
+	}
+
+	return t;
+}
+
+static const DeflateTables &deflate_tables()
+{
+	static const DeflateTables tables = make_deflate_tables();
+	return tables;
+}
+
+struct BitWriter {
+	std::vector<unsigned char> *out;
+	unsigned long long bits;
+	unsigned int count;
+};
+
+static void put_bits(BitWriter *w, unsigned int value, unsigned int count)
+{
+	w->bits |= (unsigned long long)value << w->count;
+	w->count += count;
+
+	while (w->count >= 8) {
+		w->out->push_back((unsigned char)w->bits);
+		w->bits >>= 8;
+		w->count -= 8;
+	}
+}
+
+static void flush_bits(BitWriter *w)
+{
+	if (w->count) {
+		w->out->push_back((unsigned char)w->bits);
+	}
+	w->bits = 0;
+	w->count = 0;
+}
+
+static void put_literal(BitWriter *w, const DeflateTables &t, unsigned int symbol)
+{
+	put_bits(w, t.literal_code[symbol], t.literal_bits[symbol]);
+}
+
+static void put_match(BitWriter *w, const DeflateTables &t, unsigned int length, unsigned int distance)
+{
+	const unsigned int ls = t.length_symbol[length];
+	put_literal(w, t, 257 + ls);
+	put_bits(w, length - LENGTH_BASE[ls], LENGTH_EXTRA[ls]);
+
+	const unsigned int d = distance - 1;
+	const unsigned int ds = t.distance_symbol[d < 256 ? d : 256 + (d >> 7)];
+	put_bits(w, t.distance_code[ds], 5);
+	put_bits(w, distance - DISTANCE_BASE[ds], DISTANCE_EXTRA[ds]);
+}
+
+static unsigned int hash3(const unsigned char *p)
+{
+	const unsigned int v = p[0] | (p[1] << 8) | (p[2] << 16);
+	return (v * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+static unsigned int adler32(const unsigned char *data, size_t size)
+{
+	unsigned int a = 1, b = 0;
+
+	while (size) {
+		// Largest run before b can overflow.
+		size_t run = size < 5552 ? size : 5552;
+		size -= run;
+
+		while (run--) {
+			a += *data++;
+			b += a;
+		}
+
+		a %= 65521;
+		b %= 65521;
+	}
+
+	return (b << 16) | a;
+}
+
+// zlib stream of one fixed Huffman block.
+static void zlib_compress(const unsigned char *data, size_t size, std::vector<unsigned char> &out)
+{
+	const DeflateTables &t = deflate_tables();
+
+	out.push_back(0x78);
+	out.push_back(0x01);
+
+	BitWriter w = { &out, 0, 0 };
+	put_bits(&w, 1, 1); // Final block.
+	put_bits(&w, 1, 2); // Fixed codes.
+
+	std::vector<int> head(1 << DEFLATE_HASH_BITS, -1);
+	std::vector<int> prev(DEFLATE_WINDOW, -1);
+
+	size_t pos = 0;
+	while (pos < size) {
+		unsigned int best_length = 0, best_distance = 0;
+
+		if (pos + DEFLATE_MIN_MATCH <= size) {
+			const size_t limit = size - pos < DEFLATE_MAX_MATCH ? size - pos : DEFLATE_MAX_MATCH;
+			int candidate = head[hash3(data + pos)];
+
+			for (unsigned int chain = 0; chain < DEFLATE_MAX_CHAIN && candidate >= 0; chain++) {
+				const size_t distance = pos - candidate;
+				if (distance > DEFLATE_WINDOW) {
+					break;
+				}
+
+				unsigned int length = 0;
+				while (length < limit && data[candidate + length] == data[pos + length]) {
+					length++;
+				}
+
+				if (length > best_length) {
+					best_length = length;
+					best_distance = distance;
+					if (length == limit) {
+						break;
+					}
+				}
+
+				// Slots are reused once they leave the window, which breaks the chain.
+				const int next = prev[candidate & (DEFLATE_WINDOW - 1)];
+				if (next >= candidate) {
+					break;
+				}
+				candidate = next;
+			}
+		}
+
+		const size_t advance = best_length >= DEFLATE_MIN_MATCH ? best_length : 1;
+		if (advance > 1) {
+			put_match(&w, t, best_length, best_distance);
+		} else {
+			put_literal(&w, t, data[pos]);
+		}
+
+		for (size_t end = pos + advance; pos < end; pos++) {
+			if (pos + DEFLATE_MIN_MATCH <= size) {
+				const unsigned int h = hash3(data + pos);
+				prev[pos & (DEFLATE_WINDOW - 1)] = head[h];
+				head[h] = (int)pos;
+			}
+		}
+	}
+
+	put_literal(&w, t, 256);
+	flush_bits(&w);
+
+	const unsigned int adler = adler32(data, size);
+	out.push_back(adler >> 24);
+	out.push_back(adler >> 16);
+	out.push_back(adler >> 8);
+	out.push_back(adler);
+}
+
+static void put_u32_be(std::vector<unsigned char> &out, unsigned int v)
+{
+	out.push_back(v >> 24);
+	out.push_back(v >> 16);
+	out.push_back(v >> 8);
+	out.push_back(v);
+}
+
+static void put_u32_le(std::vector<unsigned char> &out, unsigned int v)
+{
+	out.push_back(v);
+	out.push_back(v >> 8);
+	out.push_back(v >> 16);
+	out.push_back(v >> 24);
+}
+
+static void put_png_chunk(std::vector<unsigned char> &out, const char *type, const unsigned char *data, size_t size)
+{
+	const DeflateTables &t = deflate_tables();
+
+	put_u32_be(out, (unsigned int)size);
+	const size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data, data + size);
+
+	unsigned int crc = 0xFFFFFFFFu;
+	for (size_t i = start; i < out.size(); i++) {
+		crc = t.crc[(crc ^ out[i]) & 0xFF] ^ (crc >> 8);
+	}
+	put_u32_be(out, crc ^ 0xFFFFFFFFu);
+}
+
+static unsigned char paeth(int a, int b, int c)
+{
+	const int p = a + b - c;
+	const int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	if (pa <= pb && pa <= pc) {
+		return a;
+	}
+	return pb <= pc ? b : c;
+}
+
+const char *image_format_extension(unsigned int format)
+{
+	return format == IMAGE_PNG ? "png" : "bmp";
+}
+
+void encode_bmp(const unsigned char *pixels, unsigned int w, unsigned int h, std::vector<unsigned char> &out)
+{
+	// Rows are padded to 4 bytes and stored bottom up, like the pixels.
+	const unsigned int row = (w * 3 + 3) & ~3u;
+	const unsigned int header = 14 + 40;
+
+	out.reserve(out.size() + header + row * h);
+
+	out.push_back('B');
+	out.push_back('M');
+	put_u32_le(out, header + row * h);
+	put_u32_le(out, 0);
+	put_u32_le(out, header);
+
+	put_u32_le(out, 40);
+	put_u32_le(out, w);
+	put_u32_le(out, h);
+	out.push_back(1); // Planes.
+	out.push_back(0);
+	out.push_back(24); // Bits per pixel.
+	out.push_back(0);
+	put_u32_le(out, 0); // BI_RGB.
+	put_u32_le(out, row * h);
+	put_u32_le(out, 2835); // 72 dpi.
+	put_u32_le(out, 2835);
+	put_u32_le(out, 0);
+	put_u32_le(out, 0);
+
+	for (unsigned int y = 0; y < h; y++) {
+		const unsigned char *p = pixels + (size_t)y * w * 4;
+		for (unsigned int x = 0; x < w; x++, p += 4) {
+			out.push_back(p[2]);
+			out.push_back(p[1]);
+			out.push_back(p[0]);
+		}
+		for (unsigned int x = w * 3; x < row; x++) {
+			out.push_back(0);
+		}
+	}
+}
+
+void encode_png(const unsigned char *pixels, unsigned int w, unsigned int h, std::vector<unsigned char> &out)
+{
+	const unsigned int stride = w * 3;
+
+	// Each row takes whichever of the none, sub, up and paeth filters leaves
+	// the smallest sum of residuals, the usual heuristic.
+	std::vector<unsigned char> filtered((size_t)(stride + 1) * h);
+	std::vector<unsigned char> row(stride), above(stride, 0);
+	std::vector<unsigned char> candidates[4];
+	for (auto &c : candidates) {
+		c.resize(stride);
+	}
+
+	for (unsigned int y = 0; y < h; y++) {
+		const unsigned char *p = pixels + (size_t)(h - 1 - y) * w * 4;
+		for (unsigned int x = 0; x < w; x++) {
+			row[x * 3 + 0] = p[x * 4 + 0];
+			row[x * 3 + 1] = p[x * 4 + 1];
+			row[x * 3 + 2] = p[x * 4 + 2];
+		}
+
+		unsigned int best = 0;
+		unsigned int best_sum = 0xFFFFFFFFu;
+
+		for (unsigned int f = 0; f < 4; f++) {
+			unsigned int sum = 0;
+			for (unsigned int i = 0; i < stride; i++) {
+				const int a = i >= 3 ? row[i - 3] : 0;
+				const int b = above[i];
+				const int c = i >= 3 ? above[i - 3] : 0;
+
+				unsigned char predicted = 0;
+				if (f == 1) {
+					predicted = a;
+				} else if (f == 2) {
+					predicted = b;
+				} else if (f == 3) {
+					predicted = paeth(a, b, c);
+				}
+
+				const unsigned char r = row[i] - predicted;
+				candidates[f][i] = r;
+				sum += r < 128 ? r : 256 - r;
+			}
+
+			if (sum < best_sum) {
+				best_sum = sum;
+				best = f;
+			}
+		}
+
+		unsigned char *dest = filtered.data() + (size_t)y * (stride + 1);
+		dest[0] = best == 3 ? 4 : best; // Paeth is filter type 4.
+		std::copy(candidates[best].begin(), candidates[best].end(), dest + 1);
+
+		row.swap(above);
+	}
+
+	static const unsigned char SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	out.insert(out.end(), SIGNATURE, SIGNATURE + 8);
+
+	std::vector<unsigned char> ihdr;
+	put_u32_be(ihdr, w);
+	put_u32_be(ihdr, h);
+	ihdr.push_back(8); // Bit depth.
+	ihdr.push_back(2); // RGB.
+	ihdr.push_back(0);
+	ihdr.push_back(0);
+	ihdr.push_back(0);
+	put_png_chunk(out, "IHDR", ihdr.data(), ihdr.size());
+
+	std::vector<unsigned char> idat;
+	zlib_compress(filtered.data(), filtered.size(), idat);
+	put_png_chunk(out, "IDAT", idat.data(), idat.size());
+
+	put_png_chunk(out, "IEND", 0, 0);
+}
+
+void encode_image(unsigned int format, const unsigned char *pixels, unsigned int w, unsigned int h, std::vector<unsigned char> &out)
+{
+	if (format == IMAGE_PNG) {
+		encode_png(pixels, w, h, out);
+	} else {
+		encode_bmp(pixels, w, h, out);
+	}
+}
+
+bool write_file(const char *filename, const std::vector<unsigned char> &data)
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	file.write((const char *)data.data(), data.size());
+	return (bool)file;
+}
@@ -0,0 +1,23 @@
+#ifndef IMAGE_WRITE_H
+#define IMAGE_WRITE_H
+
+#include <vector>
+
+// Encoders for saving frames. Pixels are RGBA8 with the bottom row first, as
+// read back from GL. Alpha is dropped, both formats store RGB.
+
+enum ImageFormat {
+	IMAGE_BMP,
+	IMAGE_PNG,
+};
+
+extern const char *image_format_extension(unsigned int format);
+
+// Appends the encoded file to out.
+extern void encode_bmp(const unsigned char *pixels, unsigned int w, unsigned int h, std::vector<unsigned char> &out);
+extern void encode_png(const unsigned char *pixels, unsigned int w, unsigned int h, std::vector<unsigned char> &out);
+extern void encode_image(unsigned int format, const unsigned char *pixels, unsigned int w, unsigned int h, std::vector<unsigned char> &out);
+
+extern bool write_file(const char *filename, const std::vector<unsigned char> &data);
+
+#endif
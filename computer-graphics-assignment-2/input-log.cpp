@@ -0,0 +1,283 @@
+#include "input-log.h"
+
+#include <string.h>
+#include <fstream>
+#include <vector>
+
+static const unsigned int INPUT_LOG_HEADER_BYTES = 24;
+static const unsigned int INPUT_LOG_FLUSH_BYTES = 4096; // Buffered before writing.
+
+// Header flags.
+static const unsigned int INPUT_LOG_ENDED = 1 << 0; // Frame count and checksum are valid.
+
+// Record flags, fields follow in this order.
+enum InputLogField {
+	INPUT_DT = 1 << 0, // float
+	INPUT_WINDOW = 1 << 1, // u32 w, u32 h
+	INPUT_MOUSE = 1 << 2, // u32 x, u32 y
+	INPUT_BUTTONS = 1 << 3, // u32, see button_mask
+	INPUT_RESIZE = 1 << 4, // No field, window_info.resize is set.
+};
+
+static const unsigned int KEY_COUNT = sizeof(app_keyboard_input::buttons) / sizeof(app_button_state);
+static const unsigned int MOUSE_BUTTON_COUNT = sizeof(app_mouse_input::buttons) / sizeof(app_button_state);
+static_assert(2 * (KEY_COUNT + MOUSE_BUTTON_COUNT) <= 32, "buttons must fit one mask");
+
+// The frame as it is compared between records.
+struct InputLogFrame {
+	unsigned int dt; // Bits of the float, so changes are exact.
+	unsigned int w, h;
+	unsigned int x, y;
+	unsigned int buttons;
+};
+
+struct InputRecorder {
+	std::ofstream file;
+	std::vector<unsigned char> buffer;
+	InputLogFrame last;
+	unsigned int frames;
+};
+
+struct InputReplay {
+	std::vector<unsigned char> data;
+	unsigned int cursor;
+	unsigned int frames; // 0 when the recording wasn't ended.
+	unsigned int flags;
+	unsigned long long checksum;
+	InputLogFrame last;
+};
+
+static void put_u32(std::vector<unsigned char> &out, unsigned int v)
+{
+	for (unsigned int i = 0; i < 4; i++) {
+		out.push_back((unsigned char)(v >> (8 * i)));
+	}
+}
+
+static unsigned int get_u32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// Ended and started state of every key, then of the mouse buttons. started_down
+// is recorded rather than derived, so replay doesn't depend on how the
+// platform layer fills it in.
+static unsigned int button_mask(const app_input *input)
+{
+	unsigned int mask = 0, bit = 0;
+
+	for (auto &b : input->keyboard.buttons) {
+		mask |= (b.ended_down ? 1u : 0u) << bit++;
+		mask |= (b.started_down ? 1u : 0u) << bit++;
+	}
+	for (auto &b : input->mouse.buttons) {
+		mask |= (b.ended_down ? 1u : 0u) << bit++;
+		mask |= (b.started_down ? 1u : 0u) << bit++;
+	}
+
+	return mask;
+}
+
+static void unpack_buttons(unsigned int mask, app_input *input)
+{
+	unsigned int bit = 0;
+
+	for (auto &b : input->keyboard.buttons) {
+		b.ended_down = (mask >> bit++) & 1;
+		b.started_down = (mask >> bit++) & 1;
+	}
+	for (auto &b : input->mouse.buttons) {
+		b.ended_down = (mask >> bit++) & 1;
+		b.started_down = (mask >> bit++) & 1;
+	}
+}
+
+static void write_header(std::vector<unsigned char> &out, unsigned int frames, unsigned int flags, unsigned long long checksum)
+{
+	put_u32(out, INPUT_LOG_MAGIC);
+	put_u32(out, INPUT_LOG_VERSION);
+	put_u32(out, frames);
+	put_u32(out, flags);
+	put_u32(out, (unsigned int)checksum);
+	put_u32(out, (unsigned int)(checksum >> 32));
+}
+
+InputRecorder *input_record_begin(const char *filename)
+{
+	InputRecorder *r = new InputRecorder;
+	r->file.open(filename, std::ios::binary);
+	if (!r->file) {
+		delete r;
+		return 0;
+	}
+
+	// Patched by input_record_end.
+	write_header(r->buffer, 0, 0, 0);
+
+	// Every field differs from this, so the first record holds all of them.
+	memset(&r->last, 0xFF, sizeof(r->last));
+	r->frames = 0;
+
+	return r;
+}
+
+void input_record_frame(InputRecorder *r, float dt, const app_input *input, const app_window_info *window_info)
+{
+	InputLogFrame f;
+	memcpy(&f.dt, &dt, sizeof(f.dt));
+	f.w = window_info->w;
+	f.h = window_info->h;
+	f.x = input->mouse.pos.x;
+	f.y = input->mouse.pos.y;
+	f.buttons = button_mask(input);
+
+	unsigned char flags = 0;
+	if (f.dt != r->last.dt) flags |= INPUT_DT;
+	if (f.w != r->last.w || f.h != r->last.h) flags |= INPUT_WINDOW;
+	if (f.x != r->last.x || f.y != r->last.y) flags |= INPUT_MOUSE;
+	if (f.buttons != r->last.buttons) flags |= INPUT_BUTTONS;
+	if (window_info->resize) flags |= INPUT_RESIZE;
+
+	std::vector<unsigned char> &out = r->buffer;
+	out.push_back(flags);
+	if (flags & INPUT_DT) {
+		put_u32(out, f.dt);
+	}
+	if (flags & INPUT_WINDOW) {
+		put_u32(out, f.w);
+		put_u32(out, f.h);
+	}
+	if (flags & INPUT_MOUSE) {
+		put_u32(out, f.x);
+		put_u32(out, f.y);
+	}
+	if (flags & INPUT_BUTTONS) {
+		put_u32(out, f.buttons);
+	}
+
+	r->last = f;
+	r->frames++;
+
+	if (out.size() >= INPUT_LOG_FLUSH_BYTES) {
+		r->file.write((const char *)out.data(), out.size());
+		out.clear();
+	}
+}
+
+bool input_record_end(InputRecorder *r, unsigned long long checksum)
+{
+	r->file.write((const char *)r->buffer.data(), r->buffer.size());
+
+	std::vector<unsigned char> header;
+	write_header(header, r->frames, INPUT_LOG_ENDED, checksum);
+	r->file.seekp(0);
+	r->file.write((const char *)header.data(), header.size());
+
+	const bool written = (bool)r->file;
+	r->file.close();
+
+	delete r;
+	return written;
+}
+
+InputReplay *input_replay_open(const char *filename)
+{
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file) {
+		return 0;
+	}
+
+	const std::streamoff size = file.tellg();
+	if (size < INPUT_LOG_HEADER_BYTES) {
+		return 0;
+	}
+
+	InputReplay *r = new InputReplay;
+	r->data.resize((size_t)size);
+	file.seekg(0);
+	file.read((char *)r->data.data(), size);
+
+	const unsigned char *p = r->data.data();
+	if (!file || get_u32(p) != INPUT_LOG_MAGIC || get_u32(p + 4) != INPUT_LOG_VERSION) {
+		delete r;
+		return 0;
+	}
+
+	r->frames = get_u32(p + 8);
+	r->flags = get_u32(p + 12);
+	r->checksum = get_u32(p + 16) | ((unsigned long long)get_u32(p + 20) << 32);
+	r->cursor = INPUT_LOG_HEADER_BYTES;
+	r->last = {};
+
+	return r;
+}
+
+unsigned int input_replay_frames(const InputReplay *r)
+{
+	return r->frames;
+}
+
+bool input_replay_checksum(const InputReplay *r, unsigned long long *checksum)
+{
+	*checksum = r->checksum;
+	return (r->flags & INPUT_LOG_ENDED) != 0;
+}
+
+bool input_replay_next(InputReplay *r, float *dt, app_input *input, app_window_info *window_info)
+{
+	const unsigned int size = r->data.size();
+	if (r->cursor >= size) {
+		return false;
+	}
+
+	const unsigned char *p = r->data.data();
+	const unsigned char flags = p[r->cursor];
+
+	const unsigned int words = !!(flags & INPUT_DT) + 2 * !!(flags & INPUT_WINDOW) + 2 * !!(flags & INPUT_MOUSE) + !!(flags & INPUT_BUTTONS);
+	if (r->cursor + 1 + 4 * words > size) {
+		return false;
+	}
+
+	unsigned int at = r->cursor + 1;
+	InputLogFrame f = r->last;
+	if (flags & INPUT_DT) {
+		f.dt = get_u32(p + at);
+		at += 4;
+	}
+	if (flags & INPUT_WINDOW) {
+		f.w = get_u32(p + at);
+		f.h = get_u32(p + at + 4);
+		at += 8;
+	}
+	if (flags & INPUT_MOUSE) {
+		f.x = get_u32(p + at);
+		f.y = get_u32(p + at + 4);
+		at += 8;
+	}
+	if (flags & INPUT_BUTTONS) {
+		f.buttons = get_u32(p + at);
+		at += 4;
+	}
+
+	r->cursor = at;
+	r->last = f;
+
+	memcpy(dt, &f.dt, sizeof(*dt));
+
+	*input = {};
+	input->mouse.pos.x = f.x;
+	input->mouse.pos.y = f.y;
+	unpack_buttons(f.buttons, input);
+
+	window_info->w = f.w;
+	window_info->h = f.h;
+	window_info->resize = (flags & INPUT_RESIZE) != 0;
+	window_info->running = true;
+
+	return true;
+}
+
+void input_replay_close(InputReplay *r)
+{
+	delete r;
+}
@@ -0,0 +1,42 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+#include "app.h"
+
+// Records the input and dt given to app_update_and_render each frame, and
+// plays them back. update and handle_input depend only on these and the app
+// state, so replaying a log reproduces the session exactly, which makes a
+// captured editing session usable as a benchmark.
+//
+// A log is a header followed by one record per frame. A record is a byte of
+// flags saying which fields changed since the previous frame, then only those
+// fields, so a frame where nothing changed takes a single byte. Values are
+// little endian.
+
+static const unsigned int INPUT_LOG_MAGIC = 0x4C504E49; // "INPL"
+static const unsigned int INPUT_LOG_VERSION = 2;
+
+struct InputRecorder;
+struct InputReplay;
+
+// Null if the file can't be created.
+extern InputRecorder *input_record_begin(const char *filename);
+extern void input_record_frame(InputRecorder *recorder, float dt, const app_input *input, const app_window_info *window_info);
+
+// Stores the frame count and a checksum of the state the session ended in,
+// see scene_checksum, then closes the log. Returns false if writing failed.
+extern bool input_record_end(InputRecorder *recorder, unsigned long long checksum);
+
+// Reads the whole log. Null if it can't be read or isn't an input log.
+extern InputReplay *input_replay_open(const char *filename);
+extern unsigned int input_replay_frames(const InputReplay *replay);
+
+// Checksum stored by the recording, false when it wasn't ended cleanly.
+extern bool input_replay_checksum(const InputReplay *replay, unsigned long long *checksum);
+
+// The next frame's input. Returns false after the last frame or at a
+// truncated record.
+extern bool input_replay_next(InputReplay *replay, float *dt, app_input *input, app_window_info *window_info);
+extern void input_replay_close(InputReplay *replay);
+
+#endif
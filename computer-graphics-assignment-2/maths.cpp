@@ -1,5 +1,10 @@
 #include "maths.h"
 
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define MATHS_SSE
+#include <emmintrin.h>
+#endif
+
 V3& operator+=(V3 &v, V3 w)
 {
     v.x += w.x;
@@ -113,6 +118,11 @@ float radians(const float degrees)
 	return degrees * (float)(M_PI / 180.0);
 }
 
+float lerp(float v0, float v1, float t)
+{
+	return (1 - t) * v0 + t * v1;
+}
+
 V3 v3_normalise(V3 v)
 {
 	float magnitude = sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
@@ -171,6 +181,17 @@ void mat4_multiply(float* result, const float* lhs, const float* rhs)
 	}
 }
 
+V4 mat4_transform(const float* matrix, V4 v)
+{
+	V4 result;
+
+	for (unsigned int i = 0; i < 4; ++i) {
+		result.E[i] = matrix[i] * v.x + matrix[i + 4] * v.y + matrix[i + 8] * v.z + matrix[i + 12] * v.w;
+	}
+
+	return result;
+}
+
 void mat4_translate(float* matrix, const float tx, const float ty, const float tz)
 {
 	matrix[12] += (matrix[0] * tx) + (matrix[4] * ty) + (matrix[8]  * tz);
@@ -290,4 +311,402 @@ void mat4_look_at(float* matrix, V3 eye, V3 centre, V3 up)
 	matrix[12] = -v3_dot(S, eye);
 	matrix[13] = -v3_dot(U, eye);
 	matrix[14] = v3_dot(F, eye);
-}
\ No newline at end of file
+}
+
+void affine_identity(float* affine)
+{
+	for (unsigned int i = 0; i < 12; i++) {
+		affine[i] = (i % 5 == 0) ? 1.f : 0.f;
+	}
+}
+
+#ifdef MATHS_SSE
+
+// Sine and cosine of four angles in degrees. The angle is reduced to within 45
+// degrees of a multiple of 90 before converting to radians, so the reduction
+// is exact and the polynomials only need to cover +-pi/4.
+static inline void sincos_degrees4(__m128 degrees, __m128 *sin_out, __m128 *cos_out)
+{
+	const __m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(degrees, _mm_set1_ps(1.f / 90.f)));
+	const __m128 remainder = _mm_sub_ps(degrees, _mm_mul_ps(_mm_cvtepi32_ps(quadrant), _mm_set1_ps(90.f)));
+
+	const __m128 x = _mm_mul_ps(remainder, _mm_set1_ps((float)(M_PI / 180.0)));
+	const __m128 x2 = _mm_mul_ps(x, x);
+
+	// Minimax polynomials, as in the Cephes sinf and cosf.
+	__m128 s = _mm_add_ps(_mm_set1_ps(8.3321608736e-3f), _mm_mul_ps(x2, _mm_set1_ps(-1.9515295891e-4f)));
+	s = _mm_add_ps(_mm_set1_ps(-1.6666654611e-1f), _mm_mul_ps(x2, s));
+	s = _mm_add_ps(x, _mm_mul_ps(_mm_mul_ps(x, x2), s));
+
+	__m128 c = _mm_add_ps(_mm_set1_ps(-1.388731625493765e-3f), _mm_mul_ps(x2, _mm_set1_ps(2.443315711809948e-5f)));
+	c = _mm_add_ps(_mm_set1_ps(4.166664568298827e-2f), _mm_mul_ps(x2, c));
+	c = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.f), _mm_mul_ps(x2, _mm_set1_ps(0.5f))), _mm_mul_ps(_mm_mul_ps(x2, x2), c));
+
+	// Odd quadrants swap the two, and each is negated in two of the four.
+	const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+	const __m128 sin_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(2)), 30));
+	const __m128 cos_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+
+	*sin_out = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s)), sin_sign);
+	*cos_out = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c)), cos_sign);
+}
+
+// Each row is one register. A result row is the lhs row's weights times the
+// rhs rows, plus the lhs translation. Both inputs are loaded before the
+// stores, so result may be either.
+static inline void affine_product_rows(float* result, const float* lhs, __m128 r0, __m128 r1, __m128 r2)
+{
+	const __m128 w_mask = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+
+	__m128 out[3];
+	for (unsigned int i = 0; i < 3; ++i) {
+		const __m128 l = _mm_loadu_ps(lhs + 4 * i);
+		__m128 row = _mm_and_ps(l, w_mask);
+		row = _mm_add_ps(row, _mm_mul_ps(_mm_shuffle_ps(l, l, _MM_SHUFFLE(0, 0, 0, 0)), r0));
+		row = _mm_add_ps(row, _mm_mul_ps(_mm_shuffle_ps(l, l, _MM_SHUFFLE(1, 1, 1, 1)), r1));
+		row = _mm_add_ps(row, _mm_mul_ps(_mm_shuffle_ps(l, l, _MM_SHUFFLE(2, 2, 2, 2)), r2));
+		out[i] = row;
+	}
+
+	for (unsigned int i = 0; i < 3; ++i) {
+		_mm_storeu_ps(result + 4 * i, out[i]);
+	}
+}
+
+void affine_multiply(float* result, const float* lhs, const float* rhs)
+{
+	affine_product_rows(result, lhs, _mm_loadu_ps(rhs), _mm_loadu_ps(rhs + 4), _mm_loadu_ps(rhs + 8));
+}
+
+#else
+
+static inline void affine_product_rows(float* result, const float* lhs, const float* r)
+{
+	float out[12];
+	for (unsigned int i = 0; i < 3; ++i) {
+		const float* l = lhs + 4 * i;
+		for (unsigned int j = 0; j < 4; ++j) {
+			out[4 * i + j] = l[0] * r[j] + l[1] * r[4 + j] + l[2] * r[8 + j];
+		}
+		out[4 * i + 3] += l[3];
+	}
+
+	for (unsigned int i = 0; i < 12; ++i) {
+		result[i] = out[i];
+	}
+}
+
+void affine_multiply(float* result, const float* lhs, const float* rhs)
+{
+	affine_product_rows(result, lhs, rhs);
+}
+
+#endif
+
+void affine_compose_tr(float* result, const float* parent, V3 translation, V3 degrees)
+{
+#ifdef MATHS_SSE
+	// All three angles at once.
+	__m128 sines, cosines;
+	sincos_degrees4(_mm_setr_ps(degrees.x, degrees.y, degrees.z, 0.f), &sines, &cosines);
+
+	float sin_xyz[4], cos_xyz[4];
+	_mm_storeu_ps(sin_xyz, sines);
+	_mm_storeu_ps(cos_xyz, cosines);
+
+	const float sx = sin_xyz[0], cx = cos_xyz[0];
+	const float sy = sin_xyz[1], cy = cos_xyz[1];
+	const float sz = sin_xyz[2], cz = cos_xyz[2];
+#else
+	const float rx = radians(degrees.x), ry = radians(degrees.y), rz = radians(degrees.z);
+	const float sx = sinf(rx), cx = cosf(rx);
+	const float sy = sinf(ry), cy = cosf(ry);
+	const float sz = sinf(rz), cz = cosf(rz);
+#endif
+
+	// Rows of translate * rotate_z * rotate_y * rotate_x.
+#ifdef MATHS_SSE
+	affine_product_rows(result, parent,
+		_mm_setr_ps(cz * cy, cz * sy * sx - sz * cx, cz * sy * cx + sz * sx, translation.x),
+		_mm_setr_ps(sz * cy, sz * sy * sx + cz * cx, sz * sy * cx - cz * sx, translation.y),
+		_mm_setr_ps(-sy, cy * sx, cy * cx, translation.z));
+#else
+	const float local[12] = {
+		cz * cy, cz * sy * sx - sz * cx, cz * sy * cx + sz * sx, translation.x,
+		sz * cy, sz * sy * sx + cz * cx, sz * sy * cx - cz * sx, translation.y,
+		-sy, cy * sx, cy * cx, translation.z
+	};
+	affine_product_rows(result, parent, local);
+#endif
+}
+
+void mat4_from_affine_scaled(float* matrix, const float* affine, V3 scale)
+{
+#ifdef MATHS_SSE
+	const __m128 s = _mm_setr_ps(scale.x, scale.y, scale.z, 1.f);
+	__m128 r0 = _mm_mul_ps(_mm_loadu_ps(affine), s);
+	__m128 r1 = _mm_mul_ps(_mm_loadu_ps(affine + 4), s);
+	__m128 r2 = _mm_mul_ps(_mm_loadu_ps(affine + 8), s);
+	__m128 r3 = _mm_setr_ps(0.f, 0.f, 0.f, 1.f);
+
+	// Rows become the columns of the column-major matrix.
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	_mm_storeu_ps(matrix, r0);
+	_mm_storeu_ps(matrix + 4, r1);
+	_mm_storeu_ps(matrix + 8, r2);
+	_mm_storeu_ps(matrix + 12, r3);
+#else
+	for (unsigned int j = 0; j < 3; ++j) {
+		matrix[j * 4]     = affine[j] * scale.E[j];
+		matrix[j * 4 + 1] = affine[4 + j] * scale.E[j];
+		matrix[j * 4 + 2] = affine[8 + j] * scale.E[j];
+		matrix[j * 4 + 3] = 0.f;
+	}
+
+	matrix[12] = affine[3];
+	matrix[13] = affine[7];
+	matrix[14] = affine[11];
+	matrix[15] = 1.f;
+#endif
+}
+
+Quat quat_identity()
+{
+	return { 0.f, 0.f, 0.f, 1.f };
+}
+
+Quat quat_from_euler(V3 degrees)
+{
+	const float hx = radians(degrees.x) * 0.5f;
+	const float hy = radians(degrees.y) * 0.5f;
+	const float hz = radians(degrees.z) * 0.5f;
+
+	const Quat qx = { sinf(hx), 0.f, 0.f, cosf(hx) };
+	const Quat qy = { 0.f, sinf(hy), 0.f, cosf(hy) };
+	const Quat qz = { 0.f, 0.f, sinf(hz), cosf(hz) };
+
+	return quat_multiply(quat_multiply(qz, qy), qx);
+}
+
+V3 quat_to_euler(Quat q)
+{
+	const float r00 = 1.f - 2.f * (q.y * q.y + q.z * q.z);
+	const float r01 = 2.f * (q.x * q.y - q.w * q.z);
+	const float r02 = 2.f * (q.x * q.z + q.w * q.y);
+	const float r10 = 2.f * (q.x * q.y + q.w * q.z);
+	const float r11 = 1.f - 2.f * (q.x * q.x + q.z * q.z);
+	const float r12 = 2.f * (q.y * q.z - q.w * q.x);
+	const float r20 = 2.f * (q.x * q.z - q.w * q.y);
+	const float r21 = 2.f * (q.y * q.z + q.w * q.x);
+	const float r22 = 1.f - 2.f * (q.x * q.x + q.y * q.y);
+
+	const float to_degrees = (float)(180.0 / M_PI);
+
+	// Close to y = +-90 x and z each become ill-conditioned, so z is found
+	// from the matrix with x's rotation taken back off, which cancels whatever
+	// error x has. At exactly +-90 this leaves x at 0.
+	const float x = atan2f(r21, r22);
+	const float sx = sinf(x), cx = cosf(x);
+
+	return {
+		x * to_degrees,
+		atan2f(-r20, sqrtf(r00 * r00 + r10 * r10)) * to_degrees,
+		atan2f(sx * r02 - cx * r01, cx * r11 - sx * r12) * to_degrees
+	};
+}
+
+Quat quat_multiply(Quat a, Quat b)
+{
+	return {
+		a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+		a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+		a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+		a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+	};
+}
+
+Quat quat_conjugate(Quat q)
+{
+	return { -q.x, -q.y, -q.z, q.w };
+}
+
+float quat_dot(Quat a, Quat b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+
+Quat quat_normalise(Quat q)
+{
+	const float magnitude = sqrtf(quat_dot(q, q));
+	return {
+		q.x / magnitude,
+		q.y / magnitude,
+		q.z / magnitude,
+		q.w / magnitude
+	};
+}
+
+// q and -q are the same rotation, b is flipped to take the shorter way round.
+Quat quat_nlerp(Quat a, Quat b, float t)
+{
+	const float sign = quat_dot(a, b) < 0.f ? -1.f : 1.f;
+
+	return quat_normalise({
+		lerp(a.x, sign * b.x, t),
+		lerp(a.y, sign * b.y, t),
+		lerp(a.z, sign * b.z, t),
+		lerp(a.w, sign * b.w, t)
+	});
+}
+
+Quat quat_slerp(Quat a, Quat b, float t)
+{
+	float d = quat_dot(a, b);
+	float sign = 1.f;
+	if (d < 0.f) {
+		d = -d;
+		sign = -1.f;
+	}
+
+	// Nearly parallel, sin(theta) is too small to divide by.
+	if (d > 0.9995f) {
+		return quat_nlerp(a, b, t);
+	}
+
+	const float theta = acosf(d);
+	const float s = sinf(theta);
+	const float wa = sinf((1.f - t) * theta) / s;
+	const float wb = sign * sinf(t * theta) / s;
+
+	return {
+		wa * a.x + wb * b.x,
+		wa * a.y + wb * b.y,
+		wa * a.z + wb * b.z,
+		wa * a.w + wb * b.w
+	};
+}
+
+// nlerp moves fastest halfway between the keys. This bends t back towards
+// constant angular speed, fitted over the cosine d of the angle between them.
+static inline float slerp_corrected_t(float t, float d)
+{
+	const float A = 1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+	const float B = 0.848013f + d * (-1.06021f + d * 0.215638f);
+	const float k = A * (t - 0.5f) * (t - 0.5f) + B;
+	return t + t * (t - 0.5f) * (t - 1.f) * k;
+}
+
+#ifdef MATHS_SSE
+
+// Four pairs at once. Loads transpose to one register per component, so the
+// dot products don't need horizontal adds. ts, if given, has a t per pair.
+template <bool SLERP>
+static unsigned int quat_interpolate4(Quat *out, const Quat *a, const Quat *b, float t, const float *ts, unsigned int count)
+{
+	const __m128 sign_bit = _mm_set1_ps(-0.f);
+	const __m128 half = _mm_set1_ps(0.5f), one = _mm_set1_ps(1.f);
+
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 ax = _mm_loadu_ps(a[i].E), ay = _mm_loadu_ps(a[i + 1].E), az = _mm_loadu_ps(a[i + 2].E), aw = _mm_loadu_ps(a[i + 3].E);
+		__m128 bx = _mm_loadu_ps(b[i].E), by = _mm_loadu_ps(b[i + 1].E), bz = _mm_loadu_ps(b[i + 2].E), bw = _mm_loadu_ps(b[i + 3].E);
+		_MM_TRANSPOSE4_PS(ax, ay, az, aw);
+		_MM_TRANSPOSE4_PS(bx, by, bz, bw);
+
+		const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+		const __m128 flip = _mm_and_ps(d, sign_bit);
+		bx = _mm_xor_ps(bx, flip);
+		by = _mm_xor_ps(by, flip);
+		bz = _mm_xor_ps(bz, flip);
+		bw = _mm_xor_ps(bw, flip);
+
+		const __m128 t4 = ts ? _mm_loadu_ps(ts + i) : _mm_set1_ps(t);
+		__m128 tt = t4;
+		if (SLERP) {
+			const __m128 ad = _mm_andnot_ps(sign_bit, d);
+			const __m128 A = _mm_add_ps(_mm_set1_ps(1.0904f), _mm_mul_ps(ad, _mm_add_ps(_mm_set1_ps(-3.2452f),
+				_mm_mul_ps(ad, _mm_sub_ps(_mm_set1_ps(3.55645f), _mm_mul_ps(ad, _mm_set1_ps(1.43519f)))))));
+			const __m128 B = _mm_add_ps(_mm_set1_ps(0.848013f), _mm_mul_ps(ad, _mm_add_ps(_mm_set1_ps(-1.06021f), _mm_mul_ps(ad, _mm_set1_ps(0.215638f)))));
+			const __m128 h = _mm_sub_ps(t4, half);
+			const __m128 k = _mm_add_ps(_mm_mul_ps(A, _mm_mul_ps(h, h)), B);
+			tt = _mm_add_ps(t4, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t4, h), _mm_sub_ps(t4, one)), k));
+		}
+
+		__m128 x = _mm_add_ps(ax, _mm_mul_ps(_mm_sub_ps(bx, ax), tt));
+		__m128 y = _mm_add_ps(ay, _mm_mul_ps(_mm_sub_ps(by, ay), tt));
+		__m128 z = _mm_add_ps(az, _mm_mul_ps(_mm_sub_ps(bz, az), tt));
+		__m128 w = _mm_add_ps(aw, _mm_mul_ps(_mm_sub_ps(bw, aw), tt));
+
+		const __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w))));
+		x = _mm_div_ps(x, length);
+		y = _mm_div_ps(y, length);
+		z = _mm_div_ps(z, length);
+		w = _mm_div_ps(w, length);
+
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		_mm_storeu_ps(out[i].E, x);
+		_mm_storeu_ps(out[i + 1].E, y);
+		_mm_storeu_ps(out[i + 2].E, z);
+		_mm_storeu_ps(out[i + 3].E, w);
+	}
+
+	return i;
+}
+
+#endif
+
+void quat_nlerp_batch(Quat *out, const Quat *a, const Quat *b, float t, unsigned int count)
+{
+	unsigned int i = 0;
+#ifdef MATHS_SSE
+	i = quat_interpolate4<false>(out, a, b, t, 0, count);
+#endif
+	for (; i < count; i++) {
+		out[i] = quat_nlerp(a[i], b[i], t);
+	}
+}
+
+void quat_slerp_batch(Quat *out, const Quat *a, const Quat *b, float t, unsigned int count)
+{
+	unsigned int i = 0;
+#ifdef MATHS_SSE
+	i = quat_interpolate4<true>(out, a, b, t, 0, count);
+#endif
+	for (; i < count; i++) {
+		out[i] = quat_nlerp(a[i], b[i], slerp_corrected_t(t, fabsf(quat_dot(a[i], b[i]))));
+	}
+}
+
+void quat_slerp_batch_each(Quat *out, const Quat *a, const Quat *b, const float *t, unsigned int count)
+{
+	unsigned int i = 0;
+#ifdef MATHS_SSE
+	i = quat_interpolate4<true>(out, a, b, 0.f, t, count);
+#endif
+	for (; i < count; i++) {
+		out[i] = quat_nlerp(a[i], b[i], slerp_corrected_t(t[i], fabsf(quat_dot(a[i], b[i]))));
+	}
+}
+
+void mat4_rotate_quat(float* matrix, Quat q)
+{
+	const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+	// Columns of the rotation.
+	const float r[3][3] = {
+		{ 1.f - 2.f * (yy + zz), 2.f * (xy + wz), 2.f * (xz - wy) },
+		{ 2.f * (xy - wz), 1.f - 2.f * (xx + zz), 2.f * (yz + wx) },
+		{ 2.f * (xz + wy), 2.f * (yz - wx), 1.f - 2.f * (xx + yy) }
+	};
+
+	for (unsigned int i = 0; i < 4; ++i) {
+		const float a = matrix[i];
+		const float b = matrix[i + 4];
+		const float c = matrix[i + 8];
+		matrix[i]     = a * r[0][0] + b * r[0][1] + c * r[0][2];
+		matrix[i + 4] = a * r[1][0] + b * r[1][1] + c * r[1][2];
+		matrix[i + 8] = a * r[2][0] + b * r[2][1] + c * r[2][2];
+	}
+}
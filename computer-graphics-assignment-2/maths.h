@@ -3,7 +3,9 @@
 
 #include <math.h>
 
+#ifndef M_PI
 #define M_PI 3.14159265359
+#endif
 
 struct V4 {
 	union {
@@ -32,6 +34,16 @@ struct V2 {
 	};
 };
 
+// Unit quaternion, w is the scalar part.
+struct Quat {
+	union {
+		float E[4];
+		struct {
+			float x, y, z, w;
+		};
+	};
+};
+
 // Vector functions.
 extern V3& operator+=(V3 &v, V3 w);
 extern V3 &operator+=(V3 &v, float w);
@@ -49,6 +61,7 @@ extern V2 operator*(const V2 &v, const float& a);
 extern V2 operator*(const float& a, const V2 &v);
 
 extern float radians(const float degrees);
+extern float lerp(float v0, float v1, float t);
 
 extern V3 v3_normalise(V3 v);
 extern float v3_dot(V3 a, V3 b);
@@ -59,6 +72,7 @@ extern V3 v4_to_v3(V4 v);
 // Matrix functions.
 extern void mat4_copy(float* dest, float* src);
 extern void mat4_multiply(float* result, const float* lhs, const float* rhs);
+extern V4 mat4_transform(const float* matrix, V4 v);
 extern void mat4_translate(float* matrix, const float tx, const float ty, const float tz);
 extern void mat4_remove_translation(float* matrix);
 extern void mat4_scale(float* matrix, const float sx, const float sy, const float sz);
@@ -69,4 +83,41 @@ extern void mat4_identity(float* matrix);
 extern void mat4_ortho(float* matrix, float left, float right, float bottom, float top, float near, float far);
 extern void mat4_frustrum(float* matrix, float left, float right, float bottom, float top, float near, float far);
 extern void mat4_look_at(float* matrix, V3 eye, V3 centre, V3 up);
+
+// Affine functions. An affine transform is the top three rows of a 4x4 whose
+// last row is 0 0 0 1, stored row by row as 12 floats so a row fits one SSE
+// register. Unlike the 4x4 matrices it is not column-major.
+extern void affine_identity(float* affine);
+extern void affine_multiply(float* result, const float* lhs, const float* rhs);
+
+// result = parent * translate * rotate_z * rotate_y * rotate_x, with the
+// local transform built directly rather than by successive multiplies.
+extern void affine_compose_tr(float* result, const float* parent, V3 translation, V3 degrees);
+
+// The 4x4 of affine * scale.
+extern void mat4_from_affine_scaled(float* matrix, const float* affine, V3 scale);
+
+// Quaternion functions. quat_from_euler matches a Node's rotation, applied as
+// mat4_rotate_z, then mat4_rotate_y, then mat4_rotate_x. quat_to_euler gives
+// the angles back with y within +-90 degrees.
+extern Quat quat_identity();
+extern Quat quat_from_euler(V3 degrees);
+extern V3 quat_to_euler(Quat q);
+extern Quat quat_multiply(Quat a, Quat b);
+extern Quat quat_conjugate(Quat q);
+extern float quat_dot(Quat a, Quat b);
+extern Quat quat_normalise(Quat q);
+extern Quat quat_nlerp(Quat a, Quat b, float t);
+extern Quat quat_slerp(Quat a, Quat b, float t);
+
+// Interpolate count pairs with the same t, four at a time where SSE is
+// available. The batch slerp corrects t per pair and then nlerps, which stays
+// within 0.002 radians of quat_slerp without calling acos or sin.
+extern void quat_nlerp_batch(Quat *out, const Quat *a, const Quat *b, float t, unsigned int count);
+extern void quat_slerp_batch(Quat *out, const Quat *a, const Quat *b, float t, unsigned int count);
+// quat_slerp_batch with a t per pair.
+extern void quat_slerp_batch_each(Quat *out, const Quat *a, const Quat *b, const float *t, unsigned int count);
+
+// Multiplies the matrix by the rotation, q must be unit length.
+extern void mat4_rotate_quat(float* matrix, Quat q);
 #endif
\ No newline at end of file
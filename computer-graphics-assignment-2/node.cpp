@@ -1,5 +1,7 @@
 #include "node.h"
 
+#include <algorithm>
+#include <string.h>
 
 #include "object.h"
 
@@ -16,15 +18,73 @@ Node *create_node()
     node->translation.E[0] = node->translation.E[1] = node->translation.E[2] = 0;
     node->scale.E[0] = node->scale.E[1] = node->scale.E[2] = 0;
     node->flip = false;
+    node->id = 0;
 
     return node;
 }
 
 Node *descend_node(Node *node, unsigned int depth)
 {
-    if (depth == 0) {
-        return node;
+    for (unsigned int i = 0; i < depth; i++) {
+        node = node->children[0];
     }
 
-    return descend_node(node->children[0], depth - 1);
+    return node;
+}
+
+void build_skeleton(const std::vector<Node *> &limbs, Skeleton *skeleton)
+{
+    skeleton->parents.assign(limbs.size(), -1);
+    skeleton->order.clear();
+
+    for (unsigned int i = 0; i < limbs.size(); i++) {
+        for (auto &child : limbs[i]->children) {
+            auto it = std::find(limbs.begin(), limbs.end(), child);
+            if (it != limbs.end()) {
+                skeleton->parents[it - limbs.begin()] = i;
+            }
+        }
+    }
+
+    // Breadth first from the roots so every parent is resolved before its children.
+    for (unsigned int i = 0; i < limbs.size(); i++) {
+        if (skeleton->parents[i] == -1) {
+            skeleton->order.push_back(i);
+        }
+    }
+
+    for (unsigned int o = 0; o < skeleton->order.size(); o++) {
+        const unsigned int parent = skeleton->order[o];
+        for (unsigned int i = 0; i < limbs.size(); i++) {
+            if (skeleton->parents[i] == (int)parent) {
+                skeleton->order.push_back(i);
+            }
+        }
+    }
+}
+
+// Resolves the model matrix of every limb in pose, matching update_node_tree.
+// worlds receives the unscaled transforms that children inherit.
+void skeleton_world_matrices(const Skeleton *skeleton, const Node *pose, float *worlds, float *models)
+{
+    for (auto i : skeleton->order) {
+        const Node *node = pose + i;
+        float *world = worlds + 16 * i;
+
+        if (skeleton->parents[i] == -1) {
+            mat4_identity(world);
+        } else {
+            memcpy(world, worlds + 16 * skeleton->parents[i], 16 * sizeof(float));
+        }
+
+        mat4_translate(world, node->translation.x, node->translation.y, node->translation.z);
+
+        mat4_rotate_z(world, node->rotation.z);
+        mat4_rotate_y(world, node->rotation.y);
+        mat4_rotate_x(world, node->rotation.x);
+
+        float *model = models + 16 * i;
+        memcpy(model, world, 16 * sizeof(float));
+        mat4_scale(model, node->scale.x, node->scale.y, node->scale.z);
+    }
 }
\ No newline at end of file
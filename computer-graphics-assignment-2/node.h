@@ -16,10 +16,29 @@ struct Node {
     float model[16];
     bool flip;
 
+    unsigned int id; // Index in the limb list.
+
     ~Node();
 };
 
+// One level of an iterative walk down a hierarchy: the node's children still
+// to visit, and its unscaled world transform as a 3x4 affine.
+struct NodeTraversal {
+    Node *const *next_child;
+    Node *const *end_child;
+    float world[12];
+};
+
+// Flattened view of a limb hierarchy for evaluating poses without the app state.
+// Indices match the limb list, and order lists parents before their children.
+struct Skeleton {
+    std::vector<int> parents;
+    std::vector<unsigned int> order;
+};
+
 extern Node *create_node();
 extern Node *descend_node(Node *node, unsigned int depth);
+extern void build_skeleton(const std::vector<Node *> &limbs, Skeleton *skeleton);
+extern void skeleton_world_matrices(const Skeleton *skeleton, const Node *pose, float *worlds, float *models);
 
 #endif
\ No newline at end of file
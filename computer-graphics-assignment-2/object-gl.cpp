@@ -0,0 +1,59 @@
+#include "win32-opengl.h"
+#include "object.h"
+
+extern void destroy_object(Object *obj)
+{
+    glDeleteVertexArrays(1, &obj->vao);
+    glDeleteBuffers(2, obj->vbos);
+    
+    for (auto &v : obj->vertices) {
+        delete v;
+    }
+
+    for (auto &p : obj->polygons) {
+        delete p;
+    }
+}
+
+void create_vbos(Object *obj)
+{
+    glGenVertexArrays(1, &obj->vao);
+    glBindVertexArray(obj->vao);
+
+    int vertex_size = sizeof(float) * obj->vertices.size() * 8;
+    float *vert_data = (float*)malloc(vertex_size);
+
+    int polygon_size = sizeof(unsigned int) * obj->polygons.size() * 3;
+    unsigned int *poly_data = (unsigned int*)malloc(polygon_size);
+
+    if (vert_data && poly_data) {
+        glGenBuffers(2, obj->vbos);
+
+        int offset = 0;
+        for (int i = 0; i < obj->vertices.size(); i++, offset += 8) {
+            memcpy(vert_data + offset, obj->vertices[i], 8 * sizeof(float));
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, obj->vbos[0]);
+        glBufferData(GL_ARRAY_BUFFER, vertex_size, vert_data, GL_STATIC_DRAW);
+
+        offset = 0;
+        for (int i = 0; i < obj->polygons.size(); i++, offset += 3) {
+            memcpy(poly_data + offset, obj->polygons[i]->indices, 3 * sizeof(unsigned int));
+        }
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, obj->vbos[1]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, polygon_size, poly_data, GL_STATIC_DRAW);
+    }
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(3 * sizeof(float)));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
+
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+
+    free(vert_data);
+    free(poly_data);
+}
\ No newline at end of file
@@ -1,10 +1,14 @@
 #include <string>
 #include <fstream>
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
-#include "win32-opengl.h"
 #include "object.h"
 #include "app.h"
+#include "profiler.h"
+
+// Parsing only, the GL side is in object-gl.cpp.
 
 void add_vertex(Object *obj, std::string line) 
 {
@@ -25,12 +29,12 @@ void add_vertex(Object *obj, std::string line)
 
         do {
             while (text[start] == ' ' || text[start] == '\t' || text[start] == '-') {
-                assert(start < strlen(text));
+                assert((size_t)start < strlen(text));
                 ++start;
             }
 
             while (text[start] != ' ' && text[start] != '\t') {
-                assert(start < strlen(text));
+                assert((size_t)start < strlen(text));
                 ++start;
             }
 
@@ -58,12 +62,12 @@ void add_polygon(Object *obj, std::string line, int smoothing)
 
         do {
             while (text[start] == ' ' || text[start] == '\t' || text[start] == '-') {
-                assert(start < strlen(text));
+                assert((size_t)start < strlen(text));
                 ++start;
             }
 
             while (text[start] != ' ' && text[start] != '\t') {
-                assert(start < strlen(text));
+                assert((size_t)start < strlen(text));
                 ++start;
             }
 
@@ -77,6 +81,8 @@ void add_polygon(Object *obj, std::string line, int smoothing)
 
 Object *load_object(const char *filename)
 {
+    PROFILE_FUNCTION();
+
     int smoothing = 0;
 
     Object *obj = new Object();
@@ -154,60 +160,3 @@ Object *load_object(const char *filename)
 
     return obj;
 }
-
-extern void destroy_object(Object *obj)
-{
-    glDeleteVertexArrays(1, &obj->vao);
-    glDeleteBuffers(2, obj->vbos);
-    
-    for (auto &v : obj->vertices) {
-        delete v;
-    }
-
-    for (auto &p : obj->polygons) {
-        delete p;
-    }
-}
-
-void create_vbos(Object *obj)
-{
-    glGenVertexArrays(1, &obj->vao);
-    glBindVertexArray(obj->vao);
-
-    int vertex_size = sizeof(float) * obj->vertices.size() * 8;
-    float *vert_data = (float*)malloc(vertex_size);
-
-    int polygon_size = sizeof(unsigned int) * obj->polygons.size() * 3;
-    unsigned int *poly_data = (unsigned int*)malloc(polygon_size);
-
-    if (vert_data && poly_data) {
-        glGenBuffers(2, obj->vbos);
-
-        int offset = 0;
-        for (int i = 0; i < obj->vertices.size(); i++, offset += 8) {
-            memcpy(vert_data + offset, obj->vertices[i], 8 * sizeof(float));
-        }
-
-        glBindBuffer(GL_ARRAY_BUFFER, obj->vbos[0]);
-        glBufferData(GL_ARRAY_BUFFER, vertex_size, vert_data, GL_STATIC_DRAW);
-
-        offset = 0;
-        for (int i = 0; i < obj->polygons.size(); i++, offset += 3) {
-            memcpy(poly_data + offset, obj->polygons[i]->indices, 3 * sizeof(unsigned int));
-        }
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, obj->vbos[1]);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, polygon_size, poly_data, GL_STATIC_DRAW);
-    }
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(3 * sizeof(float)));
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
-
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-
-    free(vert_data);
-    free(poly_data);
-}
\ No newline at end of file
@@ -5,11 +5,16 @@
 
 struct Bitmap;
 
+static const unsigned int SHADOW_MAP_SIZE = 2048;
+
 extern bool gl_check_shader_compile_log(unsigned int shader);
 extern bool gl_check_program_link_log(unsigned int program);
 extern unsigned int gl_compile_shader_from_source(const char *source, unsigned int program, int type);
 extern unsigned int create_shader(const char *vertex_shader_source, const char *fragment_shader_source);
 extern unsigned int create_texture(Bitmap *bitmap);
 extern void create_depth_map(unsigned int &fbo, unsigned int &texture);
+extern void create_depth_array(unsigned int size, unsigned int layers, unsigned int *fbos, unsigned int &texture);
+extern void create_pick_target(unsigned int w, unsigned int h, unsigned int &fbo, unsigned int &colour, unsigned int &ids, unsigned int &depth);
+extern void destroy_pick_target(unsigned int &fbo, unsigned int &colour, unsigned int &ids, unsigned int &depth);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,161 @@
+#include "pose-cache.h"
+
+#include <math.h>
+#include <string.h>
+
+static const unsigned int NO_ENTRY = ~0u;
+
+void pose_cache_init(PoseCache *cache, float quantum, size_t budget)
+{
+	cache->quantum = quantum > 0.f ? quantum : 1.f / 60.f;
+	cache->budget = budget;
+	pose_cache_clear(cache);
+}
+
+void pose_cache_clear(PoseCache *cache)
+{
+	cache->used = 0;
+	cache->hits = cache->misses = 0;
+	cache->lookup.clear();
+	cache->entries.clear();
+	cache->free.clear();
+	cache->newest = cache->oldest = NO_ENTRY;
+}
+
+static unsigned int time_step(const PoseCache *cache, float t)
+{
+	return t > 0.f ? (unsigned int)(t / cache->quantum + 0.5f) : 0;
+}
+
+static unsigned long long cache_key(const PoseCache *cache, unsigned int clip_id, float t)
+{
+	return (unsigned long long)clip_id << 32 | time_step(cache, t);
+}
+
+static size_t entry_bytes(const PoseCacheEntry *entry)
+{
+	return sizeof(PoseCacheEntry) + entry->models.capacity() * sizeof(float);
+}
+
+static void unlink_entry(PoseCache *cache, unsigned int index)
+{
+	PoseCacheEntry *entry = &cache->entries[index];
+	if (entry->prev != NO_ENTRY) {
+		cache->entries[entry->prev].next = entry->next;
+	} else {
+		cache->newest = entry->next;
+	}
+	if (entry->next != NO_ENTRY) {
+		cache->entries[entry->next].prev = entry->prev;
+	} else {
+		cache->oldest = entry->prev;
+	}
+}
+
+static void link_newest(PoseCache *cache, unsigned int index)
+{
+	PoseCacheEntry *entry = &cache->entries[index];
+	entry->prev = NO_ENTRY;
+	entry->next = cache->newest;
+	if (cache->newest != NO_ENTRY) {
+		cache->entries[cache->newest].prev = index;
+	} else {
+		cache->oldest = index;
+	}
+	cache->newest = index;
+}
+
+static void remove_entry(PoseCache *cache, unsigned int index)
+{
+	PoseCacheEntry *entry = &cache->entries[index];
+	unlink_entry(cache, index);
+	cache->lookup.erase(entry->key);
+	cache->used -= entry_bytes(entry);
+
+	std::vector<float>().swap(entry->models);
+	cache->free.push_back(index);
+}
+
+void pose_cache_invalidate(PoseCache *cache, unsigned int clip_id)
+{
+	unsigned int index = cache->newest;
+	while (index != NO_ENTRY) {
+		const unsigned int next = cache->entries[index].next;
+		if (cache->entries[index].key >> 32 == clip_id) {
+			remove_entry(cache, index);
+		}
+		index = next;
+	}
+}
+
+const float *pose_cache_find(PoseCache *cache, unsigned int clip_id, float t)
+{
+	auto found = cache->lookup.find(cache_key(cache, clip_id, t));
+	if (found == cache->lookup.end()) {
+		cache->misses++;
+		return 0;
+	}
+
+	cache->hits++;
+	if (cache->newest != found->second) {
+		unlink_entry(cache, found->second);
+		link_newest(cache, found->second);
+	}
+	return cache->entries[found->second].models.data();
+}
+
+void pose_cache_store(PoseCache *cache, unsigned int clip_id, float t, const float *models, unsigned int limbs)
+{
+	const unsigned long long key = cache_key(cache, clip_id, t);
+	const size_t floats = 16 * (size_t)limbs;
+	const size_t bytes = sizeof(PoseCacheEntry) + floats * sizeof(float);
+
+	auto found = cache->lookup.find(key);
+	if (found != cache->lookup.end()) {
+		remove_entry(cache, found->second);
+	}
+	if (bytes > cache->budget) {
+		return;
+	}
+
+	while (cache->used + bytes > cache->budget && cache->oldest != NO_ENTRY) {
+		remove_entry(cache, cache->oldest);
+	}
+
+	unsigned int index;
+	if (!cache->free.empty()) {
+		index = cache->free.back();
+		cache->free.pop_back();
+	} else {
+		index = cache->entries.size();
+		cache->entries.push_back(PoseCacheEntry());
+	}
+
+	PoseCacheEntry *entry = &cache->entries[index];
+	entry->key = key;
+	entry->models.assign(models, models + floats);
+	cache->used += entry_bytes(entry);
+
+	cache->lookup[key] = index;
+	link_newest(cache, index);
+}
+
+void pose_cache_models(PoseCache *cache, unsigned int clip_id, const TrackClip *clip, const Skeleton *skeleton, float t, float *models)
+{
+	const size_t floats = 16 * (size_t)clip->limbs;
+
+	const float *cached = pose_cache_find(cache, clip_id, t);
+	if (cached) {
+		memcpy(models, cached, floats * sizeof(float));
+		return;
+	}
+
+	// Resolved at the snapped time, so it's the same pose whichever time
+	// in the step asked for it first.
+	const float snapped = time_step(cache, t) * cache->quantum;
+	cache->worlds.resize(floats);
+	sample_track_clip(clip, snapped, &cache->cursor, &cache->pose);
+	quat_pose_world_matrices(skeleton, &cache->pose, cache->worlds.data(), models);
+
+	pose_cache_store(cache, clip_id, t, models, clip->limbs);
+}
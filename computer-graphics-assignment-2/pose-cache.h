@@ -0,0 +1,56 @@
+#ifndef POSE_CACHE_H
+#define POSE_CACHE_H
+
+#include <stddef.h>
+#include <unordered_map>
+#include <vector>
+
+#include "animation.h"
+
+// Resolved model matrices of clips at given times, so scrubbing back and
+// forth over a timeline copies poses out rather than sampling and walking
+// the hierarchy again. Times are snapped to a multiple of the quantum, and
+// the least recently used poses are dropped to keep within the budget.
+// Clips are told apart by an id the caller picks, and a clip's poses have to
+// be invalidated whenever its keys change.
+
+struct PoseCacheEntry {
+	unsigned long long key; // Clip id above, time step below.
+	unsigned int prev, next; // Towards the most and least recently used.
+	std::vector<float> models;
+};
+
+struct PoseCache {
+	float quantum; // Seconds.
+	size_t budget, used; // Bytes.
+	unsigned long long hits, misses;
+
+	std::unordered_map<unsigned long long, unsigned int> lookup;
+	std::vector<PoseCacheEntry> entries;
+	std::vector<unsigned int> free;
+	unsigned int newest, oldest;
+
+	// For evaluating misses.
+	TrackCursor cursor;
+	QuatPose pose;
+	std::vector<float> worlds;
+};
+
+extern void pose_cache_init(PoseCache *cache, float quantum, size_t budget);
+extern void pose_cache_clear(PoseCache *cache);
+
+// Drops every pose of the clip.
+extern void pose_cache_invalidate(PoseCache *cache, unsigned int clip_id);
+
+// The cached pose at t, or 0. It stays valid until the cache next changes.
+extern const float *pose_cache_find(PoseCache *cache, unsigned int clip_id, float t);
+
+// Copies 16 floats a limb of models in as the pose at t, evicting older poses
+// until it fits. A pose bigger than the whole budget isn't kept.
+extern void pose_cache_store(PoseCache *cache, unsigned int clip_id, float t, const float *models, unsigned int limbs);
+
+// Writes the clip's model matrices at t, snapped to the quantum, into models,
+// from the cache if they're there and otherwise resolving and storing them.
+extern void pose_cache_models(PoseCache *cache, unsigned int clip_id, const TrackClip *clip, const Skeleton *skeleton, float t, float *models);
+
+#endif
@@ -0,0 +1,174 @@
+#include "profiler.h"
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+struct ProfileEvent {
+	const char *name;
+	unsigned long long begin, end;
+	unsigned int depth;
+};
+
+// Only the owning thread writes a ring. Readers take the count with acquire
+// and drop any events the owner may have overwritten while they copied.
+struct ProfileRing {
+	ProfileEvent events[PROFILER_RING_SIZE];
+	std::atomic<unsigned int> written;
+	std::atomic<const char *> name;
+	unsigned int depth;
+	unsigned int thread;
+};
+
+// Taken when a thread records its first zone, and when writing a trace.
+static std::mutex rings_mutex;
+static std::vector<ProfileRing *> rings;
+
+static thread_local ProfileRing *thread_ring = 0;
+
+// Ticks and the steady clock at start up, so the tick rate can be measured
+// against the clock when writing instead of calibrating with a sleep.
+static const unsigned long long epoch_ticks = profiler_ticks();
+static const std::chrono::steady_clock::time_point epoch_time = std::chrono::steady_clock::now();
+
+static ProfileRing *new_ring(const char *name)
+{
+	ProfileRing *ring = new ProfileRing;
+	ring->written = 0;
+	ring->name = name;
+	ring->depth = 0;
+
+	std::lock_guard<std::mutex> lock(rings_mutex);
+	ring->thread = rings.size();
+	rings.push_back(ring);
+
+	return ring;
+}
+
+static ProfileRing *get_thread_ring()
+{
+	if (!thread_ring) {
+		thread_ring = new_ring(0);
+	}
+
+	return thread_ring;
+}
+
+static void push_event(ProfileRing *ring, const char *name, unsigned long long begin, unsigned long long end, unsigned int depth)
+{
+	const unsigned int index = ring->written.load(std::memory_order_relaxed);
+	ProfileEvent *e = &ring->events[index & (PROFILER_RING_SIZE - 1)];
+	e->name = name;
+	e->begin = begin;
+	e->end = end;
+	e->depth = depth;
+
+	ring->written.store(index + 1, std::memory_order_release);
+}
+
+// Measured over the whole run so far, so it gets more precise the longer the
+// program has been running.
+static double us_per_tick()
+{
+	const unsigned long long now_ticks = profiler_ticks();
+	const double elapsed_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch_time).count();
+	return elapsed_us > 0.0 && now_ticks != epoch_ticks ? elapsed_us / (double)(now_ticks - epoch_ticks) : 1.0;
+}
+
+void profiler_set_thread_name(const char *name)
+{
+	get_thread_ring()->name = name;
+}
+
+unsigned int profiler_enter()
+{
+	return get_thread_ring()->depth++;
+}
+
+void profiler_leave(const char *name, unsigned long long begin, unsigned int depth)
+{
+	const unsigned long long end = profiler_ticks();
+
+	ProfileRing *ring = thread_ring;
+	ring->depth = depth;
+
+	push_event(ring, name, begin, end, depth);
+}
+
+ProfileRing *profiler_track(const char *name)
+{
+	return new_ring(name);
+}
+
+void profiler_record(ProfileRing *track, const char *name, unsigned long long begin, unsigned long long end, unsigned int depth)
+{
+	push_event(track, name, begin, end, depth);
+}
+
+double profiler_ticks_per_us()
+{
+	return 1.0 / us_per_tick();
+}
+
+bool profiler_write_trace(const char *filename)
+{
+	std::ofstream file(filename);
+	if (!file) {
+		return false;
+	}
+
+	const double tick_us = us_per_tick();
+
+	std::vector<ProfileRing *> threads;
+	{
+		std::lock_guard<std::mutex> lock(rings_mutex);
+		threads = rings;
+	}
+
+	std::vector<ProfileEvent> events;
+	char line[256];
+	bool first = true;
+
+	file << "{\"traceEvents\":[\n";
+
+	for (auto ring : threads) {
+		const char *name = ring->name;
+		snprintf(line, sizeof(line), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}",
+			first ? "" : ",\n", ring->thread, name ? name : "thread", ring->thread);
+		file << line;
+		first = false;
+
+		const unsigned int written = ring->written.load(std::memory_order_acquire);
+		const unsigned int count = written < PROFILER_RING_SIZE ? written : PROFILER_RING_SIZE;
+
+		events.resize(count);
+		for (unsigned int i = 0; i < count; i++) {
+			events[i] = ring->events[(written - count + i) & (PROFILER_RING_SIZE - 1)];
+		}
+
+		// Events the owner lapped while they were copied are torn. When the
+		// ring is full, so may be the one after them, which is the slot the
+		// owner writes next.
+		const unsigned int after = ring->written.load(std::memory_order_acquire);
+		const unsigned int lapped = after - written;
+		const unsigned int torn = count == PROFILER_RING_SIZE ? lapped + 1 : lapped;
+		const unsigned int skip = torn < count ? torn : count;
+
+		for (unsigned int i = skip; i < count; i++) {
+			const ProfileEvent &e = events[i];
+			const double ts = (double)(long long)(e.begin - epoch_ticks) * tick_us;
+			const double dur = (double)(e.end - e.begin) * tick_us;
+
+			snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"depth\":%u}}",
+				e.name, ring->thread, ts, dur, e.depth);
+			file << line;
+		}
+	}
+
+	file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+	return (bool)file;
+}
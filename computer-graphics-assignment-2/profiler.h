@@ -0,0 +1,84 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Scoped CPU zones for seeing where frame time goes. Each thread records into
+// a ring of its own that no other thread writes, so a zone costs two
+// timestamp reads and a store, with no locks. Rings keep the last
+// PROFILER_RING_SIZE zones of their thread and are written out as a Chrome
+// trace, which chrome://tracing and ui.perfetto.dev can open.
+//
+// Build with PROFILER_ENABLED defined as 0 to compile the zones out.
+
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define PROFILER_RDTSC
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#define PROFILER_RDTSC
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+static const unsigned int PROFILER_RING_SIZE = 1 << 13; // Power of two.
+
+// Ticks of the time stamp counter, or of the steady clock where there is none.
+// Converted to microseconds when the trace is written.
+inline unsigned long long profiler_ticks()
+{
+#ifdef PROFILER_RDTSC
+	return __rdtsc();
+#else
+	return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// Names are stored by pointer, so they must be string literals.
+extern void profiler_set_thread_name(const char *name);
+extern unsigned int profiler_enter();
+extern void profiler_leave(const char *name, unsigned long long begin, unsigned int depth);
+
+struct ProfileRing;
+
+// A ring that isn't tied to a thread, for times measured elsewhere such as on
+// the GPU. Events are recorded with begin and end already converted to ticks,
+// without locking, so only one thread may record to a track.
+extern ProfileRing *profiler_track(const char *name);
+extern void profiler_record(ProfileRing *track, const char *name, unsigned long long begin, unsigned long long end, unsigned int depth);
+extern double profiler_ticks_per_us();
+
+// Writes every thread's ring. Safe to call while the other threads record.
+extern bool profiler_write_trace(const char *filename);
+
+struct ProfileZone {
+	const char *name;
+	unsigned long long begin;
+	unsigned int depth;
+
+	ProfileZone(const char *name) : name(name), depth(profiler_enter())
+	{
+		begin = profiler_ticks();
+	}
+
+	~ProfileZone()
+	{
+		profiler_leave(name, begin, depth);
+	}
+};
+
+#if PROFILER_ENABLED
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__FUNCTION__)
+#define PROFILE_THREAD(name) profiler_set_thread_name(name)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_THREAD(name)
+#endif
+
+#endif
@@ -0,0 +1,165 @@
+#include "render-queue.h"
+
+#include <string.h>
+
+static const unsigned int NO_STATE = (unsigned int)-1;
+static const unsigned int MAX_PROGRAMS = 16;
+
+// From the most significant bits: pass 4, program 4, material 12, vao 12 and
+// depth 32. Positive floats sort the same as their bit patterns, so nearer
+// items come first within a batch.
+unsigned long long draw_key(unsigned int pass, unsigned int program, unsigned int material, unsigned int vao, float depth)
+{
+	unsigned int depth_bits = 0;
+	if (depth > 0.f) {
+		memcpy(&depth_bits, &depth, sizeof(depth_bits));
+	}
+
+	return ((unsigned long long)(pass & 0xF) << 60) |
+		((unsigned long long)(program & 0xF) << 56) |
+		((unsigned long long)(material & 0xFFF) << 44) |
+		((unsigned long long)(vao & 0xFFF) << 32) |
+		depth_bits;
+}
+
+void render_queue_clear(RenderQueue *queue)
+{
+	queue->items.clear();
+	queue->keys.clear();
+	queue->order.clear();
+}
+
+DrawItem *render_queue_push(RenderQueue *queue, unsigned int pass, unsigned int program, unsigned int material, unsigned int vao, float depth)
+{
+	queue->items.emplace_back();
+
+	DrawItem *item = &queue->items.back();
+	item->key = draw_key(pass, program, material, vao, depth);
+	item->pass = pass;
+	item->program = program;
+	item->material = material;
+	item->vao = vao;
+	item->count = 0;
+	item->object_id = 0;
+
+	return item;
+}
+
+// LSD radix sort of the keys a byte at a time, carrying the item indices.
+// Bytes that are the same for every item are skipped.
+void render_queue_sort(RenderQueue *queue)
+{
+	const unsigned int n = queue->items.size();
+
+	queue->keys.resize(n);
+	queue->order.resize(n);
+	queue->scratch_keys.resize(n);
+	queue->scratch_order.resize(n);
+
+	for (unsigned int i = 0; i < n; i++) {
+		queue->keys[i] = queue->items[i].key;
+		queue->order[i] = i;
+	}
+
+	for (unsigned int shift = 0; shift < 64; shift += 8) {
+		unsigned int counts[256] = {};
+		for (unsigned int i = 0; i < n; i++) {
+			counts[(queue->keys[i] >> shift) & 0xFF]++;
+		}
+
+		if (n == 0 || counts[(queue->keys[0] >> shift) & 0xFF] == n) {
+			continue;
+		}
+
+		unsigned int offset = 0;
+		for (unsigned int i = 0; i < 256; i++) {
+			const unsigned int count = counts[i];
+			counts[i] = offset;
+			offset += count;
+		}
+
+		for (unsigned int i = 0; i < n; i++) {
+			const unsigned int slot = counts[(queue->keys[i] >> shift) & 0xFF]++;
+			queue->scratch_keys[slot] = queue->keys[i];
+			queue->scratch_order[slot] = queue->order[i];
+		}
+
+		queue->keys.swap(queue->scratch_keys);
+		queue->order.swap(queue->scratch_order);
+	}
+}
+
+// Walks the items in the given order, calling the backend only when state
+// changes. The backend may be null to just count the changes.
+static void replay(const RenderQueue *queue, const unsigned int *order, unsigned int pass_count, const RenderQueueBackend *backend, StateChanges *changes)
+{
+	unsigned int program = NO_STATE, vao = NO_STATE;
+	unsigned int materials[MAX_PROGRAMS], setup_passes[MAX_PROGRAMS];
+
+	for (unsigned int i = 0; i < MAX_PROGRAMS; i++) {
+		materials[i] = setup_passes[i] = NO_STATE;
+	}
+
+	*changes = {};
+
+	const unsigned int n = queue->items.size();
+	unsigned int next = 0;
+
+	for (unsigned int pass = 0; pass < pass_count || next < n; pass++) {
+		if (backend && pass < pass_count) {
+			backend->begin_pass(pass);
+		}
+
+		for (; next < n && (pass_count == 0 || queue->items[order[next]].pass == pass); next++) {
+			const DrawItem *item = &queue->items[order[next]];
+
+			if (item->program != program) {
+				program = item->program;
+				changes->programs++;
+				if (backend) backend->use_program(program);
+			}
+
+			if (setup_passes[program] != item->pass) {
+				setup_passes[program] = item->pass;
+				changes->program_setups++;
+				if (backend) backend->setup_program(program, item->pass);
+			}
+
+			if (materials[program] != item->material) {
+				materials[program] = item->material;
+				changes->materials++;
+				if (backend) backend->bind_material(program, item->material);
+			}
+
+			if (item->vao != vao) {
+				vao = item->vao;
+				changes->vaos++;
+				if (backend) backend->bind_vao(vao);
+			}
+
+			if (backend) backend->draw(item);
+		}
+
+		if (pass_count == 0) {
+			break;
+		}
+	}
+}
+
+// Replays the sorted items. Every pass up to pass_count is begun in order,
+// even if nothing was submitted to it.
+void render_queue_replay(const RenderQueue *queue, unsigned int pass_count, const RenderQueueBackend *backend, StateChanges *changes)
+{
+	replay(queue, queue->order.data(), pass_count, backend, changes);
+}
+
+// State changes the same items would cost in the order they were submitted.
+void render_queue_count_submitted(const RenderQueue *queue, StateChanges *changes)
+{
+	std::vector<unsigned int> order(queue->items.size());
+	for (unsigned int i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+
+	replay(queue, order.data(), 0, nullptr, changes);
+}
@@ -0,0 +1,53 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <vector>
+#include <functional>
+
+// Draws are submitted in any order with a sort key and replayed sorted, so
+// items that share a program, material and mesh run back to back and the
+// state between them is only set when it changes.
+
+struct DrawItem {
+	unsigned long long key;
+	unsigned int pass;
+	unsigned int program;
+	unsigned int material;
+	unsigned int vao;
+	unsigned int count; // Indices to draw.
+	unsigned int object_id;
+	float model[16];
+};
+
+struct RenderQueue {
+	std::vector<DrawItem> items;
+	std::vector<unsigned long long> keys, scratch_keys;
+	std::vector<unsigned int> order, scratch_order;
+};
+
+// Calls made while replaying. Programs are set up once per pass, and a program
+// keeps its material between passes since uniforms live in the program.
+struct RenderQueueBackend {
+	std::function<void(unsigned int pass)> begin_pass;
+	std::function<void(unsigned int program)> use_program;
+	std::function<void(unsigned int program, unsigned int pass)> setup_program;
+	std::function<void(unsigned int program, unsigned int material)> bind_material;
+	std::function<void(unsigned int vao)> bind_vao;
+	std::function<void(const DrawItem *item)> draw;
+};
+
+struct StateChanges {
+	unsigned int programs;
+	unsigned int program_setups;
+	unsigned int materials;
+	unsigned int vaos;
+};
+
+extern unsigned long long draw_key(unsigned int pass, unsigned int program, unsigned int material, unsigned int vao, float depth);
+extern void render_queue_clear(RenderQueue *queue);
+extern DrawItem *render_queue_push(RenderQueue *queue, unsigned int pass, unsigned int program, unsigned int material, unsigned int vao, float depth);
+extern void render_queue_sort(RenderQueue *queue);
+extern void render_queue_replay(const RenderQueue *queue, unsigned int pass_count, const RenderQueueBackend *backend, StateChanges *changes);
+extern void render_queue_count_submitted(const RenderQueue *queue, StateChanges *changes);
+
+#endif
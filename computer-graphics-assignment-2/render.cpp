@@ -0,0 +1,998 @@
+#include "render.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#include "maths.h"
+#include "opengl-util.h"
+#include "profiler.h"
+
+static const float SHADOW_CACHE_DEGREES = 2.f; // Light movement before the static shadow casters are redrawn.
+static const int SHADOW_RECT_PADDING = 2; // Texels around a caster's bounds, covers rasterisation rounding.
+
+static const float CASCADE_LAMBDA = 0.75f; // Mostly logarithmic splits.
+static const float SHADOW_DISTANCE = 200.f; // View depth covered by the cascades.
+
+// Render queue programs and materials. Programs sort in this order within a pass.
+enum Program {
+	PROGRAM_DEPTH,
+	PROGRAM_TEXTURED,
+	PROGRAM_DIFFUSE,
+	PROGRAM_COUNT
+};
+
+enum Material {
+	MATERIAL_NONE,
+	MATERIAL_FLOOR,
+	MATERIAL_LIMB,
+	MATERIAL_PROP
+};
+
+// One pass of the frame. begin binds the target and per pass state, and the
+// matrices are uploaded when a program is first used in the pass.
+struct FramePass {
+	std::function<void()> begin;
+	const float *projection, *view;
+	const float *light_space_matrix;
+	V3 eye, forward; // Draws are sorted front to back along forward.
+	unsigned int gpu_pass; // Timed as, see gpu-timer.h.
+};
+
+// Visits the hierarchy depth first, in the order a recursive walk would,
+// passing each node's unscaled world transform. Children inherit that, the
+// scale only goes into a node's own model matrix. The stack is explicit and
+// kept between calls, so depth is limited only by memory. Leaves are visited
+// without taking a level.
+template <typename Visit>
+static void walk_node_tree(std::vector<NodeTraversal> &stack, Node *root, Visit visit)
+{
+	if (stack.empty()) {
+		stack.resize(16);
+	}
+
+	float identity[12];
+	affine_identity(identity);
+
+	unsigned int depth = 0;
+	NodeTraversal *top = &stack[0];
+	top->next_child = root->children.data();
+	top->end_child = top->next_child + root->children.size();
+	affine_compose_tr(top->world, identity, root->translation, root->rotation);
+	visit(root, top->world);
+
+	for (;;) {
+		if (top->next_child == top->end_child) {
+			if (depth == 0) {
+				break;
+			}
+			top = &stack[--depth];
+			continue;
+		}
+
+		Node *child = *top->next_child++;
+
+		if (child->children.empty()) {
+			float world[12];
+			affine_compose_tr(world, top->world, child->translation, child->rotation);
+			visit(child, world);
+			continue;
+		}
+
+		if (depth + 1 == stack.size()) {
+			stack.resize(2 * stack.size());
+			top = &stack[depth];
+		}
+
+		NodeTraversal *parent = top;
+		top = &stack[++depth];
+		top->next_child = child->children.data();
+		top->end_child = top->next_child + child->children.size();
+		affine_compose_tr(top->world, parent->world, child->translation, child->rotation);
+		visit(child, top->world);
+	}
+}
+
+void update_node_tree(app_state *state, Node *node)
+{
+	walk_node_tree(state->node_stack, node, [](Node *n, const float *world)
+	{
+		mat4_from_affine_scaled(n->model, world, n->scale);
+	});
+}
+
+// Cascades are read from texture unit 2. A cascade count of 0 makes the
+// shaders fall back to the single shadow map.
+static void set_cascade_uniforms(app_state *state, unsigned int count, unsigned int splits, unsigned int matrices, unsigned int maps)
+{
+	const unsigned int cascades = (state->shadow_mode == SHADOW_CASCADED) ? state->cascade_count : 0;
+
+	float far[MAX_CASCADES] = {};
+	float m[16 * MAX_CASCADES];
+	for (unsigned int i = 0; i < cascades; i++) {
+		far[i] = state->cascades[i].far;
+		memcpy(m + 16 * i, state->cascades[i].matrix, 16 * sizeof(float));
+	}
+
+	gfx_uniform_1i(&state->gfx, count, cascades);
+	gfx_uniform_4fv(&state->gfx, splits, 1, far);
+	if (cascades) {
+		gfx_uniform_matrix_4fv(&state->gfx, matrices, cascades, m);
+	}
+	gfx_uniform_1i(&state->gfx, maps, 2);
+}
+
+static void set_light_uniforms(app_state *state, const LightUniforms *uniforms)
+{
+	const Light *lights[2] = { &state->light_0, &state->light_1 };
+
+	for (unsigned int i = 0; i < 2; i++) {
+		gfx_uniform_3fv(&state->gfx, uniforms[i].pos, 1, (float *)&lights[i]->pos);
+		gfx_uniform_3fv(&state->gfx, uniforms[i].colour, 1, (float *)&lights[i]->colour);
+		gfx_uniform_1f(&state->gfx, uniforms[i].ambient, lights[i]->ambient);
+		gfx_uniform_1f(&state->gfx, uniforms[i].diffuse, lights[i]->diffuse);
+	}
+}
+
+// Uniforms shared by every draw with the program. The program must be bound.
+static void textured_shader_setup(app_state *state)
+{
+	gfx_uniform_1f(&state->gfx, state->textured_shader.gamma_correction, 2.2);
+
+	gfx_uniform_matrix_4fv(&state->gfx, state->textured_shader.projection, 1, state->cur_cam->frustrum);
+	gfx_uniform_matrix_4fv(&state->gfx, state->textured_shader.view, 1, state->cur_cam->view);
+
+	set_light_uniforms(state, state->textured_shader.lights);
+
+	gfx_uniform_3fv(&state->gfx, state->textured_shader.view_position, 1, (float *)&state->cur_cam->pos);
+
+	gfx_uniform_1i(&state->gfx, state->textured_shader.shadow_map, 0);
+	gfx_uniform_1i(&state->gfx, state->textured_shader.texture, 1);
+
+	set_cascade_uniforms(state, state->textured_shader.cascade_count, state->textured_shader.cascade_splits, state->textured_shader.cascade_matrices, state->textured_shader.cascade_maps);
+}
+
+static void diffuse_shader_setup(app_state *state)
+{
+	gfx_uniform_1f(&state->gfx, state->diffuse_shader.gamma_correction, 2.2);
+
+	gfx_uniform_matrix_4fv(&state->gfx, state->diffuse_shader.projection, 1, state->cur_cam->frustrum);
+	gfx_uniform_matrix_4fv(&state->gfx, state->diffuse_shader.view, 1, state->cur_cam->view);
+
+	set_light_uniforms(state, state->diffuse_shader.lights);
+
+	gfx_uniform_3fv(&state->gfx, state->diffuse_shader.view_position, 1, (float *)&state->cur_cam->pos);
+
+	gfx_uniform_1i(&state->gfx, state->diffuse_shader.shadow_map, 0);
+
+	set_cascade_uniforms(state, state->diffuse_shader.cascade_count, state->diffuse_shader.cascade_splits, state->diffuse_shader.cascade_matrices, state->diffuse_shader.cascade_maps);
+}
+
+void draw_sphere(app_state *state)
+{
+	gfx_bind_vertex_array(&state->gfx, state->sphere->vao);
+	gfx_draw_elements(&state->gfx, GFX_TRIANGLES, 3 * state->sphere->polygons.size());
+}
+
+void draw_skybox(app_state *state)
+{
+	gfx_bind_vertex_array(&state->gfx, state->skybox->vao);
+
+	float view[16];
+	mat4_copy(view, state->cur_cam->view);
+	mat4_remove_translation(view);
+
+	gfx_use_program(&state->gfx, state->skybox_shader.program);
+
+	gfx_active_texture(&state->gfx, GFX_TEXTURE0);
+	gfx_bind_texture(&state->gfx, GFX_TEXTURE_CUBE_MAP, state->skybox->texture);
+
+	gfx_uniform_1i(&state->gfx, state->skybox_shader.skybox, 0);
+	gfx_uniform_matrix_4fv(&state->gfx, state->skybox_shader.projection, 1, state->cur_cam->frustrum);
+	gfx_uniform_matrix_4fv(&state->gfx, state->skybox_shader.view, 1, view);
+
+	gfx_draw_arrays(&state->gfx, GFX_TRIANGLES, 0, 36);
+}
+
+void draw_node_tree(app_state *state, Node *node, unsigned int model_handle, bool only_selected, bool reflect)
+{
+	walk_node_tree(state->node_stack, node, [&](Node *n, const float *world)
+	{
+		if (reflect) {
+			mat4_from_affine_scaled(n->model, world, { n->scale.x, n->scale.y * -1.f, n->scale.z });
+		} else {
+			mat4_from_affine_scaled(n->model, world, n->scale);
+		}
+
+		if (only_selected && n != state->selected) {
+			return;
+		}
+
+		gfx_uniform_matrix_4fv(&state->gfx, model_handle, 1, n->model);
+		gfx_bind_vertex_array(&state->gfx, state->box->vao);
+		gfx_draw_elements(&state->gfx, GFX_TRIANGLES, 3 * state->box->polygons.size());
+	});
+}
+
+// Unit 0 is still active from the skybox, as it is for all of the overlays.
+static void render_interface(app_state *state)
+{
+	gfx_bind_vertex_array(&state->gfx, state->interface_vao);
+
+	gfx_uniform_matrix_4fv(&state->gfx, state->interface_shader.projection, 1, (float *)state->cur_cam->ortho);
+	gfx_uniform_1i(&state->gfx, state->interface_shader.texture, 0);
+
+	float model[16];
+
+	for (auto &b : state->buttons) {
+		mat4_identity(model);
+		mat4_translate(model, b.pos.x, b.pos.y, 0.f);
+		mat4_scale(model, b.size.x, b.size.y, 0.f);
+
+		gfx_bind_texture(&state->gfx, GFX_TEXTURE_2D, b.texture);
+
+		gfx_uniform_matrix_4fv(&state->gfx, state->interface_shader.model, 1, model);
+		gfx_draw_elements(&state->gfx, GFX_TRIANGLES, 6);
+	}
+}
+
+static const float GPU_TIMES_SCALE = 2.f; // Screen pixels per font pixel.
+static const float GPU_TIMES_BAR = 100.f; // Width of a pass taking the whole frame.
+
+// Draws text from the top left corner at x, y with the interface shader.
+static void render_text(app_state *state, const char *text, float x, float y)
+{
+	const float advance = (GLYPH_W + 1) * GPU_TIMES_SCALE;
+	float model[16];
+
+	for (const char *c = text; *c; c++, x += advance) {
+		const int glyph = glyph_index(*c);
+		if (glyph < 0) {
+			continue;
+		}
+
+		mat4_identity(model);
+		mat4_translate(model, x, y, 0.f);
+		mat4_scale(model, GLYPH_W * GPU_TIMES_SCALE, GLYPH_H * GPU_TIMES_SCALE, 0.f);
+
+		gfx_bind_texture(&state->gfx, GFX_TEXTURE_2D, state->glyph_textures[glyph]);
+		gfx_uniform_matrix_4fv(&state->gfx, state->interface_shader.model, 1, model);
+		gfx_draw_elements(&state->gfx, GFX_TRIANGLES, 6);
+	}
+}
+
+// Smoothed GPU milliseconds of each pass at the top right, with a bar for its
+// share of the frame. The numbers lag the frame by GPU_TIMER_FRAMES.
+static void render_gpu_times(app_state *state)
+{
+	const GpuTimer *timer = &state->gpu_timer;
+	const float line = (GLYPH_H + 3) * GPU_TIMES_SCALE;
+	const float x = state->window_info.w - 20.f - GPU_TIMES_BAR - 18 * (GLYPH_W + 1) * GPU_TIMES_SCALE;
+	float y = 20.f;
+	char text[32];
+
+	gfx_bind_vertex_array(&state->gfx, state->interface_vao);
+	gfx_uniform_matrix_4fv(&state->gfx, state->interface_shader.projection, 1, (float *)state->cur_cam->ortho);
+	gfx_uniform_1i(&state->gfx, state->interface_shader.texture, 0);
+
+	for (unsigned int p = 0; p <= GPU_PASS_COUNT; p++, y += line) {
+		const bool total = p == GPU_PASS_COUNT;
+		const float ms = total ? timer->average_total_ms : timer->average_ms[p];
+
+		snprintf(text, sizeof(text), "%-10s %6.3f", total ? "total" : GPU_PASS_NAMES[p], ms);
+		render_text(state, text, x, y);
+
+		const float share = timer->average_total_ms > 0.f ? std::min(ms / timer->average_total_ms, 1.f) : 0.f;
+		if (share > 0.f) {
+			float model[16];
+			mat4_identity(model);
+			mat4_translate(model, state->window_info.w - 20.f - GPU_TIMES_BAR, y, 0.f);
+			mat4_scale(model, share * GPU_TIMES_BAR, GLYPH_H * GPU_TIMES_SCALE, 0.f);
+
+			gfx_bind_texture(&state->gfx, GFX_TEXTURE_2D, state->glyph_textures[GLYPH_SOLID]);
+			gfx_uniform_matrix_4fv(&state->gfx, state->interface_shader.model, 1, model);
+			gfx_draw_elements(&state->gfx, GFX_TRIANGLES, 6);
+		}
+	}
+
+	if (!timer->supported) {
+		render_text(state, "no timer queries", x, y);
+	}
+}
+
+// Draws a line of text against the right edge and moves y down a line.
+static void render_stats_line(app_state *state, const char *text, float *y)
+{
+	const float advance = (GLYPH_W + 1) * GPU_TIMES_SCALE;
+	render_text(state, text, state->window_info.w - 20.f - strlen(text) * advance, *y);
+	*y += (GLYPH_H + 3) * GPU_TIMES_SCALE;
+}
+
+// CPU side counters under the GPU times, with the same projection and
+// texture unit already bound.
+static void render_frame_stats(app_state *state)
+{
+	float y = 20.f + (GPU_PASS_COUNT + 3) * (GLYPH_H + 3) * GPU_TIMES_SCALE;
+	char text[64];
+
+	const CullStats *cull = &state->visible[CULL_MAIN].stats;
+	snprintf(text, sizeof(text), "visible %u of %u in %.3f ms", cull->visible, cull->tested, cull->ms);
+	render_stats_line(state, text, &y);
+
+	const QueueStats *queue = &state->queue_stats;
+	const StateChanges *submitted = &queue->submitted, *sorted = &queue->sorted;
+	snprintf(text, sizeof(text), "queue %u draws sorted in %.3f ms", queue->items, queue->sort_ms);
+	render_stats_line(state, text, &y);
+	snprintf(text, sizeof(text), "state changes %u to %u",
+		submitted->programs + submitted->program_setups + submitted->materials + submitted->vaos,
+		sorted->programs + sorted->program_setups + sorted->materials + sorted->vaos);
+	render_stats_line(state, text, &y);
+	snprintf(text, sizeof(text), "programs %u to %u setups %u to %u", submitted->programs, sorted->programs, submitted->program_setups, sorted->program_setups);
+	render_stats_line(state, text, &y);
+	snprintf(text, sizeof(text), "materials %u to %u vaos %u to %u", submitted->materials, sorted->materials, submitted->vaos, sorted->vaos);
+	render_stats_line(state, text, &y);
+
+	const GfxNullStats *calls = &state->gfx_stats.calls;
+	snprintf(text, sizeof(text), "gl %u calls %u bytes %u draws", calls->commands, calls->bytes, calls->draws);
+	render_stats_line(state, text, &y);
+	snprintf(text, sizeof(text), "record %.3f ms replay %.3f ms", state->gfx_stats.record_ms, state->gfx_stats.replay_ms);
+	render_stats_line(state, text, &y);
+	for (unsigned int op = 0; op < GFX_OP_COUNT; op++) {
+		if (calls->redundant[op] || calls->invalid[op]) {
+			snprintf(text, sizeof(text), "%s %u calls %u redundant %u invalid", gfx_op_name(op), calls->calls[op], calls->redundant[op], calls->invalid[op]);
+			render_stats_line(state, text, &y);
+		}
+	}
+	snprintf(text, sizeof(text), "gpu %u frames read back %u dropped", state->gpu_timer.resolved, state->gpu_timer.dropped);
+	render_stats_line(state, text, &y);
+
+	const PickStats *picks = &state->pick_stats;
+	snprintf(text, sizeof(text), "picking on the %s", state->pick_mode == PICK_CPU ? "cpu" : "gpu");
+	render_stats_line(state, text, &y);
+	snprintf(text, sizeof(text), "cpu pick %.3f ms gpu pick %.3f ms %u frames", picks->cpu_ms, picks->gpu_ms, picks->latency_frames);
+	render_stats_line(state, text, &y);
+	snprintf(text, sizeof(text), "gpu picks %u mismatched %u", picks->requests, picks->mismatches);
+	render_stats_line(state, text, &y);
+
+	const EditStats *edits = &state->edit_stats;
+	snprintf(text, sizeof(text), "contacts %s", state->resolve_contacts ? "resolved" : "revert the step");
+	render_stats_line(state, text, &y);
+	snprintf(text, sizeof(text), "edit %u checks kept %.3f of the step", edits->iterations, edits->kept);
+	render_stats_line(state, text, &y);
+	snprintf(text, sizeof(text), "%.2f checks per resolved edit", edits->resolved_edits ? (float)edits->resolve_iterations / edits->resolved_edits : 0.f);
+	render_stats_line(state, text, &y);
+
+	if (state->shadow_mode == SHADOW_CASCADED) {
+		for (unsigned int i = 0; i < state->cascade_count; i++) {
+			const Cascade *cascade = &state->cascades[i];
+			snprintf(text, sizeof(text), "cascade %u %.1f to %.1f %.3f texel %u draws %llu fill", i,
+				cascade->near, cascade->far, cascade->texel_size, state->cascade_stats[i].draw_calls, state->cascade_stats[i].fill);
+			render_stats_line(state, text, &y);
+		}
+	}
+}
+
+static void render_selected_limb(app_state *state)
+{
+	gfx_bind_vertex_array(&state->gfx, state->triangle_vao);
+
+	// The stencil mask is still 0 from the start of the frame.
+	gfx_stencil_func(&state->gfx, GFX_NOTEQUAL, 1, 0xFF);
+	gfx_disable(&state->gfx, GFX_DEPTH_TEST);
+
+	gfx_use_program(&state->gfx, state->outline_shader.program);
+
+	gfx_uniform_matrix_4fv(&state->gfx, state->outline_shader.projection, 1, state->cur_cam->frustrum);
+	gfx_uniform_matrix_4fv(&state->gfx, state->outline_shader.view, 1, state->cur_cam->view);
+
+	draw_node_tree(state, state->limbs.at(0), state->outline_shader.model, true, false);
+
+	gfx_stencil_mask(&state->gfx, 0xFF);
+	gfx_stencil_func(&state->gfx, GFX_ALWAYS, 1, 0xFF);
+	gfx_enable(&state->gfx, GFX_DEPTH_TEST);
+}
+
+static void render_selected_prop(app_state *state)
+{
+	if (state->selected_prop < 0) {
+		return;
+	}
+
+	gfx_bind_vertex_array(&state->gfx, state->cylinder_vao);
+
+	gfx_stencil_func(&state->gfx, GFX_NOTEQUAL, 1, 0xFF);
+	gfx_stencil_mask(&state->gfx, 0x00);
+	gfx_disable(&state->gfx, GFX_DEPTH_TEST);
+
+	gfx_use_program(&state->gfx, state->outline_shader.program);
+
+	gfx_uniform_matrix_4fv(&state->gfx, state->outline_shader.projection, 1, state->cur_cam->frustrum);
+	gfx_uniform_matrix_4fv(&state->gfx, state->outline_shader.view, 1, state->cur_cam->view);
+	gfx_uniform_matrix_4fv(&state->gfx, state->outline_shader.model, 1, state->cylinder_models[state->selected_prop]);
+
+	gfx_draw_elements(&state->gfx, GFX_TRIANGLES, SEGMENTS * 3 * 4);
+
+	gfx_stencil_mask(&state->gfx, 0xFF);
+	gfx_stencil_func(&state->gfx, GFX_ALWAYS, 1, 0xFF);
+	gfx_enable(&state->gfx, GFX_DEPTH_TEST);
+}
+
+static void render_selected_button(app_state *state)
+{
+	gfx_use_program(&state->gfx, state->outline_shader.program);
+
+	float m[16];
+	mat4_identity(m);
+
+	gfx_uniform_matrix_4fv(&state->gfx, state->outline_shader.projection, 1, state->cur_cam->ortho);
+	gfx_uniform_matrix_4fv(&state->gfx, state->outline_shader.view, 1, m);
+
+	Button edit_button = state->buttons.at(state->edit_mode);
+
+	float model[16];
+	mat4_identity(model);
+	mat4_translate(model, edit_button.pos.x, edit_button.pos.y, 0.f);
+	mat4_scale(model, edit_button.size.x * 1.1f, edit_button.size.y * 1.1f, 0.f);
+
+	// The buttons were drawn writing the stencil, the outlines go around them.
+	gfx_stencil_func(&state->gfx, GFX_NOTEQUAL, 1, 0xFF);
+	gfx_stencil_mask(&state->gfx, 0x00);
+
+	gfx_bind_texture(&state->gfx, GFX_TEXTURE_2D, state->buttons.at(state->edit_mode).texture);
+
+	gfx_uniform_matrix_4fv(&state->gfx, state->outline_shader.model, 1, model);
+	gfx_draw_elements(&state->gfx, GFX_TRIANGLES, 6);
+
+	unsigned int axis_button_index = 2 + state->axis;
+	Button axis_button = state->buttons.at(axis_button_index);
+
+	mat4_identity(model);
+	mat4_translate(model, axis_button.pos.x, axis_button.pos.y, 0.f);
+	mat4_scale(model, axis_button.size.x * 1.1f, axis_button.size.y * 1.1f, 0.f);
+
+	gfx_bind_texture(&state->gfx, GFX_TEXTURE_2D, axis_button.texture);
+
+	gfx_uniform_matrix_4fv(&state->gfx, state->outline_shader.model, 1, model);
+	gfx_draw_elements(&state->gfx, GFX_TRIANGLES, 6);
+
+	gfx_stencil_mask(&state->gfx, 0xFF);
+	gfx_stencil_func(&state->gfx, GFX_ALWAYS, 1, 0xFF);
+}
+
+static int rect_area(const ShadowRect &r)
+{
+	return (r.x1 > r.x0 && r.y1 > r.y0) ? (r.x1 - r.x0) * (r.y1 - r.y0) : 0;
+}
+
+static ShadowRect rect_union(const ShadowRect &a, const ShadowRect &b)
+{
+	if (!rect_area(a)) return b;
+	if (!rect_area(b)) return a;
+
+	return { std::min(a.x0, b.x0), std::min(a.y0, b.y0), std::max(a.x1, b.x1), std::max(a.y1, b.y1) };
+}
+
+// Texels of the shadow map covered by a model space box.
+static ShadowRect shadow_rect_from_box(const float *light_space_matrix, unsigned int size, const float *model, const float *min, const float *max)
+{
+	Aabb box = aabb_from_box(model, min, max);
+
+	float lo[2] = { 1.f, 1.f }, hi[2] = { -1.f, -1.f };
+	for (unsigned int i = 0; i < 8; i++) {
+		V4 p = { (i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z, 1.f };
+		p = mat4_transform(light_space_matrix, p);
+
+		for (unsigned int j = 0; j < 2; j++) {
+			lo[j] = std::min(lo[j], p.E[j] / p.w);
+			hi[j] = std::max(hi[j], p.E[j] / p.w);
+		}
+	}
+
+	const float half = 0.5f * size;
+	ShadowRect r;
+	r.x0 = std::max((int)floorf((lo[0] + 1.f) * half) - SHADOW_RECT_PADDING, 0);
+	r.y0 = std::max((int)floorf((lo[1] + 1.f) * half) - SHADOW_RECT_PADDING, 0);
+	r.x1 = std::min((int)ceilf((hi[0] + 1.f) * half) + SHADOW_RECT_PADDING, (int)size);
+	r.y1 = std::min((int)ceilf((hi[1] + 1.f) * half) + SHADOW_RECT_PADDING, (int)size);
+
+	return r;
+}
+
+static ShadowRect skeleton_shadow_rect(app_state *state, const float *light_space_matrix, unsigned int size)
+{
+	ShadowRect r = {};
+	for (auto &l : state->limbs) {
+		r = rect_union(r, shadow_rect_from_box(light_space_matrix, size, l->model, LIMB_BOX_MIN, LIMB_BOX_MAX));
+	}
+
+	return r;
+}
+
+static float pass_depth(const FramePass &pass, const float *model)
+{
+	return v3_dot({ model[12] - pass.eye.x, model[13] - pass.eye.y, model[14] - pass.eye.z }, pass.forward);
+}
+
+static void submit_floor(app_state *state, const std::vector<FramePass> &passes, unsigned int pass, unsigned int program)
+{
+	float model[16];
+	mat4_identity(model);
+	mat4_scale(model, 300.f, 1.f, 300.f);
+
+	DrawItem *d = render_queue_push(&state->render_queue, pass, program, program == PROGRAM_DEPTH ? MATERIAL_NONE : MATERIAL_FLOOR, state->triangle_vao, pass_depth(passes[pass], model));
+	memcpy(d->model, model, sizeof(d->model));
+	d->count = 6;
+	d->object_id = 0;
+}
+
+// Limb models must be current, see update_limb_cull_bounds.
+static void submit_skeleton(app_state *state, const std::vector<FramePass> &passes, unsigned int pass, unsigned int program, const VisibleSet *visible)
+{
+	for (auto i : visible->limbs) {
+		const Node *limb = state->limbs[i];
+
+		DrawItem *d = render_queue_push(&state->render_queue, pass, program, program == PROGRAM_DEPTH ? MATERIAL_NONE : MATERIAL_LIMB, state->box->vao, pass_depth(passes[pass], limb->model));
+		memcpy(d->model, limb->model, sizeof(d->model));
+		d->count = 3 * state->box->polygons.size();
+		d->object_id = limb->id + 1;
+	}
+}
+
+static void submit_cylinders(app_state *state, const std::vector<FramePass> &passes, unsigned int pass, unsigned int program, const VisibleSet *visible)
+{
+	for (auto i : visible->props) {
+		const float *model = state->cylinder_models[i];
+
+		DrawItem *d = render_queue_push(&state->render_queue, pass, program, program == PROGRAM_DEPTH ? MATERIAL_NONE : MATERIAL_PROP, state->cylinder_vao, pass_depth(passes[pass], model));
+		memcpy(d->model, model, sizeof(d->model));
+		d->count = SEGMENTS * 3 * 4;
+		d->object_id = state->limbs.size() + 1 + i;
+	}
+}
+
+// Queues every caster into the shadow map.
+static void submit_shadow_casters(app_state *state, std::vector<FramePass> &passes, const float *light_space_matrix, const FramePass &light)
+{
+	const ShadowRect full = { 0, 0, (int)SHADOW_MAP_SIZE, (int)SHADOW_MAP_SIZE };
+	const VisibleSet *visible = &state->visible[CULL_SHADOW];
+
+	FramePass pass = light;
+	pass.begin = [state]()
+	{
+		gfx_bind_framebuffer(&state->gfx, GFX_FRAMEBUFFER, state->depth_map_fbo);
+		gfx_viewport(&state->gfx, 0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+		gfx_clear(&state->gfx, GFX_DEPTH_BUFFER_BIT);
+	};
+	passes.push_back(pass);
+
+	const unsigned int index = passes.size() - 1;
+	submit_floor(state, passes, index, PROGRAM_DEPTH);
+	submit_skeleton(state, passes, index, PROGRAM_DEPTH, visible);
+	submit_cylinders(state, passes, index, PROGRAM_DEPTH, visible);
+
+	state->shadow_stats.draw_calls += 1 + visible->limbs.size() + visible->props.size();
+	state->shadow_stats.fill += 2 * rect_area(full) + rect_area(skeleton_shadow_rect(state, light_space_matrix, SHADOW_MAP_SIZE));
+	for (auto i : visible->props) {
+		state->shadow_stats.fill += rect_area(shadow_rect_from_box(light_space_matrix, SHADOW_MAP_SIZE, state->cylinder_models[i], CYLINDER_BOX_MIN, CYLINDER_BOX_MAX));
+	}
+}
+
+// Queues the floor and cylinders into the static shadow map if it is stale, then
+// a pass that restores the region the skeleton covered last frame from it and
+// draws the skeleton on top. Only the union of the old and new skeleton bounds
+// changes.
+static void submit_cached_shadow_casters(app_state *state, std::vector<FramePass> &passes, const float *light_space_matrix, const FramePass &light, bool rebuild)
+{
+	const ShadowRect full = { 0, 0, (int)SHADOW_MAP_SIZE, (int)SHADOW_MAP_SIZE };
+	const VisibleSet *visible = &state->visible[CULL_SHADOW];
+
+	if (rebuild) {
+		FramePass pass = light;
+		pass.begin = [state]()
+		{
+			gfx_bind_framebuffer(&state->gfx, GFX_FRAMEBUFFER, state->static_depth_fbo);
+			gfx_viewport(&state->gfx, 0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+			gfx_clear(&state->gfx, GFX_DEPTH_BUFFER_BIT);
+		};
+		passes.push_back(pass);
+
+		submit_floor(state, passes, passes.size() - 1, PROGRAM_DEPTH);
+		submit_cylinders(state, passes, passes.size() - 1, PROGRAM_DEPTH, visible);
+
+		state->shadow_stats.draw_calls += 1 + visible->props.size();
+		state->shadow_stats.fill += 2 * rect_area(full);
+		for (auto i : visible->props) {
+			state->shadow_stats.fill += rect_area(shadow_rect_from_box(light_space_matrix, SHADOW_MAP_SIZE, state->cylinder_models[i], CYLINDER_BOX_MIN, CYLINDER_BOX_MAX));
+		}
+		state->shadow_stats.cache_rebuilds++;
+		state->shadow_cache_valid = true;
+	}
+
+	const ShadowRect skeleton = skeleton_shadow_rect(state, light_space_matrix, SHADOW_MAP_SIZE);
+	const ShadowRect dirty = rebuild ? full : rect_union(state->skeleton_shadow_rect, skeleton);
+
+	FramePass pass = light;
+	pass.begin = [state, dirty]()
+	{
+		gfx_bind_framebuffer(&state->gfx, GFX_READ_FRAMEBUFFER, state->static_depth_fbo);
+		gfx_bind_framebuffer(&state->gfx, GFX_DRAW_FRAMEBUFFER, state->depth_map_fbo);
+		if (rect_area(dirty)) {
+			gfx_blit_framebuffer(&state->gfx, dirty.x0, dirty.y0, dirty.x1, dirty.y1, dirty.x0, dirty.y0, dirty.x1, dirty.y1, GFX_DEPTH_BUFFER_BIT, GFX_NEAREST);
+		}
+		gfx_bind_framebuffer(&state->gfx, GFX_FRAMEBUFFER, state->depth_map_fbo);
+		gfx_viewport(&state->gfx, 0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+	};
+	passes.push_back(pass);
+
+	submit_skeleton(state, passes, passes.size() - 1, PROGRAM_DEPTH, visible);
+
+	state->shadow_stats.draw_calls += visible->limbs.size();
+	state->shadow_stats.fill += rect_area(dirty) + rect_area(skeleton);
+	state->skeleton_shadow_rect = skeleton;
+}
+
+// Limb bounds follow the pose, so they are refreshed before any pass is culled.
+static void update_limb_cull_bounds(app_state *state)
+{
+	update_node_tree(state, state->limbs[0]);
+
+	cull_bounds_resize(&state->limb_cull_bounds, state->limbs.size());
+	for (unsigned int i = 0; i < state->limbs.size(); i++) {
+		cull_bounds_set(&state->limb_cull_bounds, i, aabb_from_box(state->limbs[i]->model, LIMB_BOX_MIN, LIMB_BOX_MAX));
+	}
+}
+
+// Fills a pass's visible lists from the frustum of a projection * view matrix.
+static void cull_pass(app_state *state, const float *matrix, VisibleSet *set)
+{
+	PROFILE_FUNCTION();
+
+	auto start = std::chrono::steady_clock::now();
+
+	if (state->culling) {
+		Frustum frustum;
+		frustum_from_matrix(&frustum, matrix);
+		frustum_cull(&frustum, &state->prop_cull_bounds, set->props);
+		frustum_cull(&frustum, &state->limb_cull_bounds, set->limbs);
+	} else {
+		set->props.resize(state->prop_cull_bounds.count);
+		set->limbs.resize(state->limb_cull_bounds.count);
+		for (unsigned int i = 0; i < set->props.size(); i++) set->props[i] = i;
+		for (unsigned int i = 0; i < set->limbs.size(); i++) set->limbs[i] = i;
+	}
+
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+	set->stats.tested = state->prop_cull_bounds.count + state->limb_cull_bounds.count;
+	set->stats.visible = set->props.size() + set->limbs.size();
+	set->stats.ms = elapsed.count();
+}
+
+// Queues each cascade's casters with the light looking at the origin, like
+// the single map. Casters are culled against each cascade's light frustum, as
+// anything outside it can't shadow the slice. The cascade matrices already
+// include the light view.
+static void submit_cascades(app_state *state, std::vector<FramePass> &passes, const float *identity, const FramePass &light)
+{
+	float light_view[16];
+	mat4_identity(light_view);
+	mat4_look_at(light_view, state->light_0.pos, { 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f });
+
+	float splits[MAX_CASCADES];
+	cascade_splits(CAMERA_NEAR, SHADOW_DISTANCE, CASCADE_LAMBDA, state->cascade_count, splits);
+
+	const float aspect = (float)state->window_info.w / state->window_info.h;
+	const ShadowRect full = { 0, 0, (int)CASCADE_SIZE, (int)CASCADE_SIZE };
+
+	for (unsigned int i = 0; i < state->cascade_count; i++) {
+		Cascade *cascade = &state->cascades[i];
+		ShadowStats *stats = &state->cascade_stats[i];
+
+		fit_cascade(state->cur_cam, aspect, i ? splits[i - 1] : CAMERA_NEAR, splits[i], light_view, CASCADE_SIZE, cascade);
+
+		VisibleSet *visible = &state->visible[CULL_CASCADE + i];
+		cull_pass(state, cascade->matrix, visible);
+
+		FramePass pass = light;
+		pass.projection = cascade->matrix;
+		pass.view = identity;
+		pass.begin = [state, i]()
+		{
+			// Every cascade is the same size.
+			gfx_bind_framebuffer(&state->gfx, GFX_FRAMEBUFFER, state->cascade_fbos[i]);
+			if (i == 0) {
+				gfx_viewport(&state->gfx, 0, 0, CASCADE_SIZE, CASCADE_SIZE);
+			}
+			gfx_clear(&state->gfx, GFX_DEPTH_BUFFER_BIT);
+		};
+		passes.push_back(pass);
+
+		const unsigned int index = passes.size() - 1;
+
+		stats->draw_calls = 0;
+		stats->fill = rect_area(full);
+
+		submit_floor(state, passes, index, PROGRAM_DEPTH);
+		stats->draw_calls++;
+		stats->fill += rect_area(full);
+
+		submit_skeleton(state, passes, index, PROGRAM_DEPTH, visible);
+		stats->draw_calls += visible->limbs.size();
+		stats->fill += rect_area(skeleton_shadow_rect(state, cascade->matrix, CASCADE_SIZE));
+
+		submit_cylinders(state, passes, index, PROGRAM_DEPTH, visible);
+		stats->draw_calls += visible->props.size();
+		for (auto j : visible->props) {
+			stats->fill += rect_area(shadow_rect_from_box(cascade->matrix, CASCADE_SIZE, state->cylinder_models[j], CYLINDER_BOX_MIN, CYLINDER_BOX_MAX));
+		}
+
+		state->shadow_stats.draw_calls += stats->draw_calls;
+		state->shadow_stats.fill += stats->fill;
+	}
+}
+
+// Replays the queued passes. Each program's shared uniforms are uploaded once
+// per pass rather than once per object type.
+static void replay_render_queue(app_state *state, const std::vector<FramePass> &passes)
+{
+	PROFILE_FUNCTION();
+
+	const unsigned int programs[PROGRAM_COUNT] = { state->depth_shader.program, state->textured_shader.program, state->diffuse_shader.program };
+	const unsigned int models[PROGRAM_COUNT] = { state->depth_shader.model, state->textured_shader.model, state->diffuse_shader.model };
+	const unsigned int ids[PROGRAM_COUNT] = { GFX_NO_UNIFORM, state->textured_shader.object_id, state->diffuse_shader.object_id };
+
+	// Main pass materials are timed separately, see gpu-timer.h.
+	const unsigned int material_passes[] = { GPU_PASS_COUNT, GPU_PASS_FLOOR, GPU_PASS_SKELETON, GPU_PASS_CYLINDERS };
+
+	unsigned int program = PROGRAM_DEPTH;
+	unsigned int timed = GPU_PASS_COUNT;
+	const float *depth_view = 0; // The cascades share the identity view.
+	auto mark = [&](unsigned int gpu_pass)
+	{
+		if (gpu_pass != timed) {
+			gfx_timestamp(&state->gfx, gpu_pass);
+			timed = gpu_pass;
+		}
+	};
+
+	RenderQueueBackend backend;
+	backend.begin_pass = [&](unsigned int pass)
+	{
+		mark(passes[pass].gpu_pass);
+		passes[pass].begin();
+	};
+	backend.use_program = [&](unsigned int p)
+	{
+		program = p;
+		gfx_use_program(&state->gfx, programs[p]);
+	};
+	backend.setup_program = [&](unsigned int p, unsigned int pass)
+	{
+		if (p == PROGRAM_DEPTH) {
+			gfx_uniform_matrix_4fv(&state->gfx, state->depth_shader.projection, 1, passes[pass].projection);
+			if (passes[pass].view != depth_view) {
+				gfx_uniform_matrix_4fv(&state->gfx, state->depth_shader.view, 1, passes[pass].view);
+				depth_view = passes[pass].view;
+			}
+		} else if (p == PROGRAM_TEXTURED) {
+			textured_shader_setup(state);
+			gfx_uniform_matrix_4fv(&state->gfx, state->textured_shader.light_space_matrix, 1, passes[pass].light_space_matrix);
+		} else {
+			diffuse_shader_setup(state);
+			gfx_uniform_matrix_4fv(&state->gfx, state->diffuse_shader.light_space_matrix, 1, passes[pass].light_space_matrix);
+		}
+	};
+	backend.bind_material = [&](unsigned int, unsigned int material)
+	{
+		const V3 limb_colour = { 1.f, 1.f, 1.f }, prop_colour = { 0.f, 0.5f, 0.f };
+
+		if (material == MATERIAL_FLOOR) {
+			gfx_active_texture(&state->gfx, GFX_TEXTURE0 + 1);
+			gfx_bind_texture(&state->gfx, GFX_TEXTURE_2D, state->floor_tex);
+		} else if (material == MATERIAL_LIMB) {
+			gfx_uniform_3fv(&state->gfx, state->diffuse_shader.object_colour, 1, (float *)&limb_colour);
+		} else if (material == MATERIAL_PROP) {
+			gfx_uniform_3fv(&state->gfx, state->diffuse_shader.object_colour, 1, (float *)&prop_colour);
+		}
+	};
+	backend.bind_vao = [&](unsigned int vao)
+	{
+		gfx_bind_vertex_array(&state->gfx, vao);
+	};
+	backend.draw = [&](const DrawItem *item)
+	{
+		if (item->material != MATERIAL_NONE) {
+			mark(material_passes[item->material]);
+		}
+
+		gfx_uniform_matrix_4fv(&state->gfx, models[program], 1, item->model);
+		if (ids[program] != GFX_NO_UNIFORM) {
+			gfx_uniform_1ui(&state->gfx, ids[program], item->object_id);
+		}
+		gfx_draw_elements(&state->gfx, GFX_TRIANGLES, item->count);
+	};
+
+	QueueStats *stats = &state->queue_stats;
+	stats->items = state->render_queue.items.size();
+
+	auto start = std::chrono::steady_clock::now();
+	render_queue_sort(&state->render_queue);
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	stats->sort_ms = elapsed.count();
+
+	render_queue_count_submitted(&state->render_queue, &stats->submitted);
+	render_queue_replay(&state->render_queue, passes.size(), &backend, &stats->sorted);
+}
+
+// Records the frame into state->gfx.
+void render(app_state *state)
+{
+	PROFILE_FUNCTION();
+
+	gfx_reset(&state->gfx);
+
+	gfx_stencil_mask(&state->gfx, 0x00);
+
+	// The cached static casters are only valid for the light they were drawn
+	// with, so the shadows follow the light in steps of SHADOW_CACHE_DEGREES.
+	bool rebuild = !state->shadow_caching || !state->shadow_cache_valid;
+	if (!rebuild) {
+		const float cos_moved = v3_dot(v3_normalise(state->light_0.pos), v3_normalise(state->shadow_light_pos));
+		rebuild = cos_moved < cosf(radians(SHADOW_CACHE_DEGREES));
+	}
+
+	if (rebuild) {
+		state->shadow_light_pos = state->light_0.pos;
+	}
+
+	// Cascades don't draw into the cached map, so it's stale by the time the
+	// single map is switched back to.
+	if (state->shadow_mode == SHADOW_CASCADED) {
+		state->shadow_cache_valid = false;
+	}
+
+	float light_projection[16], light_view[16];
+	mat4_identity(light_projection);
+	mat4_identity(light_view);
+	mat4_ortho(light_projection, -200.f, 200.f, -200.f, 200.f, 1.f, 1000.f);
+	mat4_look_at(light_view, state->shadow_light_pos, { 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f });
+
+	float light_space_matrix[16];
+	mat4_identity(light_space_matrix);
+	mat4_multiply(light_space_matrix, light_projection, light_view);
+
+	gfx_clear_colour(&state->gfx, 0.1f, 0.1f, 0.1f, 1.f);
+
+	update_limb_cull_bounds(state);
+
+	float view_projection[16];
+	mat4_multiply(view_projection, state->cur_cam->frustrum, state->cur_cam->view);
+	cull_pass(state, view_projection, &state->visible[CULL_MAIN]);
+
+	if (state->shadow_mode == SHADOW_SINGLE) {
+		cull_pass(state, light_space_matrix, &state->visible[CULL_SHADOW]);
+	}
+
+	render_queue_clear(&state->render_queue);
+
+	std::vector<FramePass> passes;
+
+	float identity[16];
+	mat4_identity(identity);
+
+	// Render the shadow map from the lights POV.
+	FramePass light = {};
+	light.projection = light_projection;
+	light.view = light_view;
+	light.eye = state->shadow_light_pos;
+	light.forward = v3_normalise({ -light.eye.x, -light.eye.y, -light.eye.z });
+	light.gpu_pass = GPU_PASS_SHADOW;
+
+	state->shadow_stats.draw_calls = 0;
+	state->shadow_stats.fill = 0;
+
+	{
+		PROFILE_ZONE("shadow pass");
+
+		if (state->shadow_mode == SHADOW_CASCADED) {
+			submit_cascades(state, passes, identity, light);
+		} else if (state->shadow_caching) {
+			submit_cached_shadow_casters(state, passes, light_space_matrix, light, rebuild);
+		} else {
+			submit_shadow_casters(state, passes, light_space_matrix, light);
+		}
+	}
+
+	// When GPU picking, the scene goes to an offscreen target so the lit pass
+	// can also write object ids. It is blitted to the screen at the end.
+	const bool id_buffer = state->pick_mode == PICK_GPU;
+	const unsigned int draw_buffers[2] = { GFX_COLOR_ATTACHMENT0, GFX_COLOR_ATTACHMENT1 };
+
+	FramePass main = {};
+	main.projection = state->cur_cam->frustrum;
+	main.view = state->cur_cam->view;
+	main.light_space_matrix = light_space_matrix;
+	main.eye = state->cur_cam->pos;
+	main.forward = state->cur_cam->front;
+	main.gpu_pass = GPU_PASS_CLEAR;
+	main.begin = [state, id_buffer, &draw_buffers]()
+	{
+		// Shadow passes cull front faces.
+		gfx_cull_face(&state->gfx, GFX_BACK);
+
+		gfx_bind_framebuffer(&state->gfx, GFX_FRAMEBUFFER, id_buffer ? state->scene_fbo : 0);
+		gfx_viewport(&state->gfx, 0, 0, state->window_info.w, state->window_info.h);
+
+		// Finally render to screen.
+		gfx_clear(&state->gfx, GFX_COLOR_BUFFER_BIT | GFX_DEPTH_BUFFER_BIT);
+
+		if (id_buffer) {
+			const unsigned int no_object[4] = { 0, 0, 0, 0 };
+			gfx_draw_buffers(&state->gfx, 2, draw_buffers);
+			gfx_clear_buffer_uiv(&state->gfx, GFX_COLOR, 1, no_object);
+		}
+
+		gfx_active_texture(&state->gfx, GFX_TEXTURE0 + 2);
+		gfx_bind_texture(&state->gfx, GFX_TEXTURE_2D_ARRAY, state->cascade_maps);
+
+		gfx_active_texture(&state->gfx, GFX_TEXTURE0);
+		gfx_bind_texture(&state->gfx, GFX_TEXTURE_2D, state->depth_map);
+	};
+	passes.push_back(main);
+
+	const unsigned int main_pass = passes.size() - 1;
+	submit_floor(state, passes, main_pass, PROGRAM_TEXTURED);
+	submit_skeleton(state, passes, main_pass, PROGRAM_DIFFUSE, &state->visible[CULL_MAIN]);
+	submit_cylinders(state, passes, main_pass, PROGRAM_DIFFUSE, &state->visible[CULL_MAIN]);
+
+	gfx_cull_face(&state->gfx, GFX_FRONT);
+	replay_render_queue(state, passes);
+
+	// Nothing after this point is pickable.
+	if (id_buffer) {
+		gfx_draw_buffers(&state->gfx, 1, draw_buffers);
+	}
+
+	gfx_timestamp(&state->gfx, GPU_PASS_SKYBOX);
+	gfx_depth_func(&state->gfx, GFX_LEQUAL);
+	draw_skybox(state);
+	gfx_depth_func(&state->gfx, GFX_LESS);
+
+	gfx_timestamp(&state->gfx, GPU_PASS_OUTLINE);
+	gfx_clear(&state->gfx, GFX_STENCIL_BUFFER_BIT);
+
+	gfx_enable(&state->gfx, GFX_DEPTH_TEST);
+	gfx_stencil_op(&state->gfx, GFX_KEEP, GFX_KEEP, GFX_REPLACE);
+
+	if (state->show_interface) {
+		render_selected_limb(state);
+		render_selected_prop(state);
+	}
+
+	gfx_timestamp(&state->gfx, GPU_PASS_UI);
+
+	if (state->show_interface) {
+		gfx_use_program(&state->gfx, state->interface_shader.program);
+		render_interface(state);
+		render_selected_button(state);
+	}
+
+	if (state->show_gpu_times) {
+		gfx_use_program(&state->gfx, state->interface_shader.program);
+		render_gpu_times(state);
+		render_frame_stats(state);
+	}
+
+	if (id_buffer) {
+		const unsigned int w = state->window_info.w, h = state->window_info.h;
+
+		// The lit pass bound the scene target for reading too.
+		gfx_read_buffer(&state->gfx, GFX_COLOR_ATTACHMENT0);
+		gfx_bind_framebuffer(&state->gfx, GFX_DRAW_FRAMEBUFFER, 0);
+		gfx_blit_framebuffer(&state->gfx, 0, 0, w, h, 0, 0, w, h, GFX_COLOR_BUFFER_BIT, GFX_NEAREST);
+		gfx_bind_framebuffer(&state->gfx, GFX_FRAMEBUFFER, 0);
+	}
+
+	gfx_timestamp(&state->gfx, GPU_PASS_COUNT);
+}
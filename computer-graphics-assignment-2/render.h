@@ -0,0 +1,23 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "app.h"
+
+// Drawing the frame. render() only records into state->gfx and uses no GL or
+// platform headers, so it can also run against the null backend.
+
+static const int SEGMENTS = 12; // for cylinder
+
+// Model space boxes used for picking.
+static const float LIMB_BOX_MIN[3] = { -0.5f, 0.f, -0.5f };
+static const float LIMB_BOX_MAX[3] = { 0.5f, 1.f, 0.5f };
+static const float CYLINDER_BOX_MIN[3] = { -0.5f, 0.f, -0.5f };
+static const float CYLINDER_BOX_MAX[3] = { 0.5f, 3.f, 0.5f };
+
+static const float CAMERA_NEAR = .05f; // Matches camera_frustrum.
+static const unsigned int CASCADE_SIZE = 1024;
+
+extern void update_node_tree(app_state *state, Node *node);
+extern void render(app_state *state);
+
+#endif
@@ -0,0 +1,457 @@
+#include "scene.h"
+
+#include <random>
+
+#include "render.h"
+
+static const float SPACING = 1.f;
+static const float ROOT_WIDTH = 5;
+static const float LEG_WIDTH = 1;
+static const float LEG_HEIGHT = 3;
+static const float ARM_WIDTH = 3;
+static const float ARM_HEIGHT = 1;
+static const float SPINE_WIDTH = 1;
+static const float SPINE_HEIGHT = 3;
+static const float ROOT_LEG_OFFSET = (ROOT_WIDTH - 1.f) / 2.f;
+static const float SPINE_ARM_OFFSET = SPINE_WIDTH / 2.f + SPACING;
+static const float LOWER_ARM_OFFSET = ARM_WIDTH + SPACING;
+static const float LOWER_LEG_OFFSET = LEG_HEIGHT + SPACING;
+static const float LOWER_SPINE_OFFSET = 2 * SPACING;
+static const float UPPER_SPINE_OFFSET = SPINE_HEIGHT + SPACING;
+
+static const V3 CYLINDER_SCALE = { 3.f, 2.f, 3.f }; // Applied by the cylinder model matrices.
+
+static const unsigned int CASCADE_COUNT = 3;
+
+// Caps around the y axis from 0 to 3 with a radius of 0.5, see CYLINDER_BOX_MIN.
+void cylinder_mesh(std::vector<float> &vertices, std::vector<unsigned int> &indices)
+{
+	const float length = 3.f;
+
+	// Calculate angle between each triangle.
+	const float theta = (2 * M_PI) / SEGMENTS;
+	const float r = 0.5f;
+
+	// Center vertex.
+	const unsigned int face_verts_count = SEGMENTS + 1;
+	const unsigned int cylinder_verts_count = face_verts_count * 2;
+
+	const unsigned int face_verts_data_offset = face_verts_count * 8;
+
+	// Array for vertex points.
+	const unsigned VERT_DATA_COUNT = face_verts_data_offset * 2;
+	vertices.assign(VERT_DATA_COUNT, 0.f);
+	float *CYLINDER = vertices.data();
+
+	CYLINDER[4] = 1.f;
+	CYLINDER[face_verts_count + 1] = length;
+	CYLINDER[face_verts_count + 4] = 1.f;
+
+	// Calculate x,y for each point.
+	for (unsigned int i = 1, j = i - 1; i < face_verts_count; ++i, ++j) {
+		const unsigned int k = i * 8;
+		CYLINDER[k + 0] = r * sin(j * theta);
+		CYLINDER[k + 1] = 0.f;
+		CYLINDER[k + 2] = r * cos(j * theta);
+		CYLINDER[k + 3] = r * sin(j * theta);
+		CYLINDER[k + 4] = -1.f;
+		CYLINDER[k + 5] = r * cos(j * theta);
+		CYLINDER[k + 6] = 0.f;
+		CYLINDER[k + 7] = 0.f;
+
+		// 2nd circle face.
+		const unsigned int l = (face_verts_count * 8) + i * 8;
+		CYLINDER[l + 0] = r * sin(j * theta);
+		CYLINDER[l + 1] = length;
+		CYLINDER[l + 2] = r * cos(j * theta);
+		CYLINDER[l + 3] = r * sin(j * theta);
+		CYLINDER[l + 4] = 1.f;
+		CYLINDER[l + 5] = r * cos(j * theta);
+		CYLINDER[l + 6] = 0.f;
+		CYLINDER[l + 7] = 0.f;
+	}
+
+	const unsigned int face_indices_offset = SEGMENTS * 3;
+
+	// Polygon data.
+	const unsigned POLY_DATA_COUNT = face_indices_offset * 4;
+	indices.assign(POLY_DATA_COUNT, 0);
+	unsigned int *POLY = indices.data();
+
+	// Bottom face
+	for (int i = 0; i < SEGMENTS; ++i) {
+		const int j = i * 3;
+		POLY[j + 0] = 0;
+		POLY[j + 1] = face_verts_count - i - 2;
+		POLY[j + 2] = face_verts_count - i - 1;
+	}
+
+	// Top face
+	for (int i = 0; i < SEGMENTS; ++i) {
+		const int j = (SEGMENTS + i) * 3;
+		POLY[j + 0] = face_verts_count;
+		POLY[j + 1] = cylinder_verts_count - i - 2;
+		POLY[j + 2] = cylinder_verts_count - i - 1;
+	}
+
+	// Triangle 1 connecting face
+	for (int i = 0; i < SEGMENTS; ++i) {
+		const int j = (SEGMENTS * 2 + i) * 3;
+		POLY[j + 0] = face_verts_count - i - 2;
+		POLY[j + 1] = face_verts_count - i - 1;
+		POLY[j + 2] = cylinder_verts_count - i - 1;
+	}
+
+	// Triangle 2 connecting face
+	for (int i = 0; i < SEGMENTS; ++i) {
+		const int j = (SEGMENTS * 3 + i) * 3;
+		POLY[j + 0] = face_verts_count - i - 2;
+		POLY[j + 1] = cylinder_verts_count - i - 1;
+		POLY[j + 2] = cylinder_verts_count - i - 2;
+	}
+
+	POLY[POLY_DATA_COUNT - (face_indices_offset * 3) - 2] = SEGMENTS;
+	POLY[POLY_DATA_COUNT - (face_indices_offset * 2) - 2] = SEGMENTS * 2 + 1;
+	POLY[POLY_DATA_COUNT - (face_indices_offset * 1) - 3] = SEGMENTS;
+
+	POLY[POLY_DATA_COUNT - (face_indices_offset * 0) - 3] = SEGMENTS;
+	POLY[POLY_DATA_COUNT - (face_indices_offset * 0) - 1] = SEGMENTS * 2 + 1;
+}
+
+static void create_skeleton(app_state *state)
+{
+	Node *root = create_node();
+	root->translation = { 0, 8, 0 };
+	root->scale = { ROOT_WIDTH, 1, 1 };
+
+	Node *upper_left_leg = create_node();
+	upper_left_leg->translation = { -ROOT_LEG_OFFSET, -SPACING, 0 };
+	upper_left_leg->scale = { LEG_WIDTH, LEG_HEIGHT, LEG_WIDTH };
+	upper_left_leg->rotation = { 0, 0, 180 };
+
+	Node *upper_right_leg = create_node();
+	upper_right_leg->translation = { ROOT_LEG_OFFSET, -SPACING, 0 };
+	upper_right_leg->scale = { LEG_WIDTH, LEG_HEIGHT, LEG_WIDTH };
+	upper_right_leg->rotation = { 0, 0, 180 };
+
+	Node *lower_left_leg = create_node();
+	lower_left_leg->translation = { 0, LOWER_LEG_OFFSET, 0 };
+	lower_left_leg->scale = { LEG_WIDTH, LEG_HEIGHT, LEG_WIDTH };
+	lower_left_leg->rotation = { 0, 0, 0 };
+	lower_left_leg->flip = true;
+
+	Node *lower_right_leg = create_node();
+	lower_right_leg->translation = { 0, LOWER_LEG_OFFSET, 0 };
+	lower_right_leg->scale = { LEG_WIDTH, LEG_HEIGHT, LEG_WIDTH };
+	lower_right_leg->rotation = { 0, 0, 0 };
+	lower_right_leg->flip = true;
+
+	Node *lower_spine = create_node();
+	lower_spine->translation = { 0, LOWER_SPINE_OFFSET, 0 };
+	lower_spine->scale = { SPINE_WIDTH, SPINE_HEIGHT, SPINE_WIDTH };
+	lower_spine->rotation = { 0, 0, 0 };
+
+	Node *upper_spine = create_node();
+	upper_spine->translation = { 0, UPPER_SPINE_OFFSET, 0 };
+	upper_spine->scale = { SPINE_WIDTH, SPINE_HEIGHT, SPINE_WIDTH };
+	upper_spine->rotation = { 0, 0, 0 };
+
+	Node *upper_left_arm = create_node();
+	upper_left_arm->translation = { -SPINE_ARM_OFFSET, 0, 0 };
+	upper_left_arm->scale = { ARM_HEIGHT, ARM_WIDTH, ARM_HEIGHT };
+	upper_left_arm->rotation = { 0, 0, 90 };
+
+	Node *upper_right_arm = create_node();
+	upper_right_arm->translation = { SPINE_ARM_OFFSET, 0, 0 };
+	upper_right_arm->scale = { ARM_HEIGHT, ARM_WIDTH, ARM_HEIGHT };
+	upper_right_arm->rotation = { 0, 0, -90 };
+
+	Node *lower_left_arm = create_node();
+	lower_left_arm->translation = { 0, LOWER_ARM_OFFSET, 0 };
+	lower_left_arm->scale = { ARM_HEIGHT, ARM_WIDTH, ARM_HEIGHT };
+	lower_left_arm->rotation = { 0, 0, 10 };
+
+	Node *lower_right_arm = create_node();
+	lower_right_arm->translation = { 0, LOWER_ARM_OFFSET, 0 };
+	lower_right_arm->scale = { ARM_HEIGHT, ARM_WIDTH, ARM_HEIGHT };
+	lower_right_arm->rotation = { 0, 0, -10 };
+
+	root->children.push_back(upper_left_leg);
+	root->children.push_back(upper_right_leg);
+	root->children.push_back(lower_spine);
+	lower_spine->children.push_back(upper_spine);
+	upper_spine->children.push_back(upper_left_arm);
+	upper_spine->children.push_back(upper_right_arm);
+	upper_left_arm->children.push_back(lower_left_arm);
+	upper_right_arm->children.push_back(lower_right_arm);
+	upper_left_leg->children.push_back(lower_left_leg);
+	upper_right_leg->children.push_back(lower_right_leg);
+
+	state->limbs.push_back(root);
+	state->limbs.push_back(upper_spine);
+	state->limbs.push_back(lower_spine);
+	state->limbs.push_back(upper_left_arm);
+	state->limbs.push_back(upper_right_arm);
+	state->limbs.push_back(lower_left_arm);
+	state->limbs.push_back(lower_right_arm);
+	state->limbs.push_back(upper_left_leg);
+	state->limbs.push_back(upper_right_leg);
+	state->limbs.push_back(lower_left_leg);
+	state->limbs.push_back(lower_right_leg);
+
+	for (unsigned int i = 0; i < state->limbs.size(); i++) {
+		state->limbs[i]->id = i;
+	}
+}
+
+static void create_animation(app_state *state)
+{
+	std::vector<Node> frame1;
+	for (unsigned int i = 0; i < 11; i++) {
+		frame1.push_back(*state->limbs[i]);
+	}
+
+	frame1[3].rotation.x  = -26.f;
+	frame1[3].rotation.z  = 161.f;
+	frame1[4].rotation.x  = 47.f;
+	frame1[4].rotation.z  = -157.f;
+	frame1[5].rotation.x  = -61.f;
+	frame1[5].rotation.z  = 10.f;
+	frame1[6].rotation.x  = -94.f;
+	frame1[6].rotation.z  = -10.f;
+	frame1[7].rotation.x  = 48.f;
+	frame1[8].rotation.x  = -59.f;
+	frame1[9].rotation.x  = -14.f;
+	frame1[10].rotation.x = 53.f;
+
+	std::vector<Node> frame2;
+	for (unsigned int i = 0; i < 11; i++) {
+		frame2.push_back(*state->limbs[i]);
+	}
+
+	frame2[3].rotation.x = 70.f;
+	frame2[3].rotation.z = 152.f;
+	frame2[4].rotation.x = -40.f;
+	frame2[4].rotation.z = -148.f;
+	frame2[5].rotation.x = -91.f;
+	frame2[5].rotation.z = 9.f;
+	frame2[6].rotation.x = -78.f;
+	frame2[6].rotation.z = -2.f;
+	frame2[7].rotation.x = -45.f;
+	frame2[8].rotation.x = 44.f;
+	frame2[9].rotation.x = 48.f;
+	frame2[10].rotation.x = 61.f;
+
+	std::vector<Node> frame3;
+	for (unsigned int i = 0; i < 11; i++) {
+		frame3.push_back(*state->limbs[i]);
+	}
+
+	frame3[3].rotation.x = -26.f;
+	frame3[3].rotation.z = 161.f;
+	frame3[4].rotation.x = 47.f;
+	frame3[4].rotation.z = -157.f;
+	frame3[5].rotation.x = -61.f;
+	frame3[5].rotation.z = 10.f;
+	frame3[6].rotation.x = -94.f;
+	frame3[6].rotation.z = -10.f;
+	frame3[7].rotation.x = 48.f;
+	frame3[8].rotation.x = -59.f;
+	frame3[9].rotation.x = -14.f;
+	frame3[10].rotation.x = 53.f;
+
+	std::vector<Node> frame4;
+	for (unsigned int i = 0; i < 11; i++) {
+		frame4.push_back(*state->limbs[i]);
+	}
+
+	frame4[3].rotation.x = 70.f;
+	frame4[3].rotation.z = 152.f;
+	frame4[4].rotation.x = -40.f;
+	frame4[4].rotation.z = -148.f;
+	frame4[5].rotation.x = -91.f;
+	frame4[5].rotation.z = 9.f;
+	frame4[6].rotation.x = -78.f;
+	frame4[6].rotation.z = -2.f;
+	frame4[7].rotation.x = -45.f;
+	frame4[8].rotation.x = 44.f;
+	frame4[9].rotation.x = 48.f;
+	frame4[10].rotation.x = 61.f;
+
+	std::vector<Node> frame5;
+	for (unsigned int i = 0; i < 11; i++) {
+		frame5.push_back(*state->limbs[i]);
+	}
+
+	frame5[3].rotation.x = -26.f;
+	frame5[3].rotation.z = 161.f;
+	frame5[4].rotation.x = 47.f;
+	frame5[4].rotation.z = -157.f;
+	frame5[5].rotation.x = -61.f;
+	frame5[5].rotation.z = 10.f;
+	frame5[6].rotation.x = -94.f;
+	frame5[6].rotation.z = -10.f;
+	frame5[7].rotation.x = 48.f;
+	frame5[8].rotation.x = -59.f;
+	frame5[9].rotation.x = -14.f;
+	frame5[10].rotation.x = 53.f;
+
+	state->key_frames.push_back(frame1);
+	state->key_frames.push_back(frame2);
+	state->key_frames.push_back(frame3);
+	state->key_frames.push_back(frame4);
+	state->key_frames.push_back(frame5);
+}
+
+// Everything app_init sets up that doesn't need GL. Meshes, textures, shaders
+// and render targets must already be created, by GL or a software device.
+void scene_init(app_state *state)
+{
+	create_skeleton(state);
+	create_animation(state);
+
+	state->backup.resize(state->limbs.size());
+
+	camera_init(&state->main_cam);
+	state->main_cam.pos = { 0.f, 10.f, -20.f };
+	state->main_cam.front = { 0.f, 0.f, -1.f };
+	state->main_cam.yaw = 90;
+
+	camera_init(&state->skeleton_cam);
+
+	camera_frustrum(&state->skeleton_cam, state->window_info.w, state->window_info.h);
+	camera_ortho(&state->skeleton_cam, state->window_info.w, state->window_info.h);
+
+	camera_frustrum(&state->main_cam, state->window_info.w, state->window_info.h);
+	camera_ortho(&state->main_cam, state->window_info.w, state->window_info.h);
+
+	state->cur_cam = &state->main_cam;
+
+	state->selected = 0;
+	state->selected_prop = -1;
+
+	state->pick_mode = PICK_CPU;
+	state->pick_fence = 0;
+	state->pick_frame = 0;
+	state->pick_ray_pos = { 0, 0, 0 };
+	state->pick_ray_dir = { 1, 0, 0 };
+	state->pick_stats = {};
+	state->frame = 0;
+
+	state->shadow_caching = true;
+	state->shadow_cache_valid = false;
+	state->shadow_light_pos = {};
+	state->skeleton_shadow_rect = {};
+	state->shadow_stats = {};
+
+	state->shadow_mode = SHADOW_SINGLE;
+	state->cascade_count = CASCADE_COUNT;
+	for (unsigned int i = 0; i < MAX_CASCADES; i++) {
+		state->cascade_stats[i] = {};
+	}
+
+	state->light_0.pos = { -100.f, 400.f, -500.f };
+	state->light_0.colour = { 1.f, 1.f, 1.f };
+	state->light_0.ambient = 0.2f;
+	state->light_0.diffuse = 0.4f;
+	state->light_0.specular = 0.3f;
+
+	state->light_1.pos = { 100.f, 400.f, 500.f };
+	state->light_1.colour = { 0.f, 0.f, 1.f };
+	state->light_1.ambient = 0.2f;
+	state->light_1.diffuse = 1.f;
+	state->light_1.specular = 1.f;
+
+	state->edit_mode = 0; // 0 - position, 1 - rotation.
+	state->axis = 0; // 0 - x, 1 - y, 2 - z.
+
+	state->ray_pos = { 0, 0, 0 };
+	state->ray_dir = { 1, 0, 0 };
+
+	state->playing = false;
+	state->play_time = 0.f;
+	state->light_angle = 0.f;
+	state->lockstep_picks = false;
+	state->show_interface = true;
+	state->show_gpu_times = false;
+
+	state->limb_bounds_valid = false;
+	state->resolve_contacts = true;
+	state->edit_stats = {};
+
+	state->rng = std::mt19937(0);
+
+	for (unsigned int i = 0; i < CYLINDER_COUNT; i++) {
+		std::uniform_int_distribution<> pos(-100, 100);
+
+		state->cylinders[i].x = pos(state->rng);
+		state->cylinders[i].y = 0;
+		state->cylinders[i].z = pos(state->rng);
+
+		float *model = state->cylinder_models[i];
+		mat4_identity(model);
+		mat4_translate(model, state->cylinders[i].x, state->cylinders[i].y, state->cylinders[i].z);
+		mat4_scale(model, CYLINDER_SCALE.x, CYLINDER_SCALE.y, CYLINDER_SCALE.z);
+	}
+
+	state->culling = true;
+	cull_bounds_resize(&state->prop_cull_bounds, CYLINDER_COUNT);
+	for (unsigned int i = 0; i < CYLINDER_COUNT; i++) {
+		cull_bounds_set(&state->prop_cull_bounds, i, aabb_from_box(state->cylinder_models[i], CYLINDER_BOX_MIN, CYLINDER_BOX_MAX));
+	}
+
+	state->queue_stats = {};
+	gfx_reset(&state->gfx);
+	state->gfx_stats = {};
+}
+
+// FNV-1a over the bytes of a value.
+static void hash_bytes(unsigned long long *hash, const void *data, size_t size)
+{
+	const unsigned char *bytes = (const unsigned char *)data;
+	for (size_t i = 0; i < size; i++) {
+		*hash = (*hash ^ bytes[i]) * 1099511628211ull;
+	}
+}
+
+static void hash_node(unsigned long long *hash, const Node &node)
+{
+	hash_bytes(hash, &node.rotation, sizeof(node.rotation));
+	hash_bytes(hash, &node.translation, sizeof(node.translation));
+	hash_bytes(hash, &node.scale, sizeof(node.scale));
+}
+
+unsigned long long scene_checksum(const app_state *state)
+{
+	unsigned long long hash = 14695981039346656037ull;
+
+	for (auto limb : state->limbs) {
+		hash_node(&hash, *limb);
+	}
+
+	for (auto &frame : state->key_frames) {
+		for (auto &node : frame) {
+			hash_node(&hash, node);
+		}
+	}
+
+	const Camera *cams[2] = { &state->main_cam, &state->skeleton_cam };
+	for (auto cam : cams) {
+		hash_bytes(&hash, &cam->pos, sizeof(cam->pos));
+		hash_bytes(&hash, &cam->yaw, sizeof(cam->yaw));
+		hash_bytes(&hash, &cam->pitch, sizeof(cam->pitch));
+	}
+
+	const unsigned int current_cam = state->cur_cam == &state->main_cam ? 0 : 1;
+	const unsigned int selected = state->selected ? state->selected->id + 1 : 0;
+	hash_bytes(&hash, &current_cam, sizeof(current_cam));
+	hash_bytes(&hash, &selected, sizeof(selected));
+	hash_bytes(&hash, &state->selected_prop, sizeof(state->selected_prop));
+	hash_bytes(&hash, &state->edit_mode, sizeof(state->edit_mode));
+	hash_bytes(&hash, &state->axis, sizeof(state->axis));
+	hash_bytes(&hash, &state->playing, sizeof(state->playing));
+	hash_bytes(&hash, &state->play_time, sizeof(state->play_time));
+	hash_bytes(&hash, &state->light_angle, sizeof(state->light_angle));
+
+	return hash;
+}
@@ -0,0 +1,43 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <vector>
+
+#include "app.h"
+
+// Scene content shared by the GL app and headless rendering.
+
+// Vertices are pos, nor, tex.
+static const float QUAD_VERTICES[32] = {
+	 0.5f,  0, 0.5f, 0, 1.f, 0, 1.f, 0.f,
+	 0.5f, 0, -0.5f, 0, 1.f, 0, 1.f, 1.f,
+	-0.5f, 0, -0.5f, 0, 1.f, 0, 0.f, 1.f,
+	-0.5f,  0, 0.5f, 0, 1.f, 0, 0.f, 0.f,
+};
+
+static const unsigned int QUAD_INDICES[6] = {
+	0, 1, 3,
+	1, 2, 3
+};
+
+// Vertices are pos, tex.
+static const float INTERFACE_VERTICES[16] = {
+	 1.f, 1.f, 1.f, 0.f,
+	 1.f, 0.f, 1.f, 1.f,
+	 0.f, 0.f, 0.f, 1.f,
+	 0.f, 1.f, 0.f, 0.f,
+};
+
+static const unsigned int INTERFACE_INDICES[6] = {
+	0, 1, 3,
+	1, 2, 3
+};
+
+extern void cylinder_mesh(std::vector<float> &vertices, std::vector<unsigned int> &indices);
+extern void scene_init(app_state *state);
+
+// Hash of the state input can change, the pose, key frames, cameras and
+// selection, for checking a replayed session ended where the recording did.
+extern unsigned long long scene_checksum(const app_state *state);
+
+#endif
@@ -13,6 +13,7 @@ namespace Shaders {
     out vec3 v_nor;
     out vec2 v_tex;
     out vec4 frag_pos_light_space;
+    out float v_depth;
 
     uniform mat4 projection;
     uniform mat4 view;
@@ -29,6 +30,7 @@ namespace Shaders {
         v_tex = a_tex;
 
         frag_pos_light_space = light_space_matrix * world_position;
+        v_depth = -(view * world_position).z;
 
         gl_Position = projection * view * world_position;
     }
@@ -51,8 +53,10 @@ namespace Shaders {
     in vec2 v_tex;
 
     in vec4 frag_pos_light_space;
+    in float v_depth;
 
-    out vec4 frag;
+    layout(location = 0) out vec4 frag;
+    layout(location = 1) out uint frag_id;
     
     uniform DirectionalLight lights[NUM_LIGHTS];
 
@@ -63,6 +67,12 @@ namespace Shaders {
     uniform sampler2D tex;
     uniform sampler2D shadow_map;
 
+    uniform int cascade_count;
+    uniform vec4 cascade_splits;
+    uniform mat4 cascade_matrices[4];
+    uniform sampler2DArray cascade_maps;
+    uniform uint object_id;
+
     float bias(float x, float b) {
         b = -log2(1.0 - b);
         return 1.0 - pow(1.0 - pow(x, 1./b), b);
@@ -99,6 +109,44 @@ namespace Shaders {
         return shadow /= 9.0;
     }
 
+    float cascade_shadow_calculation(vec3 light_dir)
+    {
+        int cascade = cascade_count;
+        for (int i = cascade_count - 1; i >= 0; i--) {
+            if (v_depth < cascade_splits[i]) {
+                cascade = i;
+            }
+        }
+
+        // Past the last cascade there is no shadow.
+        if (cascade == cascade_count)
+            return 0.f;
+
+        vec4 pos_light_space = cascade_matrices[cascade] * vec4(v_pos, 1.f);
+        vec3 proj_coords = pos_light_space.xyz / pos_light_space.w;
+        proj_coords = proj_coords * 0.5f + 0.5f;
+
+        if (proj_coords.z > 1.f)
+            return 0.f;
+
+        float current_depth = proj_coords.z;
+        float bias = max(0.00001f * (1.f - dot(v_nor, light_dir)), 0.00001f);
+        float shadow = 0.0;
+
+        vec2 texelSize = 1.0 / textureSize(cascade_maps, 0).xy;
+
+        for(int x = -1; x <= 1; ++x)
+        {
+            for(int y = -1; y <= 1; ++y)
+            {
+                float pcfDepth = texture(cascade_maps, vec3(proj_coords.xy + vec2(x, y) * texelSize, cascade)).r;
+                shadow += current_depth - bias > pcfDepth ? 1.0 : 0.0;
+            }
+        }
+
+        return shadow / 9.0;
+    }
+
     vec3 calculate_lighting(DirectionalLight light)
     {
         vec3 ambient = light.ambient * light.colour;
@@ -112,7 +160,7 @@ namespace Shaders {
         float spec = pow(max(dot(v_nor, halfway_dir), 0.f), 3);
         vec3 specular = 0.5f * spec * light.colour;
         
-        float shadow = shadow_calculation(frag_pos_light_space, light_dir);
+        float shadow = cascade_count > 0 ? cascade_shadow_calculation(light_dir) : shadow_calculation(frag_pos_light_space, light_dir);
 
         return ambient + (1.f - shadow) * diffuse + specular;
     }
@@ -128,6 +176,7 @@ namespace Shaders {
         colour = pow(colour, vec3(1.f / gamma_correction));
 
         frag = vec4(colour, 1.f);
+        frag_id = object_id;
     }
     )";
 
@@ -148,8 +197,10 @@ namespace Shaders {
     in vec2 v_tex;
 
     in vec4 frag_pos_light_space;
+    in float v_depth;
 
-    out vec4 frag;
+    layout(location = 0) out vec4 frag;
+    layout(location = 1) out uint frag_id;
     
     uniform vec3 view_position;
 
@@ -158,6 +209,12 @@ namespace Shaders {
     uniform vec3 object_colour;
     uniform sampler2D shadow_map;
 
+    uniform int cascade_count;
+    uniform vec4 cascade_splits;
+    uniform mat4 cascade_matrices[4];
+    uniform sampler2DArray cascade_maps;
+    uniform uint object_id;
+
     float bias(float x, float b) {
         b = -log2(1.0 - b);
         return 1.0 - pow(1.0 - pow(x, 1./b), b);
@@ -194,6 +251,44 @@ namespace Shaders {
         return shadow /= 9.0;
     }
 
+    float cascade_shadow_calculation(vec3 light_dir)
+    {
+        int cascade = cascade_count;
+        for (int i = cascade_count - 1; i >= 0; i--) {
+            if (v_depth < cascade_splits[i]) {
+                cascade = i;
+            }
+        }
+
+        // Past the last cascade there is no shadow.
+        if (cascade == cascade_count)
+            return 0.f;
+
+        vec4 pos_light_space = cascade_matrices[cascade] * vec4(v_pos, 1.f);
+        vec3 proj_coords = pos_light_space.xyz / pos_light_space.w;
+        proj_coords = proj_coords * 0.5f + 0.5f;
+
+        if (proj_coords.z > 1.f)
+            return 0.f;
+
+        float current_depth = proj_coords.z;
+        float bias = max(0.00001f * (1.f - dot(v_nor, light_dir)), 0.00001f);
+        float shadow = 0.0;
+
+        vec2 texelSize = 1.0 / textureSize(cascade_maps, 0).xy;
+
+        for(int x = -1; x <= 1; ++x)
+        {
+            for(int y = -1; y <= 1; ++y)
+            {
+                float pcfDepth = texture(cascade_maps, vec3(proj_coords.xy + vec2(x, y) * texelSize, cascade)).r;
+                shadow += current_depth - bias > pcfDepth ? 1.0 : 0.0;
+            }
+        }
+
+        return shadow / 9.0;
+    }
+
     vec3 calculate_lighting(DirectionalLight light)
     {
         vec3 ambient = light.ambient * light.colour;
@@ -207,7 +302,7 @@ namespace Shaders {
         float spec = pow(max(dot(v_nor, halfway_dir), 0.f), 30);
         vec3 specular = 1.f * spec * light.colour;
         
-        float shadow = shadow_calculation(frag_pos_light_space, light_dir);
+        float shadow = cascade_count > 0 ? cascade_shadow_calculation(light_dir) : shadow_calculation(frag_pos_light_space, light_dir);
 
         return ambient + (1.f - shadow) * diffuse + specular;
     }
@@ -223,6 +318,7 @@ namespace Shaders {
         colour = pow(colour, vec3(1.f / gamma_correction));
 
         frag = vec4(colour, 1.f);
+        frag_id = object_id;
     }
     )";
 
@@ -59,6 +59,18 @@ Skybox *skybox_init()
     glBindBuffer(GL_ARRAY_BUFFER, skybox->vbos);
     glBufferData(GL_ARRAY_BUFFER, 6 * FACE_SIZE * sizeof(float), VERTEX_DATA, GL_STATIC_DRAW);
 
+    // Same layout as the other meshes, so it has its own vertex array rather
+    // than repointing a shared one each frame.
+    glGenVertexArrays(1, &skybox->vao);
+    glBindVertexArray(skybox->vao);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(3 * sizeof(float)));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glBindVertexArray(0);
+
     const char *faces[6] = {
     "right.bmp",
     "left.bmp",
@@ -100,6 +112,7 @@ void skybox_destroy(Skybox *skybox)
 {
     if (skybox) {
         glDeleteBuffers(1, &skybox->vbos);
+        glDeleteVertexArrays(1, &skybox->vao);
         free(skybox);
     }
 }
\ No newline at end of file
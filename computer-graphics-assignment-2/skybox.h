@@ -5,6 +5,7 @@
 
 struct Skybox {
 	unsigned vbos;
+	unsigned vao;
 	unsigned texture;
 };
 
@@ -0,0 +1,1607 @@
+#include "soft-raster.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "maths.h"
+#include "profiler.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define SOFT_RASTER_SSE
+#include <emmintrin.h>
+#endif
+
+static const unsigned int MAX_VARYINGS = 13; // The lit shaders' outputs.
+static const unsigned int VERTEX_FLOATS = 4 + MAX_VARYINGS; // Clip position then varyings.
+static const unsigned int MAX_CLIPPED = 3 + 5; // One extra vertex per clip plane.
+static const float GUARD_BAND = 2.f; // Triangles are clipped to twice the viewport in x and y.
+
+enum SoftTextureKind {
+	SOFT_TEXTURE_COLOUR,
+	SOFT_TEXTURE_DEPTH,
+	SOFT_TEXTURE_ID
+};
+
+// Texture bindings per unit, one per target.
+enum SoftTextureSlot {
+	SOFT_SLOT_2D,
+	SOFT_SLOT_CUBE,
+	SOFT_SLOT_ARRAY,
+	SOFT_SLOT_COUNT
+};
+
+struct SoftTexture {
+	unsigned int kind;
+	int w, h, layers;
+	std::vector<unsigned int> texels; // Colour and id textures.
+	std::vector<float> depth;
+};
+
+struct SoftMesh {
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	unsigned int vertex_count, stride;
+};
+
+struct SoftFramebuffer {
+	unsigned int colour, ids, depth, layer;
+	unsigned int draw_buffers;
+	std::vector<float> own_depth;
+	std::vector<unsigned char> stencil;
+};
+
+// Where a framebuffer's attachments are stored. Missing ones are null.
+struct SoftTarget {
+	int w, h;
+	unsigned int *colour, *ids;
+	float *depth;
+	unsigned char *stencil;
+	bool write_ids;
+};
+
+struct SoftUniforms {
+	float projection[16], view[16], model[16], light_space_matrix[16];
+	float cascade_matrices[16 * 4];
+	float cascade_splits[4];
+	int cascade_count;
+	float gamma_correction;
+	V3 view_position, object_colour;
+	unsigned int object_id;
+	int shadow_map, texture, cascade_maps, skybox; // Texture units.
+	V3 light_pos[2], light_colour[2];
+	float light_ambient[2], light_diffuse[2];
+};
+
+struct SoftProgram {
+	unsigned int shader;
+	SoftUniforms uniforms;
+};
+
+// Fixed function state, as set by enable, cull_face, depth_func and the stencil calls.
+struct SoftRasterState {
+	bool depth_test, cull, stencil_test, blend;
+	unsigned int cull_face, depth_func;
+	unsigned int stencil_func, stencil_mask, stencil_write_mask;
+	int stencil_ref;
+	unsigned int stencil_ops[3]; // Stencil fail, depth fail, pass.
+	int viewport[4];
+};
+
+// Everything a draw's fragments need, copied when it is recorded.
+struct SoftDraw {
+	unsigned int shader;
+	SoftUniforms uniforms;
+	SoftRasterState raster;
+	const SoftTexture *texture, *shadow_map, *cascade_maps, *skybox;
+};
+
+// Screen space triangle. Edges are positive inside, and attributes are planes
+// over the window, with varyings divided by w so they interpolate correctly.
+struct SoftTriangle {
+	unsigned int draw;
+	int x0, y0, x1, y1;
+	float edges[3][3];
+	bool inclusive[3]; // Pixel centres on the edge belong to this triangle.
+	float z[3], w[3];
+	float varyings[MAX_VARYINGS][3];
+	unsigned int varying_count;
+};
+
+// Draws to one target, rasterised together when it is flushed. A clear that
+// comes before any draw is done by each tile before its triangles.
+struct SoftBatch {
+	bool open;
+	SoftTarget target;
+
+	unsigned int clear_mask;
+	float clear_colour[4];
+	unsigned int clear_stencil_mask;
+	bool clear_ids;
+	unsigned int clear_id;
+
+	std::vector<SoftDraw> draws;
+	std::vector<SoftTriangle> triangles;
+
+	int tiles_x, tiles_y;
+	std::vector<std::vector<unsigned int>> bins;
+	std::vector<unsigned int> active;
+};
+
+// Workers wait for a job, which every thread runs until it runs out of tiles.
+struct SoftPool {
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable start, finished;
+	std::function<void()> job;
+	unsigned int generation;
+	unsigned int running;
+	bool quit;
+};
+
+struct SoftDevice {
+	SoftPool pool;
+
+	std::unordered_map<unsigned int, SoftProgram> programs;
+	std::unordered_map<unsigned int, SoftMesh> meshes;
+	std::unordered_map<unsigned int, SoftTexture> textures;
+	std::unordered_map<unsigned int, SoftFramebuffer> framebuffers;
+
+	SoftTexture window_colour;
+	SoftFramebuffer window;
+
+	unsigned int program, vao;
+	unsigned int read_fbo, draw_fbo;
+	unsigned int active_unit;
+	unsigned int units[GFX_MAX_TEXTURE_UNITS][SOFT_SLOT_COUNT];
+	float clear_colour[4];
+	SoftRasterState raster;
+
+	SoftBatch batch;
+	std::vector<float> vertices; // Scratch for vertex shading.
+
+	SoftStats stats;
+	std::atomic<unsigned long long> fragments;
+};
+
+static void pool_worker(SoftPool *pool)
+{
+	PROFILE_THREAD("raster");
+
+	unsigned int seen = 0;
+
+	for (;;) {
+		std::unique_lock<std::mutex> lock(pool->mutex);
+		pool->start.wait(lock, [&] { return pool->quit || pool->generation != seen; });
+		if (pool->quit) {
+			return;
+		}
+
+		seen = pool->generation;
+		lock.unlock();
+
+		pool->job();
+
+		lock.lock();
+		if (--pool->running == 0) {
+			pool->finished.notify_one();
+		}
+	}
+}
+
+// Runs job on every worker and the calling thread, and waits for all of them.
+static void pool_run(SoftPool *pool, const std::function<void()> &job)
+{
+	{
+		std::lock_guard<std::mutex> lock(pool->mutex);
+		pool->job = job;
+		pool->running = pool->threads.size();
+		pool->generation++;
+	}
+	pool->start.notify_all();
+
+	job();
+
+	std::unique_lock<std::mutex> lock(pool->mutex);
+	pool->finished.wait(lock, [&] { return pool->running == 0; });
+}
+
+SoftDevice *soft_create(unsigned int w, unsigned int h, unsigned int threads)
+{
+	SoftDevice *d = new SoftDevice;
+
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	d->pool.generation = 0;
+	d->pool.running = 0;
+	d->pool.quit = false;
+	for (unsigned int i = 1; i < threads; i++) {
+		d->pool.threads.push_back(std::thread(pool_worker, &d->pool));
+	}
+
+	d->window_colour.kind = SOFT_TEXTURE_COLOUR;
+	d->window_colour.w = w;
+	d->window_colour.h = h;
+	d->window_colour.layers = 1;
+	d->window_colour.texels.assign(w * h, 0);
+
+	d->window = {};
+	d->window.draw_buffers = 1;
+
+	d->program = 0;
+	d->vao = 0;
+	d->read_fbo = 0;
+	d->draw_fbo = 0;
+	d->active_unit = 0;
+	memset(d->units, 0, sizeof(d->units));
+	memset(d->clear_colour, 0, sizeof(d->clear_colour));
+
+	// The GL context is created with these enabled, see win32-opengl.cpp.
+	d->raster = {};
+	d->raster.depth_test = true;
+	d->raster.cull = true;
+	d->raster.blend = true;
+	d->raster.cull_face = GFX_BACK;
+	d->raster.depth_func = GFX_LESS;
+	d->raster.stencil_func = GFX_ALWAYS;
+	d->raster.stencil_mask = 0xFF;
+	d->raster.stencil_write_mask = 0xFF;
+	d->raster.stencil_ops[0] = d->raster.stencil_ops[1] = d->raster.stencil_ops[2] = GFX_KEEP;
+	d->raster.viewport[2] = w;
+	d->raster.viewport[3] = h;
+
+	d->batch.open = false;
+	d->batch.clear_mask = 0;
+	d->batch.clear_ids = false;
+
+	d->stats = {};
+	d->fragments = 0;
+
+	return d;
+}
+
+void soft_destroy(SoftDevice *device)
+{
+	{
+		std::lock_guard<std::mutex> lock(device->pool.mutex);
+		device->pool.quit = true;
+	}
+	device->pool.start.notify_all();
+
+	for (auto &t : device->pool.threads) {
+		t.join();
+	}
+
+	delete device;
+}
+
+unsigned int soft_thread_count(const SoftDevice *device)
+{
+	return device->pool.threads.size() + 1;
+}
+
+void soft_register_program(SoftDevice *device, unsigned int program, SoftShader shader)
+{
+	SoftProgram &p = device->programs[program];
+	p.shader = shader;
+	memset(&p.uniforms, 0, sizeof(p.uniforms));
+}
+
+void soft_register_mesh(SoftDevice *device, unsigned int vao, const float *vertices, unsigned int vertex_count, unsigned int stride, const unsigned int *indices, unsigned int index_count)
+{
+	SoftMesh &m = device->meshes[vao];
+	m.vertices.assign(vertices, vertices + vertex_count * stride);
+	m.indices.assign(indices, indices + (indices ? index_count : 0));
+	m.vertex_count = vertex_count;
+	m.stride = stride;
+}
+
+void soft_register_texture(SoftDevice *device, unsigned int texture, unsigned int w, unsigned int h, unsigned int layers, const unsigned char *texels)
+{
+	SoftTexture &t = device->textures[texture];
+	t.kind = SOFT_TEXTURE_COLOUR;
+	t.w = w;
+	t.h = h;
+	t.layers = layers;
+	t.texels.resize(w * h * layers);
+	memcpy(t.texels.data(), texels, t.texels.size() * sizeof(unsigned int));
+}
+
+void soft_register_depth_texture(SoftDevice *device, unsigned int texture, unsigned int size, unsigned int layers)
+{
+	SoftTexture &t = device->textures[texture];
+	t.kind = SOFT_TEXTURE_DEPTH;
+	t.w = size;
+	t.h = size;
+	t.layers = layers;
+	t.depth.assign(size * size * layers, 1.f);
+}
+
+void soft_register_id_texture(SoftDevice *device, unsigned int texture, unsigned int w, unsigned int h)
+{
+	SoftTexture &t = device->textures[texture];
+	t.kind = SOFT_TEXTURE_ID;
+	t.w = w;
+	t.h = h;
+	t.layers = 1;
+	t.texels.assign(w * h, 0);
+}
+
+void soft_register_framebuffer(SoftDevice *device, unsigned int fbo, unsigned int colour, unsigned int ids, unsigned int depth, unsigned int layer)
+{
+	SoftFramebuffer &f = device->framebuffers[fbo];
+	f.colour = colour;
+	f.ids = ids;
+	f.depth = depth;
+	f.layer = layer;
+	f.draw_buffers = 1;
+}
+
+static SoftTexture *find_texture(SoftDevice *d, unsigned int texture)
+{
+	auto it = d->textures.find(texture);
+	return it == d->textures.end() ? 0 : &it->second;
+}
+
+static SoftFramebuffer *find_framebuffer(SoftDevice *d, unsigned int fbo)
+{
+	if (fbo == 0) {
+		return &d->window;
+	}
+
+	auto it = d->framebuffers.find(fbo);
+	return it == d->framebuffers.end() ? 0 : &it->second;
+}
+
+static bool resolve_target(SoftDevice *d, unsigned int fbo, SoftTarget *target)
+{
+	*target = {};
+
+	SoftFramebuffer *f = find_framebuffer(d, fbo);
+	if (!f) {
+		return false;
+	}
+
+	SoftTexture *colour = fbo ? find_texture(d, f->colour) : &d->window_colour;
+	SoftTexture *ids = find_texture(d, f->ids);
+	SoftTexture *depth = find_texture(d, f->depth);
+
+	if (depth) {
+		target->w = depth->w;
+		target->h = depth->h;
+		target->depth = depth->depth.data() + f->layer * depth->w * depth->h;
+	} else if (colour) {
+		target->w = colour->w;
+		target->h = colour->h;
+
+		const unsigned int size = colour->w * colour->h;
+		if (f->own_depth.size() != size) {
+			f->own_depth.assign(size, 1.f);
+			f->stencil.assign(size, 0);
+		}
+
+		target->depth = f->own_depth.data();
+		target->stencil = f->stencil.data();
+	} else {
+		return false;
+	}
+
+	if (colour) {
+		target->colour = colour->texels.data();
+	}
+
+	if (ids) {
+		target->ids = ids->texels.data();
+	}
+
+	target->write_ids = ids && f->draw_buffers > 1;
+
+	return true;
+}
+
+const unsigned int *soft_colour_pixels(const SoftDevice *device, unsigned int fbo, unsigned int *w, unsigned int *h)
+{
+	const SoftTexture *colour = &device->window_colour;
+	if (fbo) {
+		auto f = device->framebuffers.find(fbo);
+		if (f == device->framebuffers.end()) {
+			return 0;
+		}
+
+		auto t = device->textures.find(f->second.colour);
+		if (t == device->textures.end()) {
+			return 0;
+		}
+
+		colour = &t->second;
+	}
+
+	*w = colour->w;
+	*h = colour->h;
+
+	return colour->texels.data();
+}
+
+const SoftStats *soft_stats(const SoftDevice *device)
+{
+	return &device->stats;
+}
+
+void soft_reset_stats(SoftDevice *device)
+{
+	device->stats = {};
+	device->fragments = 0;
+}
+
+static void transform(const float *m, const float *v, float *out)
+{
+	for (unsigned int i = 0; i < 4; i++) {
+		out[i] = m[i] * v[0] + m[4 + i] * v[1] + m[8 + i] * v[2] + m[12 + i] * v[3];
+	}
+}
+
+static unsigned int varying_count(unsigned int shader)
+{
+	switch (shader) {
+	case SOFT_SHADER_TEXTURED:
+	case SOFT_SHADER_DIFFUSE:
+		return 13;
+	case SOFT_SHADER_INTERFACE:
+		return 2;
+	case SOFT_SHADER_SKYBOX:
+		return 3;
+	}
+
+	return 0;
+}
+
+// Upper 3x3 of transpose(inverse(model)), column major.
+static void normal_matrix(const float *m, float *n)
+{
+	const float a = m[0], b = m[4], c = m[8];
+	const float d = m[1], e = m[5], f = m[9];
+	const float g = m[2], h = m[6], i = m[10];
+
+	const float A = e * i - f * h, B = f * g - d * i, C = d * h - e * g;
+	const float det = a * A + b * B + c * C;
+	const float inv = det != 0.f ? 1.f / det : 0.f;
+
+	// The inverse's transpose is the cofactor matrix over the determinant.
+	n[0] = A * inv; n[3] = B * inv; n[6] = C * inv;
+	n[1] = (c * h - b * i) * inv; n[4] = (a * i - c * g) * inv; n[7] = (b * g - a * h) * inv;
+	n[2] = (b * f - c * e) * inv; n[5] = (c * d - a * f) * inv; n[8] = (a * e - b * d) * inv;
+}
+
+// The vertex shaders in shaders.h. Each vertex becomes its clip position
+// followed by the shader's outputs.
+static void shade_vertices(const SoftDraw *draw, const SoftMesh *mesh, float *out)
+{
+	const SoftUniforms *u = &draw->uniforms;
+
+	float pv[16], mvp[16], n[9];
+	mat4_multiply(pv, u->projection, u->view);
+	mat4_multiply(mvp, pv, u->model);
+	normal_matrix(u->model, n);
+
+	for (unsigned int i = 0; i < mesh->vertex_count; i++) {
+		const float *in = mesh->vertices.data() + i * mesh->stride;
+		float *v = out + i * VERTEX_FLOATS;
+
+		switch (draw->shader) {
+		case SOFT_SHADER_DEPTH:
+		case SOFT_SHADER_OUTLINE: {
+			const float pos[4] = { in[0], in[1], in[2], 1.f };
+			transform(mvp, pos, v);
+			break;
+		}
+		case SOFT_SHADER_TEXTURED:
+		case SOFT_SHADER_DIFFUSE: {
+			const float pos[4] = { in[0], in[1], in[2], 1.f };
+			float world[4], eye[4];
+			transform(u->model, pos, world);
+			transform(pv, world, v);
+
+			v[4] = world[0];
+			v[5] = world[1];
+			v[6] = world[2];
+			for (unsigned int j = 0; j < 3; j++) {
+				v[7 + j] = n[j] * in[3] + n[3 + j] * in[4] + n[6 + j] * in[5];
+			}
+			v[10] = in[6];
+			v[11] = in[7];
+
+			transform(u->light_space_matrix, world, v + 12);
+
+			transform(u->view, world, eye);
+			v[16] = -eye[2];
+			break;
+		}
+		case SOFT_SHADER_INTERFACE: {
+			const float pos[4] = { in[0], in[1], 0.f, 1.f };
+			float world[4];
+			transform(u->model, pos, world);
+			transform(u->projection, world, v);
+			v[4] = in[2];
+			v[5] = in[3];
+			break;
+		}
+		case SOFT_SHADER_SKYBOX: {
+			const float pos[4] = { in[0], in[1], in[2], 1.f };
+			transform(pv, pos, v);
+			v[2] = v[3]; // Always at the far plane.
+
+			const float l = sqrtf(in[0] * in[0] + in[1] * in[1] + in[2] * in[2]);
+			v[4] = in[0] / l;
+			v[5] = in[1] / l;
+			v[6] = in[2] / l;
+			break;
+		}
+		}
+	}
+}
+
+// Sutherland-Hodgman against one plane, a . (x, y, z, w) >= 0.
+static unsigned int clip_plane(const float (*in)[VERTEX_FLOATS], unsigned int count, const float *plane, unsigned int floats, float (*out)[VERTEX_FLOATS])
+{
+	unsigned int n = 0;
+
+	for (unsigned int i = 0; i < count; i++) {
+		const float *a = in[i], *b = in[(i + 1) % count];
+		const float da = plane[0] * a[0] + plane[1] * a[1] + plane[2] * a[2] + plane[3] * a[3];
+		const float db = plane[0] * b[0] + plane[1] * b[1] + plane[2] * b[2] + plane[3] * b[3];
+
+		if (da >= 0.f) {
+			memcpy(out[n++], a, floats * sizeof(float));
+		}
+
+		// Interpolated from the inside vertex, so triangles sharing the edge
+		// get the same point.
+		if ((da >= 0.f) != (db >= 0.f)) {
+			const float *from = da >= 0.f ? a : b, *to = da >= 0.f ? b : a;
+			const float t = da >= 0.f ? da / (da - db) : db / (db - da);
+			for (unsigned int j = 0; j < floats; j++) {
+				out[n][j] = from[j] + (to[j] - from[j]) * t;
+			}
+			n++;
+		}
+	}
+
+	return n;
+}
+
+static void setup_triangle(SoftBatch *batch, unsigned int draw_index, const float *a, const float *b, const float *c, unsigned int varyings, SoftStats *stats)
+{
+	const SoftDraw *draw = &batch->draws[draw_index];
+	const int *vp = draw->raster.viewport;
+	const float *clip[3] = { a, b, c };
+
+	float x[3], y[3], z[3], w[3];
+	for (unsigned int i = 0; i < 3; i++) {
+		w[i] = 1.f / clip[i][3];
+		x[i] = vp[0] + (clip[i][0] * w[i] + 1.f) * 0.5f * vp[2];
+		y[i] = vp[1] + (clip[i][1] * w[i] + 1.f) * 0.5f * vp[3];
+		z[i] = clip[i][2] * w[i] * 0.5f + 0.5f;
+	}
+
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (area == 0.f) {
+		stats->culled++;
+		return;
+	}
+
+	// Window y is up, so counter clockwise is front facing as in GL.
+	const bool front = area > 0.f;
+	if (draw->raster.cull && (draw->raster.cull_face == GFX_BACK ? !front : front)) {
+		stats->culled++;
+		return;
+	}
+
+	SoftTriangle t;
+	t.draw = draw_index;
+	t.varying_count = varyings;
+
+	// Pixels whose centres are inside the bounds.
+	const float min_x = std::min(x[0], std::min(x[1], x[2])), max_x = std::max(x[0], std::max(x[1], x[2]));
+	const float min_y = std::min(y[0], std::min(y[1], y[2])), max_y = std::max(y[0], std::max(y[1], y[2]));
+	t.x0 = std::max({ (int)ceilf(min_x - 0.5f), vp[0], 0 });
+	t.y0 = std::max({ (int)ceilf(min_y - 0.5f), vp[1], 0 });
+	t.x1 = std::min({ (int)floorf(max_x - 0.5f) + 1, vp[0] + vp[2], batch->target.w });
+	t.y1 = std::min({ (int)floorf(max_y - 0.5f) + 1, vp[1] + vp[3], batch->target.h });
+
+	if (t.x0 >= t.x1 || t.y0 >= t.y1) {
+		stats->culled++;
+		return;
+	}
+
+	for (unsigned int i = 0; i < 3; i++) {
+		unsigned int j = (i + 1) % 3, k = (i + 2) % 3;
+		float sign = front ? 1.f : -1.f;
+
+		// Edges are worked out from their lower vertex, so two triangles sharing
+		// one get exactly opposite values and no pixel is drawn twice or missed.
+		if (x[k] < x[j] || (x[k] == x[j] && y[k] < y[j])) {
+			std::swap(j, k);
+			sign = -sign;
+		}
+
+		const float ea = -(y[k] - y[j]);
+		const float eb = x[k] - x[j];
+		const float ec = -(ea * x[j] + eb * y[j]);
+
+		t.edges[i][0] = ea * sign;
+		t.edges[i][1] = eb * sign;
+		t.edges[i][2] = ec * sign;
+
+		// Of the two, only one has the edge inclusive.
+		t.inclusive[i] = t.edges[i][0] > 0.f || (t.edges[i][0] == 0.f && t.edges[i][1] > 0.f);
+	}
+
+	// Gradients from vertex 0, so an attribute that is the same at every
+	// vertex is exactly that everywhere.
+	const float inv_area = 1.f / area;
+	auto plane = [&](const float *f, float *p)
+	{
+		p[0] = ((f[1] - f[0]) * (y[2] - y[0]) - (f[2] - f[0]) * (y[1] - y[0])) * inv_area;
+		p[1] = ((f[2] - f[0]) * (x[1] - x[0]) - (f[1] - f[0]) * (x[2] - x[0])) * inv_area;
+		p[2] = f[0] - p[0] * x[0] - p[1] * y[0];
+	};
+
+	plane(z, t.z);
+	plane(w, t.w);
+	for (unsigned int i = 0; i < varyings; i++) {
+		const float v[3] = { a[4 + i] * w[0], b[4 + i] * w[1], c[4 + i] * w[2] };
+		plane(v, t.varyings[i]);
+	}
+
+	batch->triangles.push_back(t);
+}
+
+// Clips a triangle to the near plane and the guard band, and sets up what is left.
+static void submit_triangle(SoftBatch *batch, unsigned int draw_index, const float *a, const float *b, const float *c, unsigned int varyings, SoftStats *stats)
+{
+	static const float planes[5][4] = {
+		{ 0.f, 0.f, 1.f, 1.f },
+		{ 1.f, 0.f, 0.f, GUARD_BAND },
+		{ -1.f, 0.f, 0.f, GUARD_BAND },
+		{ 0.f, 1.f, 0.f, GUARD_BAND },
+		{ 0.f, -1.f, 0.f, GUARD_BAND },
+	};
+
+	const float *v[3] = { a, b, c };
+
+	unsigned int outside = 0;
+	for (unsigned int p = 0; p < 5; p++) {
+		for (unsigned int i = 0; i < 3; i++) {
+			const float d = planes[p][0] * v[i][0] + planes[p][1] * v[i][1] + planes[p][2] * v[i][2] + planes[p][3] * v[i][3];
+			if (d < 0.f) {
+				outside |= 1 << p;
+			}
+		}
+	}
+
+	if (!outside) {
+		setup_triangle(batch, draw_index, a, b, c, varyings, stats);
+		return;
+	}
+
+	const unsigned int floats = 4 + varyings;
+	float polygon[2][MAX_CLIPPED][VERTEX_FLOATS];
+	unsigned int count = 3;
+	for (unsigned int i = 0; i < 3; i++) {
+		memcpy(polygon[0][i], v[i], floats * sizeof(float));
+	}
+
+	unsigned int current = 0;
+	for (unsigned int p = 0; p < 5 && count >= 3; p++) {
+		if (outside & (1 << p)) {
+			count = clip_plane(polygon[current], count, planes[p], floats, polygon[current ^ 1]);
+			current ^= 1;
+		}
+	}
+
+	if (count < 3) {
+		stats->culled++;
+		return;
+	}
+
+	stats->clipped += count - 3;
+	for (unsigned int i = 1; i + 1 < count; i++) {
+		setup_triangle(batch, draw_index, polygon[current][0], polygon[current][i], polygon[current][i + 1], varyings, stats);
+	}
+}
+
+static unsigned int pack_colour(const float *c)
+{
+	unsigned int packed = 0;
+	for (unsigned int i = 0; i < 4; i++) {
+		const float v = std::min(std::max(c[i], 0.f), 1.f);
+		packed |= (unsigned int)(v * 255.f + 0.5f) << (8 * i);
+	}
+
+	return packed;
+}
+
+static void unpack_colour(unsigned int packed, float *c)
+{
+	for (unsigned int i = 0; i < 4; i++) {
+		c[i] = ((packed >> (8 * i)) & 0xFF) * (1.f / 255.f);
+	}
+}
+
+// Nearest filtering, clamped to the edge as create_texture sets it.
+static void sample_colour(const SoftTexture *t, unsigned int layer, float u, float v, float *c)
+{
+	if (!t || t->kind != SOFT_TEXTURE_COLOUR) {
+		c[0] = c[1] = c[2] = c[3] = 1.f;
+		return;
+	}
+
+	const int x = std::min(std::max((int)floorf(u * t->w), 0), t->w - 1);
+	const int y = std::min(std::max((int)floorf(v * t->h), 0), t->h - 1);
+	unpack_colour(t->texels[(layer * t->h + y) * t->w + x], c);
+}
+
+// Face selection from the GL spec's cube map table.
+static void sample_cube(const SoftTexture *t, float x, float y, float z, float *c)
+{
+	const float ax = fabsf(x), ay = fabsf(y), az = fabsf(z);
+
+	unsigned int face;
+	float sc, tc, ma;
+	if (ax >= ay && ax >= az) {
+		face = x > 0.f ? 0 : 1;
+		sc = x > 0.f ? -z : z;
+		tc = -y;
+		ma = ax;
+	} else if (ay >= az) {
+		face = y > 0.f ? 2 : 3;
+		sc = x;
+		tc = y > 0.f ? z : -z;
+		ma = ay;
+	} else {
+		face = z > 0.f ? 4 : 5;
+		sc = z > 0.f ? x : -x;
+		tc = -y;
+		ma = az;
+	}
+
+	if (ma == 0.f) {
+		ma = 1.f;
+	}
+
+	sample_colour(t, t && t->layers == 6 ? face : 0, (sc / ma + 1.f) * 0.5f, (tc / ma + 1.f) * 0.5f, c);
+}
+
+// 3x3 PCF. Texels past the edge read as the clamp to border colour of 1.
+static float shadow_pcf(const SoftTexture *map, unsigned int layer, float u, float v, float depth)
+{
+	if (!map || map->kind != SOFT_TEXTURE_DEPTH) {
+		return 0.f;
+	}
+
+	const int cx = (int)floorf(u * map->w), cy = (int)floorf(v * map->h);
+	const float *texels = map->depth.data() + layer * map->w * map->h;
+
+	float shadow = 0.f;
+	for (int y = cy - 1; y <= cy + 1; y++) {
+		for (int x = cx - 1; x <= cx + 1; x++) {
+			const bool inside = x >= 0 && x < map->w && y >= 0 && y < map->h;
+			const float closest = inside ? texels[y * map->w + x] : 1.f;
+			shadow += depth > closest ? 1.f : 0.f;
+		}
+	}
+
+	return shadow / 9.f;
+}
+
+static float shadow_calculation(const SoftDraw *draw, const float *v, float bias)
+{
+	const float *ls = v + 8;
+	const float x = ls[0] / ls[3] * 0.5f + 0.5f;
+	const float y = ls[1] / ls[3] * 0.5f + 0.5f;
+	const float z = ls[2] / ls[3] * 0.5f + 0.5f;
+
+	if (z > 1.f) {
+		return 0.f;
+	}
+
+	return shadow_pcf(draw->shadow_map, 0, x, y, z - bias);
+}
+
+static float cascade_shadow_calculation(const SoftDraw *draw, const float *v, float bias)
+{
+	const SoftUniforms *u = &draw->uniforms;
+	const int count = std::min(u->cascade_count, 4);
+
+	int cascade = count;
+	for (int i = count - 1; i >= 0; i--) {
+		if (v[12] < u->cascade_splits[i]) {
+			cascade = i;
+		}
+	}
+
+	// Past the last cascade there is no shadow.
+	if (cascade == count) {
+		return 0.f;
+	}
+
+	const float pos[4] = { v[0], v[1], v[2], 1.f };
+	float ls[4];
+	transform(u->cascade_matrices + 16 * cascade, pos, ls);
+
+	const float x = ls[0] / ls[3] * 0.5f + 0.5f;
+	const float y = ls[1] / ls[3] * 0.5f + 0.5f;
+	const float z = ls[2] / ls[3] * 0.5f + 0.5f;
+
+	if (z > 1.f) {
+		return 0.f;
+	}
+
+	return shadow_pcf(draw->cascade_maps, cascade, x, y, z - bias);
+}
+
+static float pow30(float x)
+{
+	const float x2 = x * x, x4 = x2 * x2, x8 = x4 * x4, x16 = x8 * x8;
+	return x16 * x8 * x4 * x2;
+}
+
+// TEXTURED_FRAGMENT_SHADER_SOURCE and DIFFUSE_FRAGMENT_SHADER_SOURCE. Varyings
+// are v_pos, v_nor, v_tex, frag_pos_light_space and v_depth.
+static void lit_fragment(const SoftDraw *draw, const float *v, float *frag)
+{
+	const SoftUniforms *u = &draw->uniforms;
+	const bool textured = draw->shader == SOFT_SHADER_TEXTURED;
+
+	const V3 pos = { v[0], v[1], v[2] };
+	const V3 nor = { v[3], v[4], v[5] };
+
+	V3 result = { 0.f, 0.f, 0.f };
+	for (unsigned int i = 0; i < 2; i++) {
+		const V3 colour = u->light_colour[i];
+
+		const V3 ambient = u->light_ambient[i] * colour;
+
+		const V3 light_dir = v3_normalise(u->light_pos[i] - pos);
+		const float diff = std::max(v3_dot(nor, light_dir), 0.f);
+		const V3 diffuse = (diff * u->light_diffuse[i]) * colour;
+
+		const V3 view_dir = v3_normalise(u->view_position + pos);
+		const V3 halfway_dir = v3_normalise(light_dir + view_dir);
+		const float s = std::max(v3_dot(nor, halfway_dir), 0.f);
+		const V3 specular = (textured ? 0.5f * s * s * s : pow30(s)) * colour;
+
+		const float bias = std::max(0.00001f * (1.f - v3_dot(nor, light_dir)), 0.00001f);
+		const float shadow = u->cascade_count > 0 ? cascade_shadow_calculation(draw, v, bias) : shadow_calculation(draw, v, bias);
+
+		result += ambient + (1.f - shadow) * diffuse + specular;
+	}
+
+	float base[4] = { u->object_colour.x, u->object_colour.y, u->object_colour.z, 1.f };
+	if (textured) {
+		sample_colour(draw->texture, 0, v[6], v[7], base);
+	}
+
+	const float inv_gamma = 1.f / u->gamma_correction;
+	for (unsigned int i = 0; i < 3; i++) {
+		frag[i] = powf(std::max(base[i] * result.E[i], 0.f), inv_gamma);
+	}
+	frag[3] = 1.f;
+}
+
+static void shade_fragment(const SoftDraw *draw, const float *v, float *frag)
+{
+	switch (draw->shader) {
+	case SOFT_SHADER_TEXTURED:
+	case SOFT_SHADER_DIFFUSE:
+		lit_fragment(draw, v, frag);
+		break;
+	case SOFT_SHADER_INTERFACE:
+		sample_colour(draw->texture, 0, v[0], v[1], frag);
+		break;
+	case SOFT_SHADER_OUTLINE:
+		frag[0] = 1.f;
+		frag[1] = 0.f;
+		frag[2] = 0.f;
+		frag[3] = 1.f;
+		break;
+	case SOFT_SHADER_SKYBOX:
+		sample_cube(draw->skybox, v[0], v[1], v[2], frag);
+		break;
+	}
+}
+
+// Only the functions render() records are told apart, anything else passes.
+static bool compare(unsigned int func, float a, float b)
+{
+	switch (func) {
+	case GFX_NEVER: return false;
+	case GFX_LESS: return a < b;
+	case GFX_LEQUAL: return a <= b;
+	case GFX_NOTEQUAL: return a != b;
+	}
+
+	return true;
+}
+
+static unsigned int stencil_apply(unsigned int op, unsigned int value, unsigned int ref, unsigned int write_mask)
+{
+	const unsigned int result = op == GFX_REPLACE ? ref : value;
+	return (value & ~write_mask) | (result & write_mask);
+}
+
+// Coverage of four pixels from x on row y, as a lane mask, and their depth.
+// Pixels past the far plane are dropped, as GL clips them.
+static unsigned int quad_coverage(const SoftTriangle *t, int x, int y, float *z)
+{
+	const float py = y + 0.5f;
+
+#ifdef SOFT_RASTER_SSE
+	const __m128 px = _mm_add_ps(_mm_set1_ps((float)x), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+	const __m128 zero = _mm_setzero_ps();
+
+	__m128 inside = _mm_cmpeq_ps(zero, zero);
+	for (unsigned int i = 0; i < 3; i++) {
+		const __m128 e = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t->edges[i][0]), px), _mm_set1_ps(t->edges[i][1] * py + t->edges[i][2]));
+		inside = _mm_and_ps(inside, t->inclusive[i] ? _mm_cmpge_ps(e, zero) : _mm_cmpgt_ps(e, zero));
+	}
+
+	__m128 depth = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t->z[0]), px), _mm_set1_ps(t->z[1] * py + t->z[2]));
+	inside = _mm_and_ps(inside, _mm_cmple_ps(depth, _mm_set1_ps(1.00001f)));
+	depth = _mm_min_ps(_mm_max_ps(depth, zero), _mm_set1_ps(1.f));
+	_mm_storeu_ps(z, depth);
+
+	return _mm_movemask_ps(inside);
+#else
+	unsigned int mask = 0;
+	for (int l = 0; l < 4; l++) {
+		const float px = x + l + 0.5f;
+
+		bool inside = true;
+		for (unsigned int i = 0; i < 3; i++) {
+			const float e = t->edges[i][0] * px + (t->edges[i][1] * py + t->edges[i][2]);
+			inside = inside && (t->inclusive[i] ? e >= 0.f : e > 0.f);
+		}
+
+		const float depth = t->z[0] * px + (t->z[1] * py + t->z[2]);
+		z[l] = std::min(std::max(depth, 0.f), 1.f);
+
+		if (inside && depth <= 1.00001f) {
+			mask |= 1 << l;
+		}
+	}
+
+	return mask;
+#endif
+}
+
+// Depth test of four pixels against the buffer. full is set when all four are
+// inside the row, so they can be loaded and stored together.
+static unsigned int quad_depth_test(unsigned int func, const float *z, const float *buffer, unsigned int lanes, bool full)
+{
+#ifdef SOFT_RASTER_SSE
+	if (full) {
+		const __m128 a = _mm_loadu_ps(z), b = _mm_loadu_ps(buffer);
+
+		__m128 pass;
+		switch (func) {
+		case GFX_NEVER: return 0;
+		case GFX_LESS: pass = _mm_cmplt_ps(a, b); break;
+		case GFX_LEQUAL: pass = _mm_cmple_ps(a, b); break;
+		case GFX_NOTEQUAL: pass = _mm_cmpneq_ps(a, b); break;
+		default: return lanes;
+		}
+
+		return lanes & _mm_movemask_ps(pass);
+	}
+#endif
+
+	unsigned int mask = 0;
+	for (unsigned int l = 0; l < 4; l++) {
+		if ((lanes & (1 << l)) && compare(func, z[l], buffer[l])) {
+			mask |= 1 << l;
+		}
+	}
+
+	return mask;
+}
+
+static void quad_store_depth(const float *z, float *buffer, unsigned int lanes, bool full)
+{
+#ifdef SOFT_RASTER_SSE
+	if (full) {
+		const __m128 mask = _mm_castsi128_ps(_mm_setr_epi32(
+			(lanes & 1) ? -1 : 0, (lanes & 2) ? -1 : 0, (lanes & 4) ? -1 : 0, (lanes & 8) ? -1 : 0));
+		const __m128 merged = _mm_or_ps(_mm_and_ps(mask, _mm_loadu_ps(z)), _mm_andnot_ps(mask, _mm_loadu_ps(buffer)));
+		_mm_storeu_ps(buffer, merged);
+		return;
+	}
+#endif
+
+	for (unsigned int l = 0; l < 4; l++) {
+		if (lanes & (1 << l)) {
+			buffer[l] = z[l];
+		}
+	}
+}
+
+// Lanes of the quad at x that are within [x0, x1).
+static unsigned int span_lanes(int x, int x0, int x1)
+{
+	unsigned int lanes = 0;
+	for (int l = 0; l < 4; l++) {
+		if (x + l >= x0 && x + l < x1) {
+			lanes |= 1 << l;
+		}
+	}
+
+	return lanes;
+}
+
+static const unsigned char LANE_COUNT[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+struct TileCounters {
+	unsigned long long fragments;
+};
+
+// Rasterises a triangle over the part of it inside a tile. Fragments go
+// through the far clip, depth and stencil tests in GL's order.
+static void rasterise(const SoftBatch *batch, const SoftTriangle *t, int tx0, int ty0, int tx1, int ty1, TileCounters *counters)
+{
+	const SoftDraw *draw = &batch->draws[t->draw];
+	const SoftRasterState *r = &draw->raster;
+	const SoftTarget *target = &batch->target;
+
+	const int x0 = std::max(t->x0, tx0), x1 = std::min(t->x1, tx1);
+	const int y0 = std::max(t->y0, ty0), y1 = std::min(t->y1, ty1);
+	if (x0 >= x1 || y0 >= y1) {
+		return;
+	}
+
+	const bool stencil = r->stencil_test && target->stencil;
+	const bool colour = draw->shader != SOFT_SHADER_DEPTH && target->colour;
+	const bool ids = target->write_ids && (draw->shader == SOFT_SHADER_TEXTURED || draw->shader == SOFT_SHADER_DIFFUSE);
+	const unsigned int stencil_ref = r->stencil_ref & r->stencil_mask;
+
+	for (int y = y0; y < y1; y++) {
+		const int row = y * target->w;
+
+		for (int x = x0 & ~3; x < x1; x += 4) {
+			float z[4];
+			unsigned int lanes = quad_coverage(t, x, y, z) & span_lanes(x, x0, x1);
+			if (!lanes) {
+				continue;
+			}
+
+			const bool full = x + 4 <= target->w;
+			float *depth = target->depth + row + x;
+
+			unsigned int pass = r->depth_test ? quad_depth_test(r->depth_func, z, depth, lanes, full) : lanes;
+
+			if (stencil) {
+				unsigned int stencil_pass = 0;
+				for (unsigned int l = 0; l < 4; l++) {
+					if (!(lanes & (1 << l))) {
+						continue;
+					}
+
+					unsigned char *s = target->stencil + row + x + l;
+					unsigned int op;
+					if (!compare(r->stencil_func, (float)stencil_ref, (float)(*s & r->stencil_mask))) {
+						op = r->stencil_ops[0];
+					} else if (!(pass & (1 << l))) {
+						op = r->stencil_ops[1];
+					} else {
+						op = r->stencil_ops[2];
+						stencil_pass |= 1 << l;
+					}
+
+					*s = (unsigned char)stencil_apply(op, *s, r->stencil_ref, r->stencil_write_mask);
+				}
+
+				pass &= stencil_pass;
+			}
+
+			if (!pass) {
+				continue;
+			}
+
+			// Depth writes only happen with the test enabled, as in GL.
+			if (r->depth_test) {
+				quad_store_depth(z, depth, pass, full);
+			}
+
+			counters->fragments += LANE_COUNT[pass];
+
+			if (!colour) {
+				continue;
+			}
+
+			for (unsigned int l = 0; l < 4; l++) {
+				if (!(pass & (1 << l))) {
+					continue;
+				}
+
+				const float px = x + l + 0.5f, py = y + 0.5f;
+				const float w = 1.f / (t->w[0] * px + t->w[1] * py + t->w[2]);
+
+				float v[MAX_VARYINGS];
+				for (unsigned int i = 0; i < t->varying_count; i++) {
+					v[i] = (t->varyings[i][0] * px + t->varyings[i][1] * py + t->varyings[i][2]) * w;
+				}
+
+				float frag[4];
+				shade_fragment(draw, v, frag);
+
+				unsigned int *dest = target->colour + row + x + l;
+				if (r->blend) {
+					float old[4];
+					unpack_colour(*dest, old);
+
+					const float a = frag[3];
+					for (unsigned int i = 0; i < 4; i++) {
+						frag[i] = frag[i] * a + old[i] * (1.f - a);
+					}
+				}
+
+				*dest = pack_colour(frag);
+
+				if (ids) {
+					target->ids[row + x + l] = draw->uniforms.object_id;
+				}
+			}
+		}
+	}
+}
+
+static void clear_tile(const SoftBatch *batch, int x0, int y0, int x1, int y1)
+{
+	const SoftTarget *target = &batch->target;
+	const unsigned int colour = pack_colour(batch->clear_colour);
+
+	for (int y = y0; y < y1; y++) {
+		const int row = y * target->w;
+
+		if ((batch->clear_mask & GFX_COLOR_BUFFER_BIT) && target->colour) {
+			std::fill(target->colour + row + x0, target->colour + row + x1, colour);
+		}
+
+		if ((batch->clear_mask & GFX_DEPTH_BUFFER_BIT) && target->depth) {
+			std::fill(target->depth + row + x0, target->depth + row + x1, 1.f);
+		}
+
+		if ((batch->clear_mask & GFX_STENCIL_BUFFER_BIT) && target->stencil) {
+			for (int x = x0; x < x1; x++) {
+				target->stencil[row + x] &= ~batch->clear_stencil_mask;
+			}
+		}
+
+		if (batch->clear_ids && target->ids) {
+			std::fill(target->ids + row + x0, target->ids + row + x1, batch->clear_id);
+		}
+	}
+}
+
+// Bins the batch's triangles and rasterises the tiles in parallel. Each tile
+// is owned by one thread and draws its triangles in submission order.
+static void flush(SoftDevice *d)
+{
+	SoftBatch *b = &d->batch;
+	if (!b->open) {
+		return;
+	}
+
+	PROFILE_FUNCTION();
+
+	if (b->triangles.empty() && !b->clear_mask && !b->clear_ids) {
+		b->open = false;
+		b->draws.clear();
+		return;
+	}
+
+	b->tiles_x = (b->target.w + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+	b->tiles_y = (b->target.h + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+	b->bins.resize(b->tiles_x * b->tiles_y);
+	for (auto &bin : b->bins) {
+		bin.clear();
+	}
+
+	for (unsigned int i = 0; i < b->triangles.size(); i++) {
+		const SoftTriangle *t = &b->triangles[i];
+
+		for (int ty = t->y0 / (int)SOFT_TILE_SIZE; ty <= (t->y1 - 1) / (int)SOFT_TILE_SIZE; ty++) {
+			for (int tx = t->x0 / (int)SOFT_TILE_SIZE; tx <= (t->x1 - 1) / (int)SOFT_TILE_SIZE; tx++) {
+				// Skip tiles wholly outside an edge, tested at the corner furthest inside it.
+				const float cx0 = tx * SOFT_TILE_SIZE + 0.5f, cx1 = cx0 + SOFT_TILE_SIZE - 1.f;
+				const float cy0 = ty * SOFT_TILE_SIZE + 0.5f, cy1 = cy0 + SOFT_TILE_SIZE - 1.f;
+
+				bool outside = false;
+				for (unsigned int e = 0; e < 3 && !outside; e++) {
+					const float x = t->edges[e][0] > 0.f ? cx1 : cx0;
+					const float y = t->edges[e][1] > 0.f ? cy1 : cy0;
+					outside = t->edges[e][0] * x + t->edges[e][1] * y + t->edges[e][2] < 0.f;
+				}
+
+				if (!outside) {
+					b->bins[ty * b->tiles_x + tx].push_back(i);
+					d->stats.binned++;
+				}
+			}
+		}
+	}
+
+	const bool clearing = b->clear_mask || b->clear_ids;
+
+	b->active.clear();
+	for (unsigned int i = 0; i < b->bins.size(); i++) {
+		if (clearing || !b->bins[i].empty()) {
+			b->active.push_back(i);
+		}
+	}
+
+	std::atomic<unsigned int> next(0);
+	pool_run(&d->pool, [d, b, clearing, &next]()
+	{
+		PROFILE_ZONE("rasterise tiles");
+
+		TileCounters counters = {};
+
+		for (unsigned int i = next++; i < b->active.size(); i = next++) {
+			const unsigned int tile = b->active[i];
+			const int x0 = (tile % b->tiles_x) * SOFT_TILE_SIZE, y0 = (tile / b->tiles_x) * SOFT_TILE_SIZE;
+			const int x1 = std::min(x0 + (int)SOFT_TILE_SIZE, b->target.w), y1 = std::min(y0 + (int)SOFT_TILE_SIZE, b->target.h);
+
+			if (clearing) {
+				clear_tile(b, x0, y0, x1, y1);
+			}
+
+			for (auto t : b->bins[tile]) {
+				rasterise(b, &b->triangles[t], x0, y0, x1, y1, &counters);
+			}
+		}
+
+		d->fragments += counters.fragments;
+	});
+
+	d->stats.flushes++;
+	d->stats.fragments = d->fragments;
+
+	b->open = false;
+	b->clear_mask = 0;
+	b->clear_ids = false;
+	b->draws.clear();
+	b->triangles.clear();
+}
+
+// Starts collecting draws to the bound framebuffer.
+static bool begin_batch(SoftDevice *d)
+{
+	SoftBatch *b = &d->batch;
+	if (!b->open) {
+		if (!resolve_target(d, d->draw_fbo, &b->target)) {
+			return false;
+		}
+		b->open = true;
+	}
+
+	return true;
+}
+
+static void clear(SoftDevice *d, unsigned int mask)
+{
+	SoftBatch *b = &d->batch;
+	if (b->open && !b->triangles.empty()) {
+		flush(d);
+	}
+
+	if (!begin_batch(d)) {
+		return;
+	}
+
+	b->clear_mask |= mask;
+	if (mask & GFX_COLOR_BUFFER_BIT) {
+		memcpy(b->clear_colour, d->clear_colour, sizeof(b->clear_colour));
+	}
+	if (mask & GFX_STENCIL_BUFFER_BIT) {
+		b->clear_stencil_mask = d->raster.stencil_write_mask & 0xFF;
+	}
+}
+
+static void clear_ids(SoftDevice *d, unsigned int id)
+{
+	SoftBatch *b = &d->batch;
+	if (b->open && !b->triangles.empty()) {
+		flush(d);
+	}
+
+	if (!begin_batch(d)) {
+		return;
+	}
+
+	b->clear_ids = true;
+	b->clear_id = id;
+}
+
+static void blit(SoftDevice *d, const GfxWord *a)
+{
+	flush(d);
+
+	SoftTarget src, dst;
+	if (!resolve_target(d, d->read_fbo, &src) || !resolve_target(d, d->draw_fbo, &dst)) {
+		return;
+	}
+
+	const int sx0 = a[0].i, sy0 = a[1].i, sx1 = a[2].i, sy1 = a[3].i;
+	const int dx0 = a[4].i, dy0 = a[5].i, dx1 = a[6].i, dy1 = a[7].i;
+	const unsigned int mask = a[8].u;
+
+	if (dx1 <= dx0 || dy1 <= dy0) {
+		return;
+	}
+
+	const bool colour = (mask & GFX_COLOR_BUFFER_BIT) && src.colour && dst.colour;
+	const bool depth = (mask & GFX_DEPTH_BUFFER_BIT) && src.depth && dst.depth;
+
+	for (int y = std::max(dy0, 0); y < std::min(dy1, dst.h); y++) {
+		const int sy = sy0 + (int)((y - dy0 + 0.5f) * (sy1 - sy0) / (dy1 - dy0));
+		if (sy < 0 || sy >= src.h) {
+			continue;
+		}
+
+		for (int x = std::max(dx0, 0); x < std::min(dx1, dst.w); x++) {
+			const int sx = sx0 + (int)((x - dx0 + 0.5f) * (sx1 - sx0) / (dx1 - dx0));
+			if (sx < 0 || sx >= src.w) {
+				continue;
+			}
+
+			if (colour) {
+				dst.colour[y * dst.w + x] = src.colour[sy * src.w + sx];
+			}
+			if (depth) {
+				dst.depth[y * dst.w + x] = src.depth[sy * src.w + sx];
+			}
+		}
+	}
+}
+
+static unsigned int texture_slot(unsigned int target)
+{
+	switch (target) {
+	case GFX_TEXTURE_CUBE_MAP: return SOFT_SLOT_CUBE;
+	case GFX_TEXTURE_2D_ARRAY: return SOFT_SLOT_ARRAY;
+	}
+
+	return SOFT_SLOT_2D;
+}
+
+static const SoftTexture *bound_texture(SoftDevice *d, int unit, unsigned int slot)
+{
+	if (unit < 0 || unit >= (int)GFX_MAX_TEXTURE_UNITS) {
+		return 0;
+	}
+
+	return find_texture(d, d->units[unit][slot]);
+}
+
+static void draw(SoftDevice *d, int first, unsigned int count, bool indexed)
+{
+	auto program = d->programs.find(d->program);
+	auto mesh = d->meshes.find(d->vao);
+	if (program == d->programs.end() || mesh == d->meshes.end() || !begin_batch(d)) {
+		return;
+	}
+
+	SoftBatch *b = &d->batch;
+	const SoftMesh *m = &mesh->second;
+	const SoftUniforms *u = &program->second.uniforms;
+
+	SoftDraw draw;
+	draw.shader = program->second.shader;
+	draw.uniforms = *u;
+	draw.raster = d->raster;
+	draw.texture = bound_texture(d, u->texture, SOFT_SLOT_2D);
+	draw.shadow_map = bound_texture(d, u->shadow_map, SOFT_SLOT_2D);
+	draw.cascade_maps = bound_texture(d, u->cascade_maps, SOFT_SLOT_ARRAY);
+	draw.skybox = bound_texture(d, u->skybox, SOFT_SLOT_CUBE);
+
+	const unsigned int draw_index = b->draws.size();
+	b->draws.push_back(draw);
+
+	d->vertices.resize(m->vertex_count * VERTEX_FLOATS);
+	shade_vertices(&b->draws[draw_index], m, d->vertices.data());
+
+	const unsigned int varyings = varying_count(draw.shader);
+	const unsigned int available = indexed ? m->indices.size() : m->vertex_count;
+	const unsigned int end = std::min(first + count, available);
+
+	for (unsigned int i = first; i + 3 <= end; i += 3) {
+		unsigned int v[3] = { i, i + 1, i + 2 };
+		if (indexed) {
+			v[0] = m->indices[i];
+			v[1] = m->indices[i + 1];
+			v[2] = m->indices[i + 2];
+		}
+
+		if (v[0] >= m->vertex_count || v[1] >= m->vertex_count || v[2] >= m->vertex_count) {
+			continue;
+		}
+
+		d->stats.triangles++;
+		submit_triangle(b, draw_index, &d->vertices[v[0] * VERTEX_FLOATS], &d->vertices[v[1] * VERTEX_FLOATS], &d->vertices[v[2] * VERTEX_FLOATS], varyings, &d->stats);
+	}
+
+	d->stats.draws++;
+}
+
+static void set_uniform(SoftUniforms *u, unsigned int location, const GfxWord *v, unsigned int count)
+{
+	switch (location) {
+	case SOFT_UNIFORM_PROJECTION: memcpy(u->projection, v, sizeof(u->projection)); break;
+	case SOFT_UNIFORM_VIEW: memcpy(u->view, v, sizeof(u->view)); break;
+	case SOFT_UNIFORM_MODEL: memcpy(u->model, v, sizeof(u->model)); break;
+	case SOFT_UNIFORM_LIGHT_SPACE_MATRIX: memcpy(u->light_space_matrix, v, sizeof(u->light_space_matrix)); break;
+	case SOFT_UNIFORM_SHADOW_MAP: u->shadow_map = v[0].i; break;
+	case SOFT_UNIFORM_GAMMA_CORRECTION: u->gamma_correction = v[0].f; break;
+	case SOFT_UNIFORM_VIEW_POSITION: memcpy(&u->view_position, v, sizeof(V3)); break;
+	case SOFT_UNIFORM_TEXTURE: u->texture = v[0].i; break;
+	case SOFT_UNIFORM_OBJECT_COLOUR: memcpy(&u->object_colour, v, sizeof(V3)); break;
+	case SOFT_UNIFORM_OBJECT_ID: u->object_id = v[0].u; break;
+	case SOFT_UNIFORM_CASCADE_COUNT: u->cascade_count = v[0].i; break;
+	case SOFT_UNIFORM_CASCADE_SPLITS: memcpy(u->cascade_splits, v, sizeof(u->cascade_splits)); break;
+	case SOFT_UNIFORM_CASCADE_MATRICES: memcpy(u->cascade_matrices, v, std::min(count, 4u) * 16 * sizeof(float)); break;
+	case SOFT_UNIFORM_CASCADE_MAPS: u->cascade_maps = v[0].i; break;
+	case SOFT_UNIFORM_SKYBOX: u->skybox = v[0].i; break;
+	default:
+		if (location >= SOFT_UNIFORM_LIGHTS && location < SOFT_UNIFORM_COUNT) {
+			const unsigned int light = (location - SOFT_UNIFORM_LIGHTS) / 4;
+
+			switch ((location - SOFT_UNIFORM_LIGHTS) % 4) {
+			case 0: memcpy(&u->light_pos[light], v, sizeof(V3)); break;
+			case 1: memcpy(&u->light_colour[light], v, sizeof(V3)); break;
+			case 2: u->light_ambient[light] = v[0].f; break;
+			case 3: u->light_diffuse[light] = v[0].f; break;
+			}
+		}
+		break;
+	}
+}
+
+static void set_capability(SoftDevice *d, unsigned int cap, bool enabled)
+{
+	switch (cap) {
+	case GFX_DEPTH_TEST: d->raster.depth_test = enabled; break;
+	case GFX_CULL_FACE: d->raster.cull = enabled; break;
+	case GFX_STENCIL_TEST: d->raster.stencil_test = enabled; break;
+	}
+}
+
+// Replays the frame into the software device. Draws are batched per target
+// and rasterised when the target changes, is cleared, or is blitted from.
+void gfx_soft_replay(const GfxStream *gfx, SoftDevice *d)
+{
+	PROFILE_FUNCTION();
+
+	unsigned int cursor = 0;
+	GfxCommand c;
+	while (gfx_next(gfx, &cursor, &c)) {
+		const GfxWord *a = c.args;
+
+		switch (c.op) {
+		case GFX_OP_USE_PROGRAM:
+			d->program = a[0].u;
+			break;
+		case GFX_OP_BIND_VERTEX_ARRAY:
+			d->vao = a[0].u;
+			break;
+		case GFX_OP_BIND_FRAMEBUFFER:
+			if (a[0].u != GFX_READ_FRAMEBUFFER && a[1].u != d->draw_fbo) {
+				flush(d);
+				d->draw_fbo = a[1].u;
+			}
+			if (a[0].u != GFX_DRAW_FRAMEBUFFER) {
+				d->read_fbo = a[1].u;
+			}
+			break;
+		case GFX_OP_ACTIVE_TEXTURE:
+			d->active_unit = std::min(a[0].u - GFX_TEXTURE0, GFX_MAX_TEXTURE_UNITS - 1);
+			break;
+		case GFX_OP_BIND_TEXTURE:
+			d->units[d->active_unit][texture_slot(a[0].u)] = a[1].u;
+			break;
+		case GFX_OP_VIEWPORT:
+			for (unsigned int i = 0; i < 4; i++) {
+				d->raster.viewport[i] = a[i].i;
+			}
+			break;
+		case GFX_OP_CLEAR_COLOUR:
+			for (unsigned int i = 0; i < 4; i++) {
+				d->clear_colour[i] = a[i].f;
+			}
+			break;
+		case GFX_OP_CLEAR:
+			clear(d, a[0].u);
+			break;
+		case GFX_OP_CLEAR_BUFFER_UIV:
+			if (a[0].u == GFX_COLOR && a[1].i == 1) {
+				clear_ids(d, a[2].u);
+			}
+			break;
+		case GFX_OP_ENABLE:
+			set_capability(d, a[0].u, true);
+			break;
+		case GFX_OP_DISABLE:
+			set_capability(d, a[0].u, false);
+			break;
+		case GFX_OP_CULL_FACE:
+			d->raster.cull_face = a[0].u;
+			break;
+		case GFX_OP_DEPTH_FUNC:
+			d->raster.depth_func = a[0].u;
+			break;
+		case GFX_OP_STENCIL_FUNC:
+			d->raster.stencil_func = a[0].u;
+			d->raster.stencil_ref = a[1].i;
+			d->raster.stencil_mask = a[2].u;
+			break;
+		case GFX_OP_STENCIL_OP:
+			for (unsigned int i = 0; i < 3; i++) {
+				d->raster.stencil_ops[i] = a[i].u;
+			}
+			break;
+		case GFX_OP_STENCIL_MASK:
+			d->raster.stencil_write_mask = a[0].u;
+			break;
+		case GFX_OP_DRAW_BUFFERS:
+			if (SoftFramebuffer *f = find_framebuffer(d, d->draw_fbo)) {
+				// Changes which attachments the open batch writes.
+				flush(d);
+				f->draw_buffers = a[0].u;
+			}
+			break;
+		case GFX_OP_READ_BUFFER:
+			// Blits always read the colour attachment.
+			break;
+		case GFX_OP_BLIT_FRAMEBUFFER:
+			blit(d, a);
+			break;
+		case GFX_OP_UNIFORM_1I:
+		case GFX_OP_UNIFORM_1UI:
+		case GFX_OP_UNIFORM_1F: {
+			auto p = d->programs.find(d->program);
+			if (p != d->programs.end()) {
+				set_uniform(&p->second.uniforms, a[0].u, a + 1, 1);
+			}
+			break;
+		}
+		case GFX_OP_UNIFORM_3FV:
+		case GFX_OP_UNIFORM_4FV:
+		case GFX_OP_UNIFORM_MATRIX_4FV: {
+			auto p = d->programs.find(d->program);
+			if (p != d->programs.end()) {
+				set_uniform(&p->second.uniforms, a[0].u, a + 2, a[1].u);
+			}
+			break;
+		}
+		case GFX_OP_DRAW_ELEMENTS:
+			draw(d, 0, a[1].u, true);
+			break;
+		case GFX_OP_DRAW_ARRAYS:
+			draw(d, a[1].i, a[2].u, false);
+			break;
+		case GFX_OP_TIMESTAMP:
+			// Nothing to time, the device runs on the CPU.
+			break;
+		}
+	}
+
+	flush(d);
+}
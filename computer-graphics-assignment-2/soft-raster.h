@@ -0,0 +1,83 @@
+#ifndef SOFT_RASTER_H
+#define SOFT_RASTER_H
+
+#include "gfx.h"
+
+// Software device the recorded frame can be replayed to, for rendering
+// without a GL driver. Triangles are binned into tiles that are rasterised in
+// parallel, and the programs in shaders.h are ported to C++.
+//
+// GL objects are stood in for by names registered up front. Uniform locations
+// are SoftUniform values, shared by every program.
+
+static const unsigned int SOFT_TILE_SIZE = 64;
+
+enum SoftShader {
+	SOFT_SHADER_DEPTH,
+	SOFT_SHADER_TEXTURED,
+	SOFT_SHADER_DIFFUSE,
+	SOFT_SHADER_INTERFACE,
+	SOFT_SHADER_OUTLINE,
+	SOFT_SHADER_SKYBOX,
+	SOFT_SHADER_COUNT
+};
+
+enum SoftUniform {
+	SOFT_UNIFORM_PROJECTION,
+	SOFT_UNIFORM_VIEW,
+	SOFT_UNIFORM_MODEL,
+	SOFT_UNIFORM_LIGHT_SPACE_MATRIX,
+	SOFT_UNIFORM_SHADOW_MAP,
+	SOFT_UNIFORM_GAMMA_CORRECTION,
+	SOFT_UNIFORM_VIEW_POSITION,
+	SOFT_UNIFORM_TEXTURE,
+	SOFT_UNIFORM_OBJECT_COLOUR,
+	SOFT_UNIFORM_OBJECT_ID,
+	SOFT_UNIFORM_CASCADE_COUNT,
+	SOFT_UNIFORM_CASCADE_SPLITS,
+	SOFT_UNIFORM_CASCADE_MATRICES,
+	SOFT_UNIFORM_CASCADE_MAPS,
+	SOFT_UNIFORM_SKYBOX,
+	SOFT_UNIFORM_LIGHTS, // pos, colour, ambient and diffuse of each light.
+	SOFT_UNIFORM_COUNT = SOFT_UNIFORM_LIGHTS + 2 * 4
+};
+
+struct SoftStats {
+	unsigned int draws;
+	unsigned int triangles; // Submitted.
+	unsigned int culled; // Back facing, or outside the viewport.
+	unsigned int clipped; // Extra triangles made by near plane clipping.
+	unsigned int binned; // Triangle tile pairs.
+	unsigned int flushes;
+	unsigned long long fragments; // Passed the depth and stencil tests.
+};
+
+struct SoftDevice;
+
+// A thread count of 0 uses every hardware thread.
+extern SoftDevice *soft_create(unsigned int w, unsigned int h, unsigned int threads);
+extern void soft_destroy(SoftDevice *device);
+extern unsigned int soft_thread_count(const SoftDevice *device);
+
+extern void soft_register_program(SoftDevice *device, unsigned int program, SoftShader shader);
+
+// Vertices are stride floats each, laid out as the shader's attributes. Without
+// indices the mesh is drawn with draw_arrays.
+extern void soft_register_mesh(SoftDevice *device, unsigned int vao, const float *vertices, unsigned int vertex_count, unsigned int stride, const unsigned int *indices, unsigned int index_count);
+
+// RGBA8 texels, bottom row first. Cube maps have 6 layers in GL face order.
+extern void soft_register_texture(SoftDevice *device, unsigned int texture, unsigned int w, unsigned int h, unsigned int layers, const unsigned char *texels);
+extern void soft_register_depth_texture(SoftDevice *device, unsigned int texture, unsigned int size, unsigned int layers);
+extern void soft_register_id_texture(SoftDevice *device, unsigned int texture, unsigned int w, unsigned int h);
+
+// Attaches textures to a framebuffer. A depth of 0 gives it its own depth and
+// stencil buffer, the size of the colour texture.
+extern void soft_register_framebuffer(SoftDevice *device, unsigned int fbo, unsigned int colour, unsigned int ids, unsigned int depth, unsigned int layer);
+
+// Colour attachment of a framebuffer, 0 being the window. RGBA8, bottom row first.
+extern const unsigned int *soft_colour_pixels(const SoftDevice *device, unsigned int fbo, unsigned int *w, unsigned int *h);
+
+extern const SoftStats *soft_stats(const SoftDevice *device);
+extern void soft_reset_stats(SoftDevice *device);
+
+#endif
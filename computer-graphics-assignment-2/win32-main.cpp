@@ -1,6 +1,9 @@
 #include "win32-opengl.h"
 #include "opengl-util.h"
 #include "app.h"
+#include "image-write.h"
+#include "input-log.h"
+#include "scene.h"
 
 static bool window_resized;
 static bool running;
@@ -32,6 +35,29 @@ LRESULT CALLBACK window_proc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 	return TRUE;
 }
 
+// Copies the argument following flag, which ends at the next space.
+static bool command_line_value(const char *command_line, const char *flag, char *value, size_t size)
+{
+	const char *at = strstr(command_line, flag);
+	if (!at || size == 0) {
+		return false;
+	}
+
+	at += strlen(flag);
+	while (*at == ' ') {
+		at++;
+	}
+
+	size_t length = 0;
+	while (at[length] && at[length] != ' ' && length + 1 < size) {
+		value[length] = at[length];
+		length++;
+	}
+	value[length] = 0;
+
+	return length > 0;
+}
+
 double GetHighResolutionTime(LARGE_INTEGER freq)
 {
 	LARGE_INTEGER time;
@@ -92,6 +118,85 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
 	unsigned int h = client.bottom;
 	app_state *state = app_init(w, h);
 
+	// Offline tool mode: check the animations for limbs passing through each other and quit.
+	if (state && strstr(lpCmdLine, "--validate-clips")) {
+#ifndef _DEBUG
+		AllocConsole();
+		FILE *f;
+		freopen_s(&f, "CONOUT$", "w", stdout);
+#endif
+		unsigned int collisions = app_validate_clips(state);
+
+		app_input input = {};
+		app_window_info window_info = {};
+		window_info.running = false;
+		app_update_and_render(0.f, state, &input, &window_info);
+		delete state;
+
+		wglMakeCurrent(0, 0);
+		wglDeleteContext(glrc);
+
+		return collisions ? 1 : 0;
+	}
+
+	// Offline tool mode: render the animation to an image sequence in .\export and quit.
+	// PNG by default, --export-bmp skips the compression.
+	if (state && strstr(lpCmdLine, "--export-animation")) {
+#ifndef _DEBUG
+		AllocConsole();
+		FILE *f;
+		freopen_s(&f, "CONOUT$", "w", stdout);
+#endif
+		FrameExportSettings settings = default_frame_export_settings();
+		if (strstr(lpCmdLine, "--export-bmp")) {
+			settings.format = IMAGE_BMP;
+		}
+
+		CreateDirectoryA(settings.directory, 0);
+		unsigned int failed = app_export_animation(state, &settings);
+
+		app_input input = {};
+		app_window_info window_info = {};
+		window_info.running = false;
+		app_update_and_render(0.f, state, &input, &window_info);
+		delete state;
+
+		wglMakeCurrent(0, 0);
+		wglDeleteContext(glrc);
+
+		return failed ? 1 : 0;
+	}
+
+	// Offline tool mode: play back an input log recorded with --record-input as
+	// fast as possible and report the frame times.
+	char log_name[MAX_PATH];
+	if (state && command_line_value(lpCmdLine, "--replay-input", log_name, sizeof(log_name))) {
+#ifndef _DEBUG
+		AllocConsole();
+		FILE *f;
+		freopen_s(&f, "CONOUT$", "w", stdout);
+#endif
+		bool matched = app_replay_input(state, log_name);
+
+		app_input input = {};
+		app_window_info window_info = {};
+		window_info.running = false;
+		app_update_and_render(0.f, state, &input, &window_info);
+		delete state;
+
+		wglMakeCurrent(0, 0);
+		wglDeleteContext(glrc);
+
+		return matched ? 0 : 1;
+	}
+
+	// Every frame's input is written to the log given with --record-input.
+	InputRecorder *recorder = 0;
+	if (state && command_line_value(lpCmdLine, "--record-input", log_name, sizeof(log_name))) {
+		recorder = input_record_begin(log_name);
+		state->lockstep_picks = recorder != 0;
+	}
+
 	if (state) {
 		double dt = 0;
 		double dt_elapsed = 0;
@@ -100,6 +205,8 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
 		const unsigned int FPS = 60;
 		const float ms_per_frame = 1000. / FPS;
 
+		app_keyboard_input last_keyboard = {};
+
 		while (running) {
 			MSG msg;
 
@@ -132,6 +239,16 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
 				input.keyboard.cam_down.ended_down = keys[VK_DOWN] & 0x80;
 				input.keyboard.cam_left.ended_down = keys[VK_LEFT] & 0x80;
 				input.keyboard.cam_right.ended_down = keys[VK_RIGHT] & 0x80;
+				input.keyboard.pick_mode.ended_down = keys['P'] & 0x80;
+				input.keyboard.shadow_mode.ended_down = keys['C'] & 0x80;
+				input.keyboard.trace.ended_down = keys['T'] & 0x80;
+				input.keyboard.gpu_times.ended_down = keys['G'] & 0x80;
+				input.keyboard.resolve_contacts.ended_down = keys['R'] & 0x80;
+
+				for (unsigned int i = 0; i < ARRAYSIZE(input.keyboard.buttons); i++) {
+					input.keyboard.buttons[i].started_down = last_keyboard.buttons[i].ended_down;
+				}
+				last_keyboard = input.keyboard;
 
 				POINT p;
 				GetCursorPos(&p);
@@ -148,6 +265,17 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
 				window_info.resize = window_resized;
 				window_info.running = running;
 
+				// The last frame only shuts down, so the log ends before it
+				// while the state is still there to check.
+				if (recorder) {
+					if (running) {
+						input_record_frame(recorder, ms_per_frame / 1000.f, &input, &window_info);
+					} else {
+						input_record_end(recorder, scene_checksum(state));
+						recorder = 0;
+					}
+				}
+
 				app_update_and_render(ms_per_frame / 1000.f, state, &input, &window_info);
 
 				double finish = GetHighResolutionTime(freq);
@@ -163,6 +291,11 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
 			}
 		}
 
+		// Closed while minimised, so the last frame never ran.
+		if (recorder) {
+			input_record_end(recorder, scene_checksum(state));
+		}
+
 		delete state;
 	}
 
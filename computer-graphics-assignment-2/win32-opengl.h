@@ -56,7 +56,26 @@ GLF(GenFramebuffers, GENFRAMEBUFFERS);\
 GLF(RenderbufferStorage, RENDERBUFFERSTORAGE);\
 GLF(FramebufferRenderbuffer, FRAMEBUFFERRENDERBUFFER);\
 GLF(BufferSubData, BUFFERSUBDATA);\
-GLF(FramebufferTexture2D, FRAMEBUFFERTEXTURE2D);
+GLF(FramebufferTexture2D, FRAMEBUFFERTEXTURE2D);\
+GLF(DeleteRenderbuffers, DELETERENDERBUFFERS);\
+GLF(CheckFramebufferStatus, CHECKFRAMEBUFFERSTATUS);\
+GLF(BlitFramebuffer, BLITFRAMEBUFFER);\
+GLF(DrawBuffers, DRAWBUFFERS);\
+GLF(ClearBufferuiv, CLEARBUFFERUIV);\
+GLF(Uniform1ui, UNIFORM1UI);\
+GLF(MapBufferRange, MAPBUFFERRANGE);\
+GLF(UnmapBuffer, UNMAPBUFFER);\
+GLF(FenceSync, FENCESYNC);\
+GLF(ClientWaitSync, CLIENTWAITSYNC);\
+GLF(DeleteSync, DELETESYNC);\
+GLF(TexImage3D, TEXIMAGE3D);\
+GLF(FramebufferTextureLayer, FRAMEBUFFERTEXTURELAYER);\
+GLF(GenQueries, GENQUERIES);\
+GLF(DeleteQueries, DELETEQUERIES);\
+GLF(QueryCounter, QUERYCOUNTER);\
+GLF(GetQueryObjectiv, GETQUERYOBJECTIV);\
+GLF(GetQueryObjectui64v, GETQUERYOBJECTUI64V);\
+GLF(GetInteger64v, GETINTEGER64V);
 GL_FUNCS
 #undef GLF
 